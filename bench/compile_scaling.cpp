@@ -0,0 +1,245 @@
+// Measures how the compiler phases scale with the shape of the program,
+// using the generated programs in stress_programs.hpp. Every case runs in
+// a child process of its own, so that its peak memory can be measured and
+// a pathological case can be given up on without taking the rest down.
+// The growth column is the exponent k in time ~ size^k between successive
+// sizes; anything clearly above 1 is worth a look.
+//
+// Usage: bench_compile [max size] [--corpus dir]
+//
+// With --corpus, writes the programs to dir instead of compiling them.
+
+#include "stress_programs.hpp"
+
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/constant_propagation.hpp"
+#include "brainfuck/optimizer.hpp"
+#include "brainfuck/parser.hpp"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Cases taking longer than this are reported as timeouts.
+    unsigned const CASE_TIMEOUT_SECONDS = 60;
+
+    struct CaseResult
+    {
+        double lexMs;
+        double parseMs;
+        double propagateMs;
+        double codegenMs;
+        double optimizeMs;
+        std::uint64_t irBefore;
+        std::uint64_t irAfter;
+    };
+
+    template <typename F>
+    double timeMs(F &&f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    CaseResult compileCase(std::string const &source)
+    {
+        CaseResult result{};
+
+        result.lexMs = timeMs([&]
+                              {
+                                  std::istringstream in(source);
+                                  brainfuck::Lexer lexer(in);
+
+                                  while (lexer.currentToken() != brainfuck::Token::end_of_file)
+                                  {
+                                      lexer.advance();
+                                  } });
+
+        // Includes lexing, which parse drives.
+        std::vector<brainfuck::AST> ast;
+        result.parseMs = timeMs([&]
+                                {
+                                    std::istringstream in(source);
+                                    brainfuck::Lexer lexer(in);
+                                    ast = brainfuck::parse(lexer); });
+
+        std::vector<brainfuck::AST> program;
+        result.propagateMs = timeMs([&]
+                                    { program = brainfuck::propagateConstants(ast); });
+
+        std::optional<llvm::orc::ThreadSafeModule> tsModule;
+        result.codegenMs = timeMs([&]
+                                  {
+                                      brainfuck::CodeGenerator codegen;
+                                      codegen(program);
+                                      tsModule = codegen.finalizeModule(); });
+
+        auto &module = *tsModule->getModuleUnlocked();
+        result.irBefore = module.getInstructionCount();
+        result.optimizeMs = timeMs([&]
+                                   { brainfuck::optimizeModule(module); });
+        result.irAfter = module.getInstructionCount();
+
+        return result;
+    }
+
+    struct Measurement
+    {
+        std::optional<CaseResult> result;
+        long peakKb;
+    };
+
+    Measurement measureInChild(stress::Shape const &shape, std::size_t size)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            throw std::runtime_error("could not create pipe");
+        }
+
+        auto pid = fork();
+        if (pid < 0)
+        {
+            throw std::runtime_error("could not fork");
+        }
+
+        if (pid == 0)
+        {
+            close(fds[0]);
+            alarm(CASE_TIMEOUT_SECONDS);
+
+            auto result = compileCase(shape.generate(size));
+            auto written = write(fds[1], &result, sizeof(result));
+            _exit(written == sizeof(result) ? 0 : 1);
+        }
+
+        close(fds[1]);
+
+        CaseResult result;
+        auto bytesRead = read(fds[0], &result, sizeof(result));
+        close(fds[0]);
+
+        int status;
+        rusage usage{};
+        wait4(pid, &status, 0, &usage);
+
+        bool ok = bytesRead == sizeof(result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        return {ok ? std::optional(result) : std::nullopt, usage.ru_maxrss};
+    }
+
+    void writeCorpus(std::filesystem::path const &directory, std::vector<std::size_t> const &sizes)
+    {
+        std::filesystem::create_directories(directory);
+
+        for (auto const &shape : stress::shapes())
+        {
+            for (auto size : sizes)
+            {
+                auto name = shape.name;
+                std::replace(name.begin(), name.end(), ' ', '_');
+                std::ofstream(directory / (name + "_" + std::to_string(size) + ".bf")) << shape.generate(size);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::size_t maxSize = 65536;
+    std::optional<std::filesystem::path> corpus;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "--corpus" && i + 1 < argc)
+        {
+            corpus = argv[++i];
+        }
+        else
+        {
+            maxSize = std::stoul(arg);
+        }
+    }
+
+    std::vector<std::size_t> sizes;
+    for (std::size_t size = 1024; size <= maxSize; size *= 4)
+    {
+        sizes.push_back(size);
+    }
+
+    if (corpus)
+    {
+        writeCorpus(*corpus, sizes);
+        return 0;
+    }
+
+    std::cout << std::left << std::setw(16) << "shape" << std::right
+              << std::setw(9) << "size"
+              << std::setw(10) << "lex ms"
+              << std::setw(10) << "parse ms"
+              << std::setw(10) << "prop ms"
+              << std::setw(11) << "cgen ms"
+              << std::setw(11) << "opt ms"
+              << std::setw(10) << "IR"
+              << std::setw(10) << "IR opt"
+              << std::setw(10) << "peak MB"
+              << std::setw(8) << "growth" << std::endl;
+
+    for (auto const &shape : stress::shapes())
+    {
+        double previousTotal = 0;
+
+        for (std::size_t i = 0; i < sizes.size(); ++i)
+        {
+            auto measurement = measureInChild(shape, sizes[i]);
+
+            std::cout << std::left << std::setw(16) << shape.name << std::right << std::setw(9) << sizes[i];
+
+            if (!measurement.result)
+            {
+                std::cout << "  failed or timed out after " << CASE_TIMEOUT_SECONDS << " s" << std::endl;
+                break;
+            }
+
+            auto const &r = *measurement.result;
+            auto total = r.lexMs + r.parseMs + r.propagateMs + r.codegenMs + r.optimizeMs;
+
+            std::cout << std::fixed << std::setprecision(2)
+                      << std::setw(10) << r.lexMs
+                      << std::setw(10) << r.parseMs
+                      << std::setw(10) << r.propagateMs
+                      << std::setw(11) << r.codegenMs
+                      << std::setw(11) << r.optimizeMs
+                      << std::setw(10) << r.irBefore
+                      << std::setw(10) << r.irAfter
+                      << std::setw(10) << std::setprecision(1) << measurement.peakKb / 1024.0;
+
+            if (i > 0 && previousTotal > 0)
+            {
+                auto growth = std::log(total / previousTotal) / std::log(double(sizes[i]) / double(sizes[i - 1]));
+                std::cout << std::setw(8) << std::setprecision(2) << growth;
+            }
+
+            std::cout << std::endl;
+            previousTotal = total;
+        }
+    }
+}
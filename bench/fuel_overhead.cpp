@@ -0,0 +1,142 @@
+// Measures the run time overhead of fuel metering by running the same
+// optimized program with and without CodeGenOptions::meterFuel.
+//
+// Usage: bench_fuel [program.bf] [runs]
+//
+// Without a program, runs examples/99bottles.bf as a typical program and
+// a deep loop nest as the worst case: unmetered, LLVM folds most of the
+// nest away, which the exits for running out of fuel prevent.
+
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/constant_propagation.hpp"
+#include "brainfuck/jit.hpp"
+#include "brainfuck/optimizer.hpp"
+#include "brainfuck/parser.hpp"
+#include "brainfuck/runtime.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // 26 rounds of six nested loops of ten iterations each.
+    std::string loopNest()
+    {
+        std::string source(26, '+');
+        source += "[";
+
+        for (int i = 0; i < 5; ++i)
+        {
+            source += ">++++++++++[";
+        }
+
+        source += ">++++++++++[-]";
+
+        for (int i = 0; i < 5; ++i)
+        {
+            source += "<-]";
+        }
+
+        return source + "<-]++++++++++.";
+    }
+
+    double benchmark(std::string const &label, std::vector<brainfuck::AST> const &program, bool meterFuel, bool emitCountedLoops, int runs)
+    {
+        brainfuck::CodeGenOptions options;
+        options.meterFuel = meterFuel;
+        options.emitCountedLoops = emitCountedLoops;
+
+        brainfuck::JitEngine jit;
+        brainfuck::CodeGenerator codegen(jit.getDataLayout(), {}, brainfuck::DebugInfoLevel::none, options);
+        codegen(program);
+
+        auto tsModule = codegen.finalizeModule();
+        brainfuck::optimizeModule(*tsModule.getModuleUnlocked());
+        jit.addModule(std::move(tsModule));
+        auto mainFunc = jit.lookupMain();
+
+        std::vector<double> times;
+
+        for (int i = 0; i < runs; ++i)
+        {
+            brainfuck::BufferIo io;
+            brainfuck::ScopedProgramIo binding(io);
+            brainfuck::ScopedFuel fuel(std::numeric_limits<std::uint64_t>::max());
+
+            auto start = std::chrono::steady_clock::now();
+            auto status = mainFunc();
+            auto end = std::chrono::steady_clock::now();
+
+            if (status != 0)
+            {
+                throw std::runtime_error(label + " run failed with status " + std::to_string(status));
+            }
+
+            times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        std::sort(times.begin(), times.end());
+
+        std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed << std::setprecision(2)
+                  << " min " << std::setw(10) << times.front() << " ms"
+                  << "  median " << std::setw(10) << times[times.size() / 2] << " ms" << std::endl;
+
+        return times.front();
+    }
+
+    std::string readFile(std::string const &path)
+    {
+        std::ifstream file(path);
+
+        if (!file)
+        {
+            throw std::runtime_error("could not open " + path);
+        }
+
+        return {std::istreambuf_iterator<char>(file), {}};
+    }
+
+    void benchmarkProgram(std::string const &name, std::string const &source, int runs)
+    {
+        std::istringstream sourceStream(source);
+        brainfuck::Lexer lexer(sourceStream);
+        auto program = brainfuck::propagateConstants(brainfuck::parse(lexer));
+
+        std::cout << name << std::endl;
+
+        // Counted loops pay for all of their iterations at once, other
+        // loops check their fuel on every iteration.
+        for (bool emitCountedLoops : {true, false})
+        {
+            std::string suffix = emitCountedLoops ? "" : ", no counted";
+            auto unmetered = benchmark("unmetered" + suffix, program, false, emitCountedLoops, runs);
+            auto metered = benchmark("metered" + suffix, program, true, emitCountedLoops, runs);
+
+            std::cout << "  overhead " << std::fixed << std::setprecision(1) << (metered / unmetered - 1) * 100 << " %" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = argc > 2 ? std::stoi(argv[2]) : 100;
+
+    if (argc > 1)
+    {
+        benchmarkProgram(argv[1], readFile(argv[1]), runs);
+    }
+    else
+    {
+        benchmarkProgram("99bottles.bf", readFile(EXAMPLES_DIR "/99bottles.bf"), runs);
+        benchmarkProgram("loop nest", loopNest(), runs);
+    }
+}
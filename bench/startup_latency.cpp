@@ -0,0 +1,87 @@
+// Measures the wall-clock time of complete bfcompile runs on a trivial
+// program, which is dominated by process and LLVM target setup.
+//
+// Usage: bench_startup [runs]
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern char **environ;
+
+namespace
+{
+    double runOnce(std::vector<std::string> args)
+    {
+        std::vector<char *> argv;
+        for (auto &arg : args)
+        {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+
+        auto start = std::chrono::steady_clock::now();
+
+        pid_t pid;
+        if (posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+        {
+            throw std::runtime_error("could not start " + args[0]);
+        }
+
+        int status;
+        waitpid(pid, &status, 0);
+
+        auto end = std::chrono::steady_clock::now();
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            throw std::runtime_error(args[0] + " failed");
+        }
+
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    void benchmark(std::string const &label, std::vector<std::string> const &args, int runs)
+    {
+        std::vector<double> times;
+
+        for (int i = 0; i < runs; ++i)
+        {
+            times.push_back(runOnce(args));
+        }
+
+        std::sort(times.begin(), times.end());
+
+        std::cout << std::left << std::setw(24) << label << std::right << std::fixed << std::setprecision(2)
+                  << " min " << std::setw(8) << times.front() << " ms"
+                  << "  median " << std::setw(8) << times[times.size() / 2] << " ms"
+                  << "  max " << std::setw(8) << times.back() << " ms" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = argc > 1 ? std::stoi(argv[1]) : 20;
+
+    auto workDir = std::filesystem::temp_directory_path() / ("bench_startup_" + std::to_string(getpid()));
+    std::filesystem::create_directories(workDir);
+    auto source = (workDir / "hello.bf").string();
+
+    std::ofstream(source) << "++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]>>.>---.+++++++..+++.>>.<-.<.+++.------.--------.>>+.>++.\n";
+
+    benchmark("default", {BFCOMPILE_PATH, source}, runs);
+    benchmark("--no-unoptimized", {BFCOMPILE_PATH, "--no-unoptimized", source}, runs);
+    benchmark("--fast-startup", {BFCOMPILE_PATH, "--fast-startup", source}, runs);
+
+    std::filesystem::remove_all(workDir);
+}
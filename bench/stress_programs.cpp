@@ -0,0 +1,95 @@
+#include "stress_programs.hpp"
+
+namespace stress
+{
+    std::string operatorRuns(std::size_t size)
+    {
+        // Alternating runs that all fold, with an occasional write so that
+        // nothing can be dropped as dead.
+        std::string source;
+
+        while (source.size() < size)
+        {
+            source += std::string(97, '+') + std::string(13, '>') + std::string(55, '-') + std::string(13, '<') + ".";
+        }
+
+        return source;
+    }
+
+    std::string nestedLoops(std::size_t size)
+    {
+        auto depth = size / 6;
+        std::string source;
+
+        for (std::size_t i = 0; i < depth; ++i)
+        {
+            source += "+[>";
+        }
+
+        source += ".";
+
+        for (std::size_t i = 0; i < depth; ++i)
+        {
+            source += "<-]";
+        }
+
+        return source;
+    }
+
+    std::string siblingLoops(std::size_t size)
+    {
+        // A counted loop and a data-dependent one, over and over.
+        std::string source = ",";
+
+        while (source.size() < size)
+        {
+            source += "[->+>++<<]>>[.<]>";
+        }
+
+        return source;
+    }
+
+    std::string commentHeavy(std::size_t size)
+    {
+        // One instruction in a hundred characters; everything else is text
+        // the lexer has to skip.
+        std::string const comment = "the quick brown fox jumps over the lazy dog 0123456789 "
+                                    "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG (){}!?;:\n";
+        std::string source;
+
+        for (std::size_t i = 0; source.size() < size; ++i)
+        {
+            source += comment.substr(0, 99);
+            source += "+>.<"[i % 4];
+        }
+
+        return source;
+    }
+
+    std::string unbalancedLoop(std::size_t size)
+    {
+        // A single loop whose body moves the pointer, so no loop analysis
+        // applies, with reads that keep the body from being folded.
+        std::string source = ",[";
+
+        while (source.size() < size)
+        {
+            source += ">+>,<-";
+        }
+
+        return source + "]";
+    }
+
+    std::vector<Shape> const &shapes()
+    {
+        static std::vector<Shape> const all = {
+            {"operator runs", &operatorRuns},
+            {"nested loops", &nestedLoops},
+            {"sibling loops", &siblingLoops},
+            {"comment heavy", &commentHeavy},
+            {"unbalanced loop", &unbalancedLoop},
+        };
+
+        return all;
+    }
+}
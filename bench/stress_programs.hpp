@@ -0,0 +1,27 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_BENCH_STRESS_PROGRAMS_HPP
+#define INCLUDED_LLVM_BRAINFUCK_BENCH_STRESS_PROGRAMS_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace stress
+{
+    // Valid programs of roughly size instructions that each push one
+    // dimension of the compiler.
+    std::string operatorRuns(std::size_t size);
+    std::string nestedLoops(std::size_t size);
+    std::string siblingLoops(std::size_t size);
+    std::string commentHeavy(std::size_t size);
+    std::string unbalancedLoop(std::size_t size);
+
+    struct Shape
+    {
+        std::string name;
+        std::string (*generate)(std::size_t);
+    };
+
+    std::vector<Shape> const &shapes();
+}
+
+#endif
@@ -8,6 +8,88 @@ namespace brainfuck
     {
     }
 
+    LoopAST::LoopAST(LoopAST const &other)
+        : loc_(other.loc_)
+    {
+        // Like the destructor, copies nested loops with a work list rather
+        // than one stack frame per nesting level. Every frame builds the
+        // copy of one body; a finished body becomes a loop in its parent's.
+        struct Frame
+        {
+            std::vector<AST> const *source;
+            std::size_t next;
+            SourceLocation location;
+            std::vector<AST> copy;
+        };
+
+        std::vector<Frame> frames;
+        frames.push_back({&other.loopBody_, 0, other.loc_, {}});
+
+        for (;;)
+        {
+            auto &frame = frames.back();
+
+            if (frame.next == frame.source->size())
+            {
+                if (frames.size() == 1)
+                {
+                    loopBody_ = std::move(frame.copy);
+                    return;
+                }
+
+                LoopAST loop(frame.location, std::move(frame.copy));
+                frames.pop_back();
+                frames.back().copy.emplace_back(std::move(loop));
+                continue;
+            }
+
+            auto const &ast = (*frame.source)[frame.next++];
+
+            if (auto loop = std::get_if<LoopAST>(&ast))
+            {
+                frames.push_back({&loop->loopBody_, 0, loop->loc_, {}});
+            }
+            else
+            {
+                frame.copy.push_back(ast);
+            }
+        }
+    }
+
+    LoopAST &LoopAST::operator=(LoopAST const &other)
+    {
+        return *this = LoopAST(other);
+    }
+
+    LoopAST::~LoopAST()
+    {
+        if (loopBody_.empty())
+        {
+            return;
+        }
+
+        // Destroying the body as is would destroy nested loops from within
+        // this destructor, one stack frame per nesting level. Instead, the
+        // bodies of nested loops are moved out into a work list first, so
+        // that every loop is destroyed with an empty body.
+        std::vector<std::vector<AST>> pending;
+        pending.push_back(std::move(loopBody_));
+
+        while (!pending.empty())
+        {
+            auto body = std::move(pending.back());
+            pending.pop_back();
+
+            for (auto &ast : body)
+            {
+                if (auto loop = std::get_if<LoopAST>(&ast); loop && !loop->loopBody_.empty())
+                {
+                    pending.push_back(std::move(loop->loopBody_));
+                }
+            }
+        }
+    }
+
     SourceLocation astLocation(AST const &ast)
     {
         return std::visit([](auto &a)
@@ -4,6 +4,7 @@
 #include "token.hpp"
 #include "source_location.hpp"
 
+#include <cstdint>
 #include <variant>
 #include <vector>
 
@@ -28,14 +29,35 @@ namespace brainfuck
     using WriteAST = SimpleAST<Token::write>;
     using ReadAST = SimpleAST<Token::read>;
 
+    // Stores a constant in the current cell. Never produced by the parser,
+    // only by optimizations that know the value a cell ends up with.
+    class SetAST
+    {
+    public:
+        SetAST(SourceLocation loc, std::uint8_t value) : loc_(loc), value_(value) {}
+
+        auto location() const { return loc_; }
+        auto value() const { return value_; }
+
+    private:
+        SourceLocation loc_;
+        std::uint8_t value_;
+    };
+
     class LoopAST;
 
-    using AST = std::variant<LeftAST, RightAST, IncrAST, DecrAST, WriteAST, ReadAST, LoopAST>;
+    using AST = std::variant<LeftAST, RightAST, IncrAST, DecrAST, WriteAST, ReadAST, SetAST, LoopAST>;
 
     class LoopAST
     {
     public:
         LoopAST(SourceLocation loc, std::vector<AST> loopBody);
+        // Copies and tears down nested loops iteratively, see ast.cpp.
+        LoopAST(LoopAST const &other);
+        LoopAST(LoopAST &&) = default;
+        LoopAST &operator=(LoopAST const &other);
+        LoopAST &operator=(LoopAST &&) = default;
+        ~LoopAST();
 
         auto const &loopBody() const { return loopBody_; }
         auto location() const { return loc_; }
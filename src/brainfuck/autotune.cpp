@@ -0,0 +1,267 @@
+#include "autotune.hpp"
+#include "constant_propagation.hpp"
+#include "jit.hpp"
+#include "runtime.hpp"
+#include "structural_hash.hpp"
+
+#include <llvm/Support/Host.h>
+
+#include <algorithm>
+#include <charconv>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace brainfuck
+{
+    namespace
+    {
+        char const *const TUNING_ENTRY_NAME = "brainfuck_tuning";
+
+        struct Measurement
+        {
+            std::chrono::nanoseconds runTime;
+            std::string output;
+        };
+
+        Measurement measure(std::vector<AST> const &program, std::string const &sampleInput,
+                            TuningSettings const &settings, unsigned repetitions)
+        {
+            JitEngine jit(settings.cpu);
+
+            CodeGenOptions options;
+            options.entryPoint = EntryPoint::tapeArgument;
+            options.entryName = TUNING_ENTRY_NAME;
+            settings.apply(options);
+
+            CodeGenerator codegen(jit.getDataLayout(), {}, DebugInfoLevel::none, options);
+            codegen(settings.prepare(program));
+
+            auto tsModule = codegen.finalizeModule();
+            optimizeModule(*tsModule.getModuleUnlocked(), settings.optimizer, &jit.targetMachine());
+
+            jit.addModule(std::move(tsModule));
+            auto entry = jit.lookupTapeEntry(TUNING_ENTRY_NAME);
+
+            Measurement measurement = {std::chrono::nanoseconds::max(), {}};
+            std::vector<std::uint8_t> tape(BRAINFUCK_MEMSIZE);
+
+            for (unsigned i = 0; i < std::max(repetitions, 1u); ++i)
+            {
+                std::fill(tape.begin(), tape.end(), 0);
+
+                BufferIo io(sampleInput);
+                ScopedProgramIo binding(io);
+
+                auto start = std::chrono::steady_clock::now();
+                entry(tape.data());
+                auto runTime = std::chrono::steady_clock::now() - start;
+
+                measurement.runTime = std::min<std::chrono::nanoseconds>(measurement.runTime, runTime);
+                measurement.output = io.takeOutput();
+            }
+
+            return measurement;
+        }
+
+        std::vector<TuningSettings> neighbours(TuningSettings const &settings, std::string const &hostCpu)
+        {
+            std::vector<TuningSettings> result;
+
+            auto with = [&](auto change)
+            {
+                auto neighbour = settings;
+                change(neighbour);
+
+                if (!(neighbour == settings))
+                {
+                    result.push_back(neighbour);
+                }
+            };
+
+            for (int level = 1; level <= 3; ++level)
+            {
+                with([&](auto &s)
+                     { s.optimizer.level = level; });
+            }
+
+            with([](auto &s)
+                 { s.optimizer.loopUnrolling = !s.optimizer.loopUnrolling; });
+            with([](auto &s)
+                 { s.optimizer.loopVectorization = !s.optimizer.loopVectorization; });
+            with([](auto &s)
+                 { s.optimizer.slpVectorization = !s.optimizer.slpVectorization; });
+            with([](auto &s)
+                 { s.propagateConstants = !s.propagateConstants; });
+            with([](auto &s)
+                 { s.countedLoops = !s.countedLoops; });
+            with([&](auto &s)
+                 { s.cpu = s.cpu == hostCpu ? "generic" : hostCpu; });
+
+            return result;
+        }
+
+        std::string const PROGRAM_KEY = "program";
+    }
+
+    std::vector<AST> TuningSettings::prepare(std::vector<AST> program) const
+    {
+        return propagateConstants ? brainfuck::propagateConstants(std::move(program)) : program;
+    }
+
+    void TuningSettings::apply(CodeGenOptions &options) const
+    {
+        options.emitCountedLoops = countedLoops;
+    }
+
+    TuningReport autotune(std::vector<AST> const &program, std::string const &sampleInput,
+                          unsigned repetitions, double minimumGain)
+    {
+        auto hostCpu = llvm::sys::getHostCPUName().str();
+
+        TuningReport report;
+        auto baseline = measure(program, sampleInput, report.best, repetitions);
+        report.results.push_back({report.best, baseline.runTime});
+
+        auto bestTime = baseline.runTime;
+
+        auto tried = [&](TuningSettings const &settings)
+        {
+            return std::any_of(report.results.begin(), report.results.end(), [&](auto const &result)
+                               { return result.settings == settings; });
+        };
+
+        while (true)
+        {
+            auto roundBest = report.best;
+            auto roundBestTime = bestTime;
+
+            for (auto const &candidate : neighbours(report.best, hostCpu))
+            {
+                if (tried(candidate))
+                {
+                    continue;
+                }
+
+                auto measurement = measure(program, sampleInput, candidate, repetitions);
+                report.results.push_back({candidate, measurement.runTime});
+
+                if (measurement.output != baseline.output)
+                {
+                    throw std::logic_error("output changed under tuned settings");
+                }
+
+                if (measurement.runTime < roundBestTime)
+                {
+                    roundBest = candidate;
+                    roundBestTime = measurement.runTime;
+                }
+            }
+
+            if (roundBestTime.count() >= bestTime.count() * (1 - minimumGain))
+            {
+                return report;
+            }
+
+            report.best = roundBest;
+            bestTime = roundBestTime;
+        }
+    }
+
+    void writeTuning(std::ostream &out, std::vector<AST> const &program, TuningSettings const &settings)
+    {
+        out << PROGRAM_KEY << '=' << std::hex << structuralDigest(program).hash << std::dec << '\n'
+            << "opt_level=" << settings.optimizer.level << '\n'
+            << "loop_unrolling=" << settings.optimizer.loopUnrolling << '\n'
+            << "loop_vectorization=" << settings.optimizer.loopVectorization << '\n'
+            << "slp_vectorization=" << settings.optimizer.slpVectorization << '\n'
+            << "propagate_constants=" << settings.propagateConstants << '\n'
+            << "counted_loops=" << settings.countedLoops << '\n'
+            << "cpu=" << settings.cpu << '\n';
+    }
+
+    std::optional<TuningSettings> readTuning(std::istream &in, std::vector<AST> const &program)
+    {
+        std::map<std::string, std::string> values;
+
+        for (std::string line; std::getline(in, line);)
+        {
+            auto separator = line.find('=');
+
+            if (separator != std::string::npos)
+            {
+                values[line.substr(0, separator)] = line.substr(separator + 1);
+            }
+        }
+
+        // The whole value must be a number in range.
+        auto parse = [](std::string const &key, std::string const &text, auto &value, int base = 10)
+        {
+            auto end = text.data() + text.size();
+            auto [parsed, error] = std::from_chars(text.data(), end, value, base);
+
+            if (text.empty() || error != std::errc() || parsed != end)
+            {
+                throw std::invalid_argument("malformed tuning value " + key + "=" + text);
+            }
+        };
+
+        std::uint64_t hash = 0;
+        parse(PROGRAM_KEY, values[PROGRAM_KEY], hash, 16);
+
+        if (hash != structuralDigest(program).hash)
+        {
+            return std::nullopt;
+        }
+
+        // Missing keys keep their defaults, so that files written before a
+        // setting existed stay valid.
+        TuningSettings settings;
+
+        auto read = [&](std::string const &key, auto &value)
+        {
+            if (auto found = values.find(key); found != values.end())
+            {
+                using Value = std::decay_t<decltype(value)>;
+
+                if constexpr (std::is_same_v<Value, std::string>)
+                {
+                    value = found->second;
+                }
+                else if constexpr (std::is_same_v<Value, bool>)
+                {
+                    unsigned flag = 0;
+                    parse(key, found->second, flag);
+
+                    if (flag > 1)
+                    {
+                        throw std::invalid_argument("malformed tuning value " + key + "=" + found->second);
+                    }
+
+                    value = flag != 0;
+                }
+                else
+                {
+                    parse(key, found->second, value);
+                }
+            }
+        };
+
+        read("opt_level", settings.optimizer.level);
+        read("loop_unrolling", settings.optimizer.loopUnrolling);
+        read("loop_vectorization", settings.optimizer.loopVectorization);
+        read("slp_vectorization", settings.optimizer.slpVectorization);
+        read("propagate_constants", settings.propagateConstants);
+        read("counted_loops", settings.countedLoops);
+        read("cpu", settings.cpu);
+
+        if (settings.optimizer.level < 1 || settings.optimizer.level > 3)
+        {
+            throw std::invalid_argument("tuning opt_level must be 1, 2 or 3");
+        }
+
+        return settings;
+    }
+}
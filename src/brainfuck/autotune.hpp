@@ -0,0 +1,72 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_AUTOTUNE_HPP
+#define INCLUDED_LLVM_BRAINFUCK_AUTOTUNE_HPP
+
+#include "ast.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace brainfuck
+{
+    // Everything autotune varies. The defaults are what bfcompile does
+    // without tuning.
+    struct TuningSettings
+    {
+        OptimizerSettings optimizer;
+        // Run propagateConstants on the AST.
+        bool propagateConstants = true;
+        // CodeGenOptions::emitCountedLoops.
+        bool countedLoops = true;
+        // Target CPU, which implies the CPU features to use.
+        std::string cpu = "generic";
+
+        bool operator==(TuningSettings const &) const = default;
+
+        // Applies the AST and code generation settings.
+        std::vector<AST> prepare(std::vector<AST> program) const;
+        void apply(CodeGenOptions &options) const;
+    };
+
+    struct TuningResult
+    {
+        TuningSettings settings;
+        // Fastest of all repetitions.
+        std::chrono::nanoseconds runTime;
+    };
+
+    struct TuningReport
+    {
+        TuningSettings best;
+        // Every variant that was tried, in order, starting with the
+        // defaults.
+        std::vector<TuningResult> results;
+    };
+
+    // Searches for the settings under which program runs sampleInput the
+    // fastest, running each variant through the JIT. The search is a hill
+    // climb from the defaults: each round tries every setting that differs
+    // from the best so far in one respect (the optimization level, loop
+    // unrolling, loop and SLP vectorization, constant propagation, counted
+    // loops, or generic against host CPU) and moves to the fastest of them,
+    // until none is faster by more than minimumGain. Throws if a variant
+    // produces different output than the defaults.
+    TuningReport autotune(std::vector<AST> const &program,
+                          std::string const &sampleInput,
+                          unsigned repetitions = 3,
+                          double minimumGain = 0.02);
+
+    // Tuning files record the settings for one program, identified by the
+    // structural hash of its unoptimized AST, in lines of key=value.
+    void writeTuning(std::ostream &out, std::vector<AST> const &program, TuningSettings const &settings);
+    // Returns nothing if the file was tuned for a different program, and
+    // throws std::invalid_argument if it is malformed.
+    std::optional<TuningSettings> readTuning(std::istream &in, std::vector<AST> const &program);
+}
+
+#endif
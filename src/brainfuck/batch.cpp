@@ -0,0 +1,93 @@
+#include "batch.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+#include "runtime.hpp"
+#include "structural_hash.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <optional>
+
+namespace brainfuck
+{
+    namespace
+    {
+        char const *const BATCH_ENTRY_NAME = "brainfuck_batch_main";
+    }
+
+    BatchRunner::BatchRunner(std::vector<AST> const &program, unsigned threadCount, OutputCache *outputCache)
+        : outputCache_(outputCache),
+          programHash_(structuralDigest(program).hash),
+          pool_(threadCount),
+          tapes_(pool_.size())
+    {
+        CodeGenOptions options;
+        options.entryPoint = EntryPoint::tapeArgument;
+        options.entryName = BATCH_ENTRY_NAME;
+
+        CodeGenerator codegen(jit_.getDataLayout(), {}, DebugInfoLevel::none, options);
+        codegen(program);
+
+        auto tsModule = codegen.finalizeModule();
+        optimizeModule(*tsModule.getModuleUnlocked(), {}, &jit_.targetMachine());
+
+        jit_.addModule(std::move(tsModule));
+        entry_ = jit_.lookupTapeEntry(BATCH_ENTRY_NAME);
+
+        for (auto &tape : tapes_)
+        {
+            tape.resize(BRAINFUCK_MEMSIZE);
+        }
+    }
+
+    void BatchRunner::run(std::vector<std::string> const &inputs, BatchOrder order, ResultSink const &sink)
+    {
+        std::mutex sinkMutex;
+        std::vector<std::optional<BatchResult>> pending(order == BatchOrder::input ? inputs.size() : 0);
+        std::size_t nextToDeliver = 0;
+
+        for (std::size_t recordId = 0; recordId < inputs.size(); ++recordId)
+        {
+            pool_.submit([&, recordId]
+                         {
+                             auto result = runRecord(recordId, inputs[recordId]);
+
+                             std::lock_guard lock(sinkMutex);
+
+                             if (order == BatchOrder::completion)
+                             {
+                                 sink(result);
+                                 return;
+                             }
+
+                             pending[recordId] = std::move(result);
+
+                             while (nextToDeliver < pending.size() && pending[nextToDeliver])
+                             {
+                                 sink(*pending[nextToDeliver]);
+                                 pending[nextToDeliver].reset();
+                                 ++nextToDeliver;
+                             } });
+        }
+
+        pool_.wait();
+    }
+
+    BatchResult BatchRunner::runRecord(std::size_t recordId, std::string const &input)
+    {
+        auto run = [this](std::string_view recordInput)
+        {
+            auto &tape = tapes_[ThreadPool::workerIndex()];
+            std::fill(tape.begin(), tape.end(), 0);
+
+            BufferIo io(recordInput);
+            ScopedProgramIo binding(io);
+
+            auto status = entry_(tape.data());
+            return CachedOutput{status, io.takeOutput()};
+        };
+
+        auto output = outputCache_ ? outputCache_->getOrRun(programHash_, input, run) : run(input);
+        return {recordId, output.status, std::move(output.output)};
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_BATCH_HPP
+#define INCLUDED_LLVM_BRAINFUCK_BATCH_HPP
+
+#include "ast.hpp"
+#include "jit.hpp"
+#include "output_cache.hpp"
+#include "thread_pool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace brainfuck
+{
+    enum class BatchOrder
+    {
+        // Results are delivered in the order of the inputs.
+        input,
+        // Results are delivered as soon as they are done; use recordId to
+        // match them up with their inputs.
+        completion
+    };
+
+    struct BatchResult
+    {
+        std::size_t recordId;
+        int status;
+        std::string output;
+    };
+
+    // Runs one program against many independent inputs. The program is
+    // compiled and optimized once; records are then spread over a
+    // work-stealing thread pool, and every worker recycles its own tape
+    // instead of allocating one per record.
+    //
+    // With an output cache, records whose input the program has seen
+    // before are answered from the cache instead of being run.
+    class BatchRunner
+    {
+    public:
+        using ResultSink = std::function<void(BatchResult const &)>;
+
+        BatchRunner(std::vector<AST> const &program,
+                    unsigned threadCount = std::thread::hardware_concurrency(),
+                    OutputCache *outputCache = nullptr);
+
+        // Calls to the sink are serialized, so it does not need to be
+        // thread-safe.
+        void run(std::vector<std::string> const &inputs, BatchOrder order, ResultSink const &sink);
+
+    private:
+        BatchResult runRecord(std::size_t recordId, std::string const &input);
+
+        JitEngine jit_;
+        JitEngine::TapeEntryFunction entry_;
+        OutputCache *outputCache_;
+        std::uint64_t programHash_;
+        ThreadPool pool_;
+        std::vector<std::vector<std::uint8_t>> tapes_;
+    };
+}
+
+#endif
@@ -0,0 +1,392 @@
+#include "bytecode.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace brainfuck
+{
+    namespace
+    {
+        char const BYTECODE_MAGIC[4] = {'B', 'F', 'B', 'C'};
+
+        std::uint64_t const FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+        std::uint64_t const FNV_PRIME = 0x100000001b3ull;
+
+        std::uint64_t hashInstructions(std::span<BytecodeInstruction const> instructions)
+        {
+            auto hash = FNV_OFFSET_BASIS;
+
+            for (auto byte : std::as_bytes(instructions))
+            {
+                hash ^= static_cast<std::uint8_t>(byte);
+                hash *= FNV_PRIME;
+            }
+
+            return hash;
+        }
+
+        class BytecodeEmitter
+        {
+        public:
+            void operator()(IncrAST const &ast) { addPendingData(ast.location(), 1); }
+            void operator()(DecrAST const &ast) { addPendingData(ast.location(), -1); }
+            void operator()(RightAST const &ast) { addPendingMove(ast.location(), 1); }
+            void operator()(LeftAST const &ast) { addPendingMove(ast.location(), -1); }
+
+            void operator()(WriteAST const &ast)
+            {
+                flushPending();
+                emit(ast.location(), BytecodeOpcode::write);
+            }
+
+            void operator()(ReadAST const &ast)
+            {
+                flushPending();
+                emit(ast.location(), BytecodeOpcode::read);
+            }
+
+            void operator()(SetAST const &set)
+            {
+                if (pendingMove_ != 0)
+                {
+                    flushPending();
+                }
+
+                pendingData_ = 0;
+                emit(set.location(), BytecodeOpcode::set, set.value());
+            }
+
+            // Only reached through emitBlock.
+            void operator()(LoopAST const &) {}
+
+            // Nested loops are emitted with an explicit stack rather than by
+            // recursion, so that deep nesting cannot overflow the machine
+            // stack.
+            void emitBlock(std::vector<AST> const &block)
+            {
+                struct Frame
+                {
+                    std::vector<AST> const *block;
+                    std::size_t next;
+                    LoopAST const *loop;
+                    // Index of the loop's opening jump.
+                    std::size_t open;
+                };
+
+                std::vector<Frame> frames;
+                frames.push_back({&block, 0, nullptr, 0});
+
+                while (!frames.empty())
+                {
+                    auto &frame = frames.back();
+
+                    if (frame.next == frame.block->size())
+                    {
+                        flushPending();
+
+                        if (frame.loop)
+                        {
+                            auto distance = static_cast<std::int32_t>(instructions_.size() - frame.open);
+                            emit(frame.loop->location(), BytecodeOpcode::jumpIfNonZero, 0, -distance);
+                            instructions_[frame.open].operand = distance;
+                        }
+
+                        frames.pop_back();
+                        continue;
+                    }
+
+                    auto const &ast = (*frame.block)[frame.next++];
+
+                    if (auto loop = std::get_if<LoopAST>(&ast))
+                    {
+                        flushPending();
+
+                        auto open = instructions_.size();
+                        emit(loop->location(), BytecodeOpcode::jumpIfZero);
+                        frames.push_back({&loop->loopBody(), 0, loop, open});
+                        continue;
+                    }
+
+                    std::visit(*this, ast);
+                }
+            }
+
+            std::vector<BytecodeInstruction> instructions_;
+            std::vector<BytecodeLocation> locations_;
+
+        private:
+            void addPendingData(SourceLocation loc, int delta)
+            {
+                if (pendingMove_ != 0)
+                {
+                    flushPending();
+                }
+
+                if (pendingData_ == 0 && pendingMove_ == 0)
+                {
+                    pendingLocation_ = loc;
+                }
+
+                pendingData_ += delta;
+            }
+
+            void addPendingMove(SourceLocation loc, int delta)
+            {
+                if (pendingData_ != 0)
+                {
+                    flushPending();
+                }
+
+                if (pendingData_ == 0 && pendingMove_ == 0)
+                {
+                    pendingLocation_ = loc;
+                }
+
+                pendingMove_ += delta;
+            }
+
+            void flushPending()
+            {
+                if (auto data = static_cast<std::uint8_t>(pendingData_); data != 0)
+                {
+                    emit(pendingLocation_, BytecodeOpcode::add, data);
+                }
+
+                if (pendingMove_ != 0)
+                {
+                    emit(pendingLocation_, BytecodeOpcode::move, 0, pendingMove_);
+                }
+
+                pendingData_ = 0;
+                pendingMove_ = 0;
+            }
+
+            void emit(SourceLocation loc, BytecodeOpcode opcode, std::uint8_t value = 0, std::int32_t operand = 0)
+            {
+                instructions_.push_back({opcode, value, 0, operand});
+                locations_.push_back({loc.line(), loc.column()});
+            }
+
+            int pendingData_ = 0;
+            int pendingMove_ = 0;
+            SourceLocation pendingLocation_;
+        };
+
+        void checkJump(std::span<BytecodeInstruction const> instructions, std::size_t index, BytecodeOpcode matching)
+        {
+            auto operand = instructions[index].operand;
+            auto target = static_cast<std::int64_t>(index) + operand;
+
+            if (target < 0 || static_cast<std::size_t>(target) >= instructions.size() ||
+                instructions[target].opcode != matching || instructions[target].operand != -operand)
+            {
+                throw std::invalid_argument("bytecode jump at " + std::to_string(index) + " has no matching target");
+            }
+        }
+    }
+
+    std::vector<std::byte> encodeBytecode(std::vector<AST> const &program, bool withLocations)
+    {
+        BytecodeEmitter emitter;
+        emitter.emitBlock(program);
+
+        auto const &instructions = emitter.instructions_;
+        auto instructionBytes = instructions.size() * sizeof(BytecodeInstruction);
+
+        BytecodeHeader header{};
+        std::memcpy(header.magic, BYTECODE_MAGIC, sizeof(header.magic));
+        header.version = BYTECODE_VERSION;
+        header.flags = withLocations ? BYTECODE_HAS_LOCATIONS : 0;
+        header.instructionCount = static_cast<std::uint32_t>(instructions.size());
+        header.instructionOffset = sizeof(BytecodeHeader);
+        header.locationOffset = withLocations ? header.instructionOffset + instructionBytes : 0;
+        header.contentHash = hashInstructions(instructions);
+
+        std::vector<std::byte> image(sizeof(header) + instructionBytes * (withLocations ? 2 : 1));
+        std::memcpy(image.data(), &header, sizeof(header));
+        std::memcpy(image.data() + header.instructionOffset, instructions.data(), instructionBytes);
+
+        if (withLocations)
+        {
+            std::memcpy(image.data() + header.locationOffset, emitter.locations_.data(), instructionBytes);
+        }
+
+        return image;
+    }
+
+    BytecodeView::BytecodeView(std::span<std::byte const> image)
+    {
+        if constexpr (std::endian::native != std::endian::little)
+        {
+            throw std::invalid_argument("bytecode can only be run on little-endian hosts");
+        }
+
+        if (reinterpret_cast<std::uintptr_t>(image.data()) % alignof(BytecodeHeader) != 0)
+        {
+            throw std::invalid_argument("bytecode image is not aligned");
+        }
+
+        if (image.size() < sizeof(BytecodeHeader))
+        {
+            throw std::invalid_argument("bytecode image is truncated");
+        }
+
+        header_ = reinterpret_cast<BytecodeHeader const *>(image.data());
+
+        if (std::memcmp(header_->magic, BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC)) != 0)
+        {
+            throw std::invalid_argument("not a bytecode image");
+        }
+
+        if (header_->version != BYTECODE_VERSION)
+        {
+            throw std::invalid_argument("unsupported bytecode version " + std::to_string(header_->version));
+        }
+
+        // Offsets and sizes are 32 bits wide, so these cannot overflow.
+        auto instructionBytes = std::uint64_t{header_->instructionCount} * sizeof(BytecodeInstruction);
+        bool hasLocations = (header_->flags & BYTECODE_HAS_LOCATIONS) != 0;
+
+        if (header_->instructionOffset % alignof(BytecodeInstruction) != 0 ||
+            header_->instructionOffset + instructionBytes > image.size() ||
+            (hasLocations && (header_->locationOffset % alignof(BytecodeLocation) != 0 ||
+                              header_->locationOffset + instructionBytes > image.size())))
+        {
+            throw std::invalid_argument("bytecode image is truncated");
+        }
+
+        instructions_ = {reinterpret_cast<BytecodeInstruction const *>(image.data() + header_->instructionOffset),
+                         header_->instructionCount};
+
+        if (hasLocations)
+        {
+            locations_ = {reinterpret_cast<BytecodeLocation const *>(image.data() + header_->locationOffset),
+                          header_->instructionCount};
+        }
+
+        for (std::size_t i = 0; i < instructions_.size(); ++i)
+        {
+            switch (instructions_[i].opcode)
+            {
+            case BytecodeOpcode::add:
+            case BytecodeOpcode::move:
+            case BytecodeOpcode::set:
+            case BytecodeOpcode::write:
+            case BytecodeOpcode::read:
+                break;
+            case BytecodeOpcode::jumpIfZero:
+                checkJump(instructions_, i, BytecodeOpcode::jumpIfNonZero);
+                break;
+            case BytecodeOpcode::jumpIfNonZero:
+                checkJump(instructions_, i, BytecodeOpcode::jumpIfZero);
+                break;
+            default:
+                throw std::invalid_argument("invalid bytecode opcode at " + std::to_string(i));
+            }
+        }
+
+        if (!hashMatches())
+        {
+            throw std::invalid_argument("bytecode image is corrupted");
+        }
+    }
+
+    bool BytecodeView::hashMatches() const
+    {
+        return hashInstructions(instructions_) == header_->contentHash;
+    }
+
+    MappedBytecode::MappedBytecode(std::filesystem::path const &path)
+        : mapping_(path),
+          view_(mapping_.bytes)
+    {
+    }
+
+    MappedBytecode::Mapping::Mapping(std::filesystem::path const &path)
+    {
+        auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "could not open " + path.string());
+        }
+
+        struct stat status;
+
+        if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(BytecodeHeader)))
+        {
+            close(fd);
+            throw std::invalid_argument(path.string() + " is not a bytecode image");
+        }
+
+        auto size = static_cast<std::size_t>(status.st_size);
+        auto mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (mapping == MAP_FAILED)
+        {
+            throw std::system_error(errno, std::generic_category(), "could not map " + path.string());
+        }
+
+        bytes = {static_cast<std::byte const *>(mapping), size};
+    }
+
+    MappedBytecode::Mapping::~Mapping()
+    {
+        munmap(const_cast<std::byte *>(bytes.data()), bytes.size());
+    }
+
+    int runBytecode(BytecodeView const &program,
+                    std::uint8_t *tape,
+                    PutcharFunction putcharFunction,
+                    GetcharFunction getcharFunction)
+    {
+        auto instructions = program.instructions();
+
+        for (std::size_t pc = 0; pc < instructions.size(); ++pc)
+        {
+            auto const &instruction = instructions[pc];
+
+            switch (instruction.opcode)
+            {
+            case BytecodeOpcode::add:
+                *tape += instruction.value;
+                break;
+            case BytecodeOpcode::move:
+                tape += instruction.operand;
+                break;
+            case BytecodeOpcode::set:
+                *tape = instruction.value;
+                break;
+            case BytecodeOpcode::write:
+                putcharFunction(*tape);
+                break;
+            case BytecodeOpcode::read:
+                *tape = static_cast<std::uint8_t>(getcharFunction());
+                break;
+            case BytecodeOpcode::jumpIfZero:
+                if (*tape == 0)
+                {
+                    pc += instruction.operand;
+                }
+                break;
+            case BytecodeOpcode::jumpIfNonZero:
+                if (*tape != 0)
+                {
+                    pc += instruction.operand;
+                }
+                break;
+            }
+        }
+
+        return 0;
+    }
+}
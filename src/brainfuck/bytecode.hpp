@@ -0,0 +1,140 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_BYTECODE_HPP
+#define INCLUDED_LLVM_BRAINFUCK_BYTECODE_HPP
+
+#include "ast.hpp"
+#include "runtime.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace brainfuck
+{
+    // Precompiled programs that can be mapped into memory and interpreted
+    // in place, without lexing, parsing or copying. An image is laid out as
+    //
+    //     BytecodeHeader
+    //     BytecodeInstruction[instructionCount]
+    //     BytecodeLocation[instructionCount]    (if BYTECODE_HAS_LOCATIONS)
+    //
+    // with all offsets relative to the start of the image and all fields
+    // little-endian. Jumps are relative to the jumping instruction, so an
+    // image can be mapped at any address.
+    std::uint16_t const BYTECODE_VERSION = 1;
+    std::uint16_t const BYTECODE_HAS_LOCATIONS = 1;
+
+    struct BytecodeHeader
+    {
+        char magic[4]; // "BFBC"
+        std::uint16_t version;
+        std::uint16_t flags;
+        std::uint32_t instructionCount;
+        std::uint32_t instructionOffset;
+        std::uint32_t locationOffset;
+        std::uint32_t reserved;
+        // FNV-1a over the instruction stream, e.g. for cache keys.
+        std::uint64_t contentHash;
+    };
+
+    enum class BytecodeOpcode : std::uint8_t
+    {
+        // Adds value to the current cell.
+        add,
+        // Moves the tape pointer by operand cells.
+        move,
+        set,
+        write,
+        read,
+        // Jump to the matching instruction, at operand instructions
+        // distance, and continue after it.
+        jumpIfZero,
+        jumpIfNonZero
+    };
+
+    struct BytecodeInstruction
+    {
+        BytecodeOpcode opcode;
+        std::uint8_t value;
+        std::uint16_t reserved;
+        std::int32_t operand;
+    };
+
+    // Where the first source instruction folded into an instruction was.
+    struct BytecodeLocation
+    {
+        std::int32_t line;
+        std::int32_t column;
+    };
+
+    static_assert(sizeof(BytecodeHeader) == 32);
+    static_assert(sizeof(BytecodeInstruction) == 8);
+    static_assert(sizeof(BytecodeLocation) == 8);
+
+    // Translates a program into a bytecode image. Runs of +/- and </> are
+    // folded into single instructions.
+    std::vector<std::byte> encodeBytecode(std::vector<AST> const &program, bool withLocations = true);
+
+    // Non-owning view of a bytecode image. The constructor validates the
+    // header, the bounds and every jump target, so that running a view can
+    // not read outside of the image, and the content hash, and throws
+    // std::invalid_argument for malformed or corrupted images. The image
+    // must be 8-byte aligned.
+    class BytecodeView
+    {
+    public:
+        explicit BytecodeView(std::span<std::byte const> image);
+
+        BytecodeHeader const &header() const { return *header_; }
+        std::span<BytecodeInstruction const> instructions() const { return instructions_; }
+        // Empty if the image has no location table.
+        std::span<BytecodeLocation const> locations() const { return locations_; }
+
+    private:
+        bool hashMatches() const;
+
+        BytecodeHeader const *header_;
+        std::span<BytecodeInstruction const> instructions_;
+        std::span<BytecodeLocation const> locations_;
+    };
+
+    // A bytecode file mapped read-only, so that all processes running the
+    // same program share its pages.
+    class MappedBytecode
+    {
+    public:
+        explicit MappedBytecode(std::filesystem::path const &path);
+        MappedBytecode(MappedBytecode const &) = delete;
+        MappedBytecode &operator=(MappedBytecode const &) = delete;
+
+        BytecodeView const &view() const { return view_; }
+
+    private:
+        // Owns the mapping, so that it is released even if the image turns
+        // out to be invalid.
+        struct Mapping
+        {
+            explicit Mapping(std::filesystem::path const &path);
+            Mapping(Mapping const &) = delete;
+            Mapping &operator=(Mapping const &) = delete;
+            ~Mapping();
+
+            std::span<std::byte const> bytes;
+        };
+
+        Mapping mapping_;
+        BytecodeView view_;
+    };
+
+    using PutcharFunction = int (*)(int);
+    using GetcharFunction = int (*)();
+
+    // Interprets the program on a zeroed tape of BRAINFUCK_MEMSIZE cells.
+    int runBytecode(BytecodeView const &program,
+                    std::uint8_t *tape,
+                    PutcharFunction putcharFunction = &brainfuck_runtime_putchar,
+                    GetcharFunction getcharFunction = &brainfuck_runtime_getchar);
+}
+
+#endif
@@ -1,27 +1,37 @@
 #include "codegen.hpp"
 
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/Verifier.h>
 
-#include <algorithm>
+#include <bit>
+#include <limits>
 
 namespace brainfuck
 {
     namespace
     {
-        int const BRAINFUCK_MEMSIZE = 30000;
+        // Branch weights that keep the fuel checks out of the hot path.
+        std::uint32_t const FUEL_LEFT_WEIGHT = 1 << 20;
+        std::uint32_t const OUT_OF_FUEL_WEIGHT = 1;
+        // The same for the tape bounds checks.
+        std::uint32_t const ON_TAPE_WEIGHT = 1 << 20;
+        std::uint32_t const OFF_TAPE_WEIGHT = 1;
     }
 
     CodeGenerator::CodeGenerator(llvm::DataLayout dataLayout,
                                  std::filesystem::path const &sourceFilePath,
-                                 bool shouldEmitDebugInfo)
+                                 DebugInfoLevel debugInfo,
+                                 CodeGenOptions options)
+        : options_(std::move(options)),
+          debugInfo_(debugInfo)
     {
-        initLlvmInfrastructure(dataLayout, sourceFilePath, shouldEmitDebugInfo);
+        initLlvmInfrastructure(dataLayout, sourceFilePath);
         initConstantsAndTypes();
         initDeclareFunctions();
         initMainEntry();
     }
 
-    void CodeGenerator::initLlvmInfrastructure(llvm::DataLayout const &dataLayout, std::filesystem::path const &sourceFilePath, bool shouldEmitDebugInfo)
+    void CodeGenerator::initLlvmInfrastructure(llvm::DataLayout const &dataLayout, std::filesystem::path const &sourceFilePath)
     {
         llvmContext_ = std::make_unique<llvm::LLVMContext>();
 
@@ -30,7 +40,7 @@ namespace brainfuck
         module_->setDataLayout(dataLayout);
         irBuilder_ = std::make_unique<llvm::IRBuilder<>>(*llvmContext_);
 
-        if (shouldEmitDebugInfo)
+        if (debugInfo_ != DebugInfoLevel::none)
         {
             module_->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
 
@@ -39,7 +49,9 @@ namespace brainfuck
 
             debugInfoBuilder_ = std::make_unique<llvm::DIBuilder>(*module_);
             debugInfoFile_ = debugInfoBuilder_->createFile(sourceFileName, sourceFileDir);
-            debugInfoCompileUnit_ = debugInfoBuilder_->createCompileUnit(llvm::dwarf::DW_LANG_C, debugInfoFile_, "bfcompile", true, "", 0);
+            auto emissionKind = debugInfo_ == DebugInfoLevel::full ? llvm::DICompileUnit::FullDebug : llvm::DICompileUnit::LineTablesOnly;
+            debugInfoCompileUnit_ = debugInfoBuilder_->createCompileUnit(llvm::dwarf::DW_LANG_C, debugInfoFile_, "bfcompile", true, "", 0,
+                                                                         llvm::StringRef(), emissionKind);
         }
     }
 
@@ -60,17 +72,78 @@ namespace brainfuck
     {
         llvm::FunctionType *putcharType = llvm::FunctionType::get(intType_, {intType_}, false);
         llvm::FunctionType *getcharType = llvm::FunctionType::get(intType_, false);
-        llvm::FunctionType *mainType = llvm::FunctionType::get(intType_, false);
+        llvm::FunctionType *mainType = nullptr;
 
-        putcharFunc_ = llvm::Function::Create(putcharType, llvm::Function::ExternalLinkage, "putchar", *module_);
-        getcharFunc_ = llvm::Function::Create(getcharType, llvm::Function::ExternalLinkage, "getchar", *module_);
-        mainFunc_ = llvm::Function::Create(mainType, llvm::Function::ExternalLinkage, "main", *module_);
+        switch (options_.entryPoint)
+        {
+        case EntryPoint::main:
+            mainType = llvm::FunctionType::get(intType_, false);
+            break;
+        case EntryPoint::tapeArgument:
+            mainType = llvm::FunctionType::get(intType_, {bytePtrType_}, false);
+            break;
+        case EntryPoint::loopFunction:
+            mainType = llvm::FunctionType::get(bytePtrType_, {bytePtrType_}, false);
+            break;
+        case EntryPoint::resumable:
+            resumeStateType_ = llvm::StructType::create(*llvmContext_, {llvm::Type::getInt64Ty(*llvmContext_), intType_}, "ResumeState");
+            mainType = llvm::FunctionType::get(intType_, {bytePtrType_, llvm::PointerType::getUnqual(resumeStateType_)}, false);
+            tryGetcharFunc_ = llvm::Function::Create(getcharType, llvm::Function::ExternalLinkage, "brainfuck_try_getchar", *module_);
+            break;
+        case EntryPoint::context:
+            mainType = llvm::FunctionType::get(intType_, {bytePtrType_}, false);
+            break;
+        }
+
+        if (options_.entryPoint == EntryPoint::context)
+        {
+            // I/O and the tape go through the shared runtime of the library
+            // (see library.hpp), which gets the context with every call.
+            auto contextPutcharType = llvm::FunctionType::get(intType_, {bytePtrType_, intType_}, false);
+            auto contextGetcharType = llvm::FunctionType::get(intType_, {bytePtrType_}, false);
+            auto tapeType = llvm::FunctionType::get(bytePtrType_, {bytePtrType_}, false);
+            auto releaseTapeType = llvm::FunctionType::get(llvm::Type::getVoidTy(*llvmContext_), {bytePtrType_, bytePtrType_}, false);
+
+            putcharFunc_ = llvm::Function::Create(contextPutcharType, llvm::Function::ExternalLinkage, "brainfuck_context_putchar", *module_);
+            getcharFunc_ = llvm::Function::Create(contextGetcharType, llvm::Function::ExternalLinkage, "brainfuck_context_getchar", *module_);
+            tapeFunc_ = llvm::Function::Create(tapeType, llvm::Function::ExternalLinkage, "brainfuck_context_tape", *module_);
+            releaseTapeFunc_ = llvm::Function::Create(releaseTapeType, llvm::Function::ExternalLinkage, "brainfuck_context_release_tape", *module_);
+        }
+        else
+        {
+            putcharFunc_ = llvm::Function::Create(putcharType, llvm::Function::ExternalLinkage, "putchar", *module_);
+            getcharFunc_ = llvm::Function::Create(getcharType, llvm::Function::ExternalLinkage, "getchar", *module_);
+        }
+        mainFunc_ = llvm::Function::Create(mainType, llvm::Function::ExternalLinkage, options_.entryName, *module_);
+
+        if (options_.meterFuel && options_.entryPoint != EntryPoint::loopFunction)
+        {
+            auto fuelType = llvm::Type::getInt64Ty(*llvmContext_);
+            auto fuelTakeType = llvm::FunctionType::get(fuelType, false);
+            auto fuelReturnType = llvm::FunctionType::get(llvm::Type::getVoidTy(*llvmContext_), {fuelType}, false);
+
+            fuelTakeFunc_ = llvm::Function::Create(fuelTakeType, llvm::Function::ExternalLinkage, "brainfuck_fuel_take", *module_);
+            fuelReturnFunc_ = llvm::Function::Create(fuelReturnType, llvm::Function::ExternalLinkage, "brainfuck_fuel_return", *module_);
+        }
+
+        if (options_.profileTape && options_.entryPoint != EntryPoint::loopFunction)
+        {
+            auto hookType = llvm::FunctionType::get(llvm::Type::getVoidTy(*llvmContext_), {llvm::Type::getInt64Ty(*llvmContext_)}, false);
+
+            tapeMoveFunc_ = llvm::Function::Create(hookType, llvm::Function::ExternalLinkage, "brainfuck_tape_move", *module_);
+            tapeReadFunc_ = llvm::Function::Create(hookType, llvm::Function::ExternalLinkage, "brainfuck_tape_read", *module_);
+            tapeWriteFunc_ = llvm::Function::Create(hookType, llvm::Function::ExternalLinkage, "brainfuck_tape_write", *module_);
+        }
 
         if (debugInfoBuilder_)
         {
-            auto debugIntType = debugInfoBuilder_->createBasicType("int", 32, llvm::dwarf::DW_ATE_signed);
-            auto debugMainArgv = debugInfoBuilder_->getOrCreateTypeArray({debugIntType});
-            auto debugMainType = debugInfoBuilder_->createSubroutineType(debugMainArgv);
+            // Line tables need the function, but none of the types.
+            llvm::SmallVector<llvm::Metadata *, 1> debugMainTypes;
+            if (debugInfo_ == DebugInfoLevel::full)
+            {
+                debugMainTypes.push_back(debugInfoBuilder_->createBasicType("int", 32, llvm::dwarf::DW_ATE_signed));
+            }
+            auto debugMainType = debugInfoBuilder_->createSubroutineType(debugInfoBuilder_->getOrCreateTypeArray(debugMainTypes));
 
             debugMain_ = debugInfoBuilder_->createFunction(debugInfoFile_,
                                                            mainFunc_->getName(),
@@ -92,30 +165,85 @@ namespace brainfuck
         irBuilder_->SetInsertPoint(entryBlock);
 
         posMem_ = irBuilder_->CreateAlloca(bytePtrType_, nullptr, "posMem");
-        globalMem_ = irBuilder_->CreateAlloca(byteType_, memsize_, "globalMem");
-        irBuilder_->CreateIntrinsic(llvm::Intrinsic::memset,
-                                    {bytePtrType_, byteType_, intType_, llvm::Type::getInt1Ty(*llvmContext_)},
-                                    {globalMem_, byteZero_, memsize_, llvm::ConstantInt::get(*llvmContext_, llvm::APInt(1, 0))});
+
+        if (fuelTakeFunc_)
+        {
+            fuelMem_ = irBuilder_->CreateAlloca(llvm::Type::getInt64Ty(*llvmContext_), nullptr, "fuelMem");
+            irBuilder_->CreateStore(irBuilder_->CreateCall(fuelTakeFunc_, std::nullopt, "fuel"), fuelMem_);
+        }
+
+        if (options_.entryPoint == EntryPoint::context)
+        {
+            runtimeContext_ = mainFunc_->getArg(0);
+            runtimeContext_->setName("runtimeContext");
+            globalMem_ = irBuilder_->CreateCall(tapeFunc_, {runtimeContext_}, "globalMem");
+
+            auto noTapeBB = llvm::BasicBlock::Create(*llvmContext_, "noTape", mainFunc_);
+            auto tapeBB = llvm::BasicBlock::Create(*llvmContext_, "tape", mainFunc_);
+            irBuilder_->CreateCondBr(irBuilder_->CreateIsNull(globalMem_, "tapeFailed"), noTapeBB, tapeBB);
+
+            irBuilder_->SetInsertPoint(noTapeBB);
+            emitReturn(irBuilder_->getInt32(OUT_OF_MEMORY_STATUS));
+            irBuilder_->SetInsertPoint(tapeBB);
+        }
+        else if (options_.entryPoint != EntryPoint::main)
+        {
+            globalMem_ = mainFunc_->getArg(0);
+            globalMem_->setName("globalMem");
+        }
+        else
+        {
+            globalMem_ = irBuilder_->CreateAlloca(byteType_, memsize_, "globalMem");
+            irBuilder_->CreateMemSet(globalMem_, byteZero_, memsize_, llvm::MaybeAlign(1));
+        }
+
         irBuilder_->CreateStore(globalMem_, posMem_);
 
         if (debugInfoBuilder_)
         {
-            auto debugByteType = debugInfoBuilder_->createBasicType("unsigned char", 8, llvm::dwarf::DW_ATE_unsigned_char);
-            auto debugBytePtrType = debugInfoBuilder_->createPointerType(debugByteType, 64);
-            auto memsizeMD = llvm::ConstantAsMetadata::get(llvm::ConstantInt::getSigned(llvm::Type::getInt64Ty(*llvmContext_), BRAINFUCK_MEMSIZE));
-            auto subscripts = debugInfoBuilder_->getOrCreateSubrange(memsizeMD, nullptr, nullptr, nullptr);
-            auto subscriptsArray = debugInfoBuilder_->getOrCreateArray({subscripts});
-            auto debugByteArrayType = debugInfoBuilder_->createArrayType(BRAINFUCK_MEMSIZE, 1, debugByteType, subscriptsArray);
-
-            auto debugPos = debugInfoBuilder_->createAutoVariable(debugMain_, "pos", debugInfoFile_, 1, debugBytePtrType, true);
-            auto debugMem = debugInfoBuilder_->createAutoVariable(debugMain_, "mem", debugInfoFile_, 1, debugByteArrayType, true);
             auto debugLoc = llvm::DILocation::get(debugMain_->getContext(), 1, 0, debugMain_);
 
-            debugInfoBuilder_->insertDeclare(posMem_, debugPos, debugInfoBuilder_->createExpression(), debugLoc, irBuilder_->GetInsertBlock());
-            debugInfoBuilder_->insertDeclare(globalMem_, debugMem, debugInfoBuilder_->createExpression(), debugLoc, irBuilder_->GetInsertBlock());
+            if (debugInfo_ == DebugInfoLevel::full)
+            {
+                auto debugByteType = debugInfoBuilder_->createBasicType("unsigned char", 8, llvm::dwarf::DW_ATE_unsigned_char);
+                auto debugBytePtrType = debugInfoBuilder_->createPointerType(debugByteType, 64);
+                auto memsizeMD = llvm::ConstantAsMetadata::get(llvm::ConstantInt::getSigned(llvm::Type::getInt64Ty(*llvmContext_), BRAINFUCK_MEMSIZE));
+                auto subscripts = debugInfoBuilder_->getOrCreateSubrange(memsizeMD, nullptr, nullptr, nullptr);
+                auto subscriptsArray = debugInfoBuilder_->getOrCreateArray({subscripts});
+                auto debugByteArrayType = debugInfoBuilder_->createArrayType(BRAINFUCK_MEMSIZE, 1, debugByteType, subscriptsArray);
+
+                auto debugPos = debugInfoBuilder_->createAutoVariable(debugMain_, "pos", debugInfoFile_, 1, debugBytePtrType, true);
+                auto debugMem = debugInfoBuilder_->createAutoVariable(debugMain_, "mem", debugInfoFile_, 1, debugByteArrayType, true);
+
+                debugInfoBuilder_->insertDeclare(posMem_, debugPos, debugInfoBuilder_->createExpression(), debugLoc, irBuilder_->GetInsertBlock());
+
+                if (llvm::isa<llvm::AllocaInst>(globalMem_))
+                {
+                    debugInfoBuilder_->insertDeclare(globalMem_, debugMem, debugInfoBuilder_->createExpression(), debugLoc, irBuilder_->GetInsertBlock());
+                }
+            }
 
             irBuilder_->SetCurrentDebugLocation(debugLoc);
         }
+
+        if (options_.entryPoint == EntryPoint::resumable)
+        {
+            // Restore the tape position and dispatch to the read that the
+            // program suspended at, or to the start.
+            resumeState_ = mainFunc_->getArg(1);
+            resumeState_->setName("resumeState");
+
+            auto positionPtr = irBuilder_->CreateStructGEP(resumeStateType_, resumeState_, 0, "positionPtr");
+            auto position = irBuilder_->CreateLoad(llvm::Type::getInt64Ty(*llvmContext_), positionPtr, "savedPosition");
+            irBuilder_->CreateStore(irBuilder_->CreateGEP(byteType_, globalMem_, position, "savedPos"), posMem_);
+
+            auto resumePointPtr = irBuilder_->CreateStructGEP(resumeStateType_, resumeState_, 1, "resumePointPtr");
+            auto resumePoint = irBuilder_->CreateLoad(intType_, resumePointPtr, "resumePoint");
+
+            auto startBB = llvm::BasicBlock::Create(*llvmContext_, "startBlock", mainFunc_);
+            resumeSwitch_ = irBuilder_->CreateSwitch(resumePoint, startBB);
+            irBuilder_->SetInsertPoint(startBB);
+        }
     }
 
     void CodeGenerator::operator()(AST const &ast)
@@ -125,7 +253,54 @@ namespace brainfuck
 
     void CodeGenerator::operator()(std::vector<AST> const &block)
     {
-        std::for_each(begin(block), end(block), std::ref(*this));
+        // Nested loops are generated with an explicit stack of the bodies
+        // being worked on rather than by recursion, so that the nesting
+        // depth is not limited by the machine stack.
+        struct Frame
+        {
+            std::vector<AST> const *block;
+            std::size_t next;
+            std::optional<OpenLoop> loop;
+        };
+
+        std::vector<Frame> frames;
+        frames.push_back({&block, 0, std::nullopt});
+
+        while (!frames.empty())
+        {
+            auto &frame = frames.back();
+
+            if (frame.next == frame.block->size())
+            {
+                if (frame.loop)
+                {
+                    endLoop(*frame.loop);
+                }
+
+                frames.pop_back();
+                continue;
+            }
+
+            auto index = frame.next++;
+            auto const &ast = (*frame.block)[index];
+
+            if (frame.loop && frame.loop->skipped.contains(index))
+            {
+                continue;
+            }
+
+            if (auto loop = std::get_if<LoopAST>(&ast))
+            {
+                if (auto open = beginLoop(*loop))
+                {
+                    frames.push_back({&loop->loopBody(), 0, std::move(open)});
+                }
+            }
+            else
+            {
+                std::visit(*this, ast);
+            }
+        }
     }
 
     void CodeGenerator::operator()(IncrAST const &ast)
@@ -136,6 +311,8 @@ namespace brainfuck
         auto oldValue = irBuilder_->CreateLoad(byteType_, posValue, "incrOld");
         auto newValue = irBuilder_->CreateAdd(oldValue, byteOne_, "incrNew");
         irBuilder_->CreateStore(newValue, posValue);
+        emitTapeProfile(tapeReadFunc_, posValue);
+        emitTapeProfile(tapeWriteFunc_, posValue);
     }
 
     void CodeGenerator::operator()(DecrAST const &ast)
@@ -146,6 +323,8 @@ namespace brainfuck
         auto oldValue = irBuilder_->CreateLoad(byteType_, posValue, "decrOld");
         auto newValue = irBuilder_->CreateSub(oldValue, byteOne_, "decrNew");
         irBuilder_->CreateStore(newValue, posValue);
+        emitTapeProfile(tapeReadFunc_, posValue);
+        emitTapeProfile(tapeWriteFunc_, posValue);
     }
 
     void CodeGenerator::operator()(LeftAST const &ast)
@@ -155,8 +334,10 @@ namespace brainfuck
         auto oldPosPtr = irBuilder_->CreateLoad(bytePtrType_, posMem_, "leftOldPtr");
         auto oldPosInt = irBuilder_->CreatePtrToInt(oldPosPtr, ptrIntType_, "leftOldInt");
         auto newPosInt = irBuilder_->CreateSub(oldPosInt, ptrIntOne_, "leftNewInt");
+        checkTapeBounds(newPosInt);
         auto newPosPtr = irBuilder_->CreateIntToPtr(newPosInt, bytePtrType_, "leftNewPtr");
         irBuilder_->CreateStore(newPosPtr, posMem_);
+        emitTapeProfile(tapeMoveFunc_, newPosPtr);
     }
 
     void CodeGenerator::operator()(RightAST const &ast)
@@ -166,8 +347,10 @@ namespace brainfuck
         auto oldPosPtr = irBuilder_->CreateLoad(bytePtrType_, posMem_, "rightOldPtr");
         auto oldPosInt = irBuilder_->CreatePtrToInt(oldPosPtr, ptrIntType_, "rightOldInt");
         auto newPosInt = irBuilder_->CreateAdd(oldPosInt, ptrIntOne_, "rightNewInt");
+        checkTapeBounds(newPosInt);
         auto newPosPtr = irBuilder_->CreateIntToPtr(newPosInt, bytePtrType_, "rightNewPtr");
         irBuilder_->CreateStore(newPosPtr, posMem_);
+        emitTapeProfile(tapeMoveFunc_, newPosPtr);
     }
 
     void CodeGenerator::operator()(WriteAST const &ast)
@@ -177,22 +360,83 @@ namespace brainfuck
         auto posValue = irBuilder_->CreateLoad(bytePtrType_, posMem_, "writePos");
         auto dataValue = irBuilder_->CreateLoad(byteType_, posValue, "writeVal");
         auto dataInt = irBuilder_->CreateCast(llvm::CastInst::ZExt, dataValue, intType_, "writeCast");
-        irBuilder_->CreateCall(putcharFunc_, dataInt, "writeCall");
+        emitTapeProfile(tapeReadFunc_, posValue);
+
+        if (runtimeContext_)
+        {
+            irBuilder_->CreateCall(putcharFunc_, {runtimeContext_, dataInt}, "writeCall");
+        }
+        else
+        {
+            irBuilder_->CreateCall(putcharFunc_, dataInt, "writeCall");
+        }
     }
 
     void CodeGenerator::operator()(ReadAST const &ast)
     {
         emitDebugLocation(ast.location());
 
-        auto readValue = irBuilder_->CreateCall(getcharFunc_, std::nullopt, "readCall");
+        if (options_.entryPoint == EntryPoint::resumable)
+        {
+            emitResumableRead();
+            return;
+        }
+
+        auto readValue = runtimeContext_ ? irBuilder_->CreateCall(getcharFunc_, {runtimeContext_}, "readCall")
+                                         : irBuilder_->CreateCall(getcharFunc_, std::nullopt, "readCall");
+        auto readByte = irBuilder_->CreateTrunc(readValue, byteType_, "readByte");
         auto posValue = irBuilder_->CreateLoad(bytePtrType_, posMem_, "readPos");
-        irBuilder_->CreateStore(readValue, posValue);
+        irBuilder_->CreateStore(readByte, posValue);
+        emitTapeProfile(tapeWriteFunc_, posValue);
     }
 
-    void CodeGenerator::operator()(LoopAST const &ast)
+    void CodeGenerator::operator()(SetAST const &ast)
     {
         emitDebugLocation(ast.location());
 
+        auto posValue = irBuilder_->CreateLoad(bytePtrType_, posMem_, "setPos");
+        auto newValue = llvm::ConstantInt::get(byteType_, ast.value());
+        irBuilder_->CreateStore(newValue, posValue);
+        emitTapeProfile(tapeWriteFunc_, posValue);
+    }
+
+    void CodeGenerator::operator()(LoopAST const &ast)
+    {
+        if (auto open = beginLoop(ast))
+        {
+            (*this)(ast.loopBody());
+            endLoop(*open);
+        }
+    }
+
+    std::optional<CodeGenerator::OpenLoop> CodeGenerator::beginLoop(LoopAST const &ast)
+    {
+        emitDebugLocation(ast.location(), true);
+
+        bool resumable = options_.entryPoint == EntryPoint::resumable;
+
+        if (options_.outlinedLoopName && !resumable && !fuelMem_ && !tapeMoveFunc_ && !options_.checkTapeBounds)
+        {
+            if (auto functionName = options_.outlinedLoopName(ast))
+            {
+                remark(Remark::Kind::analysis, "OutlinedLoop", ast.location(), "loop compiled separately as " + *functionName);
+                emitOutlinedLoopCall(*functionName);
+                return std::nullopt;
+            }
+        }
+
+        if (options_.emitCountedLoops && !resumable && !tapeMoveFunc_)
+        {
+            if (auto counted = analyzeCountedLoop(ast))
+            {
+                remark(Remark::Kind::passed, "CountedLoop", ast.location(),
+                       "loop generated with a computed trip count, control cell step " + std::to_string(counted->step));
+                return beginCountedLoop(ast, *counted);
+            }
+
+            remark(Remark::Kind::missed, "CountedLoop", ast.location(), "trip count of loop cannot be computed on entry");
+        }
+
         auto headBB = llvm::BasicBlock::Create(*llvmContext_, "headBlock", mainFunc_);
         auto bodyBB = llvm::BasicBlock::Create(*llvmContext_, "bodyBlock", mainFunc_);
         // afterBB will be
@@ -204,21 +448,270 @@ namespace brainfuck
         auto posValue = irBuilder_->CreateLoad(bytePtrType_, posMem_, "loopPos");
         auto dataValue = irBuilder_->CreateLoad(byteType_, posValue, "loopVal");
         auto loopCondition = irBuilder_->CreateICmpEQ(dataValue, byteZero_, "loopCond");
+        emitTapeProfile(tapeReadFunc_, posValue);
 
         irBuilder_->CreateCondBr(loopCondition, afterBB, bodyBB);
         irBuilder_->SetInsertPoint(bodyBB);
 
-        (*this)(ast.loopBody());
+        if (fuelMem_)
+        {
+            chargeFuel(llvm::ConstantInt::get(fuelMem_->getAllocatedType(), ast.loopBody().size() + 1));
+        }
 
-        irBuilder_->CreateBr(headBB);
+        return OpenLoop{&ast, headBB, afterBB, nullptr, {}};
+    }
+
+    void CodeGenerator::endLoop(OpenLoop const &loop)
+    {
+        if (loop.counter)
+        {
+            auto nextCounter = irBuilder_->CreateAdd(loop.counter, llvm::ConstantInt::get(loop.counter->getType(), 1), "nextCounter");
+            loop.counter->addIncoming(nextCounter, irBuilder_->GetInsertBlock());
+        }
+
+        irBuilder_->CreateBr(loop.headBB);
+
+        mainFunc_->insert(mainFunc_->end(), loop.afterBB);
+        irBuilder_->SetInsertPoint(loop.afterBB);
+
+        if (loop.counter)
+        {
+            emitDebugLocation(loop.ast->location());
+
+            auto exitPos = irBuilder_->CreateLoad(bytePtrType_, posMem_, "countedExitPos");
+            irBuilder_->CreateStore(byteZero_, exitPos);
+        }
+    }
+
+    void CodeGenerator::emitOutlinedLoopCall(std::string const &functionName)
+    {
+        auto loopType = llvm::FunctionType::get(bytePtrType_, {bytePtrType_}, false);
+        auto loopFunc = module_->getOrInsertFunction(functionName, loopType);
+
+        // The function tests the cell itself, but skipping the call when
+        // the loop is not entered saves the call and, for lazily compiled
+        // loops, compiling it.
+        auto callBB = llvm::BasicBlock::Create(*llvmContext_, "outlinedCallBlock", mainFunc_);
+        auto afterBB = llvm::BasicBlock::Create(*llvmContext_, "outlinedAfterBlock", mainFunc_);
+
+        auto oldPos = irBuilder_->CreateLoad(bytePtrType_, posMem_, "outlinedOldPos");
+        auto dataValue = irBuilder_->CreateLoad(byteType_, oldPos, "outlinedVal");
+        irBuilder_->CreateCondBr(irBuilder_->CreateICmpEQ(dataValue, byteZero_, "outlinedSkip"), afterBB, callBB);
+
+        irBuilder_->SetInsertPoint(callBB);
+        auto newPos = irBuilder_->CreateCall(loopFunc, {oldPos}, "outlinedNewPos");
+        irBuilder_->CreateStore(newPos, posMem_);
+        irBuilder_->CreateBr(afterBB);
 
-        mainFunc_->insert(mainFunc_->end(), afterBB);
         irBuilder_->SetInsertPoint(afterBB);
     }
 
+    void CodeGenerator::emitResumableRead()
+    {
+        // Each read gets its own block, which is also a target of the
+        // resume switch. posMem_ holds the restored position when entered
+        // from there, so the block works the same on both paths.
+        auto resumePoint = irBuilder_->getInt32(resumeSwitch_->getNumCases() + 1);
+        auto readBB = llvm::BasicBlock::Create(*llvmContext_, "resumableReadBlock", mainFunc_);
+        auto suspendBB = llvm::BasicBlock::Create(*llvmContext_, "suspendBlock", mainFunc_);
+        auto readDoneBB = llvm::BasicBlock::Create(*llvmContext_, "readDoneBlock", mainFunc_);
+
+        irBuilder_->CreateBr(readBB);
+        resumeSwitch_->addCase(resumePoint, readBB);
+        irBuilder_->SetInsertPoint(readBB);
+
+        auto readValue = irBuilder_->CreateCall(tryGetcharFunc_, std::nullopt, "tryReadCall");
+        auto wouldBlock = irBuilder_->CreateICmpEQ(readValue, llvm::ConstantInt::getSigned(intType_, BRAINFUCK_WOULD_BLOCK), "wouldBlock");
+        irBuilder_->CreateCondBr(wouldBlock, suspendBB, readDoneBB);
+
+        irBuilder_->SetInsertPoint(suspendBB);
+        saveResumeState(resumePoint);
+        emitReturn(llvm::ConstantInt::get(intType_, RESUMABLE_SUSPENDED));
+
+        irBuilder_->SetInsertPoint(readDoneBB);
+        auto readByte = irBuilder_->CreateTrunc(readValue, byteType_, "readByte");
+        auto posValue = irBuilder_->CreateLoad(bytePtrType_, posMem_, "readPos");
+        irBuilder_->CreateStore(readByte, posValue);
+        emitTapeProfile(tapeWriteFunc_, posValue);
+    }
+
+    void CodeGenerator::saveResumeState(llvm::Value *resumePoint)
+    {
+        auto posValue = irBuilder_->CreateLoad(bytePtrType_, posMem_, "suspendPos");
+        auto posInt = irBuilder_->CreatePtrToInt(posValue, ptrIntType_, "suspendPosInt");
+        auto memInt = irBuilder_->CreatePtrToInt(globalMem_, ptrIntType_, "suspendMemInt");
+        auto position = irBuilder_->CreateSExtOrTrunc(irBuilder_->CreateSub(posInt, memInt, "suspendOffset"),
+                                                      llvm::Type::getInt64Ty(*llvmContext_), "suspendPosition");
+
+        irBuilder_->CreateStore(position, irBuilder_->CreateStructGEP(resumeStateType_, resumeState_, 0, "positionPtr"));
+        irBuilder_->CreateStore(resumePoint, irBuilder_->CreateStructGEP(resumeStateType_, resumeState_, 1, "resumePointPtr"));
+    }
+
+    CodeGenerator::OpenLoop CodeGenerator::beginCountedLoop(LoopAST const &ast, CountedLoop const &counted)
+    {
+        // The loop runs until v + n * step == 0 (mod 256). Writing step as
+        // 2^t * u with odd u, that has a solution iff v is a multiple of
+        // 2^t, namely n = (-v / 2^t) * u^-1 (mod 2^(8 - t)). If there is
+        // none, the loop never terminates, and neither must the counted
+        // loop: any finite trip count would let LLVM compute its result.
+        unsigned shift = std::countr_zero(counted.step);
+        unsigned oddPart = counted.step >> shift;
+        unsigned oddInverse = oddPart;
+
+        // Newton iteration; every step doubles the number of correct bits.
+        for (int i = 0; i < 3; ++i)
+        {
+            oddInverse = (oddInverse * (2 - oddPart * oddInverse)) & 0xff;
+        }
+
+        auto countType = llvm::Type::getInt64Ty(*llvmContext_);
+        auto countZero = llvm::ConstantInt::get(countType, 0);
+
+        auto posValue = irBuilder_->CreateLoad(bytePtrType_, posMem_, "countedPos");
+        auto dataValue = irBuilder_->CreateLoad(byteType_, posValue, "countedVal");
+        auto negValue = irBuilder_->CreateZExt(irBuilder_->CreateNeg(dataValue, "countedNeg"), countType, "countedNegExt");
+        auto scaled = irBuilder_->CreateLShr(negValue, shift, "countedScaled");
+        auto product = irBuilder_->CreateMul(scaled, llvm::ConstantInt::get(countType, oddInverse), "countedProduct");
+        llvm::Value *tripCount = irBuilder_->CreateAnd(product, (1u << (8 - shift)) - 1, "tripCount");
+        llvm::Value *endless = nullptr;
+
+        if (shift != 0)
+        {
+            auto remainder = irBuilder_->CreateAnd(dataValue, (1u << shift) - 1, "countedRemainder");
+            endless = irBuilder_->CreateICmpNE(remainder, byteZero_, "countedEndless");
+            // Only for fuel, which such a loop can never pay for.
+            tripCount = irBuilder_->CreateSelect(endless, llvm::ConstantInt::get(countType, ~0ull), tripCount, "tripCountOrInfinite");
+        }
+
+        if (fuelMem_)
+        {
+            // The whole trip count is paid up front, so the body stays free
+            // of checks. A trip count so large that the cost overflows can
+            // never be paid for anyway.
+            auto iterationCost = ast.loopBody().size() + 1;
+            auto maxTripCount = llvm::ConstantInt::get(countType, std::numeric_limits<std::uint64_t>::max() / iterationCost);
+            auto cost = irBuilder_->CreateMul(tripCount, llvm::ConstantInt::get(countType, iterationCost), "countedFuelCost");
+            auto overflows = irBuilder_->CreateICmpUGT(tripCount, maxTripCount, "countedFuelOverflows");
+            chargeFuel(irBuilder_->CreateSelect(overflows, llvm::ConstantInt::get(countType, ~0ull), cost, "countedFuel"));
+        }
+
+        auto preheaderBB = irBuilder_->GetInsertBlock();
+        auto headBB = llvm::BasicBlock::Create(*llvmContext_, "countedHeadBlock", mainFunc_);
+        auto bodyBB = llvm::BasicBlock::Create(*llvmContext_, "countedBodyBlock", mainFunc_);
+        auto afterBB = llvm::BasicBlock::Create(*llvmContext_, "countedAfterBlock");
+
+        irBuilder_->CreateBr(headBB);
+        irBuilder_->SetInsertPoint(headBB);
+
+        auto counter = irBuilder_->CreatePHI(countType, 2, "counter");
+        counter->addIncoming(countZero, preheaderBB);
+        llvm::Value *loopCondition = irBuilder_->CreateICmpULT(counter, tripCount, "countedCond");
+
+        if (endless)
+        {
+            loopCondition = irBuilder_->CreateOr(loopCondition, endless, "countedCondOrEndless");
+        }
+
+        irBuilder_->CreateCondBr(loopCondition, bodyBB, afterBB);
+        irBuilder_->SetInsertPoint(bodyBB);
+
+        // The control cell updates are left out of the body; it is set to
+        // 0 once after the loop instead.
+        return OpenLoop{&ast, headBB, afterBB, counter, counted.controlUpdates};
+    }
+
+    void CodeGenerator::chargeFuel(llvm::Value *cost)
+    {
+        if (!outOfFuelBB_)
+        {
+            llvm::IRBuilderBase::InsertPointGuard guard(*irBuilder_);
+
+            outOfFuelBB_ = llvm::BasicBlock::Create(*llvmContext_, "outOfFuelBlock", mainFunc_);
+            irBuilder_->SetInsertPoint(outOfFuelBB_);
+            emitReturn(irBuilder_->getInt32(OUT_OF_FUEL_STATUS));
+        }
+
+        auto fuelOkBB = llvm::BasicBlock::Create(*llvmContext_, "fuelOkBlock", mainFunc_);
+
+        auto fuel = irBuilder_->CreateLoad(fuelMem_->getAllocatedType(), fuelMem_, "fuel");
+        auto enough = irBuilder_->CreateICmpUGE(fuel, cost, "enoughFuel");
+        auto weights = llvm::MDBuilder(*llvmContext_).createBranchWeights(FUEL_LEFT_WEIGHT, OUT_OF_FUEL_WEIGHT);
+        irBuilder_->CreateCondBr(enough, fuelOkBB, outOfFuelBB_, weights);
+
+        irBuilder_->SetInsertPoint(fuelOkBB);
+        irBuilder_->CreateStore(irBuilder_->CreateSub(fuel, cost, "fuelLeft"), fuelMem_);
+    }
+
+    void CodeGenerator::checkTapeBounds(llvm::Value *posInt)
+    {
+        if (!options_.checkTapeBounds || options_.entryPoint == EntryPoint::loopFunction)
+        {
+            return;
+        }
+
+        if (!outOfTapeBB_)
+        {
+            llvm::IRBuilderBase::InsertPointGuard guard(*irBuilder_);
+
+            outOfTapeBB_ = llvm::BasicBlock::Create(*llvmContext_, "outOfTapeBlock", mainFunc_);
+            irBuilder_->SetInsertPoint(outOfTapeBB_);
+            emitReturn(irBuilder_->getInt32(OUT_OF_TAPE_STATUS));
+        }
+
+        auto onTapeBB = llvm::BasicBlock::Create(*llvmContext_, "onTapeBlock", mainFunc_);
+
+        // Positions before the tape wrap around to large offsets.
+        auto memInt = irBuilder_->CreatePtrToInt(globalMem_, ptrIntType_, "tapeStartInt");
+        auto offset = irBuilder_->CreateSub(posInt, memInt, "tapeOffset");
+        auto onTape = irBuilder_->CreateICmpULT(offset, llvm::ConstantInt::get(ptrIntType_, BRAINFUCK_MEMSIZE), "onTape");
+        auto weights = llvm::MDBuilder(*llvmContext_).createBranchWeights(ON_TAPE_WEIGHT, OFF_TAPE_WEIGHT);
+        irBuilder_->CreateCondBr(onTape, onTapeBB, outOfTapeBB_, weights);
+
+        irBuilder_->SetInsertPoint(onTapeBB);
+    }
+
+    void CodeGenerator::emitTapeProfile(llvm::Function *hook, llvm::Value *pos)
+    {
+        if (!hook)
+        {
+            return;
+        }
+
+        auto posInt = irBuilder_->CreatePtrToInt(pos, ptrIntType_, "profilePosInt");
+        auto memInt = irBuilder_->CreatePtrToInt(globalMem_, ptrIntType_, "profileMemInt");
+        auto position = irBuilder_->CreateSExtOrTrunc(irBuilder_->CreateSub(posInt, memInt, "profileOffset"),
+                                                      llvm::Type::getInt64Ty(*llvmContext_), "profilePosition");
+        irBuilder_->CreateCall(hook, {position});
+    }
+
+    void CodeGenerator::emitReturn(llvm::Value *value)
+    {
+        if (fuelMem_)
+        {
+            auto fuel = irBuilder_->CreateLoad(fuelMem_->getAllocatedType(), fuelMem_, "fuelLeft");
+            irBuilder_->CreateCall(fuelReturnFunc_, {fuel});
+        }
+
+        if (releaseTapeFunc_)
+        {
+            irBuilder_->CreateCall(releaseTapeFunc_, {runtimeContext_, globalMem_});
+        }
+
+        irBuilder_->CreateRet(value);
+    }
+
     llvm::orc::ThreadSafeModule CodeGenerator::finalizeModule()
     {
-        irBuilder_->CreateRet(llvm::ConstantInt::get(*llvmContext_, llvm::APInt(32, 0)));
+        if (options_.entryPoint == EntryPoint::loopFunction)
+        {
+            emitReturn(irBuilder_->CreateLoad(bytePtrType_, posMem_, "finalPos"));
+        }
+        else
+        {
+            // Also RESUMABLE_FINISHED for resumable programs.
+            emitReturn(llvm::ConstantInt::get(*llvmContext_, llvm::APInt(32, 0)));
+        }
+
         if (debugInfoBuilder_)
         {
             debugInfoBuilder_->finalize();
@@ -230,12 +723,32 @@ namespace brainfuck
         return {std::move(module_), std::move(llvmContext_)};
     }
 
-    void CodeGenerator::emitDebugLocation(SourceLocation loc)
+    void CodeGenerator::remark(Remark::Kind kind, std::string name, SourceLocation location, std::string message)
     {
-        if (debugInfoBuilder_)
+        if (options_.remarks)
         {
-            auto debugLoc = llvm::DILocation::get(debugMain_->getContext(), loc.line(), loc.column(), debugMain_);
-            irBuilder_->SetCurrentDebugLocation(debugLoc);
+            options_.remarks->add({kind, "codegen", std::move(name), std::move(message), location});
         }
     }
+
+    void CodeGenerator::emitDebugLocation(SourceLocation loc, bool exact)
+    {
+        if (!debugInfoBuilder_)
+        {
+            return;
+        }
+
+        if (debugInfo_ == DebugInfoLevel::lineTablesOnly)
+        {
+            if (!exact && loc.line() == debugLine_)
+            {
+                return;
+            }
+
+            debugLine_ = loc.line();
+        }
+
+        auto debugLoc = llvm::DILocation::get(debugMain_->getContext(), loc.line(), loc.column(), debugMain_);
+        irBuilder_->SetCurrentDebugLocation(debugLoc);
+    }
 }
@@ -2,6 +2,9 @@
 #define INCLUDED_LLVM_BRAINFUCK_CODEGEN_HPP
 
 #include "ast.hpp"
+#include "loop_analysis.hpp"
+#include "remarks.hpp"
+#include "runtime.hpp"
 
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/DIBuilder.h>
@@ -9,17 +12,135 @@
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
 
+#include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <set>
+#include <string>
 
 namespace brainfuck
 {
+    int const BRAINFUCK_MEMSIZE = 30000;
+
+    // Changes whenever the code generated for the same program and options
+    // behaves differently, so that caches of compiled code or of program
+    // outputs do not outlive the compiler that filled them.
+    int const CODEGEN_VERSION = 3;
+
+    // Shape of the function the generated program is wrapped in.
+    enum class EntryPoint
+    {
+        // int main(void), allocating and clearing its own tape. For linking
+        // into standalone executables.
+        main,
+        // int entry(unsigned char *tape), working on a zeroed tape of
+        // BRAINFUCK_MEMSIZE cells that the caller provides. For running
+        // programs in-process, e.g. through the JIT.
+        tapeArgument,
+        // unsigned char *entry(unsigned char *pos), running the code from
+        // the given tape position and returning the final position. For
+        // loops that are compiled separately from the rest of the program.
+        loopFunction,
+        // int entry(unsigned char *tape, ResumeState *state), a coroutine
+        // that returns RESUMABLE_SUSPENDED with its position saved in state
+        // when it reaches a read and no input is available, and continues
+        // at that read when entered again with the same tape and state.
+        // Returns RESUMABLE_FINISHED at the end of the program. Loops are
+        // never counted or outlined in this mode.
+        resumable,
+        // int entry(RuntimeContext *context), for linking many programs
+        // into one library (see LibraryBuilder). The tape and all I/O come
+        // from the library's shared runtime.
+        context
+    };
+
+    // How much DWARF the generated module carries.
+    enum class DebugInfoLevel
+    {
+        none,
+        // Just enough to map code back to source lines, e.g. for
+        // symbolizing profiles. Consecutive instructions on one line
+        // share a single location, taking the column of the first, except
+        // that loops start a location of their own, so that LLVM's loop
+        // remarks still point at their brackets.
+        lineTablesOnly,
+        // Locations down to the column of every instruction, and the tape
+        // and the tape pointer as variables, for stepping through programs
+        // in a debugger.
+        full
+    };
+
+    int const RESUMABLE_FINISHED = 0;
+    int const RESUMABLE_SUSPENDED = 1;
+
+    // Returned by programs generated with CodeGenOptions::meterFuel when
+    // they run out of fuel.
+    int const OUT_OF_FUEL_STATUS = 124;
+
+    // Returned by EntryPoint::context programs when the runtime could not
+    // allocate a tape.
+    int const OUT_OF_MEMORY_STATUS = 125;
+
+    // Returned by programs generated with CodeGenOptions::checkTapeBounds
+    // instead of moving off the tape.
+    int const OUT_OF_TAPE_STATUS = 126;
+
+    struct CodeGenOptions
+    {
+        EntryPoint entryPoint = EntryPoint::main;
+        std::string entryName = "main";
+
+        // Loops for which this returns a name are not generated inline but
+        // called as external functions of that name, which are expected to
+        // be generated separately with EntryPoint::loopFunction.
+        std::function<std::optional<std::string>(LoopAST const &)> outlinedLoopName;
+
+        // Emit loops with a computable trip count (see analyzeCountedLoop)
+        // as counted loops, which gives LLVM a canonical induction variable.
+        bool emitCountedLoops = true;
+
+        // Receives which loops were generated as counted or outlined loops.
+        RemarkCollector *remarks = nullptr;
+
+        // Bound the work a program may do by the fuel bound to the running
+        // thread (see ScopedFuel). Every loop iteration is charged the
+        // number of instructions directly in the loop body, before the body
+        // runs; counted loops pay for all of their iterations on entry.
+        // Straight-line code outside of loops runs a bounded number of
+        // times anyway and is free. A program that cannot pay returns
+        // OUT_OF_FUEL_STATUS. Loops are not outlined, and
+        // EntryPoint::loopFunction is never metered.
+        //
+        // This costs a few percent at most on most programs, but not on
+        // nests of counted loops: the out-of-fuel exits of the inner loops
+        // keep LLVM from folding the nest, which can make it 1.5-2x slower.
+        bool meterFuel = false;
+
+        // Report every move of the tape pointer and every read and write
+        // of a cell to the TapeProfile bound to the running thread (see
+        // ScopedTapeProfile), which only the JIT provides. Loops are
+        // neither counted nor outlined, so that the accesses are those of
+        // the program as written. EntryPoint::loopFunction is never
+        // profiled, since it does not know where the tape starts.
+        bool profileTape = false;
+
+        // Return OUT_OF_TAPE_STATUS instead of moving the tape pointer off
+        // the BRAINFUCK_MEMSIZE cells of the tape, for programs that run
+        // inside a process they must not corrupt. Loops are not outlined,
+        // and EntryPoint::loopFunction is never checked, since it does not
+        // know where the tape starts.
+        bool checkTapeBounds = false;
+    };
+
     class CodeGenerator
     {
     public:
         CodeGenerator(llvm::DataLayout dataLayout = llvm::DataLayout(""),
                       std::filesystem::path const &sourceFilePath = {},
-                      bool shouldEmitDebugInfo_ = false);
+                      DebugInfoLevel debugInfo = DebugInfoLevel::none,
+                      CodeGenOptions options = {});
 
         void operator()(AST const &ast);
         void operator()(std::vector<AST> const &block);
@@ -29,17 +150,55 @@ namespace brainfuck
         void operator()(RightAST const &);
         void operator()(WriteAST const &);
         void operator()(ReadAST const &);
+        void operator()(SetAST const &);
         void operator()(LoopAST const &loop);
 
         llvm::orc::ThreadSafeModule finalizeModule();
 
     private:
-        void initLlvmInfrastructure(llvm::DataLayout const &dataLayout, std::filesystem::path const &sourceFilePath, bool shouldEmitDebugInfo);
+        void initLlvmInfrastructure(llvm::DataLayout const &dataLayout, std::filesystem::path const &sourceFilePath);
         void initConstantsAndTypes();
         void initDeclareFunctions();
         void initMainEntry();
 
-        void emitDebugLocation(SourceLocation loc);
+        // A loop whose body is being generated.
+        struct OpenLoop
+        {
+            LoopAST const *ast;
+            llvm::BasicBlock *headBB;
+            llvm::BasicBlock *afterBB;
+            // Only set for counted loops, together with the indices of the
+            // body nodes that must not be generated.
+            llvm::PHINode *counter = nullptr;
+            std::set<std::size_t> skipped = {};
+        };
+
+        // Emits everything up to the loop body. Returns nothing if the
+        // loop has been generated completely already, e.g. as a call.
+        std::optional<OpenLoop> beginLoop(LoopAST const &ast);
+        void endLoop(OpenLoop const &loop);
+
+        // With DebugInfoLevel::lineTablesOnly, only changes the location
+        // on a new line, unless exact is set.
+        void emitDebugLocation(SourceLocation loc, bool exact = false);
+        void remark(Remark::Kind kind, std::string name, SourceLocation location, std::string message);
+        void emitOutlinedLoopCall(std::string const &functionName);
+        void emitResumableRead();
+        void saveResumeState(llvm::Value *resumePoint);
+        void chargeFuel(llvm::Value *cost);
+        // Leaves through outOfTapeBB_ if posInt is off the tape, with
+        // CodeGenOptions::checkTapeBounds.
+        void checkTapeBounds(llvm::Value *posInt);
+        // Calls the tape profiling hook with the offset of pos, if the
+        // tape is profiled.
+        void emitTapeProfile(llvm::Function *hook, llvm::Value *pos);
+        // Hands back fuel and the tape, as far as the entry point needs
+        // that, and returns value.
+        void emitReturn(llvm::Value *value);
+        OpenLoop beginCountedLoop(LoopAST const &ast, CountedLoop const &counted);
+
+        CodeGenOptions options_;
+        DebugInfoLevel debugInfo_;
 
         // LLVM infrastructure
         std::unique_ptr<llvm::LLVMContext> llvmContext_;
@@ -48,6 +207,8 @@ namespace brainfuck
         std::unique_ptr<llvm::DIBuilder> debugInfoBuilder_;
         llvm::DIFile *debugInfoFile_ = nullptr;
         llvm::DICompileUnit *debugInfoCompileUnit_ = nullptr;
+        // Line of the current location, for DebugInfoLevel::lineTablesOnly.
+        int debugLine_ = 0;
 
         // Values and types that are convenient to have around during
         // code generation. We could get these on the fly from LLVM,
@@ -67,12 +228,37 @@ namespace brainfuck
         // function wrapper for easy linking.
         llvm::Function *putcharFunc_;
         llvm::Function *getcharFunc_;
+        llvm::Function *tryGetcharFunc_ = nullptr;
+        llvm::Function *fuelTakeFunc_ = nullptr;
+        llvm::Function *fuelReturnFunc_ = nullptr;
+        llvm::Function *tapeFunc_ = nullptr;
+        llvm::Function *releaseTapeFunc_ = nullptr;
+        llvm::Function *tapeMoveFunc_ = nullptr;
+        llvm::Function *tapeReadFunc_ = nullptr;
+        llvm::Function *tapeWriteFunc_ = nullptr;
         llvm::Function *mainFunc_;
         llvm::DISubprogram *debugMain_;
 
-        // Data storage for the brainfuck runtime environment.
+        // Data storage for the brainfuck runtime environment. globalMem_ is
+        // either a local array or the tape passed in by the caller.
         llvm::AllocaInst *posMem_ = nullptr;
-        llvm::AllocaInst *globalMem_ = nullptr;
+        llvm::Value *globalMem_ = nullptr;
+        // The RuntimeContext argument for EntryPoint::context.
+        llvm::Value *runtimeContext_ = nullptr;
+
+        // For EntryPoint::resumable: the ResumeState argument, and the
+        // switch in the entry block that jumps to the read to resume at.
+        llvm::StructType *resumeStateType_ = nullptr;
+        llvm::Value *resumeState_ = nullptr;
+        llvm::SwitchInst *resumeSwitch_ = nullptr;
+
+        // For CodeGenOptions::meterFuel: the fuel left, and the block that
+        // hands it back and returns OUT_OF_FUEL_STATUS.
+        llvm::AllocaInst *fuelMem_ = nullptr;
+        llvm::BasicBlock *outOfFuelBB_ = nullptr;
+
+        // For CodeGenOptions::checkTapeBounds: returns OUT_OF_TAPE_STATUS.
+        llvm::BasicBlock *outOfTapeBB_ = nullptr;
     };
 }
 
@@ -0,0 +1,731 @@
+#include "compile_server.hpp"
+#include "codegen.hpp"
+#include "constant_propagation.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "runtime.hpp"
+#include "structural_hash.hpp"
+
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+namespace brainfuck
+{
+    // Messages are a fixed header followed by the strings it gives the
+    // sizes of, with all numbers in host byte order:
+    //
+    //     request:  u8 kind, u64 fuel, u8 opt level, u8 debug info,
+    //               u32 triple size, u32 cpu size, u32 source path size,
+    //               u32 source size, u32 input size
+    //     response: u8 ok, i32 status, u32 payload size
+    namespace
+    {
+        template <typename T>
+        void appendValue(std::string &message, T value)
+        {
+            message.append(reinterpret_cast<char const *>(&value), sizeof(value));
+        }
+
+        template <typename T>
+        T takeValue(std::string_view &header)
+        {
+            T value;
+            std::memcpy(&value, header.data(), sizeof(value));
+            header.remove_prefix(sizeof(value));
+            return value;
+        }
+
+        std::size_t const REQUEST_HEADER_SIZE = 1 + 8 + 1 + 1 + 5 * 4;
+        std::size_t const RESPONSE_HEADER_SIZE = 1 + 4 + 4;
+
+        void sendAll(int socket, std::string_view data)
+        {
+            while (!data.empty())
+            {
+                auto sent = ::send(socket, data.data(), data.size(), MSG_NOSIGNAL);
+
+                if (sent < 0 && errno != EINTR)
+                {
+                    throw std::system_error(errno, std::generic_category(), "send");
+                }
+
+                data.remove_prefix(sent < 0 ? 0 : sent);
+            }
+        }
+
+        // Returns false if the peer closed the connection before the first
+        // byte.
+        bool receiveAll(int socket, char *data, std::size_t size)
+        {
+            for (std::size_t received = 0; received < size;)
+            {
+                auto count = ::recv(socket, data + received, size - received, 0);
+
+                if (count == 0 && received == 0)
+                {
+                    return false;
+                }
+
+                if (count == 0)
+                {
+                    throw std::runtime_error("connection closed in the middle of a message");
+                }
+
+                if (count < 0 && errno != EINTR)
+                {
+                    throw std::system_error(errno, std::generic_category(), "recv");
+                }
+
+                received += count < 0 ? 0 : count;
+            }
+
+            return true;
+        }
+
+        std::string receiveString(int socket, std::uint32_t size)
+        {
+            std::string data(size, '\0');
+
+            if (size != 0 && !receiveAll(socket, data.data(), size))
+            {
+                throw std::runtime_error("connection closed in the middle of a message");
+            }
+
+            return data;
+        }
+
+        std::optional<CompileRequest> receiveRequest(int socket)
+        {
+            char headerData[REQUEST_HEADER_SIZE];
+
+            if (!receiveAll(socket, headerData, sizeof(headerData)))
+            {
+                return std::nullopt;
+            }
+
+            std::string_view header(headerData, sizeof(headerData));
+
+            CompileRequest request;
+            request.kind = static_cast<CompileRequestKind>(takeValue<std::uint8_t>(header));
+            request.fuel = takeValue<std::uint64_t>(header);
+            request.optLevel = takeValue<std::uint8_t>(header);
+            request.debugInfo = static_cast<DebugInfoLevel>(takeValue<std::uint8_t>(header));
+            auto tripleSize = takeValue<std::uint32_t>(header);
+            auto cpuSize = takeValue<std::uint32_t>(header);
+            auto sourcePathSize = takeValue<std::uint32_t>(header);
+            auto sourceSize = takeValue<std::uint32_t>(header);
+            auto inputSize = takeValue<std::uint32_t>(header);
+
+            request.triple = receiveString(socket, tripleSize);
+            request.cpu = receiveString(socket, cpuSize);
+            request.sourcePath = receiveString(socket, sourcePathSize);
+            request.source = receiveString(socket, sourceSize);
+            request.input = receiveString(socket, inputSize);
+            return request;
+        }
+
+        // Everything the object or assembly of a request depends on.
+        std::string cacheKey(CompileRequest const &request)
+        {
+            std::string key;
+            appendValue<std::uint8_t>(key, static_cast<std::uint8_t>(request.kind));
+            appendValue<std::uint8_t>(key, request.optLevel);
+            appendValue<std::uint8_t>(key, static_cast<std::uint8_t>(request.debugInfo));
+
+            for (auto part : {&request.triple, &request.cpu, &request.sourcePath, &request.source})
+            {
+                appendValue<std::uint32_t>(key, part->size());
+                key += *part;
+            }
+
+            return key;
+        }
+
+        void sendResponse(int socket, CompileResponse const &response)
+        {
+            std::string message;
+            appendValue<std::uint8_t>(message, response.ok);
+            appendValue<std::int32_t>(message, response.status);
+            appendValue<std::uint32_t>(message, response.payload.size());
+            message += response.payload;
+
+            sendAll(socket, message);
+        }
+
+        sockaddr_un socketAddress(std::filesystem::path const &socketPath)
+        {
+            sockaddr_un address = {};
+            address.sun_family = AF_UNIX;
+
+            auto const &path = socketPath.native();
+            if (path.size() >= sizeof(address.sun_path))
+            {
+                throw std::invalid_argument("socket path too long: " + path);
+            }
+
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+            return address;
+        }
+
+        std::vector<AST> parseSource(std::string const &source)
+        {
+            std::istringstream sourceStream(source);
+            Lexer lexer(sourceStream);
+            return propagateConstants(parse(lexer));
+        }
+
+        // How long serve() stops accepting after running out of file
+        // descriptors or memory, rather than spinning on the error.
+        auto const ACCEPT_BACKOFF = std::chrono::milliseconds(100);
+
+        bool outOfResources(int error)
+        {
+            return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+        }
+
+        // Errors that only concern the connection being accepted.
+        bool abortedConnection(int error)
+        {
+            return error == EINTR || error == EAGAIN || error == EWOULDBLOCK || error == ECONNABORTED || error == EPROTO;
+        }
+
+        void setTimeout(int socket, int option, std::chrono::milliseconds timeout)
+        {
+            timeval value = {};
+            value.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+            value.tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000);
+            ::setsockopt(socket, SOL_SOCKET, option, &value, sizeof(value));
+        }
+    }
+
+    ObjCodeWriter &CompileServer::Worker::writer(std::string const &triple, std::string const &cpu)
+    {
+        auto key = std::make_pair(triple, cpu);
+
+        if (auto found = writers.find(key); found != writers.end())
+        {
+            return *found->second;
+        }
+
+        std::unique_ptr<ObjCodeWriter> created(new ObjCodeWriter(triple.empty() ? llvm::sys::getDefaultTargetTriple() : triple,
+                                                                 {}, {}, cpu.empty() ? "generic" : cpu));
+
+        // Unknown targets and CPUs are rejected before they take up room.
+        auto &subtarget = *created->targetMachine().getMCSubtargetInfo();
+        if (!cpu.empty() && !subtarget.isCPUStringValid(cpu))
+        {
+            throw std::invalid_argument("unknown CPU " + cpu + " for " + subtarget.getTargetTriple().str());
+        }
+
+        return *writers.emplace(std::move(key), std::move(created)).first->second;
+    }
+
+    ModuleOptimizer &CompileServer::Worker::optimizer(ObjCodeWriter &writer, int level)
+    {
+        auto &optimizer = optimizers[{&writer, level}];
+
+        if (!optimizer)
+        {
+            OptimizerSettings settings;
+            settings.level = level;
+            try
+            {
+                optimizer = std::make_unique<ModuleOptimizer>(settings, &writer.targetMachine());
+            }
+            catch (...)
+            {
+                optimizers.erase({&writer, level});
+                throw;
+            }
+        }
+
+        return *optimizer;
+    }
+
+    CompileServer::JitProgram::JitProgram(llvm::orc::ResourceTrackerSP tracker)
+        : tracker(std::move(tracker))
+    {
+    }
+
+    CompileServer::JitProgram::~JitProgram()
+    {
+        llvm::consumeError(tracker->remove());
+    }
+
+    CompileServer::CompileServer(std::filesystem::path socketPath, unsigned threadCount, std::size_t cacheBytes,
+                                 std::size_t jitProgramLimit, std::chrono::milliseconds readTimeout,
+                                 OutputCache *outputCache)
+        : socketPath_(std::move(socketPath)),
+          readTimeout_(readTimeout),
+          pool_(threadCount),
+          jitProgramLimit_(jitProgramLimit),
+          cacheBytes_(cacheBytes),
+          outputCache_(outputCache)
+    {
+        // Pay for target setup now rather than with the first request.
+        for (unsigned i = 0; i < pool_.size(); ++i)
+        {
+            auto worker = std::make_unique<Worker>();
+            worker->optimizer(worker->writer({}, {}), OptimizerSettings().level);
+            worker->optimizer(worker->hostWriter, OptimizerSettings().level);
+            workers_.push_back(std::move(worker));
+        }
+
+        // serve() must not block on draining wakePipe_, nor pool threads on
+        // filling it.
+        if (::pipe(stopPipe_) != 0 || ::pipe2(wakePipe_, O_CLOEXEC | O_NONBLOCK) != 0)
+        {
+            auto error = errno;
+            closeSockets();
+            throw std::system_error(error, std::generic_category(), "pipe");
+        }
+
+        auto address = socketAddress(socketPath_);
+        listenSocket_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        std::filesystem::remove(socketPath_);
+
+        if (listenSocket_ < 0 ||
+            ::bind(listenSocket_, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) != 0 ||
+            ::listen(listenSocket_, SOMAXCONN) != 0)
+        {
+            auto error = errno;
+            closeSockets();
+            throw std::system_error(error, std::generic_category(), "could not listen on " + socketPath_.string());
+        }
+    }
+
+    CompileServer::~CompileServer()
+    {
+        if (listenSocket_ >= 0)
+        {
+            std::error_code ignored;
+            std::filesystem::remove(socketPath_, ignored);
+        }
+
+        closeSockets();
+    }
+
+    void CompileServer::closeSockets()
+    {
+        for (auto fd : {listenSocket_, stopPipe_[0], stopPipe_[1], wakePipe_[0], wakePipe_[1]})
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+
+        listenSocket_ = stopPipe_[0] = stopPipe_[1] = wakePipe_[0] = wakePipe_[1] = -1;
+    }
+
+    void CompileServer::serve()
+    {
+        // Connections between requests.
+        std::vector<int> idle;
+        std::optional<std::chrono::steady_clock::time_point> acceptAgain;
+        int acceptError = 0;
+
+        while (true)
+        {
+            std::vector<pollfd> fds = {{acceptAgain ? -1 : listenSocket_, POLLIN, 0},
+                                       {stopPipe_[0], POLLIN, 0},
+                                       {wakePipe_[0], POLLIN, 0}};
+            for (auto connection : idle)
+            {
+                fds.push_back({connection, POLLIN, 0});
+            }
+
+            int timeout = -1;
+            if (acceptAgain)
+            {
+                auto left = std::chrono::ceil<std::chrono::milliseconds>(*acceptAgain - std::chrono::steady_clock::now());
+                timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(left.count(), 0));
+            }
+
+            if (::poll(fds.data(), fds.size(), timeout) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                throw std::system_error(errno, std::generic_category(), "poll");
+            }
+
+            if (fds[1].revents != 0)
+            {
+                break;
+            }
+
+            // A request has started to arrive, or the client has hung up.
+            std::vector<int> stillIdle;
+            for (std::size_t i = 0; i < idle.size(); ++i)
+            {
+                if (fds[3 + i].revents != 0)
+                {
+                    pool_.submit([this, connection = idle[i]]
+                                 { serveRequest(connection); });
+                }
+                else
+                {
+                    stillIdle.push_back(idle[i]);
+                }
+            }
+            idle = std::move(stillIdle);
+
+            if (fds[2].revents != 0)
+            {
+                char bytes[64];
+                while (::read(wakePipe_[0], bytes, sizeof(bytes)) > 0)
+                {
+                }
+
+                std::lock_guard lock(returnedMutex_);
+                idle.insert(idle.end(), returned_.begin(), returned_.end());
+                returned_.clear();
+            }
+
+            if (acceptAgain && std::chrono::steady_clock::now() >= *acceptAgain)
+            {
+                acceptAgain.reset();
+            }
+
+            if (fds[0].revents == 0)
+            {
+                continue;
+            }
+
+            auto connection = ::accept4(listenSocket_, nullptr, nullptr, SOCK_CLOEXEC);
+
+            if (connection >= 0)
+            {
+                // Bounds how long a stalled client can hold a pool thread.
+                setTimeout(connection, SO_RCVTIMEO, readTimeout_);
+                setTimeout(connection, SO_SNDTIMEO, readTimeout_);
+                idle.push_back(connection);
+            }
+            else if (outOfResources(errno))
+            {
+                // The connection stays in the backlog until then.
+                acceptAgain = std::chrono::steady_clock::now() + ACCEPT_BACKOFF;
+            }
+            else if (!abortedConnection(errno))
+            {
+                acceptError = errno;
+                break;
+            }
+        }
+
+        pool_.wait();
+
+        std::lock_guard lock(returnedMutex_);
+        idle.insert(idle.end(), returned_.begin(), returned_.end());
+        returned_.clear();
+
+        for (auto connection : idle)
+        {
+            ::close(connection);
+        }
+
+        if (acceptError != 0)
+        {
+            throw std::system_error(acceptError, std::generic_category(), "accept");
+        }
+    }
+
+    void CompileServer::stop()
+    {
+        char byte = 0;
+        [[maybe_unused]] auto written = ::write(stopPipe_[1], &byte, 1);
+    }
+
+    void CompileServer::serveRequest(int connection)
+    {
+        try
+        {
+            if (auto request = receiveRequest(connection))
+            {
+                sendResponse(connection, handle(*request));
+                returnConnection(connection);
+                return;
+            }
+        }
+        catch (std::exception const &)
+        {
+            // The client went away, spoke nonsense or stalled; there is no
+            // one left to report that to.
+        }
+
+        ::close(connection);
+    }
+
+    void CompileServer::returnConnection(int connection)
+    {
+        std::lock_guard lock(returnedMutex_);
+        returned_.push_back(connection);
+
+        // If the pipe is full, serve() is bound to wake up anyway.
+        char byte = 0;
+        [[maybe_unused]] auto written = ::write(wakePipe_[1], &byte, 1);
+    }
+
+    CompileResponse CompileServer::handle(CompileRequest const &request)
+    {
+        try
+        {
+            switch (request.kind)
+            {
+            case CompileRequestKind::object:
+            case CompileRequestKind::assembly:
+                return {true, 0, compile(request)};
+            case CompileRequestKind::run:
+                return run(request);
+            }
+
+            throw std::invalid_argument("unknown request kind");
+        }
+        catch (std::exception const &e)
+        {
+            return {false, 0, e.what()};
+        }
+    }
+
+    std::string CompileServer::compile(CompileRequest const &request)
+    {
+        auto key = cacheKey(request);
+        std::string payload;
+
+        if (lookupCache(key, payload))
+        {
+            return payload;
+        }
+
+        if (request.debugInfo > DebugInfoLevel::full)
+        {
+            throw std::invalid_argument("unknown debug info level");
+        }
+
+        auto &worker = *workers_[ThreadPool::workerIndex()];
+        auto &writer = worker.writer(request.triple, request.cpu);
+        auto &optimizer = worker.optimizer(writer, request.optLevel);
+
+        CodeGenerator codegen(writer.getDataLayout(), request.sourcePath, request.debugInfo);
+        codegen(parseSource(request.source));
+
+        auto tsModule = codegen.finalizeModule();
+        auto &module = *tsModule.getModuleUnlocked();
+        optimizer(module);
+
+        llvm::SmallVector<char, 0> buffer;
+        llvm::raw_svector_ostream stream(buffer);
+        auto fileType = request.kind == CompileRequestKind::object ? llvm::CGFT_ObjectFile : llvm::CGFT_AssemblyFile;
+        writer.writeModuleToStream(stream, module, fileType);
+
+        payload.assign(buffer.data(), buffer.size());
+        storeCache(std::move(key), payload);
+        return payload;
+    }
+
+    CompileResponse CompileServer::run(CompileRequest const &request)
+    {
+        if (!outputCache_)
+        {
+            auto output = runOnJit(request);
+            return {true, output.status, std::move(output.output)};
+        }
+
+        auto program = parseSource(request.source);
+        // Runs that are cut short depend on the fuel, so it seeds the hash.
+        // Unlimited runs share their entries with BatchRunner.
+        auto programHash = structuralDigest(program, request.fuel).hash;
+        auto output = outputCache_->getOrRun(programHash, request.input, [&](std::string_view)
+                                             { return runOnJit(request, &program); });
+        return {true, output.status, std::move(output.output)};
+    }
+
+    CachedOutput CompileServer::runOnJit(CompileRequest const &request, std::vector<AST> const *program)
+    {
+        auto key = std::to_string(request.optLevel) + ':' + request.source;
+        std::shared_ptr<JitProgram> jitProgram;
+        {
+            std::lock_guard lock(jitMutex_);
+            jitProgram = lookupJitProgram(key);
+        }
+
+        if (!jitProgram)
+        {
+            auto &worker = *workers_[ThreadPool::workerIndex()];
+            auto &optimizer = worker.optimizer(worker.hostWriter, request.optLevel);
+
+            // Compiled outside the lock; should two threads race for the
+            // same program, the loser's module is dropped.
+            CodeGenOptions options;
+            options.entryPoint = EntryPoint::tapeArgument;
+            options.meterFuel = true;
+            // The program shares the server's address space.
+            options.checkTapeBounds = true;
+            // Entry names must be unique within the JIT.
+            options.entryName = "brainfuck_server_" + std::to_string(jitModuleCount_++);
+
+            CodeGenerator codegen(jit_.getDataLayout(), {}, DebugInfoLevel::none, options);
+            codegen(program ? *program : parseSource(request.source));
+
+            auto tsModule = codegen.finalizeModule();
+            optimizer(*tsModule.getModuleUnlocked());
+
+            std::lock_guard lock(jitMutex_);
+            jitProgram = lookupJitProgram(key);
+
+            if (!jitProgram)
+            {
+                jitProgram = std::make_shared<JitProgram>(jit_.addRemovableModule(std::move(tsModule)));
+                jitProgram->entry = jit_.lookupTapeEntry(options.entryName);
+
+                jitOrder_.push_front(key);
+                jitPrograms_.emplace(key, std::make_pair(jitProgram, jitOrder_.begin()));
+
+                while (jitPrograms_.size() > jitProgramLimit_)
+                {
+                    jitPrograms_.erase(jitOrder_.back());
+                    jitOrder_.pop_back();
+                }
+            }
+        }
+
+        std::vector<std::uint8_t> tape(BRAINFUCK_MEMSIZE);
+        BufferIo io(request.input);
+        ScopedProgramIo binding(io);
+
+        // Without fuel bound, metered programs run unlimited.
+        std::optional<ScopedFuel> fuel;
+        if (request.fuel != 0)
+        {
+            fuel.emplace(request.fuel);
+        }
+
+        auto status = jitProgram->entry(tape.data());
+        return {status, io.takeOutput()};
+    }
+
+    std::shared_ptr<CompileServer::JitProgram> CompileServer::lookupJitProgram(std::string const &key)
+    {
+        auto found = jitPrograms_.find(key);
+        if (found == jitPrograms_.end())
+        {
+            return nullptr;
+        }
+
+        jitOrder_.splice(jitOrder_.begin(), jitOrder_, found->second.second);
+        return found->second.first;
+    }
+
+    bool CompileServer::lookupCache(std::string const &key, std::string &payload)
+    {
+        std::lock_guard lock(cacheMutex_);
+
+        auto found = cache_.find(key);
+        if (found == cache_.end())
+        {
+            return false;
+        }
+
+        payload = found->second;
+        return true;
+    }
+
+    void CompileServer::storeCache(std::string key, std::string payload)
+    {
+        std::lock_guard lock(cacheMutex_);
+
+        if (payload.size() > cacheBytes_ || cache_.count(key) != 0)
+        {
+            return;
+        }
+
+        while (cachedBytes_ + payload.size() > cacheBytes_)
+        {
+            auto oldest = cache_.find(cacheOrder_.front());
+            cachedBytes_ -= oldest->second.size();
+            cache_.erase(oldest);
+            cacheOrder_.pop_front();
+        }
+
+        cachedBytes_ += payload.size();
+        cacheOrder_.push_back(key);
+        cache_.emplace(std::move(key), std::move(payload));
+    }
+
+    CompileClient::CompileClient(std::filesystem::path const &socketPath)
+    {
+        auto address = socketAddress(socketPath);
+        socket_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        if (socket_ < 0 || ::connect(socket_, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) != 0)
+        {
+            auto error = errno;
+
+            if (socket_ >= 0)
+            {
+                ::close(socket_);
+            }
+
+            throw std::system_error(error, std::generic_category(), "could not connect to " + socketPath.string());
+        }
+    }
+
+    CompileClient::~CompileClient()
+    {
+        ::close(socket_);
+    }
+
+    CompileResponse CompileClient::request(CompileRequest const &request)
+    {
+        std::string message;
+        appendValue<std::uint8_t>(message, static_cast<std::uint8_t>(request.kind));
+        appendValue<std::uint64_t>(message, request.fuel);
+        appendValue<std::uint8_t>(message, request.optLevel);
+        appendValue<std::uint8_t>(message, static_cast<std::uint8_t>(request.debugInfo));
+
+        for (auto part : {&request.triple, &request.cpu, &request.sourcePath, &request.source, &request.input})
+        {
+            appendValue<std::uint32_t>(message, part->size());
+        }
+
+        for (auto part : {&request.triple, &request.cpu, &request.sourcePath, &request.source, &request.input})
+        {
+            message += *part;
+        }
+
+        sendAll(socket_, message);
+
+        char headerData[RESPONSE_HEADER_SIZE];
+        if (!receiveAll(socket_, headerData, sizeof(headerData)))
+        {
+            throw std::runtime_error("compile server closed the connection");
+        }
+
+        std::string_view header(headerData, sizeof(headerData));
+
+        CompileResponse response;
+        response.ok = takeValue<std::uint8_t>(header) != 0;
+        response.status = takeValue<std::int32_t>(header);
+        response.payload = receiveString(socket_, takeValue<std::uint32_t>(header));
+        return response;
+    }
+}
@@ -0,0 +1,198 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_COMPILE_SERVER_HPP
+#define INCLUDED_LLVM_BRAINFUCK_COMPILE_SERVER_HPP
+
+#include "codegen.hpp"
+#include "jit.hpp"
+#include "objcode.hpp"
+#include "optimizer.hpp"
+#include "output_cache.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace brainfuck
+{
+    enum class CompileRequestKind : std::uint8_t
+    {
+        // An object file with int main(void), as bfcompile writes it.
+        object,
+        // The same, as assembly.
+        assembly,
+        // Run the program on input and return its output. Programs that
+        // move off the tape stop with OUT_OF_TAPE_STATUS there, rather
+        // than touching the server's memory.
+        run
+    };
+
+    struct CompileRequest
+    {
+        CompileRequestKind kind = CompileRequestKind::object;
+        std::string source;
+        // Only for CompileRequestKind::run.
+        std::string input;
+        // For CompileRequestKind::run, the fuel the program may use (see
+        // CodeGenOptions::meterFuel), or 0 for no limit.
+        std::uint64_t fuel = 0;
+
+        // Objects and assembly are generated for the given target triple
+        // and CPU, or for the server's default triple and a generic CPU
+        // if empty. Runs are always compiled for the server's host.
+        std::string triple;
+        std::string cpu;
+        // 1 to 3, as in -O1 to -O3.
+        int optLevel = 2;
+        DebugInfoLevel debugInfo = DebugInfoLevel::none;
+        // The source file that debug info refers to.
+        std::string sourcePath;
+    };
+
+    struct CompileResponse
+    {
+        // If false, payload holds the error message.
+        bool ok = false;
+        // The exit status of programs that were run.
+        int status = 0;
+        std::string payload;
+    };
+
+    // Compiles and runs programs for clients on a Unix socket, so that
+    // target setup, the target machine and the pass pipeline are paid for
+    // once rather than by every compiler process. Each connection carries
+    // any number of requests, answered in order. Idle connections wait in
+    // serve()'s poll; only a request that has started to arrive takes a
+    // thread of the pool, and only until it is answered or readTimeout
+    // passes without progress. Objects and assembly are cached by request,
+    // and the jitProgramLimit programs run most recently stay compiled in
+    // the JIT. With an output cache, runs of a program on an input it has
+    // seen before with the same fuel are answered from there.
+    class CompileServer
+    {
+    public:
+        // Replaces an existing socket file at socketPath.
+        CompileServer(std::filesystem::path socketPath,
+                      unsigned threadCount = std::thread::hardware_concurrency(),
+                      std::size_t cacheBytes = 64 << 20,
+                      std::size_t jitProgramLimit = 256,
+                      std::chrono::milliseconds readTimeout = std::chrono::seconds(10),
+                      OutputCache *outputCache = nullptr);
+        CompileServer(CompileServer const &) = delete;
+        CompileServer &operator=(CompileServer const &) = delete;
+        ~CompileServer();
+
+        // Accepts connections until stop() is called, or throws if
+        // accepting fails for good. Requests that are in progress by then
+        // are answered; idle connections are closed.
+        void serve();
+        // Can be called from any thread, including signal handlers.
+        void stop();
+
+    private:
+        // Everything a pool thread reuses from request to request, created
+        // on first use.
+        struct Worker
+        {
+            // An empty triple and CPU stand for the default triple and a
+            // generic CPU.
+            ObjCodeWriter &writer(std::string const &triple, std::string const &cpu);
+            ModuleOptimizer &optimizer(ObjCodeWriter &writer, int level);
+
+            std::map<std::pair<std::string, std::string>, std::unique_ptr<ObjCodeWriter>> writers;
+            std::map<std::pair<ObjCodeWriter *, int>, std::unique_ptr<ModuleOptimizer>> optimizers;
+
+            // Programs that are run are optimized for the host, like the
+            // JIT compiles them.
+            ObjCodeWriter hostWriter{llvm::sys::getProcessTriple(), {}, {}, llvm::sys::getHostCPUName(), hostCpuFeatures()};
+        };
+
+        // A program in the JIT, removed from it with the last reference.
+        struct JitProgram
+        {
+            explicit JitProgram(llvm::orc::ResourceTrackerSP tracker);
+            JitProgram(JitProgram const &) = delete;
+            JitProgram &operator=(JitProgram const &) = delete;
+            ~JitProgram();
+
+            llvm::orc::ResourceTrackerSP tracker;
+            JitEngine::TapeEntryFunction entry = nullptr;
+        };
+
+        void closeSockets();
+        void serveRequest(int connection);
+        void returnConnection(int connection);
+        CompileResponse handle(CompileRequest const &request);
+        std::string compile(CompileRequest const &request);
+        CompileResponse run(CompileRequest const &request);
+        // Parses the source unless program is given.
+        CachedOutput runOnJit(CompileRequest const &request, std::vector<AST> const *program = nullptr);
+
+        // Must be called with jitMutex_ held.
+        std::shared_ptr<JitProgram> lookupJitProgram(std::string const &key);
+
+        bool lookupCache(std::string const &key, std::string &payload);
+        void storeCache(std::string key, std::string payload);
+
+        std::filesystem::path socketPath_;
+        std::chrono::milliseconds readTimeout_;
+        int listenSocket_ = -1;
+        int stopPipe_[2] = {-1, -1};
+
+        // Connections whose request has been answered, for serve() to
+        // wait on again. A byte on wakePipe_ tells it there are some.
+        std::mutex returnedMutex_;
+        std::vector<int> returned_;
+        int wakePipe_[2] = {-1, -1};
+
+        ThreadPool pool_;
+        std::vector<std::unique_ptr<Worker>> workers_;
+
+        // Runs hold a reference to their program, so that evicting it
+        // from jitPrograms_ does not pull the code from under them.
+        std::mutex jitMutex_;
+        JitEngine jit_;
+        std::size_t jitProgramLimit_;
+        // Most recently run first.
+        std::list<std::string> jitOrder_;
+        std::unordered_map<std::string, std::pair<std::shared_ptr<JitProgram>, std::list<std::string>::iterator>> jitPrograms_;
+        std::atomic<std::size_t> jitModuleCount_ = 0;
+
+        // Evicted oldest first once cacheBytes_ is exceeded.
+        std::mutex cacheMutex_;
+        std::size_t cacheBytes_;
+        std::size_t cachedBytes_ = 0;
+        std::unordered_map<std::string, std::string> cache_;
+        std::deque<std::string> cacheOrder_;
+
+        OutputCache *outputCache_;
+    };
+
+    // One connection to a CompileServer.
+    class CompileClient
+    {
+    public:
+        explicit CompileClient(std::filesystem::path const &socketPath);
+        CompileClient(CompileClient const &) = delete;
+        CompileClient &operator=(CompileClient const &) = delete;
+        ~CompileClient();
+
+        CompileResponse request(CompileRequest const &request);
+
+    private:
+        int socket_ = -1;
+    };
+}
+
+#endif
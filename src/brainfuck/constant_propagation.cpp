@@ -0,0 +1,289 @@
+#include "constant_propagation.hpp"
+#include "loop_analysis.hpp"
+
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+namespace brainfuck
+{
+    namespace
+    {
+        using CellValue = std::optional<std::uint8_t>;
+
+        // What is known about the tape at one point in the program. Cell
+        // offsets are relative to an arbitrary anchor, since the absolute
+        // pointer position is lost after loops that move it.
+        class TapeState
+        {
+        public:
+            static TapeState zeroed() { return TapeState(true); }
+            static TapeState unknown() { return TapeState(false); }
+
+            CellValue current() const
+            {
+                auto it = cells_.find(pos_);
+                return it != cells_.end() ? it->second : defaultValue();
+            }
+
+            void setCurrent(CellValue value) { cells_[pos_] = value; }
+            void move(long delta) { pos_ += delta; }
+
+            // Forgets the cells at the given offsets from the current
+            // position.
+            void forget(std::set<long> const &offsets)
+            {
+                for (auto offset : offsets)
+                {
+                    cells_[pos_ + offset] = std::nullopt;
+                }
+            }
+
+        private:
+            TapeState(bool othersZero) : othersZero_(othersZero) {}
+
+            CellValue defaultValue() const { return othersZero_ ? CellValue(0) : std::nullopt; }
+
+            bool othersZero_;
+            std::map<long, CellValue> cells_;
+            long pos_ = 0;
+        };
+
+        bool isDataUpdate(AST const &ast)
+        {
+            return std::holds_alternative<IncrAST>(ast) || std::holds_alternative<DecrAST>(ast) || std::holds_alternative<SetAST>(ast);
+        }
+
+        bool isClearLoop(LoopAST const &loop)
+        {
+            auto const &body = loop.loopBody();
+            return body.size() == 1 && (std::holds_alternative<IncrAST>(body[0]) || std::holds_alternative<DecrAST>(body[0]));
+        }
+
+        // Loops touching more cells than this are treated like loops that
+        // move the tape pointer, which bounds the time spent on footprints.
+        std::size_t const LOOP_FOOTPRINT_MAX_CELLS = 1024;
+
+        class ConstantPropagator
+        {
+        public:
+            ConstantPropagator(std::vector<AST> const &program, RemarkCollector *remarks)
+                : remarks_(remarks),
+                  footprints_(loopFootprints(program, LOOP_FOOTPRINT_MAX_CELLS))
+            {
+            }
+
+            // Nested loops are handled with an explicit stack of the bodies
+            // being rewritten, so that deep nesting cannot overflow the
+            // machine stack. A finished body becomes a loop in its parent.
+            std::vector<AST> run(std::vector<AST> const &program)
+            {
+                struct Frame
+                {
+                    std::vector<AST> const *input;
+                    std::size_t next;
+                    LoopAST const *loop;
+                    TapeState state;
+                    std::vector<AST> output;
+                };
+
+                std::vector<Frame> frames;
+                frames.push_back({&program, 0, nullptr, TapeState::zeroed(), {}});
+
+                for (;;)
+                {
+                    auto &frame = frames.back();
+                    auto const &input = *frame.input;
+
+                    if (frame.next == input.size())
+                    {
+                        if (frames.size() == 1)
+                        {
+                            return std::move(frame.output);
+                        }
+
+                        LoopAST loop(frame.loop->location(), std::move(frame.output));
+                        frames.pop_back();
+                        frames.back().output.emplace_back(std::move(loop));
+                        continue;
+                    }
+
+                    if (std::holds_alternative<IncrAST>(input[frame.next]) || std::holds_alternative<DecrAST>(input[frame.next]))
+                    {
+                        frame.next = dataRun(input, frame.next, frame.output, frame.state);
+                        continue;
+                    }
+
+                    auto const &ast = input[frame.next++];
+
+                    if (auto loop = std::get_if<LoopAST>(&ast))
+                    {
+                        if (auto bodyState = enterLoop(*loop, frame.output, frame.state))
+                        {
+                            frames.push_back({&loop->loopBody(), 0, loop, std::move(*bodyState), {}});
+                        }
+
+                        continue;
+                    }
+
+                    std::visit([&](auto const &leaf)
+                               { node(leaf, frame.output, frame.state); },
+                               ast);
+                }
+            }
+
+        private:
+            // Handles the run of +/- starting at input[start] and returns
+            // the index after it.
+            std::size_t dataRun(std::vector<AST> const &input, std::size_t start, std::vector<AST> &output, TapeState &state)
+            {
+                std::size_t end = start;
+                int delta = 0;
+
+                for (; end < input.size(); ++end)
+                {
+                    if (std::holds_alternative<IncrAST>(input[end]))
+                    {
+                        ++delta;
+                    }
+                    else if (std::holds_alternative<DecrAST>(input[end]))
+                    {
+                        --delta;
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+
+                if (auto oldValue = state.current())
+                {
+                    auto newValue = static_cast<std::uint8_t>(*oldValue + delta);
+
+                    if (newValue != *oldValue)
+                    {
+                        emitSet(output, SetAST(astLocation(input[start]), newValue));
+                    }
+
+                    remark(Remark::Kind::passed, "ConstantFold", astLocation(input[start]),
+                           "run of " + std::to_string(end - start) + " +/- on a cell known to be " + std::to_string(*oldValue) +
+                               " folded into " + std::to_string(newValue));
+
+                    state.setCurrent(newValue);
+                }
+                else
+                {
+                    output.insert(output.end(), input.begin() + start, input.begin() + end);
+                }
+
+                return end;
+            }
+
+            // A store makes all preceding updates of the same cell dead.
+            void emitSet(std::vector<AST> &output, SetAST set)
+            {
+                while (!output.empty() && isDataUpdate(output.back()))
+                {
+                    output.pop_back();
+                }
+
+                output.emplace_back(set);
+            }
+
+            void node(LeftAST const &ast, std::vector<AST> &output, TapeState &state)
+            {
+                state.move(-1);
+                output.emplace_back(ast);
+            }
+
+            void node(RightAST const &ast, std::vector<AST> &output, TapeState &state)
+            {
+                state.move(1);
+                output.emplace_back(ast);
+            }
+
+            void node(WriteAST const &ast, std::vector<AST> &output, TapeState &)
+            {
+                output.emplace_back(ast);
+            }
+
+            void node(ReadAST const &ast, std::vector<AST> &output, TapeState &state)
+            {
+                state.setCurrent(std::nullopt);
+                output.emplace_back(ast);
+            }
+
+            void node(SetAST const &ast, std::vector<AST> &output, TapeState &state)
+            {
+                if (state.current() != ast.value())
+                {
+                    emitSet(output, ast);
+                }
+
+                state.setCurrent(ast.value());
+            }
+
+            // Only reached through dataRun and run.
+            void node(IncrAST const &, std::vector<AST> &, TapeState &) {}
+            void node(DecrAST const &, std::vector<AST> &, TapeState &) {}
+            void node(LoopAST const &, std::vector<AST> &, TapeState &) {}
+
+            // Updates state for the loop as a whole. Returns the state to
+            // rewrite the body with, or nothing if the loop has been dealt
+            // with already.
+            std::optional<TapeState> enterLoop(LoopAST const &loop, std::vector<AST> &output, TapeState &state)
+            {
+                if (state.current() == 0)
+                {
+                    remark(Remark::Kind::passed, "DeadLoop", loop.location(), "loop removed, its cell is always zero on entry");
+                    return std::nullopt;
+                }
+
+                if (isClearLoop(loop))
+                {
+                    remark(Remark::Kind::passed, "ClearLoop", loop.location(), "loop replaced by a store of 0");
+                    emitSet(output, SetAST(loop.location(), 0));
+                    state.setCurrent(0);
+                    return std::nullopt;
+                }
+
+                // The body is analyzed once, with everything it might change
+                // unknown, which holds on every iteration.
+                if (auto const &footprint = footprints_.at(&loop))
+                {
+                    state.forget(footprint->writes);
+                }
+                else
+                {
+                    remark(Remark::Kind::missed, "UnbalancedLoop", loop.location(),
+                           "loop moves the tape pointer or touches too many cells, all known cell values are lost");
+                    state = TapeState::unknown();
+                }
+
+                auto bodyState = state;
+                bodyState.setCurrent(std::nullopt);
+
+                state.setCurrent(0);
+                return bodyState;
+            }
+
+            void remark(Remark::Kind kind, std::string name, SourceLocation location, std::string message)
+            {
+                if (remarks_)
+                {
+                    remarks_->add({kind, "constant-propagation", std::move(name), std::move(message), location});
+                }
+            }
+
+            RemarkCollector *remarks_;
+            std::unordered_map<LoopAST const *, std::optional<BlockFootprint>> footprints_;
+        };
+    }
+
+    std::vector<AST> propagateConstants(std::vector<AST> const &program, RemarkCollector *remarks)
+    {
+        return ConstantPropagator(program, remarks).run(program);
+    }
+}
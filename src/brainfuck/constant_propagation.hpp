@@ -0,0 +1,27 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_CONSTANT_PROPAGATION_HPP
+#define INCLUDED_LLVM_BRAINFUCK_CONSTANT_PROPAGATION_HPP
+
+#include "ast.hpp"
+#include "remarks.hpp"
+
+#include <vector>
+
+namespace brainfuck
+{
+    // Simplifies a program by tracking which tape cells hold known values.
+    // The tape starts out all zero, and every loop leaves its current cell
+    // at zero; on top of that, loops with no net pointer movement keep all
+    // cells they do not touch intact. With that knowledge:
+    //
+    //  * loops entered on a known zero cell are removed (comment loops at
+    //    the top of a program, loops directly after other loops, ...),
+    //  * runs of +/- on a known cell become a single SetAST,
+    //  * [-] and [+] become SetAST(0), and stores that are overwritten
+    //    before anything reads them are dropped.
+    //
+    // Every such rewrite, and every loop that makes the tape unknown, is
+    // reported to remarks if given.
+    std::vector<AST> propagateConstants(std::vector<AST> const &program, RemarkCollector *remarks = nullptr);
+}
+
+#endif
@@ -0,0 +1,441 @@
+#include "executable.hpp"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/BinaryFormat/ELF.h>
+#include <llvm/Object/ELF.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/MathExtras.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace brainfuck
+{
+    namespace
+    {
+        // putchar collects output in a buffer that brainfuck_flush writes
+        // out; getchar flushes first so that prompts show up before the
+        // program blocks on input. _start is entered with an aligned stack,
+        // unlike regular functions, so it cannot be generated as IR.
+        char const *const FREESTANDING_RUNTIME = R"(
+    .text
+    .globl _start
+_start:
+    xorl %ebp, %ebp
+    andq $-16, %rsp
+    callq main
+    movl %eax, %ebx
+    callq brainfuck_flush
+    movl %ebx, %edi
+    movl $60, %eax
+    syscall
+    hlt
+
+brainfuck_flush:
+    leaq brainfuck_out_buffer(%rip), %rsi
+    movq brainfuck_out_length(%rip), %rdx
+1:
+    testq %rdx, %rdx
+    jle 2f
+    movl $1, %eax
+    movl $1, %edi
+    syscall
+    testq %rax, %rax
+    jle 2f
+    addq %rax, %rsi
+    subq %rax, %rdx
+    jmp 1b
+2:
+    movq $0, brainfuck_out_length(%rip)
+    retq
+
+    .globl putchar
+putchar:
+    movq brainfuck_out_length(%rip), %rax
+    leaq brainfuck_out_buffer(%rip), %rcx
+    movb %dil, (%rcx,%rax)
+    incq %rax
+    movq %rax, brainfuck_out_length(%rip)
+    cmpq $4096, %rax
+    jne 1f
+    pushq %rdi
+    callq brainfuck_flush
+    popq %rdi
+1:
+    movzbl %dil, %eax
+    retq
+
+    .globl getchar
+getchar:
+    subq $24, %rsp
+    callq brainfuck_flush
+    xorl %eax, %eax
+    xorl %edi, %edi
+    movq %rsp, %rsi
+    movl $1, %edx
+    syscall
+    cmpq $1, %rax
+    jne 1f
+    movzbl (%rsp), %eax
+    addq $24, %rsp
+    retq
+1:
+    movl $-1, %eax
+    addq $24, %rsp
+    retq
+
+    .globl memset
+memset:
+    movq %rdi, %r8
+    movl %esi, %eax
+    movq %rdx, %rcx
+    rep stosb
+    movq %r8, %rax
+    retq
+
+    .bss
+    .p2align 4
+brainfuck_out_buffer:
+    .zero 4096
+brainfuck_out_length:
+    .zero 8
+
+    .text
+)";
+
+        using ELFT = llvm::object::ELF64LE;
+
+        std::uint64_t const IMAGE_BASE = 0x400000;
+        std::uint64_t const PAGE_SIZE = 0x1000;
+
+        template <typename T>
+        T unwrap(llvm::Expected<T> value)
+        {
+            if (!value)
+            {
+                throw std::runtime_error(llvm::toString(value.takeError()));
+            }
+
+            return std::move(*value);
+        }
+
+        struct Segment
+        {
+            explicit Segment(std::uint32_t flags) : flags(flags) {}
+
+            std::uint32_t flags;
+            std::vector<ELFT::Shdr const *> sections;
+            std::uint64_t offset = 0;
+            std::uint64_t fileSize = 0;
+            std::uint64_t memorySize = 0;
+        };
+
+        void applyRelocation(std::vector<char> &image, std::uint64_t place, std::uint32_t type, std::uint64_t value)
+        {
+            auto location = image.data() + (place - IMAGE_BASE);
+            auto pcRelative = static_cast<std::int64_t>(value - place);
+
+            switch (type)
+            {
+            case llvm::ELF::R_X86_64_NONE:
+                break;
+            case llvm::ELF::R_X86_64_64:
+                llvm::support::endian::write64le(location, value);
+                break;
+            case llvm::ELF::R_X86_64_PC64:
+                llvm::support::endian::write64le(location, pcRelative);
+                break;
+            case llvm::ELF::R_X86_64_PC32:
+            case llvm::ELF::R_X86_64_PLT32:
+                if (!llvm::isInt<32>(pcRelative))
+                {
+                    throw std::runtime_error("PC-relative relocation out of range");
+                }
+                llvm::support::endian::write32le(location, pcRelative);
+                break;
+            case llvm::ELF::R_X86_64_32:
+                if (!llvm::isUInt<32>(value))
+                {
+                    throw std::runtime_error("absolute relocation out of range");
+                }
+                llvm::support::endian::write32le(location, value);
+                break;
+            case llvm::ELF::R_X86_64_32S:
+                if (!llvm::isInt<32>(static_cast<std::int64_t>(value)))
+                {
+                    throw std::runtime_error("absolute relocation out of range");
+                }
+                llvm::support::endian::write32le(location, value);
+                break;
+            default:
+                throw std::runtime_error("unsupported relocation type " + std::to_string(type));
+            }
+        }
+    }
+
+    void addFreestandingRuntime(llvm::Module &module)
+    {
+        llvm::Triple triple(module.getTargetTriple());
+
+        if (triple.getArch() != llvm::Triple::x86_64 || !triple.isOSLinux())
+        {
+            throw std::runtime_error("freestanding executables are only supported on x86-64 Linux");
+        }
+
+        module.appendModuleInlineAsm(FREESTANDING_RUNTIME);
+    }
+
+    void linkStaticExecutable(llvm::MemoryBufferRef object,
+                              std::filesystem::path const &outputPath,
+                              std::string_view entrySymbol)
+    {
+        auto elf = unwrap(llvm::object::ELFFile<ELFT>::create(object.getBuffer()));
+        auto const &header = elf.getHeader();
+
+        if (header.e_type != llvm::ELF::ET_REL || header.e_machine != llvm::ELF::EM_X86_64)
+        {
+            throw std::runtime_error("expected an x86-64 relocatable object");
+        }
+
+        auto sections = unwrap(elf.sections());
+
+        // One read-only segment that also holds the headers, one for code
+        // and one for writable data with .bss at its end.
+        std::array<Segment, 3> segments{Segment(llvm::ELF::PF_R),
+                                        Segment(llvm::ELF::PF_R | llvm::ELF::PF_X),
+                                        Segment(llvm::ELF::PF_R | llvm::ELF::PF_W)};
+
+        for (auto const &section : sections)
+        {
+            if ((section.sh_flags & llvm::ELF::SHF_ALLOC) == 0)
+            {
+                continue;
+            }
+
+            auto &segment = (section.sh_flags & llvm::ELF::SHF_WRITE)       ? segments[2]
+                            : (section.sh_flags & llvm::ELF::SHF_EXECINSTR) ? segments[1]
+                                                                              : segments[0];
+            segment.sections.push_back(&section);
+        }
+
+        for (auto &segment : segments)
+        {
+            std::stable_partition(begin(segment.sections), end(segment.sections),
+                                  [](auto section)
+                                  { return section->sh_type != llvm::ELF::SHT_NOBITS; });
+        }
+
+        auto isEmitted = [&](Segment const &segment)
+        { return &segment == &segments[0] || !segment.sections.empty(); };
+
+        // Program headers for the segments and a non-executable stack.
+        auto segmentCount = std::count_if(begin(segments), end(segments), isEmitted);
+        auto headersSize = sizeof(ELFT::Ehdr) + (segmentCount + 1) * sizeof(ELFT::Phdr);
+
+        // File offsets equal addresses minus IMAGE_BASE, so the image can be
+        // written as is.
+        std::map<ELFT::Shdr const *, std::uint64_t> addresses;
+        std::uint64_t offset = headersSize;
+
+        for (auto &segment : segments)
+        {
+            if (!isEmitted(segment))
+            {
+                continue;
+            }
+
+            segment.offset = &segment == &segments[0] ? 0 : llvm::alignTo(offset, PAGE_SIZE);
+
+            auto address = IMAGE_BASE + std::max(segment.offset, offset);
+            auto fileEnd = address;
+
+            for (auto section : segment.sections)
+            {
+                address = llvm::alignTo(address, std::max<std::uint64_t>(section->sh_addralign, 1));
+                addresses[section] = address;
+                address += section->sh_size;
+
+                if (section->sh_type != llvm::ELF::SHT_NOBITS)
+                {
+                    fileEnd = address;
+                }
+            }
+
+            segment.fileSize = fileEnd - IMAGE_BASE - segment.offset;
+            segment.memorySize = address - IMAGE_BASE - segment.offset;
+            offset = segment.offset + segment.fileSize;
+        }
+
+        std::vector<char> image(offset);
+
+        for (auto [section, address] : addresses)
+        {
+            if (section->sh_type != llvm::ELF::SHT_NOBITS)
+            {
+                auto contents = unwrap(elf.getSectionContents(*section));
+                std::memcpy(image.data() + (address - IMAGE_BASE), contents.data(), contents.size());
+            }
+        }
+
+        std::optional<std::uint64_t> entryAddress;
+
+        for (auto const &relocations : sections)
+        {
+            bool isSymbolTable = relocations.sh_type == llvm::ELF::SHT_SYMTAB;
+
+            if (relocations.sh_type != llvm::ELF::SHT_RELA && !isSymbolTable)
+            {
+                continue;
+            }
+
+            if (!isSymbolTable && relocations.sh_link >= sections.size())
+            {
+                throw std::runtime_error("relocation section without a symbol table");
+            }
+
+            auto const &symbolTable = isSymbolTable ? relocations : sections[relocations.sh_link];
+            auto symbols = unwrap(elf.symbols(&symbolTable));
+            auto stringTable = unwrap(elf.getStringTableForSymtab(symbolTable));
+
+            auto symbolAddress = [&](ELFT::Sym const &symbol) -> std::uint64_t
+            {
+                switch (symbol.st_shndx)
+                {
+                case llvm::ELF::SHN_UNDEF:
+                    throw std::runtime_error("undefined symbol " + unwrap(symbol.getName(stringTable)).str());
+                case llvm::ELF::SHN_ABS:
+                    return symbol.st_value;
+                default:
+                    // Reserved indices such as SHN_COMMON and SHN_XINDEX do
+                    // not index the section table.
+                    if (symbol.st_shndx >= llvm::ELF::SHN_LORESERVE || symbol.st_shndx >= sections.size())
+                    {
+                        throw std::runtime_error("symbol " + unwrap(symbol.getName(stringTable)).str() + " in unsupported section index " + std::to_string(symbol.st_shndx));
+                    }
+
+                    auto placed = addresses.find(&sections[symbol.st_shndx]);
+
+                    if (placed == addresses.end())
+                    {
+                        throw std::runtime_error("symbol " + unwrap(symbol.getName(stringTable)).str() + " in a discarded section");
+                    }
+
+                    return placed->second + symbol.st_value;
+                }
+            };
+
+            if (isSymbolTable)
+            {
+                for (auto const &symbol : symbols)
+                {
+                    if (symbol.getBinding() == llvm::ELF::STB_GLOBAL && std::string_view(unwrap(symbol.getName(stringTable))) == entrySymbol)
+                    {
+                        entryAddress = symbolAddress(symbol);
+                    }
+                }
+
+                continue;
+            }
+
+            auto target = addresses.find(&sections[relocations.sh_info]);
+
+            if (target == addresses.end())
+            {
+                continue;
+            }
+
+            for (auto const &relocation : unwrap(elf.relas(relocations)))
+            {
+                auto const &symbol = symbols[relocation.getSymbol(false)];
+                auto value = symbolAddress(symbol) + relocation.r_addend;
+
+                applyRelocation(image, target->second + relocation.r_offset, relocation.getType(false), value);
+            }
+        }
+
+        if (!entryAddress)
+        {
+            throw std::runtime_error("entry symbol " + std::string(entrySymbol) + " not found");
+        }
+
+        ELFT::Ehdr fileHeader{};
+        std::memcpy(fileHeader.e_ident, llvm::ELF::ElfMagic, std::strlen(llvm::ELF::ElfMagic));
+        fileHeader.e_ident[llvm::ELF::EI_CLASS] = llvm::ELF::ELFCLASS64;
+        fileHeader.e_ident[llvm::ELF::EI_DATA] = llvm::ELF::ELFDATA2LSB;
+        fileHeader.e_ident[llvm::ELF::EI_VERSION] = llvm::ELF::EV_CURRENT;
+        fileHeader.e_ident[llvm::ELF::EI_OSABI] = llvm::ELF::ELFOSABI_NONE;
+        fileHeader.e_type = llvm::ELF::ET_EXEC;
+        fileHeader.e_machine = llvm::ELF::EM_X86_64;
+        fileHeader.e_version = llvm::ELF::EV_CURRENT;
+        fileHeader.e_entry = *entryAddress;
+        fileHeader.e_phoff = sizeof(ELFT::Ehdr);
+        fileHeader.e_ehsize = sizeof(ELFT::Ehdr);
+        fileHeader.e_phentsize = sizeof(ELFT::Phdr);
+        fileHeader.e_phnum = segmentCount + 1;
+        std::memcpy(image.data(), &fileHeader, sizeof(fileHeader));
+
+        auto programHeaders = image.data() + sizeof(ELFT::Ehdr);
+
+        for (auto const &segment : segments)
+        {
+            if (!isEmitted(segment))
+            {
+                continue;
+            }
+
+            ELFT::Phdr programHeader{};
+            programHeader.p_type = llvm::ELF::PT_LOAD;
+            programHeader.p_flags = segment.flags;
+            programHeader.p_offset = segment.offset;
+            programHeader.p_vaddr = IMAGE_BASE + segment.offset;
+            programHeader.p_paddr = IMAGE_BASE + segment.offset;
+            programHeader.p_filesz = segment.fileSize;
+            programHeader.p_memsz = segment.memorySize;
+            programHeader.p_align = PAGE_SIZE;
+
+            std::memcpy(programHeaders, &programHeader, sizeof(programHeader));
+            programHeaders += sizeof(programHeader);
+        }
+
+        ELFT::Phdr stackHeader{};
+        stackHeader.p_type = llvm::ELF::PT_GNU_STACK;
+        stackHeader.p_flags = llvm::ELF::PF_R | llvm::ELF::PF_W;
+        std::memcpy(programHeaders, &stackHeader, sizeof(stackHeader));
+
+        // Replace rather than overwrite, in case the old executable is running.
+        std::filesystem::remove(outputPath);
+
+        std::ofstream out(outputPath, std::ios::binary);
+        out.write(image.data(), image.size());
+        out.close();
+
+        if (!out)
+        {
+            throw std::runtime_error("could not write " + outputPath.string());
+        }
+
+        std::filesystem::permissions(outputPath,
+                                     std::filesystem::perms::owner_exec | std::filesystem::perms::group_exec | std::filesystem::perms::others_exec,
+                                     std::filesystem::perm_options::add);
+    }
+
+    void writeExecutable(ObjCodeWriter &objWriter, llvm::Module &module, std::filesystem::path const &outputPath)
+    {
+        module.setTargetTriple(objWriter.getTargetTriple());
+        addFreestandingRuntime(module);
+
+        llvm::SmallVector<char, 0> object;
+        llvm::raw_svector_ostream objectStream(object);
+        objWriter.writeModuleToStream(objectStream, module);
+
+        linkStaticExecutable(llvm::MemoryBufferRef(llvm::StringRef(object.data(), object.size()), outputPath.string()), outputPath);
+    }
+}
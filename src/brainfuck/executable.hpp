@@ -0,0 +1,34 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_EXECUTABLE_HPP
+#define INCLUDED_LLVM_BRAINFUCK_EXECUTABLE_HPP
+
+#include "objcode.hpp"
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBufferRef.h>
+
+#include <filesystem>
+#include <string_view>
+
+namespace brainfuck
+{
+    // Defines _start, putchar, getchar and memset in the module on top of
+    // raw Linux syscalls, so that a program generated with EntryPoint::main
+    // does not need libc. Output is buffered and flushed before reading
+    // and on exit. Only x86-64 Linux is supported.
+    void addFreestandingRuntime(llvm::Module &module);
+
+    // Turns a self-contained x86-64 ELF relocatable object into a static
+    // executable starting at entrySymbol. Only allocated sections are kept,
+    // so debug info is dropped. Throws on undefined symbols and on
+    // relocation types that need a GOT or PLT.
+    void linkStaticExecutable(llvm::MemoryBufferRef object,
+                              std::filesystem::path const &outputPath,
+                              std::string_view entrySymbol = "_start");
+
+    // Adds the freestanding runtime to a module generated with
+    // EntryPoint::main, compiles it and links it in-process, so no
+    // external linker or libc is involved.
+    void writeExecutable(ObjCodeWriter &objWriter, llvm::Module &module, std::filesystem::path const &outputPath);
+}
+
+#endif
@@ -0,0 +1,127 @@
+#include "incremental.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+#include "structural_hash.hpp"
+
+#include <llvm/Config/llvm-config.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <functional>
+#include <set>
+#include <string>
+
+namespace brainfuck
+{
+    namespace
+    {
+        std::string loopFunctionName(std::uint64_t hash)
+        {
+            char buffer[32];
+            std::snprintf(buffer, sizeof buffer, "bf_loop_%016llx", static_cast<unsigned long long>(hash));
+            return buffer;
+        }
+    }
+
+    IncrementalCompiler::IncrementalCompiler(ObjCodeWriter &writer,
+                                             std::filesystem::path cacheDirectory,
+                                             std::size_t minimumLoopSize,
+                                             IncrementalSettings settings)
+        : writer_(writer),
+          cacheDirectory_(std::move(cacheDirectory)),
+          minimumLoopSize_(minimumLoopSize),
+          settings_(settings)
+    {
+        std::filesystem::create_directories(cacheDirectory_);
+    }
+
+    std::vector<std::filesystem::path> IncrementalCompiler::compile(std::vector<AST> const &program,
+                                                                    std::filesystem::path const &sourcePath,
+                                                                    std::filesystem::path const &mainObject)
+    {
+        // Objects built by another compiler, for another target or with
+        // other settings must never be picked up.
+        auto &targetMachine = writer_.targetMachine();
+        auto const &optimizer = settings_.optimizer;
+        auto seed = std::hash<std::string>{}(
+            std::to_string(CODEGEN_VERSION) + " " + LLVM_VERSION_STRING + " " +
+            writer_.getTargetTriple() + " " + targetMachine.getTargetCPU().str() + " " +
+            targetMachine.getTargetFeatureString().str() + " O" + std::to_string(optimizer.level) +
+            (optimizer.loopUnrolling ? " unroll" : "") +
+            (optimizer.loopVectorization ? " vectorize" : "") +
+            (optimizer.slpVectorization ? " slp" : "") +
+            (settings_.emitCountedLoops ? " counted" : ""));
+        auto digests = loopDigests(program, seed);
+
+        auto outlinedName = [&](LoopAST const &loop, LoopAST const *root) -> std::optional<std::string>
+        {
+            auto const &digest = digests.at(&loop);
+
+            if (&loop == root || digest.size < minimumLoopSize_)
+            {
+                return std::nullopt;
+            }
+
+            return loopFunctionName(digest.hash);
+        };
+
+        std::vector<std::filesystem::path> objects{mainObject};
+        std::set<std::uint64_t> seen;
+
+        for (auto const &[loop, digest] : digests)
+        {
+            if (digest.size < minimumLoopSize_ || !seen.insert(digest.hash).second)
+            {
+                continue;
+            }
+
+            auto functionName = loopFunctionName(digest.hash);
+            auto objectPath = cacheDirectory_ / (functionName + ".o");
+            objects.push_back(objectPath);
+
+            if (std::filesystem::exists(objectPath))
+            {
+                ++statistics_.loopsReused;
+                continue;
+            }
+
+            CodeGenOptions options;
+            options.entryPoint = EntryPoint::loopFunction;
+            options.entryName = functionName;
+            options.emitCountedLoops = settings_.emitCountedLoops;
+            options.outlinedLoopName = [&, root = loop](LoopAST const &nested)
+            { return outlinedName(nested, root); };
+            CodeGenerator codegen(writer_.getDataLayout(), {}, DebugInfoLevel::none, options);
+            codegen(*loop);
+
+            auto tsModule = codegen.finalizeModule();
+            auto &module = *tsModule.getModuleUnlocked();
+            optimizeModule(module, settings_.optimizer, &targetMachine);
+
+            // Write under a temporary name first so that concurrent or
+            // interrupted builds never leave a truncated object behind.
+            auto tempPath = objectPath;
+            tempPath += "." + std::to_string(getpid()) + ".tmp";
+            writer_.writeModuleToFile(tempPath.string(), module);
+            std::filesystem::rename(tempPath, objectPath);
+
+            ++statistics_.loopsRebuilt;
+        }
+
+        CodeGenOptions mainOptions;
+        mainOptions.outlinedLoopName = [&](LoopAST const &loop)
+        { return outlinedName(loop, nullptr); };
+        mainOptions.emitCountedLoops = settings_.emitCountedLoops;
+
+        CodeGenerator codegen(writer_.getDataLayout(), sourcePath, settings_.debugInfo, mainOptions);
+        codegen(program);
+
+        auto tsModule = codegen.finalizeModule();
+        auto &module = *tsModule.getModuleUnlocked();
+        optimizeModule(module, settings_.optimizer, &targetMachine);
+        writer_.writeModuleToFile(mainObject.string(), module);
+
+        return objects;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_INCREMENTAL_HPP
+#define INCLUDED_LLVM_BRAINFUCK_INCREMENTAL_HPP
+
+#include "ast.hpp"
+#include "codegen.hpp"
+#include "objcode.hpp"
+#include "optimizer.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+namespace brainfuck
+{
+    // Compiles programs so that every loop with at least minimumLoopSize
+    // nodes becomes a function of its own, named after the structural hash
+    // of the loop. The object code for these functions is kept in a cache
+    // directory and only rebuilt when no object for the hash exists, so
+    // after a local edit only the changed loops (and the loops enclosing
+    // them, minus their own outlined children) are compiled again.
+    //
+    // Outlined loops are optimized on their own; LLVM cannot inline across
+    // them, so this trades some run time for edit-compile-run latency.
+    struct IncrementalSettings
+    {
+        OptimizerSettings optimizer;
+        bool emitCountedLoops = true;
+        // For the object of the program itself. Cached loops are shared
+        // between programs and never carry debug info.
+        DebugInfoLevel debugInfo = DebugInfoLevel::full;
+    };
+
+    class IncrementalCompiler
+    {
+    public:
+        struct Statistics
+        {
+            std::size_t loopsRebuilt = 0;
+            std::size_t loopsReused = 0;
+        };
+
+        IncrementalCompiler(ObjCodeWriter &writer,
+                            std::filesystem::path cacheDirectory,
+                            std::size_t minimumLoopSize = 16,
+                            IncrementalSettings settings = {});
+
+        // Writes the object for the top-level program to mainObject and
+        // returns the list of all objects that need to be linked.
+        std::vector<std::filesystem::path> compile(std::vector<AST> const &program,
+                                                   std::filesystem::path const &sourcePath,
+                                                   std::filesystem::path const &mainObject);
+
+        auto const &statistics() const { return statistics_; }
+
+    private:
+        ObjCodeWriter &writer_;
+        std::filesystem::path cacheDirectory_;
+        std::size_t minimumLoopSize_;
+        IncrementalSettings settings_;
+        Statistics statistics_;
+    };
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include "jit.hpp"
+#include "objcode.hpp"
+#include "runtime.hpp"
+
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+
+#include <stdexcept>
+
+namespace brainfuck
+{
+    namespace
+    {
+        void throwIfError(llvm::Error err)
+        {
+            if (err)
+            {
+                throw std::runtime_error(llvm::toString(std::move(err)));
+            }
+        }
+
+        template <typename T>
+        T throwIfError(llvm::Expected<T> value)
+        {
+            throwIfError(value.takeError());
+            return std::move(*value);
+        }
+    }
+
+    JitEngine::JitEngine(std::string const &cpu, unsigned compileThreads)
+    {
+        initializeNativeTarget();
+
+        // Detects the host CPU name and features.
+        auto targetMachineBuilder = throwIfError(llvm::orc::JITTargetMachineBuilder::detectHost());
+
+        if (!cpu.empty())
+        {
+            targetMachineBuilder.setCPU(cpu);
+            targetMachineBuilder.getFeatures() = llvm::SubtargetFeatures();
+        }
+
+        targetMachine_ = throwIfError(targetMachineBuilder.createTargetMachine());
+        jit_ = throwIfError(llvm::orc::LLJITBuilder()
+                                .setJITTargetMachineBuilder(std::move(targetMachineBuilder))
+                                .setNumCompileThreads(compileThreads)
+                                .create());
+
+        auto &mainDylib = jit_->getMainJITDylib();
+        auto runtimeSymbol = [](auto function)
+        {
+            return llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(function),
+                                            llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+        };
+
+        throwIfError(mainDylib.define(llvm::orc::absoluteSymbols({
+            {jit_->mangleAndIntern("putchar"), runtimeSymbol(&brainfuck_runtime_putchar)},
+            {jit_->mangleAndIntern("getchar"), runtimeSymbol(&brainfuck_runtime_getchar)},
+            {jit_->mangleAndIntern("brainfuck_try_getchar"), runtimeSymbol(&brainfuck_runtime_try_getchar)},
+            {jit_->mangleAndIntern("brainfuck_fuel_take"), runtimeSymbol(&brainfuck_runtime_fuel_take)},
+            {jit_->mangleAndIntern("brainfuck_fuel_return"), runtimeSymbol(&brainfuck_runtime_fuel_return)},
+            {jit_->mangleAndIntern("brainfuck_tape_move"), runtimeSymbol(&brainfuck_runtime_tape_move)},
+            {jit_->mangleAndIntern("brainfuck_tape_read"), runtimeSymbol(&brainfuck_runtime_tape_read)},
+            {jit_->mangleAndIntern("brainfuck_tape_write"), runtimeSymbol(&brainfuck_runtime_tape_write)},
+        })));
+
+        // Intrinsics such as memset may be lowered to libc calls.
+        auto prefix = jit_->getDataLayout().getGlobalPrefix();
+        mainDylib.addGenerator(throwIfError(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(prefix)));
+    }
+
+    llvm::DataLayout JitEngine::getDataLayout() const
+    {
+        return jit_->getDataLayout();
+    }
+
+    void JitEngine::addModule(llvm::orc::ThreadSafeModule module)
+    {
+        throwIfError(jit_->addIRModule(std::move(module)));
+    }
+
+    llvm::orc::ResourceTrackerSP JitEngine::addRemovableModule(llvm::orc::ThreadSafeModule module)
+    {
+        auto tracker = jit_->getMainJITDylib().createResourceTracker();
+        throwIfError(jit_->addIRModule(tracker, std::move(module)));
+        return tracker;
+    }
+
+    JitEngine::MainFunction JitEngine::lookupMain(std::string const &name)
+    {
+        auto entry = throwIfError(jit_->lookup(name));
+        return entry.toPtr<MainFunction>();
+    }
+
+    JitEngine::TapeEntryFunction JitEngine::lookupTapeEntry(std::string const &name)
+    {
+        auto entry = throwIfError(jit_->lookup(name));
+        return entry.toPtr<TapeEntryFunction>();
+    }
+
+    JitEngine::ResumableEntryFunction JitEngine::lookupResumableEntry(std::string const &name)
+    {
+        auto entry = throwIfError(jit_->lookup(name));
+        return entry.toPtr<ResumableEntryFunction>();
+    }
+
+    JitEngine::ContextEntryFunction JitEngine::lookupContextEntry(std::string const &name)
+    {
+        auto entry = throwIfError(jit_->lookup(name));
+        return entry.toPtr<ContextEntryFunction>();
+    }
+
+    LibraryEntry const *JitEngine::lookupLibraryPrograms()
+    {
+        auto table = throwIfError(jit_->lookup(LIBRARY_PROGRAMS_SYMBOL));
+        return table.toPtr<LibraryEntry const *>();
+    }
+}
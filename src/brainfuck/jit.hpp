@@ -0,0 +1,62 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_JIT_HPP
+#define INCLUDED_LLVM_BRAINFUCK_JIT_HPP
+
+#include "runtime.hpp"
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace brainfuck
+{
+    // Compiles modules to native code in-process. putchar and getchar are
+    // bound to the brainfuck runtime (see runtime.hpp), so generated code
+    // talks to whatever ProgramIo the calling thread has bound.
+    class JitEngine
+    {
+    public:
+        // Signatures of code generated with EntryPoint::main,
+        // EntryPoint::tapeArgument, EntryPoint::resumable and
+        // EntryPoint::context.
+        using MainFunction = int (*)();
+        using TapeEntryFunction = int (*)(std::uint8_t *tape);
+        using ResumableEntryFunction = int (*)(std::uint8_t *tape, ResumeState *state);
+        using ContextEntryFunction = int (*)(RuntimeContext *context);
+
+        // Generates code for the given CPU, with just the features it
+        // implies, or for the host CPU and all its features if empty. With
+        // compileThreads, modules are compiled on threads of their own
+        // rather than by whichever thread first looks up their symbols.
+        explicit JitEngine(std::string const &cpu = {}, unsigned compileThreads = 0);
+
+        llvm::DataLayout getDataLayout() const;
+        // Matches the code the JIT generates, for optimizeModule. Only one
+        // thread may use it at a time.
+        llvm::TargetMachine &targetMachine() { return *targetMachine_; }
+
+        void addModule(llvm::orc::ThreadSafeModule module);
+        // Adds module such that removing the returned tracker frees its
+        // code again. No thread may run the code by then.
+        llvm::orc::ResourceTrackerSP addRemovableModule(llvm::orc::ThreadSafeModule module);
+        MainFunction lookupMain(std::string const &name = "main");
+        TapeEntryFunction lookupTapeEntry(std::string const &name);
+        ResumableEntryFunction lookupResumableEntry(std::string const &name);
+        ContextEntryFunction lookupContextEntry(std::string const &name);
+        // The program table of a module built with LibraryBuilder.
+        LibraryEntry const *lookupLibraryPrograms();
+
+        // For building on ORC directly, e.g. for lazy compilation.
+        llvm::orc::LLJIT &lljit() { return *jit_; }
+
+    private:
+        std::unique_ptr<llvm::TargetMachine> targetMachine_;
+        std::unique_ptr<llvm::orc::LLJIT> jit_;
+    };
+}
+
+#endif
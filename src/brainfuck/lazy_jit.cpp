@@ -0,0 +1,279 @@
+#include "lazy_jit.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+#include "structural_hash.hpp"
+
+#include <llvm/IR/IRBuilder.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+
+namespace brainfuck
+{
+    namespace
+    {
+        char const *const LAZY_ENTRY_NAME = "brainfuck_lazy_main";
+
+        void throwIfError(llvm::Error err)
+        {
+            if (err)
+            {
+                throw std::runtime_error(llvm::toString(std::move(err)));
+            }
+        }
+
+        template <typename T>
+        T throwIfError(llvm::Expected<T> value)
+        {
+            throwIfError(value.takeError());
+            return std::move(*value);
+        }
+
+        std::string chunkName(std::size_t chunk)
+        {
+            return "bf_lazy_chunk_" + std::to_string(chunk);
+        }
+
+        // Where a stub jumps if its code could not be compiled. The program
+        // cannot go on without it, and the error has already been reported
+        // to the execution session.
+        void lazyCompileFailed()
+        {
+            std::fputs("brainfuck: compiling code on demand failed\n", stderr);
+            std::abort();
+        }
+    }
+
+    // Generates and compiles the body of one loop or chunk when its stub is
+    // first called.
+    class LazyProgram::LazyUnit : public llvm::orc::MaterializationUnit
+    {
+    public:
+        LazyUnit(LazyProgram &program, llvm::orc::SymbolStringPtr body, std::function<llvm::orc::ThreadSafeModule()> generate)
+            : MaterializationUnit(Interface(llvm::orc::SymbolFlagsMap{{std::move(body), llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable}}, nullptr)),
+              program_(program),
+              generate_(std::move(generate))
+        {
+        }
+
+        llvm::StringRef getName() const override
+        {
+            return "brainfuck::LazyProgram::LazyUnit";
+        }
+
+        void materialize(std::unique_ptr<llvm::orc::MaterializationResponsibility> responsibility) override
+        {
+            llvm::orc::ThreadSafeModule module;
+
+            try
+            {
+                module = generate_();
+            }
+            catch (std::exception const &e)
+            {
+                responsibility->failMaterialization();
+                program_.jit_.lljit().getExecutionSession().reportError(
+                    llvm::make_error<llvm::StringError>(e.what(), llvm::inconvertibleErrorCode()));
+                return;
+            }
+
+            program_.jit_.lljit().getIRCompileLayer().emit(std::move(responsibility), std::move(module));
+        }
+
+    private:
+        void discard(llvm::orc::JITDylib const &, llvm::orc::SymbolStringPtr const &) override
+        {
+        }
+
+        LazyProgram &program_;
+        std::function<llvm::orc::ThreadSafeModule()> generate_;
+    };
+
+    LazyProgram::LazyProgram(std::vector<AST> program, std::size_t minimumLoopSize, unsigned compileThreads)
+        : program_(std::move(program)),
+          jit_({}, compileThreads)
+    {
+        for (auto const &ast : program_)
+        {
+            if (auto loop = std::get_if<LoopAST>(&ast))
+            {
+                loopNames_.emplace(loop, std::string());
+            }
+        }
+
+        for (auto const &[loop, digest] : loopDigests(program_))
+        {
+            if (digest.size >= minimumLoopSize)
+            {
+                loopNames_.emplace(loop, std::string());
+            }
+        }
+
+        std::size_t index = 0;
+        for (auto &[loop, name] : loopNames_)
+        {
+            name = "bf_lazy_loop_" + std::to_string(index++);
+        }
+
+        chunkCount_ = (program_.size() + LAZY_CHUNK_SIZE - 1) / LAZY_CHUNK_SIZE;
+
+        auto &lljit = jit_.lljit();
+        auto &session = lljit.getExecutionSession();
+        auto const &triple = lljit.getTargetTriple();
+
+        callThroughManager_ = throwIfError(llvm::orc::createLocalLazyCallThroughManager(
+            triple, session, llvm::orc::ExecutorAddr::fromPtr(&lazyCompileFailed)));
+        stubsManager_ = llvm::orc::createLocalIndirectStubsManagerBuilder(triple)();
+
+        // The bodies live in a dylib of their own, so that the stubs in the
+        // main dylib can take their names; they find the runtime and each
+        // other's stubs through the main dylib.
+        auto bodiesDylib = lljit.createJITDylib("brainfuck_lazy_loops");
+        throwIfError(bodiesDylib.takeError());
+        auto &bodies = *bodiesDylib;
+        bodies.addToLinkOrder(lljit.getMainJITDylib());
+
+        llvm::orc::SymbolAliasMap stubs;
+        auto defineLazy = [&](std::string const &name, std::function<llvm::orc::ThreadSafeModule()> generate)
+        {
+            auto body = lljit.mangleAndIntern(name + ".body");
+            throwIfError(bodies.define(std::make_unique<LazyUnit>(*this, body, std::move(generate))));
+            stubs[lljit.mangleAndIntern(name)] = {body, llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable};
+        };
+
+        for (auto const &[loop, name] : loopNames_)
+        {
+            defineLazy(name, [this, loop = loop]
+                       { return generateLoop(*loop); });
+        }
+
+        for (std::size_t chunk = 0; chunk < chunkCount_; ++chunk)
+        {
+            defineLazy(chunkName(chunk), [this, chunk]
+                       { return generateChunk(chunk); });
+        }
+
+        if (!stubs.empty())
+        {
+            throwIfError(lljit.getMainJITDylib().define(
+                llvm::orc::lazyReexports(*callThroughManager_, *stubsManager_, bodies, std::move(stubs))));
+        }
+
+        jit_.addModule(generateMain());
+        entry_ = jit_.lookupTapeEntry(LAZY_ENTRY_NAME);
+    }
+
+    LazyProgram::~LazyProgram() = default;
+
+    int LazyProgram::run(std::uint8_t *tape)
+    {
+        return entry_(tape);
+    }
+
+    std::optional<std::string> LazyProgram::outlinedLoopName(LoopAST const &loop, LoopAST const *root) const
+    {
+        if (&loop == root)
+        {
+            return std::nullopt;
+        }
+
+        auto found = loopNames_.find(&loop);
+        return found == loopNames_.end() ? std::nullopt : std::optional<std::string>(found->second);
+    }
+
+    llvm::orc::ThreadSafeModule LazyProgram::generateLoop(LoopAST const &loop)
+    {
+        CodeGenOptions options;
+        options.entryPoint = EntryPoint::loopFunction;
+        options.entryName = loopNames_.at(&loop) + ".body";
+        options.outlinedLoopName = [this, &loop](LoopAST const &nested)
+        { return outlinedLoopName(nested, &loop); };
+
+        CodeGenerator codegen(jit_.getDataLayout(), {}, DebugInfoLevel::none, options);
+        codegen(loop);
+
+        auto tsModule = codegen.finalizeModule();
+        optimize(*tsModule.getModuleUnlocked());
+
+        ++compiledLoops_;
+        return tsModule;
+    }
+
+    llvm::orc::ThreadSafeModule LazyProgram::generateChunk(std::size_t chunk)
+    {
+        CodeGenOptions options;
+        options.entryPoint = EntryPoint::loopFunction;
+        options.entryName = chunkName(chunk) + ".body";
+        options.outlinedLoopName = [this](LoopAST const &loop)
+        { return outlinedLoopName(loop, nullptr); };
+
+        CodeGenerator codegen(jit_.getDataLayout(), {}, DebugInfoLevel::none, options);
+
+        // Top-level loops are all outlined, so nothing here nests.
+        auto begin = chunk * LAZY_CHUNK_SIZE;
+        auto end = std::min(begin + LAZY_CHUNK_SIZE, program_.size());
+        for (auto index = begin; index < end; ++index)
+        {
+            codegen(program_[index]);
+        }
+
+        auto tsModule = codegen.finalizeModule();
+        optimize(*tsModule.getModuleUnlocked());
+        return tsModule;
+    }
+
+    llvm::orc::ThreadSafeModule LazyProgram::generateMain() const
+    {
+        auto context = std::make_unique<llvm::LLVMContext>();
+        auto module = std::make_unique<llvm::Module>(LAZY_ENTRY_NAME, *context);
+        module->setDataLayout(jit_.getDataLayout());
+
+        auto bytePtrType = llvm::Type::getInt8PtrTy(*context);
+        auto chunkType = llvm::FunctionType::get(bytePtrType, {bytePtrType}, false);
+        auto mainType = llvm::FunctionType::get(llvm::Type::getInt32Ty(*context), {bytePtrType}, false);
+        auto main = llvm::Function::Create(mainType, llvm::Function::ExternalLinkage, LAZY_ENTRY_NAME, *module);
+
+        llvm::IRBuilder<> builder(llvm::BasicBlock::Create(*context, "entry", main));
+        llvm::Value *pos = main->getArg(0);
+
+        for (std::size_t chunk = 0; chunk < chunkCount_; ++chunk)
+        {
+            pos = builder.CreateCall(module->getOrInsertFunction(chunkName(chunk), chunkType), {pos}, "pos");
+        }
+
+        builder.CreateRet(builder.getInt32(0));
+        return {std::move(module), std::move(context)};
+    }
+
+    void LazyProgram::optimize(llvm::Module &module)
+    {
+        auto targetMachine = takeTargetMachine();
+        optimizeModule(module, {}, targetMachine.get());
+        returnTargetMachine(std::move(targetMachine));
+    }
+
+    std::unique_ptr<llvm::TargetMachine> LazyProgram::takeTargetMachine()
+    {
+        {
+            std::lock_guard lock(targetMachinesMutex_);
+
+            if (!targetMachines_.empty())
+            {
+                auto targetMachine = std::move(targetMachines_.back());
+                targetMachines_.pop_back();
+                return targetMachine;
+            }
+        }
+
+        return throwIfError(throwIfError(llvm::orc::JITTargetMachineBuilder::detectHost()).createTargetMachine());
+    }
+
+    void LazyProgram::returnTargetMachine(std::unique_ptr<llvm::TargetMachine> targetMachine)
+    {
+        std::lock_guard lock(targetMachinesMutex_);
+        targetMachines_.push_back(std::move(targetMachine));
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_LAZY_JIT_HPP
+#define INCLUDED_LLVM_BRAINFUCK_LAZY_JIT_HPP
+
+#include "ast.hpp"
+#include "jit.hpp"
+
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LazyReexports.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace brainfuck
+{
+    // Runs a program through the JIT without compiling the loops it never
+    // enters. Top-level loops, and nested loops of at least minimumLoopSize
+    // nodes, become functions of their own (EntryPoint::loopFunction) that
+    // are called through ORC lazy reexport stubs. The IR for such a loop is
+    // only generated, optimized and compiled when the program first enters
+    // it. The top-level code is cut into chunks of LAZY_CHUNK_SIZE nodes
+    // that are compiled the same way when the program reaches them, so
+    // that the program starts as soon as its first chunk is compiled, and
+    // no function grows with the length of the program. Compiling happens
+    // on compileThreads background threads while the program waits at the
+    // entry of the loop or chunk, or on the running thread if
+    // compileThreads is 0.
+    //
+    // Loops that are compiled separately cannot be optimized together with
+    // their callers, so this trades some run time for startup time.
+    std::size_t const LAZY_CHUNK_SIZE = 64;
+
+    class LazyProgram
+    {
+    public:
+        explicit LazyProgram(std::vector<AST> program, std::size_t minimumLoopSize = 64, unsigned compileThreads = 1);
+        LazyProgram(LazyProgram const &) = delete;
+        LazyProgram &operator=(LazyProgram const &) = delete;
+        ~LazyProgram();
+
+        // Runs on a zeroed tape of BRAINFUCK_MEMSIZE cells, with the I/O
+        // that the calling thread has bound, and returns the exit status.
+        int run(std::uint8_t *tape);
+
+        std::size_t lazyLoopCount() const { return loopNames_.size(); }
+        // How many of them have been entered, and therefore compiled, so
+        // far.
+        std::size_t compiledLoopCount() const { return compiledLoops_; }
+
+    private:
+        class LazyUnit;
+
+        std::optional<std::string> outlinedLoopName(LoopAST const &loop, LoopAST const *root) const;
+        llvm::orc::ThreadSafeModule generateLoop(LoopAST const &loop);
+        llvm::orc::ThreadSafeModule generateChunk(std::size_t chunk);
+        // Calls the chunks in order.
+        llvm::orc::ThreadSafeModule generateMain() const;
+        void optimize(llvm::Module &module);
+
+        // Target machines for optimizing loops, one per compile that is
+        // in flight, since they must not be shared between threads.
+        std::unique_ptr<llvm::TargetMachine> takeTargetMachine();
+        void returnTargetMachine(std::unique_ptr<llvm::TargetMachine> targetMachine);
+
+        std::vector<AST> program_;
+        std::map<LoopAST const *, std::string> loopNames_;
+        std::size_t chunkCount_ = 0;
+        std::atomic<std::size_t> compiledLoops_ = 0;
+
+        std::mutex targetMachinesMutex_;
+        std::vector<std::unique_ptr<llvm::TargetMachine>> targetMachines_;
+
+        JitEngine jit_;
+        JitEngine::TapeEntryFunction entry_ = nullptr;
+
+        // Hold symbols of the JIT's execution session for the stubs that
+        // have not been called yet, so they must go before the JIT.
+        std::unique_ptr<llvm::orc::LazyCallThroughManager> callThroughManager_;
+        std::unique_ptr<llvm::orc::IndirectStubsManager> stubsManager_;
+    };
+}
+
+#endif
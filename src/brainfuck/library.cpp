@@ -0,0 +1,226 @@
+#include "library.hpp"
+#include "structural_hash.hpp"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Linker/Linker.h>
+
+#include <cctype>
+#include <stdexcept>
+
+namespace brainfuck
+{
+    namespace
+    {
+        // Field indices of RuntimeContext.
+        unsigned const CONTEXT_USER = 0;
+        unsigned const CONTEXT_PUTCHAR = 1;
+        unsigned const CONTEXT_GETCHAR = 2;
+
+        // Defines the runtime function name with the given type, if any
+        // program uses it, as internal so that it can be inlined into the
+        // programs. Returns nothing if it is unused.
+        llvm::Function *defineInternal(llvm::Module &module, std::string const &name)
+        {
+            auto function = module.getFunction(name);
+
+            if (function == nullptr)
+            {
+                return nullptr;
+            }
+
+            function->setLinkage(llvm::GlobalValue::InternalLinkage);
+            llvm::BasicBlock::Create(module.getContext(), "entry", function);
+            return function;
+        }
+
+        // Calls the context's callback in the given field with the user
+        // pointer and args, or fallback with args if it is null.
+        void defineForwarding(llvm::Module &module, std::string const &name, unsigned field, llvm::FunctionCallee fallback)
+        {
+            auto function = defineInternal(module, name);
+
+            if (function == nullptr)
+            {
+                return;
+            }
+
+            auto &context = module.getContext();
+            auto bytePtrType = llvm::Type::getInt8PtrTy(context);
+            auto contextType = llvm::StructType::get(context, {bytePtrType, bytePtrType, bytePtrType});
+
+            llvm::IRBuilder<> builder(&function->getEntryBlock());
+
+            auto runtimeContext = builder.CreateBitCast(function->getArg(0), contextType->getPointerTo(), "runtimeContext");
+            std::vector<llvm::Value *> args;
+            for (auto &arg : llvm::drop_begin(function->args()))
+            {
+                args.push_back(&arg);
+            }
+
+            auto callbackPtr = builder.CreateStructGEP(contextType, runtimeContext, field, "callbackPtr");
+            auto callback = builder.CreateLoad(bytePtrType, callbackPtr, "callback");
+
+            auto callbackBB = llvm::BasicBlock::Create(context, "callback", function);
+            auto fallbackBB = llvm::BasicBlock::Create(context, "fallback", function);
+            builder.CreateCondBr(builder.CreateIsNull(callback, "noCallback"), fallbackBB, callbackBB);
+
+            builder.SetInsertPoint(callbackBB);
+            auto userPtr = builder.CreateStructGEP(contextType, runtimeContext, CONTEXT_USER, "userPtr");
+            std::vector<llvm::Value *> callbackArgs = {builder.CreateLoad(bytePtrType, userPtr, "user")};
+            callbackArgs.insert(callbackArgs.end(), args.begin(), args.end());
+
+            std::vector<llvm::Type *> callbackParams;
+            for (auto arg : callbackArgs)
+            {
+                callbackParams.push_back(arg->getType());
+            }
+
+            auto callbackType = llvm::FunctionType::get(function->getReturnType(), callbackParams, false);
+            auto typedCallback = builder.CreateBitCast(callback, llvm::PointerType::getUnqual(callbackType));
+            builder.CreateRet(builder.CreateCall(callbackType, typedCallback, callbackArgs));
+
+            builder.SetInsertPoint(fallbackBB);
+            builder.CreateRet(builder.CreateCall(fallback, args));
+        }
+    }
+
+    LibraryBuilder::LibraryBuilder(llvm::DataLayout dataLayout, std::string const &libraryName)
+        : dataLayout_(std::move(dataLayout)),
+          llvmContext_(std::make_unique<llvm::LLVMContext>()),
+          module_(std::make_unique<llvm::Module>(libraryName, *llvmContext_))
+    {
+        module_->setDataLayout(dataLayout_);
+    }
+
+    std::string LibraryBuilder::add(std::string_view name, std::vector<AST> const &program, CodeGenOptions options)
+    {
+        // The library's runtime has no fuel, tape profile or outlined loops
+        // to offer, and the symbols would be left undefined.
+        if (options.meterFuel || options.profileTape || options.outlinedLoopName)
+        {
+            throw std::invalid_argument("fuel metering, tape profiling and outlined loops are not supported in libraries");
+        }
+
+        options.entryPoint = EntryPoint::context;
+        options.entryName = uniqueEntryName(name);
+
+        CodeGenerator codegen(dataLayout_, {}, DebugInfoLevel::none, options);
+        codegen(program);
+        auto tsModule = codegen.finalizeModule();
+
+        // Every CodeGenerator has a context of its own; bitcode carries the
+        // program over into the library's.
+        llvm::SmallVector<char, 0> bitcode;
+        llvm::raw_svector_ostream bitcodeStream(bitcode);
+        llvm::WriteBitcodeToFile(*tsModule.getModuleUnlocked(), bitcodeStream);
+
+        llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), options.entryName);
+        auto programModule = llvm::parseBitcodeFile(buffer, *llvmContext_);
+
+        if (!programModule)
+        {
+            throw std::runtime_error(llvm::toString(programModule.takeError()));
+        }
+
+        if (llvm::Linker::linkModules(*module_, std::move(*programModule)))
+        {
+            throw std::runtime_error("could not link " + options.entryName + " into the library");
+        }
+
+        entryNames_.push_back(options.entryName);
+        entryHashes_.push_back(structuralDigest(program).hash);
+        return options.entryName;
+    }
+
+    std::string LibraryBuilder::uniqueEntryName(std::string_view name)
+    {
+        std::string base = "bf_";
+
+        for (unsigned char c : name)
+        {
+            base += std::isalnum(c) ? static_cast<char>(c) : '_';
+        }
+
+        auto entryName = base;
+        for (int suffix = 2; !usedNames_.insert(entryName).second; ++suffix)
+        {
+            entryName = base + "_" + std::to_string(suffix);
+        }
+
+        return entryName;
+    }
+
+    void LibraryBuilder::defineRuntime()
+    {
+        auto &context = *llvmContext_;
+        auto intType = llvm::Type::getInt32Ty(context);
+        auto bytePtrType = llvm::Type::getInt8PtrTy(context);
+        auto sizeType = dataLayout_.getIntPtrType(context);
+
+        defineForwarding(*module_, "brainfuck_context_putchar", CONTEXT_PUTCHAR,
+                         module_->getOrInsertFunction("putchar", intType, intType));
+        defineForwarding(*module_, "brainfuck_context_getchar", CONTEXT_GETCHAR,
+                         module_->getOrInsertFunction("getchar", intType));
+
+        if (auto tape = defineInternal(*module_, "brainfuck_context_tape"))
+        {
+            llvm::IRBuilder<> builder(&tape->getEntryBlock());
+            auto calloc = module_->getOrInsertFunction("calloc", bytePtrType, sizeType, sizeType);
+            builder.CreateRet(builder.CreateCall(calloc, {llvm::ConstantInt::get(sizeType, BRAINFUCK_MEMSIZE),
+                                                          llvm::ConstantInt::get(sizeType, 1)}));
+        }
+
+        if (auto releaseTape = defineInternal(*module_, "brainfuck_context_release_tape"))
+        {
+            llvm::IRBuilder<> builder(&releaseTape->getEntryBlock());
+            auto free = module_->getOrInsertFunction("free", llvm::Type::getVoidTy(context), bytePtrType);
+            builder.CreateCall(free, {releaseTape->getArg(1)});
+            builder.CreateRetVoid();
+        }
+    }
+
+    void LibraryBuilder::defineProgramTable()
+    {
+        auto &context = *llvmContext_;
+        auto bytePtrType = llvm::Type::getInt8PtrTy(context);
+        auto hashType = llvm::Type::getInt64Ty(context);
+        auto entryType = llvm::StructType::get(context, {bytePtrType, bytePtrType, hashType});
+
+        std::vector<llvm::Constant *> entries;
+
+        for (std::size_t i = 0; i < entryNames_.size(); ++i)
+        {
+            auto const &entryName = entryNames_[i];
+            auto nameData = llvm::ConstantDataArray::getString(context, entryName);
+            auto nameGlobal = new llvm::GlobalVariable(*module_, nameData->getType(), true, llvm::GlobalValue::PrivateLinkage,
+                                                       nameData, entryName + ".name");
+            nameGlobal->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+
+            auto function = module_->getFunction(entryName);
+            entries.push_back(llvm::ConstantStruct::get(entryType, {llvm::ConstantExpr::getPointerCast(nameGlobal, bytePtrType),
+                                                                    llvm::ConstantExpr::getPointerCast(function, bytePtrType),
+                                                                    llvm::ConstantInt::get(hashType, entryHashes_[i])}));
+        }
+
+        entries.push_back(llvm::ConstantStruct::get(entryType, {llvm::ConstantPointerNull::get(bytePtrType),
+                                                                llvm::ConstantPointerNull::get(bytePtrType),
+                                                                llvm::ConstantInt::get(hashType, 0)}));
+
+        auto tableType = llvm::ArrayType::get(entryType, entries.size());
+        new llvm::GlobalVariable(*module_, tableType, true, llvm::GlobalValue::ExternalLinkage,
+                                 llvm::ConstantArray::get(tableType, entries), LIBRARY_PROGRAMS_SYMBOL);
+    }
+
+    llvm::orc::ThreadSafeModule LibraryBuilder::finalizeModule()
+    {
+        defineRuntime();
+        defineProgramTable();
+
+        llvm::verifyModule(*module_);
+
+        return {std::move(module_), std::move(llvmContext_)};
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_LIBRARY_HPP
+#define INCLUDED_LLVM_BRAINFUCK_LIBRARY_HPP
+
+#include "ast.hpp"
+#include "codegen.hpp"
+#include "runtime.hpp"
+
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/DataLayout.h>
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace brainfuck
+{
+    // Many programs in one module, e.g. to build a single shared object
+    // that a host loads once and dispatches into by name, instead of one
+    // executable per program. Every program becomes an exported
+    //
+    //     int <entry name>(RuntimeContext *context)
+    //
+    // (EntryPoint::context), and the module holds a single copy of the
+    // runtime they share: forwarding I/O to the context and allocating
+    // tapes. A program returns OUT_OF_MEMORY_STATUS without running when
+    // its tape cannot be allocated. The exported LIBRARY_PROGRAMS_SYMBOL
+    // table lists all programs.
+    class LibraryBuilder
+    {
+    public:
+        explicit LibraryBuilder(llvm::DataLayout dataLayout = llvm::DataLayout(""),
+                                std::string const &libraryName = "brainfuck_library");
+
+        // Compiles program into the library and returns its entry name:
+        // name turned into a C identifier, prefixed with "bf_" and made
+        // unique within the library. The entry point settings in options
+        // are ignored; meterFuel, profileTape and outlinedLoopName are
+        // rejected with std::invalid_argument.
+        std::string add(std::string_view name, std::vector<AST> const &program, CodeGenOptions options = {});
+
+        auto const &entryNames() const { return entryNames_; }
+
+        // Adds the shared runtime and the program table. Like
+        // CodeGenerator::finalizeModule, leaves optimizing to the caller.
+        llvm::orc::ThreadSafeModule finalizeModule();
+
+    private:
+        std::string uniqueEntryName(std::string_view name);
+        void defineRuntime();
+        void defineProgramTable();
+
+        llvm::DataLayout dataLayout_;
+        std::unique_ptr<llvm::LLVMContext> llvmContext_;
+        std::unique_ptr<llvm::Module> module_;
+
+        std::vector<std::string> entryNames_;
+        std::vector<std::uint64_t> entryHashes_;
+        std::set<std::string> usedNames_;
+    };
+}
+
+#endif
@@ -0,0 +1,269 @@
+#include "loop_analysis.hpp"
+
+#include <algorithm>
+
+namespace brainfuck
+{
+    namespace
+    {
+        // Bounds the work analyzeCountedLoop spends on nested loops, which
+        // would otherwise be quadratic in the nesting depth.
+        std::size_t const COUNTED_LOOP_MAX_NESTED_NODES = 128;
+    }
+
+    std::optional<BlockFootprint> balancedFootprint(std::vector<AST> const &block, std::size_t maxNodes)
+    {
+        // Nested loops are walked with an explicit stack, so that deep
+        // nesting cannot overflow the machine stack. All offsets are
+        // relative to the start of the outermost block; every loop body has
+        // to end at the offset it started at.
+        struct Frame
+        {
+            std::vector<AST> const *block;
+            std::size_t next;
+            long start;
+        };
+
+        BlockFootprint footprint;
+        long pos = 0;
+        std::size_t nodes = 0;
+
+        std::vector<Frame> frames{{&block, 0, 0}};
+
+        while (!frames.empty())
+        {
+            auto &frame = frames.back();
+
+            if (frame.next == frame.block->size())
+            {
+                if (pos != frame.start)
+                {
+                    return std::nullopt;
+                }
+
+                frames.pop_back();
+                continue;
+            }
+
+            if (++nodes > maxNodes)
+            {
+                return std::nullopt;
+            }
+
+            auto const &ast = (*frame.block)[frame.next++];
+
+            if (std::holds_alternative<LeftAST>(ast))
+            {
+                --pos;
+            }
+            else if (std::holds_alternative<RightAST>(ast))
+            {
+                ++pos;
+            }
+            else if (std::holds_alternative<WriteAST>(ast))
+            {
+                footprint.reads.insert(pos);
+            }
+            else if (auto loop = std::get_if<LoopAST>(&ast))
+            {
+                footprint.reads.insert(pos);
+                footprint.writes.insert(pos);
+
+                frames.push_back({&loop->loopBody(), 0, pos});
+            }
+            else
+            {
+                // +, - and SetAST also depend on the old value.
+                if (!std::holds_alternative<ReadAST>(ast) && !std::holds_alternative<SetAST>(ast))
+                {
+                    footprint.reads.insert(pos);
+                }
+
+                footprint.writes.insert(pos);
+            }
+        }
+
+        return footprint;
+    }
+
+    std::unordered_map<LoopAST const *, std::optional<BlockFootprint>> loopFootprints(std::vector<AST> const &program,
+                                                                                      std::size_t maxCells)
+    {
+        // Every frame collects the footprint of one loop body, relative to
+        // where the body starts. A finished body is recorded and merged
+        // into its parent's footprint at the parent's current position.
+        struct Frame
+        {
+            std::vector<AST> const *block;
+            std::size_t next;
+            LoopAST const *loop;
+            long pos;
+            std::optional<BlockFootprint> footprint;
+        };
+
+        std::unordered_map<LoopAST const *, std::optional<BlockFootprint>> footprints;
+        std::vector<Frame> frames;
+        frames.push_back({&program, 0, nullptr, 0, BlockFootprint{}});
+
+        auto tooLarge = [&](BlockFootprint const &footprint)
+        {
+            return std::max(footprint.reads.size(), footprint.writes.size()) > maxCells;
+        };
+
+        while (!frames.empty())
+        {
+            auto &frame = frames.back();
+
+            if (frame.next == frame.block->size())
+            {
+                auto finished = std::move(frame);
+                frames.pop_back();
+
+                if (!finished.loop)
+                {
+                    continue;
+                }
+
+                if (finished.pos != 0)
+                {
+                    finished.footprint.reset();
+                }
+
+                auto &parent = frames.back();
+
+                if (!finished.footprint)
+                {
+                    parent.footprint.reset();
+                }
+                else if (parent.footprint)
+                {
+                    for (auto offset : finished.footprint->reads)
+                    {
+                        parent.footprint->reads.insert(parent.pos + offset);
+                    }
+
+                    for (auto offset : finished.footprint->writes)
+                    {
+                        parent.footprint->writes.insert(parent.pos + offset);
+                    }
+
+                    if (tooLarge(*parent.footprint))
+                    {
+                        parent.footprint.reset();
+                    }
+                }
+
+                footprints.emplace(finished.loop, std::move(finished.footprint));
+                continue;
+            }
+
+            auto const &ast = (*frame.block)[frame.next++];
+
+            if (std::holds_alternative<LeftAST>(ast))
+            {
+                --frame.pos;
+            }
+            else if (std::holds_alternative<RightAST>(ast))
+            {
+                ++frame.pos;
+            }
+            else if (auto loop = std::get_if<LoopAST>(&ast))
+            {
+                if (frame.footprint)
+                {
+                    frame.footprint->reads.insert(frame.pos);
+                    frame.footprint->writes.insert(frame.pos);
+                }
+
+                frames.push_back({&loop->loopBody(), 0, loop, 0, BlockFootprint{}});
+                continue;
+            }
+            else if (frame.footprint)
+            {
+                if (std::holds_alternative<WriteAST>(ast))
+                {
+                    frame.footprint->reads.insert(frame.pos);
+                }
+                else
+                {
+                    // +, - and SetAST also depend on the old value.
+                    if (!std::holds_alternative<ReadAST>(ast) && !std::holds_alternative<SetAST>(ast))
+                    {
+                        frame.footprint->reads.insert(frame.pos);
+                    }
+
+                    frame.footprint->writes.insert(frame.pos);
+                }
+            }
+
+            if (frame.footprint && tooLarge(*frame.footprint))
+            {
+                frame.footprint.reset();
+            }
+        }
+
+        return footprints;
+    }
+
+    std::optional<CountedLoop> analyzeCountedLoop(LoopAST const &loop)
+    {
+        auto const &body = loop.loopBody();
+
+        CountedLoop counted{0, {}};
+        long pos = 0;
+
+        for (std::size_t i = 0; i < body.size(); ++i)
+        {
+            auto const &ast = body[i];
+
+            if (std::holds_alternative<LeftAST>(ast))
+            {
+                --pos;
+            }
+            else if (std::holds_alternative<RightAST>(ast))
+            {
+                ++pos;
+            }
+            else if (auto nested = std::get_if<LoopAST>(&ast))
+            {
+                // A loop on the control cell itself can never qualify; check
+                // that before walking the nested loop.
+                if (pos == 0)
+                {
+                    return std::nullopt;
+                }
+
+                auto footprint = balancedFootprint(nested->loopBody(), COUNTED_LOOP_MAX_NESTED_NODES);
+
+                if (!footprint || footprint->reads.contains(-pos) || footprint->writes.contains(-pos))
+                {
+                    return std::nullopt;
+                }
+            }
+            else if (pos == 0)
+            {
+                if (std::holds_alternative<IncrAST>(ast))
+                {
+                    ++counted.step;
+                }
+                else if (std::holds_alternative<DecrAST>(ast))
+                {
+                    --counted.step;
+                }
+                else
+                {
+                    return std::nullopt;
+                }
+
+                counted.controlUpdates.insert(i);
+            }
+        }
+
+        if (pos != 0 || counted.step == 0)
+        {
+            return std::nullopt;
+        }
+
+        return counted;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_LOOP_ANALYSIS_HPP
+#define INCLUDED_LLVM_BRAINFUCK_LOOP_ANALYSIS_HPP
+
+#include "ast.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace brainfuck
+{
+    // Cells a block of code may read and change, as offsets from the
+    // position it starts at.
+    struct BlockFootprint
+    {
+        std::set<long> reads;
+        std::set<long> writes;
+    };
+
+    // Returns nothing unless the block ends where it started and all loops
+    // in it do the same, since the footprint cannot be expressed in fixed
+    // offsets otherwise. Also returns nothing once more than maxNodes
+    // nodes, counting those in nested loops, have been looked at.
+    std::optional<BlockFootprint> balancedFootprint(std::vector<AST> const &block,
+                                                    std::size_t maxNodes = std::numeric_limits<std::size_t>::max());
+
+    // balancedFootprint of the body of every loop in a program, computed
+    // in a single bottom-up pass, so that looking up all of them does not
+    // take time quadratic in the nesting depth. A footprint is also left
+    // empty once it covers more than maxCells cells.
+    std::unordered_map<LoopAST const *, std::optional<BlockFootprint>> loopFootprints(std::vector<AST> const &program,
+                                                                                      std::size_t maxCells);
+
+    // A loop whose control cell is changed by the same constant on every
+    // iteration and by nothing else, and that nothing inside reads the
+    // control cell. Its trip count is a function of the control cell's
+    // value on entry.
+    struct CountedLoop
+    {
+        // Net change of the control cell per iteration, modulo 256; never 0.
+        std::uint8_t step;
+        // Indices of the +/- nodes in the loop body that update the
+        // control cell.
+        std::set<std::size_t> controlUpdates;
+    };
+
+    std::optional<CountedLoop> analyzeCountedLoop(LoopAST const &loop);
+}
+
+#endif
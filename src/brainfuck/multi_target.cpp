@@ -0,0 +1,98 @@
+#include "multi_target.hpp"
+#include "objcode.hpp"
+#include "thread_pool.hpp"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LLVMContext.h>
+
+#include <stdexcept>
+
+namespace brainfuck
+{
+    std::string TargetSpec::fileSuffix() const
+    {
+        auto suffix = triple;
+
+        if (cpu != "generic")
+        {
+            suffix += "." + cpu;
+        }
+
+        return suffix;
+    }
+
+    TargetSpec parseTargetSpec(std::string_view spec)
+    {
+        TargetSpec target;
+
+        auto cpuStart = spec.find(':');
+        target.triple = spec.substr(0, cpuStart);
+
+        if (cpuStart != std::string_view::npos)
+        {
+            auto featuresStart = spec.find(':', cpuStart + 1);
+            target.cpu = spec.substr(cpuStart + 1, featuresStart - cpuStart - 1);
+
+            if (featuresStart != std::string_view::npos)
+            {
+                target.features = spec.substr(featuresStart + 1);
+            }
+        }
+
+        if (target.triple.empty())
+        {
+            throw std::invalid_argument("target triple missing in " + std::string(spec));
+        }
+
+        return target;
+    }
+
+    std::vector<std::filesystem::path> writeModuleForTargets(llvm::Module const &module,
+                                                             std::vector<TargetSpec> const &targets,
+                                                             std::filesystem::path const &pathStem,
+                                                             llvm::CodeGenFileType fileType)
+    {
+        // Bitcode is the cheapest way to clone a module into another context.
+        llvm::SmallVector<char, 0> bitcode;
+        llvm::raw_svector_ostream bitcodeStream(bitcode);
+        llvm::WriteBitcodeToFile(module, bitcodeStream);
+
+        auto extension = fileType == llvm::CGFT_AssemblyFile ? ".asm" : ".o";
+
+        std::vector<std::filesystem::path> paths;
+        for (auto const &target : targets)
+        {
+            auto path = pathStem;
+            path += "." + target.fileSuffix() + extension;
+            paths.push_back(path);
+        }
+
+        ThreadPool pool(targets.size());
+
+        for (std::size_t i = 0; i < targets.size(); ++i)
+        {
+            pool.submit([&, i]
+                        {
+                            auto const &target = targets[i];
+
+                            llvm::LLVMContext context;
+                            llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), module.getModuleIdentifier());
+                            auto clone = llvm::parseBitcodeFile(buffer, context);
+
+                            if (!clone)
+                            {
+                                throw std::runtime_error(llvm::toString(clone.takeError()));
+                            }
+
+                            (*clone)->setTargetTriple(target.triple);
+
+                            ObjCodeWriter writer(target.triple, {}, {}, target.cpu, target.features);
+                            writer.writeModuleToFile(paths[i].string(), **clone, fileType); });
+        }
+
+        pool.wait();
+
+        return paths;
+    }
+}
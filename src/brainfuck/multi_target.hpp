@@ -0,0 +1,38 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_MULTI_TARGET_HPP
+#define INCLUDED_LLVM_BRAINFUCK_MULTI_TARGET_HPP
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CodeGen.h>
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace brainfuck
+{
+    struct TargetSpec
+    {
+        std::string triple;
+        std::string cpu = "generic";
+        std::string features;
+
+        // Suffix for output files, e.g. x86_64-pc-linux-gnu.x86-64-v3
+        std::string fileSuffix() const;
+    };
+
+    // Parses triple[:cpu[:features]], e.g. x86_64-pc-linux-gnu:x86-64-v3
+    TargetSpec parseTargetSpec(std::string_view spec);
+
+    // Runs the backend for every target on a thread of its own and writes
+    // <pathStem>.<target suffix>.o (or .asm). The module is expected to be
+    // optimized already and is not changed; every thread works on its own
+    // copy in its own LLVMContext, since LLVM modules and contexts must not
+    // be shared between threads. Returns the paths of the written files.
+    std::vector<std::filesystem::path> writeModuleForTargets(llvm::Module const &module,
+                                                             std::vector<TargetSpec> const &targets,
+                                                             std::filesystem::path const &pathStem,
+                                                             llvm::CodeGenFileType fileType = llvm::CGFT_ObjectFile);
+}
+
+#endif
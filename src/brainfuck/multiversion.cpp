@@ -0,0 +1,264 @@
+#include "multiversion.hpp"
+#include "codegen.hpp"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Linker/Linker.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+namespace brainfuck
+{
+    namespace
+    {
+        // What a level needs, as bits of CPUID leaf 1 ECX, leaf 7 EBX,
+        // leaf 0x80000001 ECX, and of XCR0, i.e. the register state the
+        // operating system saves.
+        struct IsaLevel
+        {
+            char const *cpu;
+            std::uint32_t leaf1Ecx;
+            std::uint32_t leaf7Ebx;
+            std::uint32_t extendedEcx;
+            std::uint32_t xcr0;
+        };
+
+        std::uint32_t const SSE3 = 1u << 0, SSSE3 = 1u << 9, FMA = 1u << 12, CX16 = 1u << 13,
+                            SSE41 = 1u << 19, SSE42 = 1u << 20, MOVBE = 1u << 22, POPCNT = 1u << 23,
+                            OSXSAVE = 1u << 27, AVX = 1u << 28, F16C = 1u << 29;
+        std::uint32_t const BMI1 = 1u << 3, AVX2 = 1u << 5, BMI2 = 1u << 8, AVX512F = 1u << 16,
+                            AVX512DQ = 1u << 17, AVX512CD = 1u << 28, AVX512BW = 1u << 30, AVX512VL = 1u << 31;
+        std::uint32_t const LAHF = 1u << 0, LZCNT = 1u << 5;
+        std::uint32_t const XMM_YMM_STATE = 0x6, ZMM_STATE = 0xe0;
+
+        std::uint32_t const V2_LEAF1 = SSE3 | SSSE3 | CX16 | SSE41 | SSE42 | POPCNT;
+        std::uint32_t const V3_LEAF1 = V2_LEAF1 | FMA | MOVBE | OSXSAVE | AVX | F16C;
+        std::uint32_t const V3_LEAF7 = BMI1 | AVX2 | BMI2;
+
+        IsaLevel const ISA_LEVELS[] = {
+            {"x86-64", 0, 0, 0, 0},
+            {"x86-64-v2", V2_LEAF1, 0, LAHF, 0},
+            {"x86-64-v3", V3_LEAF1, V3_LEAF7, LAHF | LZCNT, XMM_YMM_STATE},
+            {"x86-64-v4", V3_LEAF1, V3_LEAF7 | AVX512F | AVX512DQ | AVX512CD | AVX512BW | AVX512VL, LAHF | LZCNT, XMM_YMM_STATE | ZMM_STATE},
+        };
+
+        IsaLevel const &findIsaLevel(std::string const &cpu)
+        {
+            auto level = std::find_if(std::begin(ISA_LEVELS), std::end(ISA_LEVELS), [&](auto const &level)
+                                      { return cpu == level.cpu; });
+
+            if (level == std::end(ISA_LEVELS))
+            {
+                throw std::invalid_argument("not an x86-64 ISA level: " + cpu);
+            }
+
+            return *level;
+        }
+
+        std::string kernelName(std::string const &entryName, std::string const &cpu)
+        {
+            auto name = entryName + "_" + cpu;
+            std::replace(name.begin(), name.end(), '-', '_');
+            return name;
+        }
+
+        std::unique_ptr<llvm::Module> cloneInto(llvm::Module const &module, llvm::LLVMContext &context)
+        {
+            llvm::SmallVector<char, 0> bitcode;
+            llvm::raw_svector_ostream bitcodeStream(bitcode);
+            llvm::WriteBitcodeToFile(module, bitcodeStream);
+
+            llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), module.getModuleIdentifier());
+            auto clone = llvm::parseBitcodeFile(buffer, context);
+
+            if (!clone)
+            {
+                throw std::runtime_error(llvm::toString(clone.takeError()));
+            }
+
+            return std::move(*clone);
+        }
+
+        // Builds int <entryName>_isa_level(void), which returns the index
+        // of the last of levels that the CPU supports, or -1.
+        llvm::Function *emitIsaLevelFunction(llvm::Module &module, std::vector<IsaLevel const *> const &levels, std::string const &name)
+        {
+            auto &context = module.getContext();
+            auto intType = llvm::Type::getInt32Ty(context);
+
+            auto function = llvm::Function::Create(llvm::FunctionType::get(intType, false), llvm::Function::ExternalLinkage, name, module);
+            auto entryBB = llvm::BasicBlock::Create(context, "entry", function);
+            auto xgetbvBB = llvm::BasicBlock::Create(context, "xgetbv", function);
+            auto selectBB = llvm::BasicBlock::Create(context, "select", function);
+
+            llvm::IRBuilder<> builder(entryBB);
+
+            auto registersType = llvm::StructType::get(context, {intType, intType, intType, intType});
+            auto cpuidAsm = llvm::InlineAsm::get(llvm::FunctionType::get(registersType, {intType, intType}, false),
+                                                 "cpuid", "={ax},={bx},={cx},={dx},{ax},{cx},~{dirflag},~{fpsr},~{flags}", false);
+            auto cpuid = [&](std::uint32_t leaf, unsigned reg, char const *regName)
+            {
+                auto registers = builder.CreateCall(cpuidAsm->getFunctionType(), cpuidAsm, {builder.getInt32(leaf), builder.getInt32(0)});
+                return builder.CreateExtractValue(registers, reg, regName);
+            };
+
+            // Leaves beyond the maximum return garbage rather than zeros.
+            auto maxLeaf = cpuid(0, 0, "maxLeaf");
+            auto maxExtendedLeaf = cpuid(0x80000000, 0, "maxExtendedLeaf");
+
+            auto leaf1Ecx = cpuid(1, 2, "leaf1Ecx");
+            auto leaf7Ebx = builder.CreateSelect(builder.CreateICmpUGE(maxLeaf, builder.getInt32(7)),
+                                                 cpuid(7, 1, "leaf7EbxRaw"), builder.getInt32(0), "leaf7Ebx");
+            auto extendedEcx = builder.CreateSelect(builder.CreateICmpUGE(maxExtendedLeaf, builder.getInt32(0x80000001)),
+                                                    cpuid(0x80000001, 2, "extendedEcxRaw"), builder.getInt32(0), "extendedEcx");
+
+            // xgetbv faults unless the operating system enabled it.
+            auto osxsave = builder.CreateICmpNE(builder.CreateAnd(leaf1Ecx, OSXSAVE), builder.getInt32(0), "osxsave");
+            builder.CreateCondBr(osxsave, xgetbvBB, selectBB);
+
+            builder.SetInsertPoint(xgetbvBB);
+            // Spelled out, since older assemblers do not know xgetbv.
+            auto xgetbvAsm = llvm::InlineAsm::get(llvm::FunctionType::get(llvm::StructType::get(context, {intType, intType}), {intType}, false),
+                                                  ".byte 0x0f, 0x01, 0xd0", "={ax},={dx},{cx},~{dirflag},~{fpsr},~{flags}", true);
+            auto xcr0Read = builder.CreateExtractValue(builder.CreateCall(xgetbvAsm->getFunctionType(), xgetbvAsm, {builder.getInt32(0)}), 0, "xcr0Read");
+            builder.CreateBr(selectBB);
+
+            builder.SetInsertPoint(selectBB);
+            auto xcr0 = builder.CreatePHI(intType, 2, "xcr0");
+            xcr0->addIncoming(builder.getInt32(0), entryBB);
+            xcr0->addIncoming(xcr0Read, xgetbvBB);
+
+            auto hasAll = [&](llvm::Value *bits, std::uint32_t mask)
+            {
+                return builder.CreateICmpEQ(builder.CreateAnd(bits, mask), builder.getInt32(mask));
+            };
+
+            llvm::Value *selected = builder.getInt32(-1);
+            for (std::size_t i = 0; i < levels.size(); ++i)
+            {
+                auto const &level = *levels[i];
+                auto supported = builder.CreateAnd({hasAll(leaf1Ecx, level.leaf1Ecx),
+                                                    hasAll(leaf7Ebx, level.leaf7Ebx),
+                                                    hasAll(extendedEcx, level.extendedEcx),
+                                                    hasAll(xcr0, level.xcr0)});
+                selected = builder.CreateSelect(supported, builder.getInt32(i), selected);
+            }
+
+            builder.CreateRet(selected);
+            return function;
+        }
+    }
+
+    std::vector<std::string> const &x86IsaLevels()
+    {
+        static auto const levels = []
+        {
+            std::vector<std::string> names;
+            for (auto const &level : ISA_LEVELS)
+            {
+                names.push_back(level.cpu);
+            }
+            return names;
+        }();
+
+        return levels;
+    }
+
+    llvm::orc::ThreadSafeModule buildMultiversionModule(std::vector<AST> const &program,
+                                                        ObjCodeWriter &writer,
+                                                        std::vector<std::string> const &levels,
+                                                        std::string const &entryName)
+    {
+        if (llvm::Triple(writer.getTargetTriple()).getArch() != llvm::Triple::x86_64)
+        {
+            throw std::invalid_argument("multiversioning needs an x86-64 target, not " + writer.getTargetTriple());
+        }
+
+        std::vector<IsaLevel const *> isaLevels;
+        for (auto const &level : levels)
+        {
+            isaLevels.push_back(&findIsaLevel(level));
+        }
+
+        auto dataLayout = writer.getDataLayout();
+
+        auto context = std::make_unique<llvm::LLVMContext>();
+        auto module = std::make_unique<llvm::Module>(entryName, *context);
+        module->setDataLayout(dataLayout);
+        module->setTargetTriple(writer.getTargetTriple());
+
+        std::vector<llvm::Function *> kernels;
+
+        for (auto level : isaLevels)
+        {
+            CodeGenOptions options;
+            options.entryPoint = EntryPoint::tapeArgument;
+            options.entryName = kernelName(entryName, level->cpu);
+
+            CodeGenerator codegen(dataLayout, {}, DebugInfoLevel::none, options);
+            codegen(program);
+
+            auto kernelModule = codegen.finalizeModule();
+
+            for (auto &function : *kernelModule.getModuleUnlocked())
+            {
+                if (!function.isDeclaration())
+                {
+                    // The level alone decides the features, whatever the
+                    // target machine has been set up with.
+                    function.addFnAttr("target-cpu", level->cpu);
+                    function.addFnAttr("target-features", "");
+                }
+            }
+
+            if (llvm::Linker::linkModules(*module, cloneInto(*kernelModule.getModuleUnlocked(), *context)))
+            {
+                throw std::runtime_error("could not link kernel " + options.entryName);
+            }
+
+            kernels.push_back(module->getFunction(options.entryName));
+        }
+
+        auto isaLevel = emitIsaLevelFunction(*module, isaLevels, entryName + "_isa_level");
+
+        auto intType = llvm::Type::getInt32Ty(*context);
+        auto main = llvm::Function::Create(llvm::FunctionType::get(intType, false), llvm::Function::ExternalLinkage, entryName, *module);
+        auto entryBB = llvm::BasicBlock::Create(*context, "entry", main);
+        auto unsupportedBB = llvm::BasicBlock::Create(*context, "unsupported", main);
+
+        llvm::IRBuilder<> builder(entryBB);
+        auto tape = builder.CreateAlloca(builder.getInt8Ty(), builder.getInt32(BRAINFUCK_MEMSIZE), "tape");
+        builder.CreateMemSet(tape, builder.getInt8(0), BRAINFUCK_MEMSIZE, llvm::MaybeAlign(1));
+
+        auto dispatch = builder.CreateSwitch(builder.CreateCall(isaLevel, {}, "level"), unsupportedBB, kernels.size());
+
+        for (std::size_t i = 0; i < kernels.size(); ++i)
+        {
+            auto kernelBB = llvm::BasicBlock::Create(*context, kernels[i]->getName(), main);
+            dispatch->addCase(builder.getInt32(i), kernelBB);
+
+            builder.SetInsertPoint(kernelBB);
+            builder.CreateRet(builder.CreateCall(kernels[i], {tape}));
+        }
+
+        builder.SetInsertPoint(unsupportedBB);
+        builder.CreateRet(builder.getInt32(1));
+
+        // Whatever the target machine, the dispatch itself has to run on
+        // every x86-64 CPU.
+        for (auto function : {isaLevel, main})
+        {
+            function->addFnAttr("target-cpu", ISA_LEVELS[0].cpu);
+            function->addFnAttr("target-features", "");
+        }
+
+        llvm::verifyModule(*module);
+
+        return {std::move(module), std::move(context)};
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_MULTIVERSION_HPP
+#define INCLUDED_LLVM_BRAINFUCK_MULTIVERSION_HPP
+
+#include "ast.hpp"
+#include "objcode.hpp"
+
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+
+#include <string>
+#include <vector>
+
+namespace brainfuck
+{
+    // The x86-64 micro-architecture levels of the psABI, from the baseline
+    // up to AVX-512, under their LLVM CPU names.
+    std::vector<std::string> const &x86IsaLevels();
+
+    // For objects that are built once and run on CPUs of different
+    // generations: compiles program once per level into a kernel
+    //
+    //     int <entryName>_<level>(unsigned char *tape)
+    //
+    // (with dashes in the level turned into underscores) whose target-cpu
+    // attribute is that level, and adds
+    //
+    //     int <entryName>(void)
+    //
+    // which allocates the tape and runs the kernel of the last of levels
+    // that both the CPU and the operating system support, or returns 1 if
+    // there is none. The choice is made with cpuid by
+    //
+    //     int <entryName>_isa_level(void)
+    //
+    // which returns the index of that level, or -1. Levels that are not
+    // in x86IsaLevels() or targets other than x86-64 throw.
+    //
+    // Like CodeGenerator::finalizeModule, leaves optimizing to the caller,
+    // which should pass writer.targetMachine() to optimizeModule so that
+    // every kernel is vectorized for its own level.
+    llvm::orc::ThreadSafeModule buildMultiversionModule(std::vector<AST> const &program,
+                                                        ObjCodeWriter &writer,
+                                                        std::vector<std::string> const &levels = x86IsaLevels(),
+                                                        std::string const &entryName = "main");
+}
+
+#endif
@@ -5,36 +5,99 @@
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/TargetSelect.h>
 
+#include <mutex>
 #include <sstream>
 
 namespace brainfuck
 {
+    void initializeNativeTarget()
+    {
+        static std::once_flag once;
+
+        std::call_once(once, []
+                       {
+                           llvm::InitializeNativeTarget();
+                           llvm::InitializeNativeTargetAsmPrinter();
+                           llvm::InitializeNativeTargetAsmParser(); });
+    }
+
+    void initializeAllTargets()
+    {
+        static std::once_flag once;
+
+        std::call_once(once, []
+                       {
+                           llvm::InitializeAllTargetInfos();
+                           llvm::InitializeAllTargets();
+                           llvm::InitializeAllTargetMCs();
+                           llvm::InitializeAllAsmParsers();
+                           llvm::InitializeAllAsmPrinters(); });
+    }
+
+    std::string hostCpuFeatures()
+    {
+        llvm::StringMap<bool> features;
+        llvm::sys::getHostCPUFeatures(features);
+
+        std::string result;
+        for (auto const &feature : features)
+        {
+            result += result.empty() ? "" : ",";
+            result += (feature.second ? "+" : "-") + feature.first().str();
+        }
+
+        return result;
+    }
+
     ObjCodeWriter::ObjCodeWriter(std::string const &targetTriple,
                                  llvm::TargetOptions options,
                                  std::optional<llvm::Reloc::Model> relocationModel,
                                  std::string_view cpu,
-                                 std::string_view features)
+                                 std::string_view features,
+                                 TargetInitialization initialization)
+        : targetTriple_(targetTriple),
+          options_(std::move(options)),
+          relocationModel_(relocationModel),
+          cpu_(cpu),
+          features_(features),
+          initialization_(initialization)
+    {
+    }
+
+    llvm::TargetMachine &ObjCodeWriter::targetMachine()
     {
-        llvm::InitializeAllTargetInfos();
-        llvm::InitializeAllTargets();
-        llvm::InitializeAllTargetMCs();
-        llvm::InitializeAllAsmParsers();
-        llvm::InitializeAllAsmPrinters();
+        if (targetMachine_)
+        {
+            return *targetMachine_;
+        }
+
+        auto sameArch = llvm::Triple(targetTriple_).getArch() == llvm::Triple(llvm::sys::getProcessTriple()).getArch();
+
+        if (initialization_ == TargetInitialization::native && sameArch)
+        {
+            initializeNativeTarget();
+        }
+        else
+        {
+            initializeAllTargets();
+        }
 
         std::string errMsg;
-        auto target = llvm::TargetRegistry::lookupTarget(targetTriple, errMsg);
+        auto target = llvm::TargetRegistry::lookupTarget(targetTriple_, errMsg);
 
         if (target == nullptr)
         {
             throw std::runtime_error(errMsg);
         }
 
-        targetMachine_.reset(target->createTargetMachine(targetTriple, cpu, features, options, relocationModel));
+        targetMachine_.reset(target->createTargetMachine(targetTriple_, cpu_, features_, options_, relocationModel_));
 
         if (targetMachine_.get() == nullptr)
         {
             throw std::runtime_error("could not create target machine description");
         }
+
+        return *targetMachine_;
     }
 
     void ObjCodeWriter::writeModuleToFile(std::string_view fileName,
@@ -61,12 +124,14 @@ namespace brainfuck
     {
         llvm::legacy::PassManager passManager;
 
-        if (targetMachine_->addPassesToEmitFile(passManager, dest, nullptr, fileType))
+        auto &targetMachine = this->targetMachine();
+
+        if (targetMachine.addPassesToEmitFile(passManager, dest, nullptr, fileType))
         {
             throw std::runtime_error("Target Machine can't emit a file of this type");
         }
 
-        module.setDataLayout(targetMachine_->createDataLayout());
+        module.setDataLayout(targetMachine.createDataLayout());
         passManager.run(module);
         dest.flush();
     }
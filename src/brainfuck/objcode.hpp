@@ -9,20 +9,45 @@
 
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <string_view>
 
 namespace brainfuck
 {
+    // Which LLVM targets to register before looking up a target machine.
+    // Registering every target LLVM was built with is what makes
+    // cross-compilation work, but it is also a noticeable part of the
+    // startup time of short compiler runs.
+    enum class TargetInitialization
+    {
+        all,
+        // Only the host target. Falls back to all targets if a foreign
+        // triple is requested.
+        native
+    };
+
+    // Both are safe to call repeatedly and from several threads; the
+    // registration itself happens at most once per process.
+    void initializeNativeTarget();
+    void initializeAllTargets();
+
+    // The CPU features of the host in target feature syntax, e.g.
+    // "+avx2,-avx512f,...", for use with llvm::sys::getHostCPUName().
+    std::string hostCpuFeatures();
+
     class ObjCodeWriter
     {
     public:
+        // The target machine is only created when it is first needed.
         ObjCodeWriter(std::string const &targetTriple = llvm::sys::getDefaultTargetTriple(),
                       llvm::TargetOptions options = {},
                       std::optional<llvm::Reloc::Model> relocationModel = {},
                       std::string_view cpu = "generic",
-                      std::string_view features = "");
+                      std::string_view features = "",
+                      TargetInitialization initialization = TargetInitialization::all);
 
-        auto getDataLayout() const { return targetMachine_->createDataLayout(); }
+        auto getDataLayout() { return targetMachine().createDataLayout(); }
+        auto getTargetTriple() { return targetMachine().getTargetTriple().str(); }
 
         void writeModuleToFile(std::string_view filename,
                                llvm::Module &module,
@@ -32,7 +57,18 @@ namespace brainfuck
                                  llvm::Module &module,
                                  llvm::CodeGenFileType fileType = llvm::CGFT_ObjectFile);
 
+        // E.g. for optimizeModule, so that the optimizer's cost models know
+        // what the code will run on.
+        llvm::TargetMachine &targetMachine();
+
     private:
+        std::string targetTriple_;
+        llvm::TargetOptions options_;
+        std::optional<llvm::Reloc::Model> relocationModel_;
+        std::string cpu_;
+        std::string features_;
+        TargetInitialization initialization_;
+
         std::unique_ptr<llvm::TargetMachine> targetMachine_;
     };
 }
@@ -1,26 +1,62 @@
 #include "optimizer.hpp"
 
-#include <llvm/Passes/PassBuilder.h>
+#include <stdexcept>
 
 namespace brainfuck
 {
-    void optimizeModule(llvm::Module &module)
+    namespace
     {
-        llvm::PassBuilder builder;
+        llvm::PipelineTuningOptions tuningOptions(OptimizerSettings const &settings)
+        {
+            llvm::PipelineTuningOptions options;
+            options.LoopUnrolling = settings.loopUnrolling;
+            options.LoopVectorization = settings.loopVectorization;
+            options.SLPVectorization = settings.slpVectorization;
+            return options;
+        }
 
-        llvm::LoopAnalysisManager lam;
-        llvm::FunctionAnalysisManager fam;
-        llvm::CGSCCAnalysisManager cgam;
-        llvm::ModuleAnalysisManager mam;
+        llvm::OptimizationLevel optimizationLevel(int level)
+        {
+            switch (level)
+            {
+            case 1:
+                return llvm::OptimizationLevel::O1;
+            case 2:
+                return llvm::OptimizationLevel::O2;
+            case 3:
+                return llvm::OptimizationLevel::O3;
+            }
 
-        builder.registerModuleAnalyses(mam);
-        builder.registerCGSCCAnalyses(cgam);
-        builder.registerFunctionAnalyses(fam);
-        builder.registerLoopAnalyses(lam);
-        builder.crossRegisterProxies(lam, fam, cgam, mam);
+            throw std::invalid_argument("optimization level must be 1, 2 or 3");
+        }
+    }
 
-        llvm::ModulePassManager mpm = builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
+    ModuleOptimizer::ModuleOptimizer(OptimizerSettings const &settings, llvm::TargetMachine *targetMachine)
+        : builder_(targetMachine, tuningOptions(settings))
+    {
+        builder_.registerModuleAnalyses(mam_);
+        builder_.registerCGSCCAnalyses(cgam_);
+        builder_.registerFunctionAnalyses(fam_);
+        builder_.registerLoopAnalyses(lam_);
+        builder_.crossRegisterProxies(lam_, fam_, cgam_, mam_);
 
-        mpm.run(module, mam);
+        mpm_ = builder_.buildPerModuleDefaultPipeline(optimizationLevel(settings.level));
+    }
+
+    void ModuleOptimizer::operator()(llvm::Module &module)
+    {
+        mpm_.run(module, mam_);
+
+        // Analysis results refer to the module, which is about to go away.
+        lam_.clear();
+        fam_.clear();
+        cgam_.clear();
+        mam_.clear();
+    }
+
+    void optimizeModule(llvm::Module &module, OptimizerSettings const &settings, llvm::TargetMachine *targetMachine)
+    {
+        ModuleOptimizer optimizer(settings, targetMachine);
+        optimizer(module);
     }
-}
\ No newline at end of file
+}
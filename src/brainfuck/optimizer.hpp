@@ -2,10 +2,52 @@
 #define INCLUDED_LLVM_BRAINFUCK_OPTIMIZER_HPP
 
 #include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Target/TargetMachine.h>
 
 namespace brainfuck
 {
-    void optimizeModule(llvm::Module &module);
+    // The defaults are LLVM's own defaults for the O2 pipeline.
+    struct OptimizerSettings
+    {
+        // 1 to 3, as in -O1 to -O3.
+        int level = 2;
+        bool loopUnrolling = true;
+        bool loopVectorization = true;
+        bool slpVectorization = false;
+
+        bool operator==(OptimizerSettings const &) const = default;
+    };
+
+    // The optimization pipeline, built once for optimizing many modules in
+    // a row, e.g. in a server. Not thread-safe; use one per thread.
+    //
+    // Without a target machine, the cost models know nothing about the
+    // target and hardly vectorize. With one, they use its CPU, or the
+    // target-cpu attribute of the function at hand. The target machine
+    // must not be in use by other threads meanwhile.
+    class ModuleOptimizer
+    {
+    public:
+        explicit ModuleOptimizer(OptimizerSettings const &settings = {}, llvm::TargetMachine *targetMachine = nullptr);
+        ModuleOptimizer(ModuleOptimizer const &) = delete;
+        ModuleOptimizer &operator=(ModuleOptimizer const &) = delete;
+
+        void operator()(llvm::Module &module);
+
+    private:
+        llvm::PassBuilder builder_;
+
+        llvm::LoopAnalysisManager lam_;
+        llvm::FunctionAnalysisManager fam_;
+        llvm::CGSCCAnalysisManager cgam_;
+        llvm::ModuleAnalysisManager mam_;
+
+        llvm::ModulePassManager mpm_;
+    };
+
+    void optimizeModule(llvm::Module &module, OptimizerSettings const &settings = {}, llvm::TargetMachine *targetMachine = nullptr);
 }
 
 #endif
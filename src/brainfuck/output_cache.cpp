@@ -0,0 +1,353 @@
+#include "output_cache.hpp"
+#include "codegen.hpp"
+
+#include <llvm/Support/xxhash.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace brainfuck
+{
+    namespace
+    {
+        std::atomic<unsigned> tempFileCounter = 0;
+
+        // Roughly, with the list node and the index entry, so that empty
+        // outputs are not free.
+        std::size_t memoryCost(CachedOutput const &output)
+        {
+            return output.output.size() + 64;
+        }
+    }
+
+    std::size_t OutputCache::KeyHash::operator()(Key const &key) const
+    {
+        return key.programHash ^ (key.inputHash * 0x9e3779b97f4a7c15ull) ^ key.inputSize;
+    }
+
+    OutputCache::OutputCache(std::size_t memoryBytes, std::size_t maxEntryBytes, std::filesystem::path diskDirectory,
+                             std::uintmax_t diskBytes)
+        : memoryBytes_(memoryBytes),
+          maxEntryBytes_(maxEntryBytes),
+          diskDirectory_(std::move(diskDirectory)),
+          diskBytes_(diskBytes)
+    {
+        if (!diskDirectory_.empty())
+        {
+            std::filesystem::create_directories(diskDirectory_);
+            trimDisk();
+        }
+    }
+
+    std::optional<CachedOutput> OutputCache::find(std::uint64_t programHash, std::string_view input)
+    {
+        auto key = makeKey(programHash, input);
+
+        {
+            std::lock_guard lock(mutex_);
+
+            if (auto found = index_.find(key); found != index_.end())
+            {
+                entries_.splice(entries_.begin(), entries_, found->second);
+                ++statistics_.memoryHits;
+                return found->second->value;
+            }
+        }
+
+        // The disk is read without holding the lock, so that other threads
+        // can use the memory cache meanwhile.
+        auto output = diskDirectory_.empty() ? std::nullopt : readDisk(key);
+
+        std::lock_guard lock(mutex_);
+
+        if (output)
+        {
+            ++statistics_.diskHits;
+            insertMemory(key, *output);
+        }
+        else
+        {
+            ++statistics_.misses;
+        }
+
+        return output;
+    }
+
+    void OutputCache::store(std::uint64_t programHash, std::string_view input, CachedOutput const &output)
+    {
+        if (output.output.size() > maxEntryBytes_)
+        {
+            std::lock_guard lock(mutex_);
+            ++statistics_.oversized;
+            return;
+        }
+
+        auto key = makeKey(programHash, input);
+        std::uintmax_t written = 0;
+        bool diskError = false;
+
+        if (!diskDirectory_.empty())
+        {
+            // The disk only backs the memory cache, so a full or read-only
+            // disk must not fail the run that produced the output.
+            try
+            {
+                written = writeDisk(key, output);
+            }
+            catch (std::runtime_error const &)
+            {
+                diskError = true;
+            }
+        }
+
+        bool overBudget;
+        {
+            std::lock_guard lock(mutex_);
+            ++statistics_.stores;
+            statistics_.diskErrors += diskError;
+            statistics_.diskBytes += written;
+            overBudget = statistics_.diskBytes > diskBytes_;
+            insertMemory(key, output);
+        }
+
+        if (overBudget)
+        {
+            trimDisk();
+        }
+    }
+
+    CachedOutput OutputCache::getOrRun(std::uint64_t programHash, std::string_view input,
+                                       std::function<CachedOutput(std::string_view)> const &run)
+    {
+        if (auto cached = find(programHash, input))
+        {
+            return std::move(*cached);
+        }
+
+        auto output = run(input);
+        store(programHash, input, output);
+        return output;
+    }
+
+    OutputCacheStatistics OutputCache::statistics() const
+    {
+        std::lock_guard lock(mutex_);
+        return statistics_;
+    }
+
+    OutputCache::Key OutputCache::makeKey(std::uint64_t programHash, std::string_view input)
+    {
+        return {programHash, llvm::xxHash64(llvm::StringRef(input.data(), input.size())), input.size()};
+    }
+
+    std::filesystem::path OutputCache::diskPath(Key const &key) const
+    {
+        char name[64];
+        std::snprintf(name, sizeof name, "v%d-%016llx-%016llx-%llx.out", CODEGEN_VERSION,
+                      static_cast<unsigned long long>(key.programHash),
+                      static_cast<unsigned long long>(key.inputHash),
+                      static_cast<unsigned long long>(key.inputSize));
+        return diskDirectory_ / name;
+    }
+
+    // Entries are stored as the status in host byte order, followed by the
+    // output.
+    std::optional<CachedOutput> OutputCache::readDisk(Key const &key) const
+    {
+        auto path = diskPath(key);
+        std::ifstream in(path, std::ios::binary);
+        std::int32_t status;
+
+        if (!in || !in.read(reinterpret_cast<char *>(&status), sizeof status))
+        {
+            return std::nullopt;
+        }
+
+        // Marks the entry as used for trimDisk. Should that fail, it is
+        // only evicted sooner.
+        std::error_code error;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+        return CachedOutput{status, std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>())};
+    }
+
+    std::uintmax_t OutputCache::writeDisk(Key const &key, CachedOutput const &output) const
+    {
+        auto path = diskPath(key);
+
+        // Written under a temporary name first, so that concurrent writers
+        // and readers never see a truncated entry.
+        auto tempPath = path;
+        tempPath += "." + std::to_string(getpid()) + "." + std::to_string(tempFileCounter++) + ".tmp";
+
+        try
+        {
+            {
+                std::ofstream out(tempPath, std::ios::binary);
+                std::int32_t status = output.status;
+
+                if (!out.write(reinterpret_cast<char const *>(&status), sizeof status) ||
+                    !out.write(output.output.data(), output.output.size()) || !out.flush())
+                {
+                    throw std::runtime_error("could not write " + tempPath.string());
+                }
+            }
+
+            std::filesystem::rename(tempPath, path);
+        }
+        catch (...)
+        {
+            std::error_code error;
+            std::filesystem::remove(tempPath, error);
+            throw;
+        }
+
+        return sizeof(std::int32_t) + output.output.size();
+    }
+
+    void OutputCache::trimDisk()
+    {
+        std::lock_guard diskLock(diskMutex_);
+
+        struct EntryFile
+        {
+            std::filesystem::path path;
+            std::uintmax_t size;
+            std::filesystem::file_time_type lastUsed;
+        };
+
+        std::vector<EntryFile> files;
+        std::uintmax_t total = 0;
+
+        // Other processes may add and remove entries meanwhile; files that
+        // vanish are skipped.
+        std::error_code error;
+        for (std::filesystem::directory_iterator it(diskDirectory_, error), end; !error && it != end; it.increment(error))
+        {
+            if (it->path().extension() != ".out")
+            {
+                continue;
+            }
+
+            std::error_code sizeError;
+            std::error_code timeError;
+            auto size = it->file_size(sizeError);
+            auto lastUsed = it->last_write_time(timeError);
+
+            if (!sizeError && !timeError)
+            {
+                files.push_back({it->path(), size, lastUsed});
+                total += size;
+            }
+        }
+
+        std::uint64_t evicted = 0;
+
+        if (total > diskBytes_)
+        {
+            std::sort(files.begin(), files.end(), [](EntryFile const &a, EntryFile const &b)
+                      { return a.lastUsed < b.lastUsed; });
+
+            for (auto const &file : files)
+            {
+                if (total <= diskBytes_ / 4 * 3)
+                {
+                    break;
+                }
+
+                if (std::filesystem::remove(file.path, error))
+                {
+                    total -= file.size;
+                    ++evicted;
+                }
+            }
+        }
+
+        std::lock_guard lock(mutex_);
+        statistics_.diskBytes = total;
+        statistics_.diskEvictions += evicted;
+    }
+
+    void OutputCache::insertMemory(Key const &key, CachedOutput output)
+    {
+        if (auto found = index_.find(key); found != index_.end())
+        {
+            statistics_.memoryBytes -= memoryCost(found->second->value);
+            entries_.erase(found->second);
+            index_.erase(found);
+        }
+
+        auto cost = memoryCost(output);
+
+        if (cost > memoryBytes_)
+        {
+            return;
+        }
+
+        while (statistics_.memoryBytes + cost > memoryBytes_)
+        {
+            auto &oldest = entries_.back();
+            statistics_.memoryBytes -= memoryCost(oldest.value);
+            index_.erase(oldest.key);
+            entries_.pop_back();
+            ++statistics_.evictions;
+        }
+
+        statistics_.memoryBytes += cost;
+        entries_.push_front({key, std::move(output)});
+        index_.emplace(key, entries_.begin());
+    }
+
+    CachedOutput runCached(OutputCache *cache, std::uint64_t programHash, int (*entry)(std::uint8_t *tape),
+                           std::string_view input)
+    {
+        auto run = [entry](std::string_view programInput)
+        {
+            std::vector<std::uint8_t> tape(BRAINFUCK_MEMSIZE);
+            BufferIo io(programInput);
+            ScopedProgramIo binding(io);
+
+            auto status = entry(tape.data());
+            return CachedOutput{status, io.takeOutput()};
+        };
+
+        return cache ? cache->getOrRun(programHash, input, run) : run(input);
+    }
+
+    CachedOutput runCached(OutputCache *cache, std::uint64_t programHash, int (*entry)(RuntimeContext *context),
+                           std::string_view input)
+    {
+        auto run = [entry](std::string_view programInput)
+        {
+            BufferIo io(programInput);
+
+            RuntimeContext context;
+            context.user = &io;
+            context.putchar = [](void *user, int c)
+            {
+                static_cast<BufferIo *>(user)->write(c);
+                return c;
+            };
+            context.getchar = [](void *user)
+            { return static_cast<BufferIo *>(user)->read(); };
+
+            auto status = entry(&context);
+            return CachedOutput{status, io.takeOutput()};
+        };
+
+        return cache ? cache->getOrRun(programHash, input, run) : run(input);
+    }
+
+    CachedOutput runCached(OutputCache *cache, LibraryEntry const &program, std::string_view input)
+    {
+        return runCached(cache, program.hash, program.run, input);
+    }
+}
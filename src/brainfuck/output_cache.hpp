@@ -0,0 +1,167 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_OUTPUT_CACHE_HPP
+#define INCLUDED_LLVM_BRAINFUCK_OUTPUT_CACHE_HPP
+
+#include "runtime.hpp"
+#include "static_program.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace brainfuck
+{
+    struct CachedOutput
+    {
+        int status;
+        std::string output;
+    };
+
+    struct OutputCacheStatistics
+    {
+        std::uint64_t memoryHits = 0;
+        std::uint64_t diskHits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t stores = 0;
+        // Outputs over the maximum entry size, which are never stored.
+        std::uint64_t oversized = 0;
+        // Entries dropped from memory to make room; they stay on disk.
+        std::uint64_t evictions = 0;
+        // Entries removed from disk to stay within its budget.
+        std::uint64_t diskEvictions = 0;
+        // Entries that could not be written to disk. They are still kept
+        // in memory.
+        std::uint64_t diskErrors = 0;
+        // Outputs in memory, plus a fixed overhead per entry.
+        std::size_t memoryBytes = 0;
+        // Entry files in the disk directory, including those of other
+        // processes as of the last time it was scanned.
+        std::uintmax_t diskBytes = 0;
+    };
+
+    // Outputs of deterministic programs by program and input, for running
+    // programs that only depend on their input without running them again.
+    // That holds for every program as far as the program itself goes,
+    // since getchar and putchar are its only side effects; whether the
+    // host's I/O is a pure function of the input is up to the caller.
+    //
+    // Entries are keyed by the structural hash of the program and a hash
+    // of the whole input. Memory holds up to memoryBytes of entries and
+    // drops the least recently used ones first; with a disk directory,
+    // every entry is also written there, so that it survives eviction and
+    // the process. Outputs over maxEntryBytes are not cached at all.
+    //
+    // The directory may be shared by several processes. Its file names
+    // carry CODEGEN_VERSION, so that a newer compiler never picks up the
+    // outputs of an older one. Once the entries in it exceed diskBytes,
+    // the least recently used ones are removed until it is down to three
+    // quarters of that, so that a full directory is not scanned again on
+    // every store. Failing to write an entry is counted, not thrown.
+    // Thread-safe.
+    class OutputCache
+    {
+    public:
+        explicit OutputCache(std::size_t memoryBytes = 64 << 20,
+                             std::size_t maxEntryBytes = 1 << 20,
+                             std::filesystem::path diskDirectory = {},
+                             std::uintmax_t diskBytes = std::uintmax_t(1) << 30);
+        OutputCache(OutputCache const &) = delete;
+        OutputCache &operator=(OutputCache const &) = delete;
+
+        std::optional<CachedOutput> find(std::uint64_t programHash, std::string_view input);
+        void store(std::uint64_t programHash, std::string_view input, CachedOutput const &output);
+
+        // The cached output for program and input, or the one run returns
+        // for input, which is then stored.
+        CachedOutput getOrRun(std::uint64_t programHash, std::string_view input,
+                              std::function<CachedOutput(std::string_view)> const &run);
+
+        OutputCacheStatistics statistics() const;
+
+    private:
+        struct Key
+        {
+            std::uint64_t programHash;
+            std::uint64_t inputHash;
+            std::size_t inputSize;
+
+            bool operator==(Key const &) const = default;
+        };
+
+        struct KeyHash
+        {
+            std::size_t operator()(Key const &key) const;
+        };
+
+        struct Entry
+        {
+            Key key;
+            CachedOutput value;
+        };
+
+        static Key makeKey(std::uint64_t programHash, std::string_view input);
+        std::filesystem::path diskPath(Key const &key) const;
+        std::optional<CachedOutput> readDisk(Key const &key) const;
+        // Returns the size of the entry file.
+        std::uintmax_t writeDisk(Key const &key, CachedOutput const &output) const;
+        // Brings the directory back within diskBytes_ and recounts it.
+        void trimDisk();
+        // Expects mutex_ to be held.
+        void insertMemory(Key const &key, CachedOutput output);
+
+        std::size_t memoryBytes_;
+        std::size_t maxEntryBytes_;
+        std::filesystem::path diskDirectory_;
+        std::uintmax_t diskBytes_;
+
+        // Held while trimming, so that only one thread scans the directory.
+        std::mutex diskMutex_;
+        mutable std::mutex mutex_;
+        // Most recently used first.
+        std::list<Entry> entries_;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+        OutputCacheStatistics statistics_;
+    };
+
+    // Runs a program compiled with EntryPoint::tapeArgument, such as
+    // JitEngine::lookupTapeEntry returns, on a fresh tape with input,
+    // through cache unless it is null.
+    CachedOutput runCached(OutputCache *cache, std::uint64_t programHash, int (*entry)(std::uint8_t *tape),
+                           std::string_view input);
+    // The same for EntryPoint::context, as in libraries.
+    CachedOutput runCached(OutputCache *cache, std::uint64_t programHash, int (*entry)(RuntimeContext *context),
+                           std::string_view input);
+    CachedOutput runCached(OutputCache *cache, LibraryEntry const &program, std::string_view input);
+
+    // The same for programs embedded with static_program.hpp, keyed by
+    // staticProgramHash.
+    template <StaticSource source>
+    CachedOutput runStaticCached(OutputCache *cache, std::string_view input)
+    {
+        auto run = [](std::string_view programInput)
+        {
+            std::vector<std::uint8_t> tape(BRAINFUCK_STATIC_MEMSIZE);
+            std::string output;
+            std::size_t read = 0;
+
+            runStatic<source>(
+                tape.data(), [&](std::uint8_t c)
+                { output += static_cast<char>(c); },
+                [&]() -> int
+                { return read < programInput.size() ? static_cast<unsigned char>(programInput[read++]) : EOF; });
+
+            return CachedOutput{0, std::move(output)};
+        };
+
+        return cache ? cache->getOrRun(staticProgramHash<source>, input, run) : run(input);
+    }
+}
+
+#endif
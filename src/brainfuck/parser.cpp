@@ -6,87 +6,78 @@
 
 namespace brainfuck
 {
-    namespace
+    ParseError::ParseError(SourceLocation loc, std::string_view errMsg)
+        : runtime_error((std::ostringstream{} << loc << " " << errMsg).str())
     {
-        void expectToken(Lexer &lexer, Token expected, std::string_view errMsg)
-        {
-            if (lexer.currentToken() != expected)
-            {
-                throw ParseError(lexer.currentLocation(), errMsg);
-            }
-
-            lexer.advance();
-        }
-
-        std::vector<AST> parseLoopBody(Lexer &lexer);
+    }
 
-        LoopAST parseLoop(Lexer &lexer)
+    std::vector<AST> parse(Lexer &lexer)
+    {
+        // Loops that have been opened but not closed yet, innermost last.
+        // Keeping them on an explicit stack rather than parsing loops
+        // recursively means the nesting depth is only limited by memory.
+        struct OpenLoop
         {
-            SourceLocation loopStart = lexer.currentLocation();
-
-            expectToken(lexer, Token::loop_start, "Expected [ at start of loop");
-
-            auto loopBody = parseLoopBody(lexer);
+            SourceLocation start;
+            std::vector<AST> body;
+        };
 
-            if (lexer.currentToken() != Token::loop_end)
-            {
-                throw ParseError(lexer.currentLocation(), "Expected ] at end of loop");
-            }
+        std::vector<AST> mainProgram;
+        std::vector<OpenLoop> openLoops;
 
-            return {loopStart, std::move(loopBody)};
-        }
-
-        std::vector<AST> parseLoopBody(Lexer &lexer)
+        while (lexer.currentToken() != Token::end_of_file)
         {
-            std::vector<AST> body;
+            auto &body = openLoops.empty() ? mainProgram : openLoops.back().body;
 
-            while (lexer.currentToken() != Token::end_of_file && lexer.currentToken() != Token::loop_end)
+            switch (lexer.currentToken())
+            {
+            case Token::right:
+                body.emplace_back(RightAST(lexer.currentLocation()));
+                break;
+            case Token::left:
+                body.emplace_back(LeftAST(lexer.currentLocation()));
+                break;
+            case Token::incr:
+                body.emplace_back(IncrAST(lexer.currentLocation()));
+                break;
+            case Token::decr:
+                body.emplace_back(DecrAST(lexer.currentLocation()));
+                break;
+            case Token::write:
+                body.emplace_back(WriteAST(lexer.currentLocation()));
+                break;
+            case Token::read:
+                body.emplace_back(ReadAST(lexer.currentLocation()));
+                break;
+            case Token::loop_start:
+                openLoops.push_back({lexer.currentLocation(), {}});
+                break;
+            case Token::loop_end:
             {
-                switch (lexer.currentToken())
+                if (openLoops.empty())
                 {
-                case Token::right:
-                    body.emplace_back(RightAST(lexer.currentLocation()));
-                    break;
-                case Token::left:
-                    body.emplace_back(LeftAST(lexer.currentLocation()));
-                    break;
-                case Token::incr:
-                    body.emplace_back(IncrAST(lexer.currentLocation()));
-                    break;
-                case Token::decr:
-                    body.emplace_back(DecrAST(lexer.currentLocation()));
-                    break;
-                case Token::write:
-                    body.emplace_back(WriteAST(lexer.currentLocation()));
-                    break;
-                case Token::read:
-                    body.emplace_back(ReadAST(lexer.currentLocation()));
-                    break;
-                case Token::loop_start:
-                    body.emplace_back(parseLoop(lexer));
-                    break;
-                default:
-                    // Purely defensive programming; this should be impossible to reach
-                    throw ParseError(lexer.currentLocation(), "unexpected token in loop body: " + to_string(lexer.currentToken()));
+                    throw ParseError(lexer.currentLocation(), "unmatched ]");
                 }
 
-                lexer.advance();
+                auto loop = std::move(openLoops.back());
+                openLoops.pop_back();
+
+                auto &parentBody = openLoops.empty() ? mainProgram : openLoops.back().body;
+                parentBody.emplace_back(LoopAST(loop.start, std::move(loop.body)));
+                break;
+            }
+            default:
+                // Purely defensive programming; this should be impossible to reach
+                throw ParseError(lexer.currentLocation(), "unexpected token in loop body: " + to_string(lexer.currentToken()));
             }
 
-            return body;
+            lexer.advance();
         }
-    }
 
-    ParseError::ParseError(SourceLocation loc, std::string_view errMsg)
-        : runtime_error((std::ostringstream{} << loc << " " << errMsg).str())
-    {
-    }
-
-    std::vector<AST> parse(Lexer &lexer)
-    {
-        std::vector<AST> mainProgram = parseLoopBody(lexer);
-
-        expectToken(lexer, Token::end_of_file, "unmatched ]");
+        if (!openLoops.empty())
+        {
+            throw ParseError(lexer.currentLocation(), "Expected ] at end of loop");
+        }
 
         return mainProgram;
     }
@@ -0,0 +1,247 @@
+#include "pipeline.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace brainfuck
+{
+    namespace
+    {
+        // Rounds of re-checking before blocking; enough to ride out the
+        // other side being busy for a moment without a futex call.
+        int const SPIN_LIMIT = 1024;
+
+        void cpuRelax()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+
+        // Connects a stage to its neighbours. The first and last stage use
+        // the pipeline's ProgramIo on one side instead of a ring.
+        class StageIo : public ProgramIo
+        {
+        public:
+            StageIo(ProgramIo &input, ProgramIo &output, ByteRing *inRing, ByteRing *outRing)
+                : input_(input),
+                  output_(output),
+                  inRing_(inRing),
+                  outRing_(outRing)
+            {
+            }
+
+            int read() override
+            {
+                return inRing_ ? inRing_->pop() : input_.read();
+            }
+
+            void write(int c) override
+            {
+                if (outRing_)
+                {
+                    outRing_->push(static_cast<std::uint8_t>(c));
+                }
+                else
+                {
+                    output_.write(c);
+                }
+            }
+
+        private:
+            ProgramIo &input_;
+            ProgramIo &output_;
+            ByteRing *inRing_;
+            ByteRing *outRing_;
+        };
+    }
+
+    ByteRing::ByteRing(std::size_t capacity)
+        : buffer_(std::bit_ceil(std::max<std::size_t>(capacity, 1))),
+          mask_(buffer_.size() - 1)
+    {
+    }
+
+    void ByteRing::push(std::uint8_t byte)
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+
+        if (tail - producerHead_ == buffer_.size())
+        {
+            for (int spins = 0;; ++spins)
+            {
+                auto head = head_.load(std::memory_order_acquire);
+
+                if (head & CLOSED)
+                {
+                    return;
+                }
+
+                producerHead_ = head;
+
+                if (tail - head < buffer_.size())
+                {
+                    break;
+                }
+
+                if (spins < SPIN_LIMIT)
+                {
+                    cpuRelax();
+                }
+                else
+                {
+                    head_.wait(head, std::memory_order_acquire);
+                }
+            }
+        }
+
+        buffer_[tail & mask_] = byte;
+        tail_.store(tail + 1, std::memory_order_release);
+        tail_.notify_one();
+    }
+
+    void ByteRing::closeWriting()
+    {
+        tail_.fetch_or(CLOSED, std::memory_order_release);
+        tail_.notify_all();
+    }
+
+    int ByteRing::pop()
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+
+        if (head == consumerTail_)
+        {
+            for (int spins = 0;; ++spins)
+            {
+                auto tail = tail_.load(std::memory_order_acquire);
+                consumerTail_ = tail & ~CLOSED;
+
+                if (consumerTail_ != head)
+                {
+                    break;
+                }
+
+                if (tail & CLOSED)
+                {
+                    return EOF;
+                }
+
+                if (spins < SPIN_LIMIT)
+                {
+                    cpuRelax();
+                }
+                else
+                {
+                    tail_.wait(tail, std::memory_order_acquire);
+                }
+            }
+        }
+
+        auto byte = buffer_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        head_.notify_one();
+
+        return byte;
+    }
+
+    void ByteRing::closeReading()
+    {
+        head_.fetch_or(CLOSED, std::memory_order_release);
+        head_.notify_all();
+    }
+
+    Pipeline::Pipeline(std::vector<std::vector<AST>> const &stages, std::size_t ringCapacity)
+        : ringCapacity_(ringCapacity)
+    {
+        if (stages.empty())
+        {
+            throw std::invalid_argument("a pipeline needs at least one stage");
+        }
+
+        for (std::size_t i = 0; i < stages.size(); ++i)
+        {
+            CodeGenOptions options;
+            options.entryPoint = EntryPoint::tapeArgument;
+            options.entryName = "brainfuck_stage_" + std::to_string(i);
+
+            CodeGenerator codegen(jit_.getDataLayout(), {}, DebugInfoLevel::none, options);
+            codegen(stages[i]);
+
+            auto tsModule = codegen.finalizeModule();
+            optimizeModule(*tsModule.getModuleUnlocked(), {}, &jit_.targetMachine());
+
+            jit_.addModule(std::move(tsModule));
+            entries_.push_back(jit_.lookupTapeEntry(options.entryName));
+        }
+    }
+
+    std::vector<int> Pipeline::run(ProgramIo &input, ProgramIo &output)
+    {
+        auto stageCount = entries_.size();
+
+        std::vector<std::unique_ptr<ByteRing>> rings;
+        for (std::size_t i = 0; i + 1 < stageCount; ++i)
+        {
+            rings.push_back(std::make_unique<ByteRing>(ringCapacity_));
+        }
+
+        std::vector<int> statuses(stageCount);
+        std::vector<std::exception_ptr> errors(stageCount);
+        std::vector<std::thread> threads;
+
+        for (std::size_t i = 0; i < stageCount; ++i)
+        {
+            threads.emplace_back([&, i]
+                                 {
+                                     auto inRing = i > 0 ? rings[i - 1].get() : nullptr;
+                                     auto outRing = i + 1 < stageCount ? rings[i].get() : nullptr;
+
+                                     try
+                                     {
+                                         StageIo io(input, output, inRing, outRing);
+                                         ScopedProgramIo binding(io);
+
+                                         std::vector<std::uint8_t> tape(BRAINFUCK_MEMSIZE);
+                                         statuses[i] = entries_[i](tape.data());
+                                     }
+                                     catch (...)
+                                     {
+                                         errors[i] = std::current_exception();
+                                     }
+
+                                     if (inRing)
+                                     {
+                                         inRing->closeReading();
+                                     }
+
+                                     if (outRing)
+                                     {
+                                         outRing->closeWriting();
+                                     } });
+        }
+
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+
+        for (auto const &error : errors)
+        {
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+
+        return statuses;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_PIPELINE_HPP
+#define INCLUDED_LLVM_BRAINFUCK_PIPELINE_HPP
+
+#include "ast.hpp"
+#include "jit.hpp"
+#include "runtime.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace brainfuck
+{
+    // Lock-free single-producer/single-consumer byte queue. Both sides spin
+    // briefly when the ring is full or empty and then block on the other
+    // side's index, so idle stages do not burn a core.
+    class ByteRing
+    {
+    public:
+        // The capacity is rounded up to a power of two.
+        explicit ByteRing(std::size_t capacity = 1 << 16);
+        ByteRing(ByteRing const &) = delete;
+        ByteRing &operator=(ByteRing const &) = delete;
+
+        // Producer side. Once the consumer has closed its end, pushed bytes
+        // are dropped instead of blocking forever.
+        void push(std::uint8_t byte);
+        void closeWriting();
+
+        // Consumer side. Returns EOF once the producer has closed its end
+        // and everything it pushed has been read.
+        int pop();
+        void closeReading();
+
+        auto capacity() const { return buffer_.size(); }
+
+    private:
+        // Set in an index when its owner has closed its end. Counts never
+        // get anywhere near it.
+        static constexpr std::size_t CLOSED = std::size_t{1} << 63;
+        static constexpr std::size_t CACHE_LINE = 64;
+
+        // Next byte to read, written by the consumer only, and next slot to
+        // write, written by the producer only. Each side keeps its last view
+        // of the other side's index to touch the shared line only when the
+        // ring looks full or empty.
+        alignas(CACHE_LINE) std::atomic<std::size_t> head_ = 0;
+        alignas(CACHE_LINE) std::atomic<std::size_t> tail_ = 0;
+        alignas(CACHE_LINE) std::size_t producerHead_ = 0;
+        alignas(CACHE_LINE) std::size_t consumerTail_ = 0;
+
+        std::vector<std::uint8_t> buffer_;
+        std::size_t mask_;
+    };
+
+    // Several programs compiled into one process and connected like a shell
+    // pipeline: every stage runs on a thread of its own, and the output of
+    // each stage is the input of the next one, passed through a ByteRing
+    // instead of a kernel pipe.
+    class Pipeline
+    {
+    public:
+        Pipeline(std::vector<std::vector<AST>> const &stages, std::size_t ringCapacity = 1 << 16);
+
+        // The first stage reads from input, the last one writes to output.
+        // A stage that finishes closes the rings on both of its sides, so
+        // its neighbours see EOF or have further output dropped. Unlike
+        // with SIGPIPE, a stage whose consumer is gone still runs to its
+        // end. Returns the exit status of every stage.
+        std::vector<int> run(ProgramIo &input, ProgramIo &output);
+
+    private:
+        JitEngine jit_;
+        std::vector<JitEngine::TapeEntryFunction> entries_;
+        std::size_t ringCapacity_;
+    };
+}
+
+#endif
@@ -0,0 +1,134 @@
+#include "remarks.hpp"
+
+#include <llvm/IR/DiagnosticInfo.h>
+
+#include <iomanip>
+
+namespace brainfuck
+{
+    namespace
+    {
+        class RemarkHandler : public llvm::DiagnosticHandler
+        {
+        public:
+            RemarkHandler(RemarkCollector &collector) : collector_(collector) {}
+
+            bool isAnalysisRemarkEnabled(llvm::StringRef) const override { return true; }
+            bool isMissedOptRemarkEnabled(llvm::StringRef) const override { return true; }
+            bool isPassedOptRemarkEnabled(llvm::StringRef) const override { return true; }
+            bool isAnyRemarkEnabled() const override { return true; }
+
+            bool handleDiagnostics(llvm::DiagnosticInfo const &info) override
+            {
+                auto optimization = llvm::dyn_cast<llvm::DiagnosticInfoOptimizationBase>(&info);
+
+                if (optimization == nullptr)
+                {
+                    return false;
+                }
+
+                Remark remark;
+                remark.kind = optimization->isPassed()   ? Remark::Kind::passed
+                              : optimization->isMissed() ? Remark::Kind::missed
+                                                         : Remark::Kind::analysis;
+                remark.pass = optimization->getPassName().str();
+                remark.name = optimization->getRemarkName().str();
+                remark.message = optimization->getMsg();
+
+                // Debug locations are the line and column of the AST node
+                // the instruction was generated for.
+                if (auto location = optimization->getLocation(); location.isValid())
+                {
+                    remark.location = SourceLocation(location.getLine(), location.getColumn());
+                }
+
+                collector_.add(std::move(remark));
+                return true;
+            }
+
+        private:
+            RemarkCollector &collector_;
+        };
+
+        char const *kindName(Remark::Kind kind)
+        {
+            switch (kind)
+            {
+            case Remark::Kind::passed:
+                return "passed";
+            case Remark::Kind::missed:
+                return "missed";
+            case Remark::Kind::analysis:
+                return "analysis";
+            }
+
+            return "unknown";
+        }
+
+        void writeJsonString(std::ostream &out, std::string const &text)
+        {
+            out << '"';
+
+            for (unsigned char c : text)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    out << '\\' << c;
+                }
+                else if (c < 0x20)
+                {
+                    out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+                }
+                else
+                {
+                    out << c;
+                }
+            }
+
+            out << '"';
+        }
+    }
+
+    void RemarkCollector::add(Remark remark)
+    {
+        remarks_.push_back(std::move(remark));
+    }
+
+    ScopedLlvmRemarks::ScopedLlvmRemarks(llvm::LLVMContext &context, RemarkCollector &collector)
+        : context_(context),
+          previous_(context.getDiagnosticHandler())
+    {
+        context_.setDiagnosticHandler(std::make_unique<RemarkHandler>(collector));
+    }
+
+    ScopedLlvmRemarks::~ScopedLlvmRemarks()
+    {
+        context_.setDiagnosticHandler(std::move(previous_));
+    }
+
+    void RemarkCollector::writeJson(std::ostream &out) const
+    {
+        out << "[\n";
+
+        for (std::size_t i = 0; i < remarks_.size(); ++i)
+        {
+            auto const &remark = remarks_[i];
+
+            out << "  {\"kind\": \"" << kindName(remark.kind) << "\", \"pass\": ";
+            writeJsonString(out, remark.pass);
+            out << ", \"name\": ";
+            writeJsonString(out, remark.name);
+
+            if (remark.location)
+            {
+                out << ", \"line\": " << remark.location->line() << ", \"column\": " << remark.location->column();
+            }
+
+            out << ", \"message\": ";
+            writeJsonString(out, remark.message);
+            out << (i + 1 < remarks_.size() ? "},\n" : "}\n");
+        }
+
+        out << "]\n";
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_REMARKS_HPP
+#define INCLUDED_LLVM_BRAINFUCK_REMARKS_HPP
+
+#include "source_location.hpp"
+
+#include <llvm/IR/DiagnosticHandler.h>
+#include <llvm/IR/LLVMContext.h>
+
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace brainfuck
+{
+    // One transformation that was applied to a program, or that was
+    // considered and not applied, either by our own AST passes or by LLVM.
+    struct Remark
+    {
+        enum class Kind
+        {
+            passed,
+            missed,
+            analysis
+        };
+
+        Kind kind;
+        // The pass, e.g. constant-propagation or loop-vectorize, and what
+        // it did, e.g. ClearLoop or Vectorized.
+        std::string pass;
+        std::string name;
+        std::string message;
+        // Where in the brainfuck source the remark applies. LLVM remarks
+        // only have one if the module was generated with debug info.
+        std::optional<SourceLocation> location;
+    };
+
+    // Collects remarks from all stages of a compilation. Not thread-safe.
+    class RemarkCollector
+    {
+    public:
+        void add(Remark remark);
+
+        auto const &remarks() const { return remarks_; }
+
+        // Writes all remarks as a JSON array of objects with kind, pass,
+        // name, message and, if known, line and column.
+        void writeJson(std::ostream &out) const;
+
+    private:
+        std::vector<Remark> remarks_;
+    };
+
+    // Routes LLVM's optimization remarks for everything in the context to
+    // a collector for the lifetime of the object. Other diagnostics go to
+    // the previous handler.
+    class ScopedLlvmRemarks
+    {
+    public:
+        ScopedLlvmRemarks(llvm::LLVMContext &context, RemarkCollector &collector);
+        ScopedLlvmRemarks(ScopedLlvmRemarks const &) = delete;
+        ScopedLlvmRemarks &operator=(ScopedLlvmRemarks const &) = delete;
+        ~ScopedLlvmRemarks();
+
+    private:
+        llvm::LLVMContext &context_;
+        std::unique_ptr<llvm::DiagnosticHandler> previous_;
+    };
+}
+
+#endif
@@ -0,0 +1,178 @@
+#include "runtime.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <utility>
+
+namespace brainfuck
+{
+    namespace
+    {
+        thread_local ProgramIo *currentIo = nullptr;
+        thread_local ScopedFuel *currentFuel = nullptr;
+        thread_local TapeProfile *currentTapeProfile = nullptr;
+
+        void countAccess(std::vector<std::uint64_t> &counts, std::int64_t position)
+        {
+            if (position >= 0 && static_cast<std::uint64_t>(position) < counts.size())
+            {
+                ++counts[position];
+            }
+            else
+            {
+                ++currentTapeProfile->outsideAccesses;
+            }
+        }
+    }
+
+    BufferIo::BufferIo(std::string_view input)
+        : input_(input)
+    {
+    }
+
+    void BufferIo::reset(std::string_view input)
+    {
+        input_ = input;
+        output_.clear();
+    }
+
+    int BufferIo::read()
+    {
+        if (input_.empty())
+        {
+            return EOF;
+        }
+
+        unsigned char c = input_.front();
+        input_.remove_prefix(1);
+        return c;
+    }
+
+    void BufferIo::write(int c)
+    {
+        output_.push_back(static_cast<char>(c));
+    }
+
+    std::string BufferIo::takeOutput()
+    {
+        return std::move(output_);
+    }
+
+    int StandardIo::read()
+    {
+        return std::getchar();
+    }
+
+    void StandardIo::write(int c)
+    {
+        std::putchar(c);
+    }
+
+    ScopedProgramIo::ScopedProgramIo(ProgramIo &io)
+        : previous_(currentIo)
+    {
+        currentIo = &io;
+    }
+
+    ScopedProgramIo::~ScopedProgramIo()
+    {
+        currentIo = previous_;
+    }
+
+    ScopedFuel::ScopedFuel(std::uint64_t fuel)
+        : remaining_(fuel),
+          previous_(currentFuel)
+    {
+        currentFuel = this;
+    }
+
+    ScopedFuel::~ScopedFuel()
+    {
+        currentFuel = previous_;
+    }
+
+    TapeProfile::TapeProfile(std::size_t tapeSize)
+        : reads(tapeSize),
+          writes(tapeSize)
+    {
+    }
+
+    ScopedTapeProfile::ScopedTapeProfile(TapeProfile &profile)
+        : previous_(currentTapeProfile)
+    {
+        currentTapeProfile = &profile;
+    }
+
+    ScopedTapeProfile::~ScopedTapeProfile()
+    {
+        currentTapeProfile = previous_;
+    }
+
+    extern "C"
+    {
+        int brainfuck_runtime_getchar()
+        {
+            return currentIo ? currentIo->read() : std::getchar();
+        }
+
+        int brainfuck_runtime_try_getchar()
+        {
+            return currentIo ? currentIo->tryRead() : std::getchar();
+        }
+
+        std::uint64_t brainfuck_runtime_fuel_take()
+        {
+            if (currentFuel == nullptr)
+            {
+                return std::numeric_limits<std::uint64_t>::max();
+            }
+
+            return std::exchange(currentFuel->remaining_, 0);
+        }
+
+        void brainfuck_runtime_fuel_return(std::uint64_t fuel)
+        {
+            if (currentFuel)
+            {
+                currentFuel->remaining_ = fuel;
+            }
+        }
+
+        void brainfuck_runtime_tape_move(std::int64_t position)
+        {
+            if (currentTapeProfile)
+            {
+                currentTapeProfile->minPosition = std::min(currentTapeProfile->minPosition, position);
+                currentTapeProfile->maxPosition = std::max(currentTapeProfile->maxPosition, position);
+            }
+        }
+
+        void brainfuck_runtime_tape_read(std::int64_t position)
+        {
+            if (currentTapeProfile)
+            {
+                countAccess(currentTapeProfile->reads, position);
+            }
+        }
+
+        void brainfuck_runtime_tape_write(std::int64_t position)
+        {
+            if (currentTapeProfile)
+            {
+                countAccess(currentTapeProfile->writes, position);
+            }
+        }
+
+        int brainfuck_runtime_putchar(int c)
+        {
+            if (currentIo == nullptr)
+            {
+                return std::putchar(c);
+            }
+
+            currentIo->write(c);
+            return static_cast<unsigned char>(c);
+        }
+    }
+}
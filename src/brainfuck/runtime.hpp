@@ -0,0 +1,175 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_RUNTIME_HPP
+#define INCLUDED_LLVM_BRAINFUCK_RUNTIME_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace brainfuck
+{
+    // Byte I/O for programs that run in-process. Generated code calls
+    // putchar/getchar; in-process execution binds those symbols to the
+    // runtime functions below, which forward to the ProgramIo that is
+    // bound to the calling thread.
+    class ProgramIo
+    {
+    public:
+        virtual ~ProgramIo() = default;
+
+        // Returns the next input byte or EOF.
+        virtual int read() = 0;
+        virtual void write(int c) = 0;
+
+        // Like read, but returns BRAINFUCK_WOULD_BLOCK instead of waiting
+        // when no input is available yet. Used by resumable programs.
+        virtual int tryRead() { return read(); }
+    };
+
+    int const BRAINFUCK_WOULD_BLOCK = -2;
+
+    // Where a program generated with EntryPoint::resumable continues when
+    // it is entered again. Zero-initialized, it starts at the beginning.
+    struct ResumeState
+    {
+        // Offset of the tape pointer from the start of the tape.
+        std::int64_t position = 0;
+        // 0 for the start of the program, otherwise the index of the read
+        // the program suspended at, counting from 1.
+        std::int32_t resumePoint = 0;
+    };
+
+    // Reads from a fixed input buffer and collects output in memory.
+    class BufferIo : public ProgramIo
+    {
+    public:
+        BufferIo(std::string_view input = {});
+
+        void reset(std::string_view input);
+
+        int read() override;
+        void write(int c) override;
+
+        auto const &output() const { return output_; }
+        std::string takeOutput();
+
+    private:
+        std::string_view input_;
+        std::string output_;
+    };
+
+    // Reads stdin and writes stdout through C stdio.
+    class StandardIo : public ProgramIo
+    {
+    public:
+        int read() override;
+        void write(int c) override;
+    };
+
+    // Binds a ProgramIo to the current thread for the lifetime of the
+    // object. Bindings nest; the previous one is restored on destruction.
+    class ScopedProgramIo
+    {
+    public:
+        ScopedProgramIo(ProgramIo &io);
+        ScopedProgramIo(ScopedProgramIo const &) = delete;
+        ScopedProgramIo &operator=(ScopedProgramIo const &) = delete;
+        ~ScopedProgramIo();
+
+    private:
+        ProgramIo *previous_;
+    };
+
+    // Passed to every program of a library built with LibraryBuilder. The
+    // library's shared runtime calls the callbacks with user for all I/O,
+    // or uses the C library's putchar and getchar where they are null.
+    struct RuntimeContext
+    {
+        void *user = nullptr;
+        int (*putchar)(void *user, int c) = nullptr;
+        int (*getchar)(void *user) = nullptr;
+    };
+
+    // An element of the LIBRARY_PROGRAMS_SYMBOL table that every library
+    // exports, which ends with an entry whose name is null.
+    struct LibraryEntry
+    {
+        char const *name;
+        int (*run)(RuntimeContext *context);
+        // The structural hash of the program, e.g. to cache its outputs
+        // (see OutputCache).
+        std::uint64_t hash;
+    };
+
+    char const LIBRARY_PROGRAMS_SYMBOL[] = "brainfuck_library_programs";
+
+    extern "C"
+    {
+        // Fall back to stdin/stdout when no ProgramIo is bound.
+        int brainfuck_runtime_getchar();
+        int brainfuck_runtime_putchar(int c);
+        int brainfuck_runtime_try_getchar();
+
+        std::uint64_t brainfuck_runtime_fuel_take();
+        void brainfuck_runtime_fuel_return(std::uint64_t fuel);
+
+        // Do nothing when no TapeProfile is bound.
+        void brainfuck_runtime_tape_move(std::int64_t position);
+        void brainfuck_runtime_tape_read(std::int64_t position);
+        void brainfuck_runtime_tape_write(std::int64_t position);
+    }
+
+    // Fuel for programs generated with CodeGenOptions::meterFuel, bound to
+    // the current thread for the lifetime of the object. A program takes
+    // the fuel when it starts and hands back what is left when it returns;
+    // without a binding, programs get unlimited fuel.
+    class ScopedFuel
+    {
+    public:
+        explicit ScopedFuel(std::uint64_t fuel);
+        ScopedFuel(ScopedFuel const &) = delete;
+        ScopedFuel &operator=(ScopedFuel const &) = delete;
+        ~ScopedFuel();
+
+        std::uint64_t remaining() const { return remaining_; }
+
+    private:
+        friend std::uint64_t brainfuck_runtime_fuel_take();
+        friend void brainfuck_runtime_fuel_return(std::uint64_t fuel);
+
+        std::uint64_t remaining_;
+        ScopedFuel *previous_;
+    };
+
+    // Where on the tape a program generated with CodeGenOptions::profileTape
+    // went, with positions as offsets from the start of the tape.
+    struct TapeProfile
+    {
+        explicit TapeProfile(std::size_t tapeSize);
+
+        // Extremes of the tape pointer, which may lie outside the tape.
+        std::int64_t minPosition = 0;
+        std::int64_t maxPosition = 0;
+        // Per cell. Accesses outside the tape are only counted in total.
+        std::vector<std::uint64_t> reads;
+        std::vector<std::uint64_t> writes;
+        std::uint64_t outsideAccesses = 0;
+    };
+
+    // Binds a TapeProfile to the current thread for the lifetime of the
+    // object, like ScopedProgramIo.
+    class ScopedTapeProfile
+    {
+    public:
+        explicit ScopedTapeProfile(TapeProfile &profile);
+        ScopedTapeProfile(ScopedTapeProfile const &) = delete;
+        ScopedTapeProfile &operator=(ScopedTapeProfile const &) = delete;
+        ~ScopedTapeProfile();
+
+    private:
+        TapeProfile *previous_;
+    };
+}
+
+#endif
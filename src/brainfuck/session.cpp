@@ -0,0 +1,99 @@
+#include "session.hpp"
+#include "codegen.hpp"
+#include "optimizer.hpp"
+
+#include <cstdio>
+#include <utility>
+
+namespace brainfuck
+{
+    class Session::Io : public ProgramIo
+    {
+    public:
+        explicit Io(Session &session)
+            : session_(session)
+        {
+        }
+
+        int tryRead() override
+        {
+            if (session_.inputOffset_ < session_.input_.size())
+            {
+                return static_cast<unsigned char>(session_.input_[session_.inputOffset_++]);
+            }
+
+            return session_.inputClosed_ ? EOF : BRAINFUCK_WOULD_BLOCK;
+        }
+
+        int read() override
+        {
+            auto c = tryRead();
+            return c == BRAINFUCK_WOULD_BLOCK ? EOF : c;
+        }
+
+        void write(int c) override
+        {
+            session_.output_.push_back(static_cast<char>(c));
+        }
+
+    private:
+        Session &session_;
+    };
+
+    ResumableProgram::ResumableProgram(std::vector<AST> const &program)
+    {
+        CodeGenOptions options;
+        options.entryPoint = EntryPoint::resumable;
+        options.entryName = "brainfuck_resumable";
+
+        CodeGenerator codegen(jit_.getDataLayout(), {}, DebugInfoLevel::none, options);
+        codegen(program);
+
+        auto tsModule = codegen.finalizeModule();
+        optimizeModule(*tsModule.getModuleUnlocked(), {}, &jit_.targetMachine());
+
+        jit_.addModule(std::move(tsModule));
+        entry_ = jit_.lookupResumableEntry(options.entryName);
+    }
+
+    Session::Session(ResumableProgram const &program)
+        : program_(&program),
+          tape_(BRAINFUCK_MEMSIZE)
+    {
+    }
+
+    void Session::feed(std::string_view input)
+    {
+        input_.erase(0, inputOffset_);
+        inputOffset_ = 0;
+        input_.append(input);
+    }
+
+    void Session::closeInput()
+    {
+        inputClosed_ = true;
+    }
+
+    SessionStatus Session::resume()
+    {
+        if (status_ == SessionStatus::finished)
+        {
+            return status_;
+        }
+
+        Io io(*this);
+        ScopedProgramIo binding(io);
+
+        if (program_->entry_(tape_.data(), &state_) == RESUMABLE_FINISHED)
+        {
+            status_ = SessionStatus::finished;
+        }
+
+        return status_;
+    }
+
+    std::string Session::takeOutput()
+    {
+        return std::exchange(output_, {});
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_SESSION_HPP
+#define INCLUDED_LLVM_BRAINFUCK_SESSION_HPP
+
+#include "ast.hpp"
+#include "jit.hpp"
+#include "runtime.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace brainfuck
+{
+    // A program compiled once as a coroutine (EntryPoint::resumable), to be
+    // run by any number of Sessions.
+    class ResumableProgram
+    {
+    public:
+        explicit ResumableProgram(std::vector<AST> const &program);
+        ResumableProgram(ResumableProgram const &) = delete;
+        ResumableProgram &operator=(ResumableProgram const &) = delete;
+
+    private:
+        friend class Session;
+
+        JitEngine jit_;
+        JitEngine::ResumableEntryFunction entry_;
+    };
+
+    enum class SessionStatus
+    {
+        // Waiting for input; call resume() once more has been fed.
+        suspended,
+        finished
+    };
+
+    // One run of a ResumableProgram. Instead of blocking its thread in
+    // getchar, the program returns from resume() when it reaches a read and
+    // no input has been fed; tape and position stay in the session, so any
+    // thread can pick it up again later. A session must not be resumed by
+    // two threads at once, but sessions of the same program can run
+    // concurrently.
+    class Session
+    {
+    public:
+        explicit Session(ResumableProgram const &program);
+
+        void feed(std::string_view input);
+        // Reads beyond the fed input return EOF instead of suspending.
+        void closeInput();
+
+        // Runs the program until it needs more input or finishes. Does
+        // nothing once it has finished.
+        SessionStatus resume();
+        SessionStatus status() const { return status_; }
+
+        std::string takeOutput();
+
+    private:
+        class Io;
+
+        ResumableProgram const *program_;
+        std::vector<std::uint8_t> tape_;
+        ResumeState state_;
+        SessionStatus status_ = SessionStatus::suspended;
+
+        // Input fed but not read yet starts at inputOffset_.
+        std::string input_;
+        std::size_t inputOffset_ = 0;
+        bool inputClosed_ = false;
+        std::string output_;
+    };
+}
+
+#endif
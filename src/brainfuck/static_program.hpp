@@ -0,0 +1,360 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_STATIC_PROGRAM_HPP
+#define INCLUDED_LLVM_BRAINFUCK_STATIC_PROGRAM_HPP
+
+#include "token.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+// Compile-time counterpart to Lexer, parse and CodeGenerator for programs
+// that are known when the host program is built. The source is turned into
+// a StaticInstruction array during constant evaluation, and runStatic
+// expands that array into one template instantiation per instruction, so
+// the host compiler sees plain C++ with constant offsets and inlines it
+// into the caller. Nothing happens at startup, and no LLVM is involved.
+//
+//     std::array<std::uint8_t, BRAINFUCK_STATIC_MEMSIZE> tape{};
+//     brainfuck::runStatic<",[.,]">(tape.data());
+//
+// Malformed programs, e.g. with unmatched brackets, fail to compile.
+
+namespace brainfuck
+{
+    // Same size as BRAINFUCK_MEMSIZE in codegen.hpp, which this header does
+    // not depend on.
+    std::size_t const BRAINFUCK_STATIC_MEMSIZE = 30000;
+
+    // A string literal as a template argument.
+    template <std::size_t N>
+    struct StaticSource
+    {
+        constexpr StaticSource(char const (&source)[N])
+        {
+            std::copy_n(source, N, text);
+        }
+
+        constexpr std::string_view view() const { return {text, N - 1}; }
+
+        char text[N];
+    };
+
+    // The tokens, plus the instructions that runs of them fold into.
+    // incr adds value and right moves by offset; decr and left never
+    // appear, and neither does end_of_file.
+    enum class StaticOpcode
+    {
+#define TOKEN(tok) tok,
+#include "token.list"
+        // Stores value, from [-] and [+].
+        set
+    };
+
+    // Cell accesses are relative to the tape position at the start of the
+    // current straight-line run; the pointer itself only moves by a single
+    // right before every bracket and at the end of the program.
+    struct StaticInstruction
+    {
+        StaticOpcode opcode = StaticOpcode::end_of_file;
+        std::int32_t offset = 0;
+        std::uint8_t value = 0;
+        // For brackets, the index of the matching bracket.
+        std::size_t match = 0;
+    };
+
+    namespace detail
+    {
+        // Writes the instructions for source to out, unless it is null, and
+        // returns their number. Called once to size the array and once to
+        // fill it.
+        constexpr std::size_t compileStatic(std::string_view source, StaticInstruction *out)
+        {
+            std::size_t count = 0;
+            std::size_t depth = 0;
+            std::int32_t offset = 0;
+            std::int32_t pendingOffset = 0;
+            int pendingAdd = 0;
+
+            auto emit = [&](StaticOpcode opcode, std::int32_t instructionOffset, int value = 0)
+            {
+                if (out)
+                {
+                    out[count] = {opcode, instructionOffset, static_cast<std::uint8_t>(value), 0};
+                }
+
+                ++count;
+            };
+
+            auto flushAdd = [&]
+            {
+                if (static_cast<std::uint8_t>(pendingAdd) != 0)
+                {
+                    emit(StaticOpcode::incr, pendingOffset, pendingAdd);
+                }
+
+                pendingAdd = 0;
+            };
+
+            auto flushMove = [&]
+            {
+                flushAdd();
+
+                if (offset != 0)
+                {
+                    emit(StaticOpcode::right, offset);
+                }
+
+                offset = 0;
+            };
+
+            for (std::size_t i = 0; i < source.size(); ++i)
+            {
+                switch (source[i])
+                {
+                case '+':
+                case '-':
+                    if (pendingAdd != 0 && pendingOffset != offset)
+                    {
+                        flushAdd();
+                    }
+
+                    pendingOffset = offset;
+                    pendingAdd += source[i] == '+' ? 1 : -1;
+                    break;
+                case '>':
+                    ++offset;
+                    break;
+                case '<':
+                    --offset;
+                    break;
+                case '.':
+                case ',':
+                    flushAdd();
+                    emit(source[i] == '.' ? StaticOpcode::write : StaticOpcode::read, offset);
+                    break;
+                case '[':
+                    if (source.substr(i, 3) == "[-]" || source.substr(i, 3) == "[+]")
+                    {
+                        // An add to the same cell right before is dead.
+                        if (pendingOffset == offset)
+                        {
+                            pendingAdd = 0;
+                        }
+
+                        flushAdd();
+                        emit(StaticOpcode::set, offset);
+                        i += 2;
+                        break;
+                    }
+
+                    flushMove();
+                    emit(StaticOpcode::loop_start, 0);
+                    ++depth;
+                    break;
+                case ']':
+                    if (depth == 0)
+                    {
+                        throw std::invalid_argument("unmatched ]");
+                    }
+
+                    flushMove();
+                    --depth;
+
+                    if (out)
+                    {
+                        // Walk back to the matching loop_start.
+                        auto start = count - 1;
+                        std::size_t nested = 0;
+
+                        while (out[start].opcode != StaticOpcode::loop_start || nested != 0)
+                        {
+                            if (out[start].opcode == StaticOpcode::loop_end)
+                            {
+                                ++nested;
+                            }
+                            else if (out[start].opcode == StaticOpcode::loop_start)
+                            {
+                                --nested;
+                            }
+
+                            --start;
+                        }
+
+                        out[start].match = count;
+                        emit(StaticOpcode::loop_end, 0);
+                        out[count - 1].match = start;
+                    }
+                    else
+                    {
+                        emit(StaticOpcode::loop_end, 0);
+                    }
+                    break;
+                }
+            }
+
+            if (depth != 0)
+            {
+                throw std::invalid_argument("unmatched [");
+            }
+
+            flushMove();
+            return count;
+        }
+
+        template <StaticSource source>
+        constexpr auto compileStaticProgram()
+        {
+            std::array<StaticInstruction, compileStatic(source.view(), nullptr)> program;
+            compileStatic(source.view(), program.data());
+            return program;
+        }
+
+        template <auto const &program, std::size_t begin, std::size_t end>
+        constexpr std::size_t countSteps()
+        {
+            std::size_t count = 0;
+
+            for (auto pc = begin; pc < end; ++count)
+            {
+                pc = program[pc].opcode == StaticOpcode::loop_start ? program[pc].match + 1 : pc + 1;
+            }
+
+            return count;
+        }
+
+        // Indices of the instructions in [begin, end) that are not inside a
+        // loop that also starts there.
+        template <auto const &program, std::size_t begin, std::size_t end>
+        constexpr auto collectSteps()
+        {
+            std::array<std::size_t, countSteps<program, begin, end>()> steps{};
+            std::size_t count = 0;
+
+            for (auto pc = begin; pc < end; ++count)
+            {
+                steps[count] = pc;
+                pc = program[pc].opcode == StaticOpcode::loop_start ? program[pc].match + 1 : pc + 1;
+            }
+
+            return steps;
+        }
+
+        template <auto const &program, std::size_t begin, std::size_t end>
+        inline constexpr auto blockSteps = collectSteps<program, begin, end>();
+
+        template <auto const &program, std::size_t begin, std::size_t end, typename Put, typename Get>
+        constexpr void runStaticBlock(std::uint8_t *&pos, Put &put, Get &get);
+
+        template <auto const &program, std::size_t pc, typename Put, typename Get>
+        constexpr void runStaticStep(std::uint8_t *&pos, Put &put, Get &get)
+        {
+            constexpr auto instruction = program[pc];
+            constexpr auto offset = instruction.offset;
+
+            if constexpr (instruction.opcode == StaticOpcode::incr)
+            {
+                pos[offset] = static_cast<std::uint8_t>(pos[offset] + instruction.value);
+            }
+            else if constexpr (instruction.opcode == StaticOpcode::set)
+            {
+                pos[offset] = instruction.value;
+            }
+            else if constexpr (instruction.opcode == StaticOpcode::right)
+            {
+                pos += offset;
+            }
+            else if constexpr (instruction.opcode == StaticOpcode::write)
+            {
+                put(pos[offset]);
+            }
+            else if constexpr (instruction.opcode == StaticOpcode::read)
+            {
+                pos[offset] = static_cast<std::uint8_t>(get());
+            }
+            else if constexpr (instruction.opcode == StaticOpcode::loop_start)
+            {
+                while (*pos != 0)
+                {
+                    runStaticBlock<program, pc + 1, instruction.match>(pos, put, get);
+                }
+            }
+        }
+
+        // Straight-line code is expanded with a fold rather than by
+        // recursion, so only loop nesting adds to the instantiation depth.
+        template <auto const &program, std::size_t begin, std::size_t end, typename Put, typename Get>
+        constexpr void runStaticBlock(std::uint8_t *&pos, Put &put, Get &get)
+        {
+            [&]<std::size_t... I>(std::index_sequence<I...>)
+            {
+                (runStaticStep<program, blockSteps<program, begin, end>[I]>(pos, put, get), ...);
+            }(std::make_index_sequence<blockSteps<program, begin, end>.size()>());
+        }
+    }
+
+    template <StaticSource source>
+    inline constexpr auto staticProgram = detail::compileStaticProgram<source>();
+
+    namespace detail
+    {
+        // FNV-1a over the instructions.
+        template <auto const &program>
+        constexpr std::uint64_t hashStaticProgram()
+        {
+            std::uint64_t hash = 0xcbf29ce484222325ull;
+            auto mix = [&](std::uint64_t value)
+            {
+                for (int byte = 0; byte < 8; ++byte)
+                {
+                    hash = (hash ^ ((value >> (byte * 8)) & 0xff)) * 0x100000001b3ull;
+                }
+            };
+
+            for (auto const &instruction : program)
+            {
+                mix(static_cast<std::uint64_t>(instruction.opcode));
+                mix(static_cast<std::uint32_t>(instruction.offset));
+                mix(instruction.value);
+                mix(instruction.match);
+            }
+
+            return hash;
+        }
+    }
+
+    // Identifies the program by its instructions, so that it does not
+    // change with comments, e.g. to cache its outputs (see OutputCache).
+    template <StaticSource source>
+    inline constexpr std::uint64_t staticProgramHash = detail::hashStaticProgram<staticProgram<source>>();
+
+    // Runs the program on tape, which must be zeroed and hold
+    // BRAINFUCK_STATIC_MEMSIZE cells, and returns the final tape position.
+    // put is called with every output byte and get for every input byte,
+    // returning EOF or a byte. With constexpr put and get, the program can
+    // run during constant evaluation.
+    template <StaticSource source, typename Put, typename Get>
+    constexpr std::uint8_t *runStatic(std::uint8_t *tape, Put put, Get get)
+    {
+        auto pos = tape;
+        detail::runStaticBlock<staticProgram<source>, 0, staticProgram<source>.size()>(pos, put, get);
+        return pos;
+    }
+
+    // Runs the program on stdin and stdout.
+    template <StaticSource source>
+    std::uint8_t *runStatic(std::uint8_t *tape)
+    {
+        return runStatic<source>(
+            tape, [](std::uint8_t c)
+            { std::putchar(c); },
+            []
+            { return std::getchar(); });
+    }
+}
+
+#endif
@@ -0,0 +1,203 @@
+#include "structural_hash.hpp"
+
+namespace brainfuck
+{
+    namespace
+    {
+        std::uint64_t const FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+        std::uint64_t const FNV_PRIME = 0x100000001b3ull;
+
+        // Tags that do not collide with any Token value, used to delimit
+        // loop bodies and mark nodes that have no token of their own.
+        std::uint64_t const LOOP_OPEN_TAG = 0x100;
+        std::uint64_t const LOOP_CLOSE_TAG = 0x101;
+        std::uint64_t const SET_TAG = 0x102;
+
+        void mix(std::uint64_t &hash, std::uint64_t value)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                hash ^= (value >> (i * 8)) & 0xff;
+                hash *= FNV_PRIME;
+            }
+        }
+
+        class DigestBuilder
+        {
+        public:
+            DigestBuilder(std::unordered_map<LoopAST const *, StructuralDigest> *loops)
+                : loops_(loops)
+            {
+            }
+
+            void operator()(std::vector<AST> const &block, StructuralDigest &digest)
+            {
+                walk(block, nullptr, digest);
+            }
+
+            void operator()(AST const &ast, StructuralDigest &digest)
+            {
+                if (auto loop = std::get_if<LoopAST>(&ast))
+                {
+                    walk(loop->loopBody(), loop, digest);
+                }
+                else
+                {
+                    node(ast, digest);
+                }
+            }
+
+        private:
+            // Nested loops are walked with an explicit stack, so that deep
+            // nesting cannot overflow the machine stack. Every frame holds
+            // the digest of one loop body so far; a finished loop's digest
+            // is folded into its parent's.
+            void walk(std::vector<AST> const &block, LoopAST const *loop, StructuralDigest &digest)
+            {
+                struct Frame
+                {
+                    std::vector<AST> const *block;
+                    std::size_t next;
+                    LoopAST const *loop;
+                    StructuralDigest digest;
+                };
+
+                std::vector<Frame> frames;
+                frames.push_back({&block, 0, loop, loop ? openLoop() : digest});
+
+                for (;;)
+                {
+                    auto &frame = frames.back();
+
+                    if (frame.next == frame.block->size())
+                    {
+                        auto finished = std::move(frame);
+                        frames.pop_back();
+
+                        auto &parent = frames.empty() ? digest : frames.back().digest;
+
+                        if (finished.loop)
+                        {
+                            closeLoop(*finished.loop, finished.digest, parent);
+                        }
+                        else
+                        {
+                            parent = finished.digest;
+                        }
+
+                        if (frames.empty())
+                        {
+                            return;
+                        }
+
+                        continue;
+                    }
+
+                    auto const &ast = (*frame.block)[frame.next++];
+
+                    if (auto nested = std::get_if<LoopAST>(&ast))
+                    {
+                        frames.push_back({&nested->loopBody(), 0, nested, openLoop()});
+                    }
+                    else
+                    {
+                        node(ast, frame.digest);
+                    }
+                }
+            }
+
+            static void node(AST const &ast, StructuralDigest &digest)
+            {
+                std::visit([&](auto const &leaf)
+                           { node(leaf, digest); },
+                           ast);
+            }
+
+            template <Token opcode>
+            static void node(SimpleAST<opcode> const &, StructuralDigest &digest)
+            {
+                mix(digest.hash, static_cast<std::uint64_t>(opcode));
+                ++digest.size;
+            }
+
+            static void node(SetAST const &set, StructuralDigest &digest)
+            {
+                mix(digest.hash, SET_TAG);
+                mix(digest.hash, set.value());
+                ++digest.size;
+            }
+
+            // Loops are handled by walk.
+            static void node(LoopAST const &, StructuralDigest &) {}
+
+            static StructuralDigest openLoop()
+            {
+                StructuralDigest loopDigest{FNV_OFFSET_BASIS, 1};
+                mix(loopDigest.hash, LOOP_OPEN_TAG);
+                return loopDigest;
+            }
+
+            void closeLoop(LoopAST const &loop, StructuralDigest loopDigest, StructuralDigest &digest)
+            {
+                mix(loopDigest.hash, LOOP_CLOSE_TAG);
+
+                if (loops_)
+                {
+                    (*loops_)[&loop] = loopDigest;
+                }
+
+                mix(digest.hash, loopDigest.hash);
+                digest.size += loopDigest.size;
+            }
+
+            std::unordered_map<LoopAST const *, StructuralDigest> *loops_;
+        };
+
+        StructuralDigest seededDigest(std::uint64_t seed)
+        {
+            StructuralDigest digest{FNV_OFFSET_BASIS, 0};
+            mix(digest.hash, seed);
+            return digest;
+        }
+    }
+
+    StructuralDigest structuralDigest(AST const &ast, std::uint64_t seed)
+    {
+        auto digest = seededDigest(seed);
+        DigestBuilder builder(nullptr);
+
+        builder(ast, digest);
+
+        return digest;
+    }
+
+    StructuralDigest structuralDigest(std::vector<AST> const &block, std::uint64_t seed)
+    {
+        auto digest = seededDigest(seed);
+        DigestBuilder builder(nullptr);
+
+        builder(block, digest);
+
+        return digest;
+    }
+
+    std::unordered_map<LoopAST const *, StructuralDigest> loopDigests(std::vector<AST> const &program, std::uint64_t seed)
+    {
+        std::unordered_map<LoopAST const *, StructuralDigest> loops;
+        auto digest = seededDigest(seed);
+        DigestBuilder builder(&loops);
+
+        builder(program, digest);
+
+        // Fold the seed into every loop so digests from differently
+        // configured builds never match.
+        for (auto &[loop, loopDigest] : loops)
+        {
+            auto seeded = seededDigest(seed);
+            mix(seeded.hash, loopDigest.hash);
+            loopDigest.hash = seeded.hash;
+        }
+
+        return loops;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_STRUCTURAL_HASH_HPP
+#define INCLUDED_LLVM_BRAINFUCK_STRUCTURAL_HASH_HPP
+
+#include "ast.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace brainfuck
+{
+    // Hash and node count of an AST subtree. Only the structure of the
+    // code is taken into account, not its source location, so moving a
+    // loop around or changing its comments does not change its digest.
+    struct StructuralDigest
+    {
+        std::uint64_t hash;
+        std::size_t size;
+    };
+
+    StructuralDigest structuralDigest(AST const &ast, std::uint64_t seed = 0);
+    StructuralDigest structuralDigest(std::vector<AST> const &block, std::uint64_t seed = 0);
+
+    // Digests of all loops in a program, computed in a single pass.
+    std::unordered_map<LoopAST const *, StructuralDigest> loopDigests(std::vector<AST> const &program, std::uint64_t seed = 0);
+}
+
+#endif
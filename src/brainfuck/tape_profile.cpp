@@ -0,0 +1,98 @@
+#include "tape_profile.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+namespace brainfuck
+{
+    namespace
+    {
+        std::size_t const HISTOGRAM_WIDTH = 40;
+    }
+
+    std::vector<CacheLineAccesses> cacheLineAccesses(TapeProfile const &profile, std::size_t lineSize)
+    {
+        std::vector<CacheLineAccesses> lines;
+
+        for (std::size_t cell = 0; cell < profile.reads.size(); ++cell)
+        {
+            if (profile.reads[cell] == 0 && profile.writes[cell] == 0)
+            {
+                continue;
+            }
+
+            auto line = cell / lineSize;
+
+            if (lines.empty() || lines.back().line != line)
+            {
+                lines.push_back({line, 0, 0});
+            }
+
+            lines.back().reads += profile.reads[cell];
+            lines.back().writes += profile.writes[cell];
+        }
+
+        return lines;
+    }
+
+    std::size_t requiredTapeSize(TapeProfile const &profile, std::size_t lineSize)
+    {
+        if (profile.minPosition < 0)
+        {
+            return 0;
+        }
+
+        return (static_cast<std::size_t>(profile.maxPosition) / lineSize + 1) * lineSize;
+    }
+
+    void writeTapeReport(std::ostream &out, TapeProfile const &profile, std::size_t lineSize)
+    {
+        auto lines = cacheLineAccesses(profile, lineSize);
+
+        std::size_t cellsTouched = 0;
+        std::uint64_t reads = 0, writes = 0, busiestLine = 0;
+
+        for (std::size_t cell = 0; cell < profile.reads.size(); ++cell)
+        {
+            cellsTouched += profile.reads[cell] != 0 || profile.writes[cell] != 0;
+        }
+
+        for (auto const &line : lines)
+        {
+            reads += line.reads;
+            writes += line.writes;
+            busiestLine = std::max(busiestLine, line.reads + line.writes);
+        }
+
+        out << "pointer: " << profile.minPosition << " to " << profile.maxPosition << '\n'
+            << "touched: " << cellsTouched << " of " << profile.reads.size() << " cells in "
+            << lines.size() << " lines of " << lineSize << '\n'
+            << "accesses: " << reads << " reads, " << writes << " writes, "
+            << profile.outsideAccesses << " outside the tape\n";
+
+        if (auto size = requiredTapeSize(profile, lineSize))
+        {
+            out << "required tape: " << size << " cells\n";
+        }
+        else
+        {
+            out << "required tape: unknown, the pointer went left of the tape\n";
+        }
+
+        out << std::setw(12) << "cells" << std::setw(14) << "reads" << std::setw(14) << "writes" << '\n';
+
+        for (auto const &line : lines)
+        {
+            auto first = line.line * lineSize;
+            auto total = line.reads + line.writes;
+            // Every accessed line gets at least one mark.
+            auto bar = std::max<std::size_t>(1, total * HISTOGRAM_WIDTH / busiestLine);
+
+            out << std::setw(12) << std::to_string(first) + "-" + std::to_string(first + lineSize - 1)
+                << std::setw(14) << line.reads << std::setw(14) << line.writes
+                << "  " << std::string(bar, '#') << '\n';
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_TAPE_PROFILE_HPP
+#define INCLUDED_LLVM_BRAINFUCK_TAPE_PROFILE_HPP
+
+#include "runtime.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace brainfuck
+{
+    // Accesses to the cells [line * lineSize, (line + 1) * lineSize).
+    struct CacheLineAccesses
+    {
+        std::size_t line;
+        std::uint64_t reads;
+        std::uint64_t writes;
+    };
+
+    // The lines of the tape that were accessed at all, in tape order.
+    std::vector<CacheLineAccesses> cacheLineAccesses(TapeProfile const &profile, std::size_t lineSize = 64);
+
+    // The smallest tape the profiled run would have fit on, in whole
+    // lines, or 0 if the pointer left the tape to the left.
+    std::size_t requiredTapeSize(TapeProfile const &profile, std::size_t lineSize = 64);
+
+    // Writes a summary (pointer range, cells and lines touched, access
+    // totals, required tape size) followed by one histogram row per
+    // accessed line.
+    void writeTapeReport(std::ostream &out, TapeProfile const &profile, std::size_t lineSize = 64);
+}
+
+#endif
@@ -0,0 +1,157 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace brainfuck
+{
+    namespace
+    {
+        thread_local ThreadPool *currentPool = nullptr;
+        thread_local int currentWorker = -1;
+    }
+
+    ThreadPool::ThreadPool(unsigned threadCount)
+    {
+        threadCount = std::max(threadCount, 1u);
+
+        for (unsigned i = 0; i < threadCount; ++i)
+        {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+
+        for (unsigned i = 0; i < threadCount; ++i)
+        {
+            threads_.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+
+        wakeup_.notify_all();
+
+        for (auto &thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::submit(std::function<void()> task)
+    {
+        std::size_t target;
+
+        {
+            std::lock_guard lock(mutex_);
+            ++unfinished_;
+            ++queued_;
+            target = currentPool == this ? currentWorker : nextWorker_++ % workers_.size();
+        }
+
+        {
+            std::lock_guard lock(workers_[target]->mutex);
+            workers_[target]->tasks.push_back(std::move(task));
+        }
+
+        wakeup_.notify_one();
+    }
+
+    void ThreadPool::wait()
+    {
+        std::unique_lock lock(mutex_);
+        done_.wait(lock, [this]
+                   { return unfinished_ == 0; });
+
+        if (error_)
+        {
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+    }
+
+    int ThreadPool::workerIndex()
+    {
+        return currentWorker;
+    }
+
+    void ThreadPool::workerLoop(unsigned index)
+    {
+        currentPool = this;
+        currentWorker = static_cast<int>(index);
+
+        for (;;)
+        {
+            if (auto task = takeTask(index))
+            {
+                std::exception_ptr error;
+
+                try
+                {
+                    task();
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+
+                std::lock_guard lock(mutex_);
+
+                if (error && !error_)
+                {
+                    error_ = error;
+                }
+
+                if (--unfinished_ == 0)
+                {
+                    done_.notify_all();
+                }
+
+                continue;
+            }
+
+            std::unique_lock lock(mutex_);
+            wakeup_.wait(lock, [this]
+                         { return stopping_ || queued_ > 0; });
+
+            if (stopping_ && queued_ == 0)
+            {
+                return;
+            }
+        }
+    }
+
+    std::function<void()> ThreadPool::takeTask(unsigned index)
+    {
+        {
+            auto &own = *workers_[index];
+            std::lock_guard lock(own.mutex);
+
+            if (!own.tasks.empty())
+            {
+                auto task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                --queued_;
+                return task;
+            }
+        }
+
+        for (std::size_t i = 1; i < workers_.size(); ++i)
+        {
+            auto &victim = *workers_[(index + i) % workers_.size()];
+            std::lock_guard lock(victim.mutex);
+
+            if (!victim.tasks.empty())
+            {
+                auto task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                --queued_;
+                return task;
+            }
+        }
+
+        return {};
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_THREAD_POOL_HPP
+#define INCLUDED_LLVM_BRAINFUCK_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace brainfuck
+{
+    // Work-stealing thread pool. Every worker owns a task deque; it works
+    // LIFO on its own deque and steals FIFO from the others when that runs
+    // dry, so tasks submitted from within a task stay on the same core.
+    class ThreadPool
+    {
+    public:
+        ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+        ThreadPool(ThreadPool const &) = delete;
+        ThreadPool &operator=(ThreadPool const &) = delete;
+        ~ThreadPool();
+
+        void submit(std::function<void()> task);
+
+        // Blocks until all submitted tasks are done. Rethrows the first
+        // exception a task has thrown since the last call.
+        void wait();
+
+        unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+
+        // Index of the calling worker in its pool, or -1 when not called
+        // from a pool thread.
+        static int workerIndex();
+
+    private:
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        void workerLoop(unsigned index);
+        std::function<void()> takeTask(unsigned index);
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::vector<std::thread> threads_;
+
+        std::mutex mutex_;
+        std::condition_variable wakeup_;
+        std::condition_variable done_;
+        std::atomic<std::size_t> queued_ = 0;
+        std::size_t unfinished_ = 0;
+        std::size_t nextWorker_ = 0;
+        bool stopping_ = false;
+        std::exception_ptr error_;
+    };
+}
+
+#endif
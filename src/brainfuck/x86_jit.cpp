@@ -0,0 +1,258 @@
+#include "x86_jit.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace brainfuck
+{
+    namespace
+    {
+        using EntryFunction = int (*)(std::uint8_t *, X86TemplateJit::PutcharFunction, X86TemplateJit::GetcharFunction);
+
+        // Register use: rbx holds the tape pointer, r12 the putchar and r13
+        // the getchar function. All three are callee-saved, so they survive
+        // the I/O calls.
+        class TemplateEmitter
+        {
+        public:
+            std::vector<std::uint8_t> emitProgram(std::vector<AST> const &program)
+            {
+                emitBytes({0x53,               // push rbx
+                           0x41, 0x54,         // push r12
+                           0x41, 0x55,         // push r13; rsp is 16-byte aligned now
+                           0x48, 0x89, 0xfb,   // mov rbx, rdi
+                           0x49, 0x89, 0xf4,   // mov r12, rsi
+                           0x49, 0x89, 0xd5}); // mov r13, rdx
+
+                emitBlock(program);
+
+                emitBytes({0x31, 0xc0, // xor eax, eax
+                           0x41, 0x5d, // pop r13
+                           0x41, 0x5c, // pop r12
+                           0x5b,       // pop rbx
+                           0xc3});     // ret
+
+                return std::move(code_);
+            }
+
+            void operator()(IncrAST const &) { addPendingData(1); }
+            void operator()(DecrAST const &) { addPendingData(-1); }
+            void operator()(RightAST const &) { addPendingMove(1); }
+            void operator()(LeftAST const &) { addPendingMove(-1); }
+
+            void operator()(WriteAST const &)
+            {
+                flushPending();
+                emitBytes({0x0f, 0xb6, 0x3b,  // movzx edi, byte [rbx]
+                           0x41, 0xff, 0xd4}); // call r12
+            }
+
+            void operator()(ReadAST const &)
+            {
+                flushPending();
+                emitBytes({0x41, 0xff, 0xd5, // call r13
+                           0x88, 0x03});     // mov [rbx], al
+            }
+
+            void operator()(SetAST const &set)
+            {
+                if (pendingMove_ != 0)
+                {
+                    flushPending();
+                }
+
+                pendingData_ = 0;
+                emitBytes({0xc6, 0x03, set.value()}); // mov byte [rbx], imm8
+            }
+
+            // Only reached through emitBlock.
+            void operator()(LoopAST const &) {}
+
+        private:
+            // Nested loops are emitted with an explicit stack rather than by
+            // recursion, so that deep nesting cannot overflow the machine
+            // stack.
+            void emitBlock(std::vector<AST> const &block)
+            {
+                struct Frame
+                {
+                    std::vector<AST> const *block;
+                    std::size_t next;
+                    bool isLoop;
+                    std::size_t exitJump;
+                    std::size_t bodyStart;
+                };
+
+                std::vector<Frame> frames;
+                frames.push_back({&block, 0, false, 0, 0});
+
+                while (!frames.empty())
+                {
+                    auto &frame = frames.back();
+
+                    if (frame.next == frame.block->size())
+                    {
+                        flushPending();
+
+                        if (frame.isLoop)
+                        {
+                            emitBytes({0x80, 0x3b, 0x00, // cmp byte [rbx], 0
+                                       0x0f, 0x85});     // jne rel32
+                            auto backJump = emitRel32Placeholder();
+
+                            patchRel32(backJump, frame.bodyStart);
+                            patchRel32(frame.exitJump, code_.size());
+                        }
+
+                        frames.pop_back();
+                        continue;
+                    }
+
+                    auto const &ast = (*frame.block)[frame.next++];
+
+                    if (auto loop = std::get_if<LoopAST>(&ast))
+                    {
+                        flushPending();
+
+                        emitBytes({0x80, 0x3b, 0x00, // cmp byte [rbx], 0
+                                   0x0f, 0x84});     // je rel32
+                        auto exitJump = emitRel32Placeholder();
+                        frames.push_back({&loop->loopBody(), 0, true, exitJump, code_.size()});
+                        continue;
+                    }
+
+                    std::visit(*this, ast);
+                }
+            }
+
+            void addPendingData(int delta)
+            {
+                if (pendingMove_ != 0)
+                {
+                    flushPending();
+                }
+
+                pendingData_ += delta;
+            }
+
+            void addPendingMove(int delta)
+            {
+                if (pendingData_ != 0)
+                {
+                    flushPending();
+                }
+
+                pendingMove_ += delta;
+            }
+
+            void flushPending()
+            {
+                if (auto data = static_cast<std::uint8_t>(pendingData_); data != 0)
+                {
+                    emitBytes({0x80, 0x03, data}); // add byte [rbx], imm8
+                }
+
+                if (pendingMove_ >= -128 && pendingMove_ <= 127 && pendingMove_ != 0)
+                {
+                    emitBytes({0x48, 0x83, 0xc3, static_cast<std::uint8_t>(pendingMove_)}); // add rbx, imm8
+                }
+                else if (pendingMove_ != 0)
+                {
+                    emitBytes({0x48, 0x81, 0xc3}); // add rbx, imm32
+                    emitInt32(pendingMove_);
+                }
+
+                pendingData_ = 0;
+                pendingMove_ = 0;
+            }
+
+            void emitBytes(std::initializer_list<std::uint8_t> bytes)
+            {
+                code_.insert(code_.end(), bytes);
+            }
+
+            void emitInt32(std::int32_t value)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    code_.push_back(static_cast<std::uint8_t>(static_cast<std::uint32_t>(value) >> (8 * i)));
+                }
+            }
+
+            std::size_t emitRel32Placeholder()
+            {
+                auto position = code_.size();
+                emitInt32(0);
+                return position;
+            }
+
+            // Jump displacements are relative to the end of the instruction,
+            // which is where the rel32 field ends.
+            void patchRel32(std::size_t position, std::size_t target)
+            {
+                auto displacement = static_cast<std::int64_t>(target) - static_cast<std::int64_t>(position + 4);
+                auto value = static_cast<std::uint32_t>(static_cast<std::int32_t>(displacement));
+
+                for (int i = 0; i < 4; ++i)
+                {
+                    code_[position + i] = static_cast<std::uint8_t>(value >> (8 * i));
+                }
+            }
+
+            std::vector<std::uint8_t> code_;
+            int pendingData_ = 0;
+            int pendingMove_ = 0;
+        };
+    }
+
+    X86TemplateJit::X86TemplateJit(std::vector<AST> const &program)
+    {
+#if defined(__x86_64__) && !defined(_WIN32)
+        auto code = TemplateEmitter().emitProgram(program);
+
+        auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        codeSize_ = code.size();
+        mappingSize_ = (codeSize_ + pageSize - 1) / pageSize * pageSize;
+
+        code_ = mmap(nullptr, mappingSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (code_ == MAP_FAILED)
+        {
+            code_ = nullptr;
+            throw std::system_error(errno, std::generic_category(), "could not map memory for generated code");
+        }
+
+        std::memcpy(code_, code.data(), codeSize_);
+
+        // Never writable and executable at the same time.
+        if (mprotect(code_, mappingSize_, PROT_READ | PROT_EXEC) != 0)
+        {
+            auto err = errno;
+            munmap(code_, mappingSize_);
+            code_ = nullptr;
+            throw std::system_error(err, std::generic_category(), "could not make generated code executable");
+        }
+#else
+        (void)program;
+        throw std::runtime_error("the template JIT only supports x86-64");
+#endif
+    }
+
+    X86TemplateJit::~X86TemplateJit()
+    {
+        if (code_)
+        {
+            munmap(code_, mappingSize_);
+        }
+    }
+
+    int X86TemplateJit::run(std::uint8_t *tape, PutcharFunction putcharFunction, GetcharFunction getcharFunction) const
+    {
+        return reinterpret_cast<EntryFunction>(code_)(tape, putcharFunction, getcharFunction);
+    }
+}
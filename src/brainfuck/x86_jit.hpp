@@ -0,0 +1,48 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_X86_JIT_HPP
+#define INCLUDED_LLVM_BRAINFUCK_X86_JIT_HPP
+
+#include "ast.hpp"
+#include "runtime.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace brainfuck
+{
+    // Translates the AST directly into x86-64 machine code without going
+    // through LLVM, by stitching together a fixed instruction template for
+    // every kind of node. Runs of +/- and </> are folded into single
+    // instructions, and the tape pointer lives in rbx for the whole run.
+    // The generated code is much worse than what LLVM produces, but it is
+    // ready in microseconds, so it fills the gap between interpreting and
+    // compiling for huge or short-running programs.
+    //
+    // Only available on x86-64 hosts that use the System V calling
+    // convention; the constructor throws everywhere else.
+    class X86TemplateJit
+    {
+    public:
+        using PutcharFunction = int (*)(int);
+        using GetcharFunction = int (*)();
+
+        X86TemplateJit(std::vector<AST> const &program);
+        X86TemplateJit(X86TemplateJit const &) = delete;
+        X86TemplateJit &operator=(X86TemplateJit const &) = delete;
+        ~X86TemplateJit();
+
+        // Runs the program on a zeroed tape of BRAINFUCK_MEMSIZE cells.
+        int run(std::uint8_t *tape,
+                PutcharFunction putcharFunction = &brainfuck_runtime_putchar,
+                GetcharFunction getcharFunction = &brainfuck_runtime_getchar) const;
+
+        auto codeSize() const { return codeSize_; }
+
+    private:
+        void *code_ = nullptr;
+        std::size_t mappingSize_ = 0;
+        std::size_t codeSize_ = 0;
+    };
+}
+
+#endif
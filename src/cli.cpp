@@ -1,15 +1,326 @@
+#include "brainfuck/autotune.hpp"
+#include "brainfuck/batch.hpp"
+#include "brainfuck/bytecode.hpp"
+#include "brainfuck/compile_server.hpp"
+#include "brainfuck/constant_propagation.hpp"
+#include "brainfuck/executable.hpp"
+#include "brainfuck/incremental.hpp"
+#include "brainfuck/jit.hpp"
+#include "brainfuck/lazy_jit.hpp"
 #include "brainfuck/lexer.hpp"
+#include "brainfuck/library.hpp"
+#include "brainfuck/multi_target.hpp"
+#include "brainfuck/multiversion.hpp"
 #include "brainfuck/parser.hpp"
+#include "brainfuck/pipeline.hpp"
 #include "brainfuck/objcode.hpp"
 #include "brainfuck/codegen.hpp"
 #include "brainfuck/optimizer.hpp"
+#include "brainfuck/remarks.hpp"
+#include "brainfuck/runtime.hpp"
+#include "brainfuck/structural_hash.hpp"
+#include "brainfuck/tape_profile.hpp"
+#include "brainfuck/x86_jit.hpp"
 
+#include <chrono>
+#include <csignal>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace
 {
+    struct Options
+    {
+        // Run the program against every line of stdin instead of compiling
+        // it to an object file.
+        bool batch = false;
+        // Run all programs at once, each feeding its output to the next one,
+        // with the first reading stdin and the last writing stdout.
+        bool pipeline = false;
+        // Run the program on stdin/stdout right away, compiled with the
+        // template JIT instead of LLVM.
+        bool templateJit = false;
+        // Run the program on stdin/stdout right away, compiling each loop
+        // only when it is first entered (see LazyProgram).
+        bool lazyJit = false;
+        // Run the program on stdin/stdout right away and report to stderr
+        // which parts of the tape it used (see TapeProfile).
+        bool profileTape = false;
+        // Stream batch results as they complete, prefixed with their record
+        // number, instead of in input order.
+        bool tagged = false;
+        unsigned threads = std::thread::hardware_concurrency();
+        // Also write <stem>.remarks.json with what the AST passes and LLVM's
+        // optimizations did to which loop.
+        bool remarks = false;
+        // Write <stem>.bfc, a bytecode image, instead of object files.
+        bool emitBytecode = false;
+        // Interpret the given bytecode images instead of compiling sources.
+        bool runBytecode = false;
+        // Write a static executable <stem> that needs neither libc nor an
+        // external linker instead of object files.
+        bool executable = false;
+        // Cache directory for separately compiled loops; empty to compile
+        // every program as a whole.
+        std::filesystem::path incrementalCache;
+        // Compile all programs into the single position independent object
+        // <stem>.o with one entry point each (see LibraryBuilder), e.g. for
+        // cc -shared <stem>.o -o lib<stem>.so; empty to compile every
+        // program on its own.
+        std::filesystem::path library;
+        // Serve compile requests on this Unix socket until SIGINT or
+        // SIGTERM instead of compiling anything (see CompileServer).
+        std::filesystem::path serveSocket;
+        // Have the server on this socket compile the object files.
+        std::filesystem::path serverSocket;
+        // Tune every program on this sample input and write the fastest
+        // settings to <stem>.tuning, which later compiles pick up, instead
+        // of compiling it.
+        std::filesystem::path autotuneInput;
+        // Also write .ll/.o/.asm files of the unoptimized module.
+        bool dumpUnoptimized = true;
+        brainfuck::TargetInitialization targetInitialization = brainfuck::TargetInitialization::all;
+        // Emit objects for all of these targets in parallel instead of one
+        // for the host.
+        std::vector<brainfuck::TargetSpec> targets;
+        // CPU for objects and executables; "native" for the host CPU and
+        // all of its features.
+        std::string cpu = "generic";
+        // Whether --cpu was given. Only the default and native give way to
+        // the CPU of a tuning file, so that explicitly generic objects stay
+        // generic.
+        bool cpuGiven = false;
+        // Write objects with a kernel for every x86-64 ISA level, chosen at
+        // startup, instead of code for a single CPU.
+        bool multiversion = false;
+        // For batch mode, the compile server and running programs right
+        // away: reuse the outputs of inputs seen before, keeping them in
+        // this directory across runs (see OutputCache); empty to run every
+        // program.
+        std::filesystem::path outputCache;
+        // Bytes of outputs to keep in memory and on disk, and the largest
+        // output to cache.
+        std::size_t outputCacheMemory = 64 << 20;
+        std::uintmax_t outputCacheDisk = std::uintmax_t(1) << 30;
+        std::size_t outputCacheMaxEntry = 1 << 20;
+        // Debug info in object files. Line tables are enough to symbolize
+        // profiles; --debug-info=full is for stepping through programs.
+        brainfuck::DebugInfoLevel debugInfo = brainfuck::DebugInfoLevel::lineTablesOnly;
+
+        std::vector<std::string> fileNames;
+    };
+
+    brainfuck::DebugInfoLevel parseDebugInfoLevel(std::string_view level)
+    {
+        if (level == "none")
+        {
+            return brainfuck::DebugInfoLevel::none;
+        }
+        if (level == "line-tables")
+        {
+            return brainfuck::DebugInfoLevel::lineTablesOnly;
+        }
+        if (level == "full")
+        {
+            return brainfuck::DebugInfoLevel::full;
+        }
+
+        throw std::invalid_argument("unknown debug info level: " + std::string(level));
+    }
+
+    void parseOption(Options &options, std::string_view arg)
+    {
+        if (arg == "--batch")
+        {
+            options.batch = true;
+        }
+        else if (arg == "--pipeline")
+        {
+            options.pipeline = true;
+        }
+        else if (arg == "--template-jit")
+        {
+            options.templateJit = true;
+        }
+        else if (arg == "--lazy-jit")
+        {
+            options.lazyJit = true;
+        }
+        else if (arg == "--profile-tape")
+        {
+            options.profileTape = true;
+        }
+        else if (arg == "--tagged")
+        {
+            options.tagged = true;
+        }
+        else if (arg.starts_with("--threads="))
+        {
+            options.threads = std::stoul(std::string(arg.substr(10)));
+        }
+        else if (arg == "--remarks")
+        {
+            options.remarks = true;
+        }
+        else if (arg == "--emit-bytecode")
+        {
+            options.emitBytecode = true;
+        }
+        else if (arg == "--run-bytecode")
+        {
+            options.runBytecode = true;
+        }
+        else if (arg == "--executable")
+        {
+            options.executable = true;
+        }
+        else if (arg == "--fast-startup")
+        {
+            options.dumpUnoptimized = false;
+            options.targetInitialization = brainfuck::TargetInitialization::native;
+        }
+        else if (arg == "--no-unoptimized")
+        {
+            options.dumpUnoptimized = false;
+        }
+        else if (arg.starts_with("--cpu="))
+        {
+            options.cpu = arg.substr(6);
+            options.cpuGiven = true;
+        }
+        else if (arg == "--multiversion")
+        {
+            options.multiversion = true;
+        }
+        else if (arg.starts_with("--target="))
+        {
+            options.targets.push_back(brainfuck::parseTargetSpec(arg.substr(9)));
+        }
+        else if (arg.starts_with("--incremental="))
+        {
+            options.incrementalCache = arg.substr(14);
+        }
+        else if (arg.starts_with("--library="))
+        {
+            options.library = arg.substr(10);
+        }
+        else if (arg.starts_with("--serve="))
+        {
+            options.serveSocket = arg.substr(8);
+        }
+        else if (arg.starts_with("--server="))
+        {
+            options.serverSocket = arg.substr(9);
+        }
+        else if (arg.starts_with("--autotune="))
+        {
+            options.autotuneInput = arg.substr(11);
+        }
+        else if (arg.starts_with("--output-cache="))
+        {
+            options.outputCache = arg.substr(15);
+        }
+        else if (arg.starts_with("--output-cache-memory="))
+        {
+            options.outputCacheMemory = std::stoull(std::string(arg.substr(22)));
+        }
+        else if (arg.starts_with("--output-cache-disk="))
+        {
+            options.outputCacheDisk = std::stoull(std::string(arg.substr(20)));
+        }
+        else if (arg.starts_with("--output-cache-max-entry="))
+        {
+            options.outputCacheMaxEntry = std::stoull(std::string(arg.substr(25)));
+        }
+        else if (arg.starts_with("--debug-info="))
+        {
+            options.debugInfo = parseDebugInfoLevel(arg.substr(13));
+        }
+        else
+        {
+            options.fileNames.emplace_back(arg);
+        }
+    }
+
+    // Throws std::invalid_argument naming the option if a value does not
+    // parse.
+    Options parseOptions(int argc, char *argv[])
+    {
+        Options options;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string_view arg = argv[i];
+
+            try
+            {
+                parseOption(options, arg);
+            }
+            catch (std::logic_error const &)
+            {
+                // Also std::out_of_range, from std::stoul and friends.
+                throw std::invalid_argument("invalid option " + std::string(arg));
+            }
+        }
+
+        return options;
+    }
+
+    std::vector<brainfuck::AST> parseUnoptimized(std::istream &in)
+    {
+        brainfuck::Lexer lexer(in);
+        return brainfuck::parse(lexer);
+    }
+
+    std::vector<brainfuck::AST> parseProgram(std::istream &in, brainfuck::RemarkCollector *remarks = nullptr)
+    {
+        return brainfuck::propagateConstants(parseUnoptimized(in), remarks);
+    }
+
+    std::filesystem::path tuningPath(std::filesystem::path const &sourcePath)
+    {
+        auto path = sourcePath.parent_path() / sourcePath.stem();
+        path += ".tuning";
+        return path;
+    }
+
+    // The settings autotune found for program, or the defaults if it has
+    // not been tuned since its last change or the tuning file is broken.
+    brainfuck::TuningSettings loadTuning(std::filesystem::path const &sourcePath, std::vector<brainfuck::AST> const &program)
+    {
+        auto path = tuningPath(sourcePath);
+        std::ifstream in(path);
+
+        try
+        {
+            return in ? brainfuck::readTuning(in, program).value_or(brainfuck::TuningSettings{}) : brainfuck::TuningSettings{};
+        }
+        catch (std::invalid_argument const &e)
+        {
+            std::cerr << path.string() << ": " << e.what() << ", using the default settings" << std::endl;
+            return {};
+        }
+    }
+
+    // A writer for --cpu, where native stands for the host CPU with all of
+    // its features.
+    brainfuck::ObjCodeWriter makeObjWriter(Options const &options, std::optional<llvm::Reloc::Model> relocationModel = {})
+    {
+        auto native = options.cpu == "native";
+        return brainfuck::ObjCodeWriter(llvm::sys::getDefaultTargetTriple(), {}, relocationModel,
+                                        native ? llvm::sys::getHostCPUName().str() : options.cpu,
+                                        native ? brainfuck::hostCpuFeatures() : "",
+                                        options.targetInitialization);
+    }
+
     void dumpModule(llvm::Module &module, brainfuck::ObjCodeWriter &objWriter, std::filesystem::path const &fileNameStem)
     {
         std::error_code ec;
@@ -23,44 +334,580 @@ namespace
         objWriter.writeModuleToFile(fileNameStem.string() + ".asm", module, llvm::CGFT_AssemblyFile);
     }
 
-    void do_compile(std::istream &in, std::filesystem::path const &sourcePath)
+    void do_compile(std::istream &in, std::filesystem::path const &sourcePath, brainfuck::ObjCodeWriter &objWriter, Options const &options)
     {
-        brainfuck::Lexer lexer(in);
-        brainfuck::ObjCodeWriter objWriter;
-        brainfuck::CodeGenerator codegen(objWriter.getDataLayout(), sourcePath, true);
+        brainfuck::RemarkCollector remarks;
+        auto remarksOrNull = options.remarks ? &remarks : nullptr;
 
-        auto ast = brainfuck::parse(lexer);
-        codegen(ast);
+        auto program = parseUnoptimized(in);
+        auto tuning = loadTuning(sourcePath, program);
+
+        if (tuning.propagateConstants)
+        {
+            program = brainfuck::propagateConstants(std::move(program), remarksOrNull);
+        }
+
+        brainfuck::CodeGenOptions codegenOptions;
+        codegenOptions.remarks = remarksOrNull;
+        tuning.apply(codegenOptions);
+
+        std::optional<brainfuck::ObjCodeWriter> tunedObjWriter;
+        if (tuning.cpu != brainfuck::TuningSettings().cpu && (!options.cpuGiven || options.cpu == "native"))
+        {
+            std::cerr << sourcePath.string() << ": using CPU " << tuning.cpu << " from " << tuningPath(sourcePath).string() << std::endl;
+
+            // Like --cpu=native, the host CPU comes with all of its features.
+            auto host = tuning.cpu == llvm::sys::getHostCPUName();
+            tunedObjWriter.emplace(llvm::sys::getDefaultTargetTriple(), llvm::TargetOptions(), std::optional<llvm::Reloc::Model>(), tuning.cpu,
+                                   host ? brainfuck::hostCpuFeatures() : "", options.targetInitialization);
+        }
+
+        auto &writer = tunedObjWriter ? *tunedObjWriter : objWriter;
+
+        // LLVM's remarks only find their way back to the loops through the
+        // debug locations.
+        auto debugInfo = options.remarks && options.debugInfo == brainfuck::DebugInfoLevel::none
+                             ? brainfuck::DebugInfoLevel::lineTablesOnly
+                             : options.debugInfo;
+
+        brainfuck::CodeGenerator codegen(writer.getDataLayout(), sourcePath, debugInfo, codegenOptions);
+        codegen(program);
 
         auto tsModule = codegen.finalizeModule();
         auto &module = *tsModule.getModuleUnlocked();
 
         auto pathStem = sourcePath.parent_path() / sourcePath.stem();
-        auto pathStemUnoptimized = pathStem;
-        pathStemUnoptimized += "_unoptimized";
 
-        dumpModule(module, objWriter, pathStemUnoptimized);
+        if (options.dumpUnoptimized)
+        {
+            auto pathStemUnoptimized = pathStem;
+            pathStemUnoptimized += "_unoptimized";
+
+            dumpModule(module, writer, pathStemUnoptimized);
+        }
+
+        if (options.remarks)
+        {
+            brainfuck::ScopedLlvmRemarks capture(module.getContext(), remarks);
+            brainfuck::optimizeModule(module, tuning.optimizer, &writer.targetMachine());
+        }
+        else
+        {
+            brainfuck::optimizeModule(module, tuning.optimizer, &writer.targetMachine());
+        }
+
+        dumpModule(module, writer, pathStem);
+
+        if (options.remarks)
+        {
+            std::ofstream remarksOut(pathStem.string() + ".remarks.json");
+            remarks.writeJson(remarksOut);
+        }
+    }
+
+    // linkStaticExecutable only keeps allocated sections, so executables
+    // carry no debug info whatever the level.
+    void do_compile_executable(std::istream &in, std::filesystem::path const &sourcePath, brainfuck::ObjCodeWriter &objWriter, Options const &options)
+    {
+        brainfuck::CodeGenerator codegen(objWriter.getDataLayout(), sourcePath, options.debugInfo);
+        codegen(parseProgram(in));
+
+        auto tsModule = codegen.finalizeModule();
+        auto &module = *tsModule.getModuleUnlocked();
+
+        brainfuck::optimizeModule(module, {}, &objWriter.targetMachine());
+
+        brainfuck::writeExecutable(objWriter, module, sourcePath.parent_path() / sourcePath.stem());
+    }
+
+    void do_compile_multiversion(std::istream &in, std::filesystem::path const &sourcePath, Options const &options)
+    {
+        // The kernels bring their own CPUs; the object is meant to be
+        // linked anywhere, including into position independent code.
+        brainfuck::ObjCodeWriter objWriter(llvm::sys::getDefaultTargetTriple(), {}, llvm::Reloc::PIC_, "generic", "", options.targetInitialization);
+
+        auto tsModule = brainfuck::buildMultiversionModule(parseProgram(in), objWriter);
+        auto &module = *tsModule.getModuleUnlocked();
+
+        brainfuck::optimizeModule(module, {}, &objWriter.targetMachine());
+
+        objWriter.writeModuleToFile((sourcePath.parent_path() / sourcePath.stem()).string() + ".o", module);
+    }
+
+    // The IR is optimized once without target information; only the
+    // backends run per target.
+    void do_compile_multi_target(std::istream &in, std::filesystem::path const &sourcePath, Options const &options)
+    {
+        brainfuck::CodeGenerator codegen(llvm::DataLayout(""), sourcePath, options.debugInfo);
+
+        auto ast = parseProgram(in);
+        codegen(ast);
+
+        auto tsModule = codegen.finalizeModule();
+        auto &module = *tsModule.getModuleUnlocked();
 
         brainfuck::optimizeModule(module);
 
-        dumpModule(module, objWriter, pathStem);
+        auto pathStem = sourcePath.parent_path() / sourcePath.stem();
+        brainfuck::writeModuleForTargets(module, options.targets, pathStem);
+    }
+
+    // Writes <stem>.o for the program itself and <stem>.rsp, a linker
+    // response file listing it together with all cached loop objects it
+    // needs, e.g. for cc @hello.rsp -o hello.
+    void do_compile_incremental(std::istream &in, std::filesystem::path const &sourcePath, brainfuck::ObjCodeWriter &objWriter, Options const &options)
+    {
+        brainfuck::IncrementalSettings settings;
+        settings.debugInfo = options.debugInfo;
+
+        brainfuck::IncrementalCompiler compiler(objWriter, options.incrementalCache, 16, settings);
+
+        auto ast = parseProgram(in);
+
+        auto pathStem = sourcePath.parent_path() / sourcePath.stem();
+        auto objects = compiler.compile(ast, sourcePath, pathStem.string() + ".o");
+
+        std::ofstream responseFile(pathStem.string() + ".rsp");
+        for (auto const &object : objects)
+        {
+            responseFile << object.string() << '\n';
+        }
+
+        auto const &stats = compiler.statistics();
+        std::cerr << sourcePath.string() << ": " << stats.loopsRebuilt << " loops rebuilt, "
+                  << stats.loopsReused << " reused" << std::endl;
+    }
+
+    // Creates the output cache in cache if the options ask for one.
+    void makeOutputCache(std::optional<brainfuck::OutputCache> &cache, Options const &options)
+    {
+        if (!options.outputCache.empty())
+        {
+            cache.emplace(options.outputCacheMemory, options.outputCacheMaxEntry, options.outputCache,
+                          options.outputCacheDisk);
+        }
+    }
+
+    void printOutputCacheStatistics(brainfuck::OutputCache const &cache)
+    {
+        auto stats = cache.statistics();
+        std::cerr << "output cache: " << stats.memoryHits << " memory hits, " << stats.diskHits << " disk hits, "
+                  << stats.misses << " misses, " << stats.oversized << " too large, " << stats.diskEvictions
+                  << " evicted from disk, " << stats.diskErrors << " disk errors" << std::endl;
+    }
+
+    // Runs the program on a fresh tape with stdin and stdout and returns
+    // its exit status. With an output cache, the program sees all of stdin
+    // at once, so that its output can come from the cache instead.
+    int runOnStdio(std::uint64_t programHash, std::function<int(std::uint8_t *tape)> const &run, Options const &options)
+    {
+        std::optional<brainfuck::OutputCache> outputCache;
+        makeOutputCache(outputCache, options);
+
+        if (!outputCache)
+        {
+            std::vector<std::uint8_t> tape(brainfuck::BRAINFUCK_MEMSIZE);
+            auto status = run(tape.data());
+
+            std::cout << std::flush;
+            return status;
+        }
+
+        std::string input(std::istreambuf_iterator<char>(std::cin), {});
+        auto output = outputCache->getOrRun(programHash, input, [&](std::string_view programInput)
+                                            {
+                                                std::vector<std::uint8_t> tape(brainfuck::BRAINFUCK_MEMSIZE);
+                                                brainfuck::BufferIo io(programInput);
+                                                brainfuck::ScopedProgramIo binding(io);
+
+                                                auto status = run(tape.data());
+                                                return brainfuck::CachedOutput{status, io.takeOutput()}; });
+
+        std::cout << output.output << std::flush;
+        printOutputCacheStatistics(*outputCache);
+        return output.status;
+    }
+
+    int do_run_template_jit(std::istream &in, Options const &options)
+    {
+        auto program = parseProgram(in);
+        brainfuck::X86TemplateJit jit(program);
+
+        return runOnStdio(brainfuck::structuralDigest(program).hash, [&](std::uint8_t *tape)
+                          { return jit.run(tape); }, options);
+    }
+
+    int do_run_lazy_jit(std::istream &in, Options const &options)
+    {
+        auto ast = parseProgram(in);
+        auto hash = brainfuck::structuralDigest(ast).hash;
+        brainfuck::LazyProgram program(std::move(ast));
+
+        return runOnStdio(hash, [&](std::uint8_t *tape)
+                          { return program.run(tape); }, options);
+    }
+
+    void do_profile_tape(std::istream &in, std::filesystem::path const &sourcePath)
+    {
+        brainfuck::CodeGenOptions codegenOptions;
+        codegenOptions.entryPoint = brainfuck::EntryPoint::tapeArgument;
+        codegenOptions.profileTape = true;
+
+        // Neither constant propagation nor the optimizer runs, so that the
+        // report shows every access of the program as written.
+        brainfuck::JitEngine jit;
+        brainfuck::CodeGenerator codegen(jit.getDataLayout(), {}, brainfuck::DebugInfoLevel::none, codegenOptions);
+        codegen(parseUnoptimized(in));
+
+        jit.addModule(codegen.finalizeModule());
+        auto entry = jit.lookupTapeEntry(codegenOptions.entryName);
+
+        std::vector<std::uint8_t> tape(brainfuck::BRAINFUCK_MEMSIZE);
+        brainfuck::TapeProfile profile(tape.size());
+        {
+            brainfuck::ScopedTapeProfile binding(profile);
+            entry(tape.data());
+        }
+
+        std::cout << std::flush;
+        std::cerr << sourcePath.string() << ":\n";
+        brainfuck::writeTapeReport(std::cerr, profile);
+    }
+
+    void do_emit_bytecode(std::istream &in, std::filesystem::path const &sourcePath)
+    {
+        auto image = brainfuck::encodeBytecode(parseProgram(in));
+
+        auto bytecodePath = sourcePath.parent_path() / sourcePath.stem();
+        bytecodePath += ".bfc";
+
+        std::ofstream out(bytecodePath, std::ios::binary);
+        out.write(reinterpret_cast<char const *>(image.data()), image.size());
+    }
+
+    int do_run_bytecode(std::filesystem::path const &bytecodePath, Options const &options)
+    {
+        brainfuck::MappedBytecode bytecode(bytecodePath);
+
+        return runOnStdio(bytecode.view().header().contentHash, [&](std::uint8_t *tape)
+                          { return brainfuck::runBytecode(bytecode.view(), tape); }, options);
+    }
+
+    int do_pipeline(Options const &options)
+    {
+        std::vector<std::vector<brainfuck::AST>> stages;
+
+        for (auto const &fileName : options.fileNames)
+        {
+            std::ifstream in(fileName);
+
+            if (!in)
+            {
+                std::cerr << "Could not open " << fileName << std::endl;
+                return 1;
+            }
+
+            stages.push_back(parseProgram(in));
+        }
+
+        brainfuck::Pipeline pipeline(stages);
+        brainfuck::StandardIo io;
+        auto statuses = pipeline.run(io, io);
+
+        std::cout << std::flush;
+
+        // The first stage that failed decides the exit status.
+        for (auto status : statuses)
+        {
+            if (status != 0)
+            {
+                return status;
+            }
+        }
+
+        return 0;
+    }
+
+    // Programs are named after their file name stems.
+    int do_compile_library(Options const &options)
+    {
+        auto objWriter = makeObjWriter(options, llvm::Reloc::PIC_);
+        brainfuck::LibraryBuilder library(objWriter.getDataLayout(), options.library.stem().string());
+
+        for (auto const &fileName : options.fileNames)
+        {
+            std::ifstream in(fileName);
+
+            if (!in)
+            {
+                std::cerr << "Could not open " << fileName << std::endl;
+                return 1;
+            }
+
+            library.add(std::filesystem::path(fileName).stem().string(), parseProgram(in));
+        }
+
+        auto tsModule = library.finalizeModule();
+        auto &module = *tsModule.getModuleUnlocked();
+
+        brainfuck::optimizeModule(module, {}, &objWriter.targetMachine());
+
+        objWriter.writeModuleToFile(options.library.string() + ".o", module);
+        return 0;
+    }
+
+    void do_autotune(std::istream &in, std::filesystem::path const &sourcePath, Options const &options)
+    {
+        std::ifstream sampleIn(options.autotuneInput, std::ios::binary);
+        std::string sampleInput(std::istreambuf_iterator<char>(sampleIn), {});
+
+        auto program = parseUnoptimized(in);
+        auto report = brainfuck::autotune(program, sampleInput);
+
+        for (auto const &result : report.results)
+        {
+            auto const &settings = result.settings;
+            std::cerr << sourcePath.string() << ": O" << settings.optimizer.level
+                      << " unroll=" << settings.optimizer.loopUnrolling
+                      << " vectorize=" << settings.optimizer.loopVectorization
+                      << " slp=" << settings.optimizer.slpVectorization
+                      << " propagate=" << settings.propagateConstants
+                      << " counted=" << settings.countedLoops
+                      << " cpu=" << settings.cpu
+                      << ": " << result.runTime.count() / 1000 << " us"
+                      << (settings == report.best ? " (best)" : "") << std::endl;
+        }
+
+        std::ofstream out(tuningPath(sourcePath));
+        brainfuck::writeTuning(out, program, report.best);
+    }
+
+    brainfuck::CompileServer *runningServer = nullptr;
+
+    int do_serve(Options const &options)
+    {
+        std::optional<brainfuck::OutputCache> outputCache;
+        makeOutputCache(outputCache, options);
+
+        brainfuck::CompileServer server(options.serveSocket, options.threads, 64 << 20, 256, std::chrono::seconds(10),
+                                        outputCache ? &*outputCache : nullptr);
+        runningServer = &server;
+
+        auto stop = [](int)
+        { runningServer->stop(); };
+        std::signal(SIGINT, stop);
+        std::signal(SIGTERM, stop);
+
+        server.serve();
+
+        if (outputCache)
+        {
+            printOutputCacheStatistics(*outputCache);
+        }
+
+        return 0;
+    }
+
+    // Writes <stem>.o next to every source, like do_compile without any of
+    // its extra outputs.
+    int do_compile_on_server(Options const &options)
+    {
+        brainfuck::CompileClient client(options.serverSocket);
+        int exitStatus = 0;
+
+        for (auto const &fileName : options.fileNames)
+        {
+            std::ifstream in(fileName);
+
+            if (!in)
+            {
+                std::cerr << "Could not open " << fileName << std::endl;
+                exitStatus = 1;
+                continue;
+            }
+
+            brainfuck::CompileRequest request;
+            request.source.assign(std::istreambuf_iterator<char>(in), {});
+            request.sourcePath = fileName;
+            request.debugInfo = options.debugInfo;
+            // The server only knows CPU names.
+            if (options.cpu == "native")
+            {
+                request.cpu = llvm::sys::getHostCPUName().str();
+            }
+            else if (options.cpu != "generic")
+            {
+                request.cpu = options.cpu;
+            }
+
+            auto response = client.request(request);
+
+            if (!response.ok)
+            {
+                std::cerr << fileName << ": " << response.payload << std::endl;
+                exitStatus = 1;
+                continue;
+            }
+
+            std::filesystem::path sourcePath = fileName;
+            std::ofstream out((sourcePath.parent_path() / sourcePath.stem()).string() + ".o", std::ios::binary);
+            out << response.payload;
+        }
+
+        return exitStatus;
+    }
+
+    // Every line of stdin is one record; the program sees the line including
+    // its newline as input.
+    void do_batch(std::istream &in, Options const &options)
+    {
+        std::optional<brainfuck::OutputCache> outputCache;
+        makeOutputCache(outputCache, options);
+
+        brainfuck::BatchRunner runner(parseProgram(in), options.threads, outputCache ? &*outputCache : nullptr);
+
+        std::vector<std::string> records;
+        for (std::string line; std::getline(std::cin, line);)
+        {
+            records.push_back(line + '\n');
+        }
+
+        auto order = options.tagged ? brainfuck::BatchOrder::completion : brainfuck::BatchOrder::input;
+
+        runner.run(records, order, [&](brainfuck::BatchResult const &result)
+                   {
+                       if (options.tagged)
+                       {
+                           std::cout << '#' << result.recordId << ' ' << result.output.size() << '\n';
+                       }
+
+                       std::cout << result.output; });
+
+        std::cout << std::flush;
+
+        if (outputCache)
+        {
+            printOutputCacheStatistics(*outputCache);
+        }
     }
 }
 
 int main(int argc, char *argv[])
 {
-    for (int i = 1; i < argc; ++i)
+    Options options;
+
+    try
+    {
+        options = parseOptions(argc, argv);
+    }
+    catch (std::invalid_argument const &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (options.batch && options.fileNames.size() != 1)
+    {
+        std::cerr << "Batch mode needs exactly one program" << std::endl;
+        return 1;
+    }
+
+    if (!options.autotuneInput.empty() && !std::ifstream(options.autotuneInput))
+    {
+        std::cerr << "Could not open " << options.autotuneInput.string() << std::endl;
+        return 1;
+    }
+
+    if (options.pipeline)
+    {
+        return do_pipeline(options);
+    }
+
+    if (!options.library.empty())
+    {
+        return do_compile_library(options);
+    }
+
+    if (!options.serveSocket.empty())
+    {
+        return do_serve(options);
+    }
+
+    if (!options.serverSocket.empty())
+    {
+        return do_compile_on_server(options);
+    }
+
+    // Shared by all files, so target setup is only paid for once.
+    auto objWriter = makeObjWriter(options);
+
+    // The first program run that fails decides the exit status.
+    int exitStatus = 0;
+    auto recordStatus = [&](int status)
+    {
+        if (exitStatus == 0)
+        {
+            exitStatus = status;
+        }
+    };
+
+    for (auto const &fileName : options.fileNames)
     {
-        std::string fileName = argv[i];
         std::ifstream in(fileName);
 
-        if (in)
+        if (!in)
+        {
+            std::cerr << "Could not open " << fileName << std::endl;
+        }
+        else if (!options.autotuneInput.empty())
+        {
+            do_autotune(in, fileName, options);
+        }
+        else if (options.batch)
         {
-            do_compile(in, fileName);
+            do_batch(in, options);
+        }
+        else if (options.runBytecode)
+        {
+            recordStatus(do_run_bytecode(fileName, options));
+        }
+        else if (options.emitBytecode)
+        {
+            do_emit_bytecode(in, fileName);
+        }
+        else if (options.templateJit)
+        {
+            recordStatus(do_run_template_jit(in, options));
+        }
+        else if (options.lazyJit)
+        {
+            recordStatus(do_run_lazy_jit(in, options));
+        }
+        else if (options.profileTape)
+        {
+            do_profile_tape(in, fileName);
+        }
+        else if (options.executable)
+        {
+            do_compile_executable(in, fileName, objWriter, options);
+        }
+        else if (options.multiversion)
+        {
+            do_compile_multiversion(in, fileName, options);
+        }
+        else if (!options.targets.empty())
+        {
+            do_compile_multi_target(in, fileName, options);
+        }
+        else if (!options.incrementalCache.empty())
+        {
+            do_compile_incremental(in, fileName, objWriter, options);
         }
         else
         {
-            std::cerr << "Could not open " << fileName << std::endl;
+            do_compile(in, fileName, objWriter, options);
         }
     }
+
+    return exitStatus;
 }
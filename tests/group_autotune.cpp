@@ -0,0 +1,87 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/autotune.hpp"
+#include "brainfuck/parser.hpp"
+#include "test_util.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(autotune)
+
+BOOST_AUTO_TEST_CASE(tuning_file_round_trip)
+{
+    auto program = parseSource(",[.,]");
+
+    brainfuck::TuningSettings settings;
+    settings.optimizer.level = 3;
+    settings.optimizer.loopUnrolling = false;
+    settings.optimizer.slpVectorization = true;
+    settings.countedLoops = false;
+    settings.cpu = "skylake";
+
+    std::stringstream file;
+    brainfuck::writeTuning(file, program, settings);
+
+    auto read = brainfuck::readTuning(file, program);
+    BOOST_REQUIRE(read);
+    BOOST_CHECK(settings == *read);
+
+    // Tuned for a different program.
+    file.clear();
+    file.seekg(0);
+    BOOST_CHECK(!brainfuck::readTuning(file, parseSource(",[..,]")));
+
+    // Comments and whitespace do not change the program.
+    file.clear();
+    file.seekg(0);
+    BOOST_CHECK(brainfuck::readTuning(file, parseSource("read , [ print . read , ]")));
+}
+
+BOOST_AUTO_TEST_CASE(malformed_tuning_files)
+{
+    auto program = parseSource(",[.,]");
+
+    std::ostringstream written;
+    brainfuck::writeTuning(written, program, {});
+    auto file = written.str();
+
+    auto readWith = [&](std::string const &from, std::string const &to)
+    {
+        auto edited = file;
+        auto at = edited.find(from);
+        BOOST_REQUIRE(at != std::string::npos);
+        std::istringstream in(edited.replace(at, from.size(), to));
+        return brainfuck::readTuning(in, program);
+    };
+
+    BOOST_CHECK(readWith("opt_level=2", "opt_level=1"));
+    BOOST_CHECK_THROW(readWith("opt_level=2", "opt_level=two"), std::invalid_argument);
+    BOOST_CHECK_THROW(readWith("opt_level=2", "opt_level=4"), std::invalid_argument);
+    BOOST_CHECK_THROW(readWith("opt_level=2", "opt_level=99999999999"), std::invalid_argument);
+    BOOST_CHECK_THROW(readWith("counted_loops=1", "counted_loops=yes"), std::invalid_argument);
+    BOOST_CHECK_THROW(readWith("counted_loops=1", "counted_loops=2"), std::invalid_argument);
+    BOOST_CHECK_THROW(readWith("program=", "program=z"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(tries_variants)
+{
+    auto program = parseSource(",+[->++++[<++++>-]<.,+]");
+    auto report = brainfuck::autotune(program, "abc", 1);
+
+    BOOST_REQUIRE(!report.results.empty());
+    BOOST_CHECK(brainfuck::TuningSettings() == report.results.front().settings);
+
+    // At least one round of single changes from the defaults.
+    BOOST_CHECK_GT(report.results.size(), 8u);
+
+    bool bestWasTried = false;
+    for (auto const &result : report.results)
+    {
+        bestWasTried = bestWasTried || result.settings == report.best;
+    }
+    BOOST_CHECK(bestWasTried);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/batch.hpp"
+#include "brainfuck/parser.hpp"
+#include "test_util.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(batch)
+
+namespace
+{
+    std::string const rot13Source = "-,+[-[>>++++[>+++++"
+                                    "+++<-]<+<-[>+>+>-[>"
+                                    ">>]<[[>+<-]>>+>]<<<"
+                                    "<<-]]>>>[-]+>--[-[<"
+                                    "->+++[-]]]<[+++++++"
+                                    "+++++<[>-[>+>>]>[+["
+                                    "<+>-]>+>>]<<<<<-]>>"
+                                    "[<+>-]>[-[-<<[-]>>]"
+                                    "<<[<<->>-]>>]<<[<<+"
+                                    ">>-]]<[-]<.[-]<-,+]";
+
+    std::string rot13(std::string text)
+    {
+        for (auto &c : text)
+        {
+            if (c >= 'a' && c <= 'z')
+            {
+                c = 'a' + (c - 'a' + 13) % 26;
+            }
+            else if (c >= 'A' && c <= 'Z')
+            {
+                c = 'A' + (c - 'A' + 13) % 26;
+            }
+        }
+
+        return text;
+    }
+
+    std::vector<std::string> makeRecords(std::size_t count)
+    {
+        std::vector<std::string> records;
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            records.push_back("Record " + std::to_string(i) + " says Hello\n");
+        }
+
+        return records;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(input_order)
+{
+    brainfuck::BatchRunner runner(parseSource(rot13Source), 4);
+    auto records = makeRecords(500);
+
+    std::vector<brainfuck::BatchResult> results;
+    runner.run(records, brainfuck::BatchOrder::input, [&](brainfuck::BatchResult const &result)
+               { results.push_back(result); });
+
+    BOOST_REQUIRE_EQUAL(records.size(), results.size());
+
+    for (std::size_t i = 0; i < records.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(i, results[i].recordId);
+        BOOST_CHECK_EQUAL(0, results[i].status);
+        BOOST_CHECK_EQUAL(rot13(records[i]), results[i].output);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(completion_order)
+{
+    brainfuck::BatchRunner runner(parseSource(rot13Source), 4);
+    auto records = makeRecords(500);
+
+    std::vector<brainfuck::BatchResult> results;
+    runner.run(records, brainfuck::BatchOrder::completion, [&](brainfuck::BatchResult const &result)
+               { results.push_back(result); });
+
+    BOOST_REQUIRE_EQUAL(records.size(), results.size());
+
+    std::sort(results.begin(), results.end(), [](auto const &lhs, auto const &rhs)
+              { return lhs.recordId < rhs.recordId; });
+
+    for (std::size_t i = 0; i < records.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(i, results[i].recordId);
+        BOOST_CHECK_EQUAL(rot13(records[i]), results[i].output);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tape_is_recycled_clean)
+{
+    // Leaves a non-zero cell behind; the next record must not see it.
+    brainfuck::BatchRunner runner(parseSource(">[.]+++<,."), 1);
+
+    std::vector<std::string> outputs;
+    runner.run({"a", "b", "c"}, brainfuck::BatchOrder::input, [&](brainfuck::BatchResult const &result)
+               { outputs.push_back(result.output); });
+
+    BOOST_CHECK(outputs == (std::vector<std::string>{"a", "b", "c"}));
+}
+
+BOOST_AUTO_TEST_CASE(repeated_inputs_come_from_the_output_cache)
+{
+    brainfuck::OutputCache cache;
+    brainfuck::BatchRunner runner(parseSource(rot13Source), 1, &cache);
+
+    std::vector<std::string> outputs;
+    auto sink = [&](brainfuck::BatchResult const &result)
+    { outputs.push_back(result.output); };
+
+    runner.run({"abc\n", "abc\n", "xyz\n"}, brainfuck::BatchOrder::input, sink);
+    runner.run({"xyz\n"}, brainfuck::BatchOrder::input, sink);
+
+    BOOST_CHECK(outputs == (std::vector<std::string>{"nop\n", "nop\n", "klm\n", "klm\n"}));
+
+    auto stats = cache.statistics();
+    BOOST_CHECK_EQUAL(2u, stats.misses);
+    BOOST_CHECK_EQUAL(2u, stats.stores);
+    BOOST_CHECK_EQUAL(2u, stats.memoryHits);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
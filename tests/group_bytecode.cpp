@@ -0,0 +1,135 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/bytecode.hpp"
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/parser.hpp"
+#include "brainfuck/runtime.hpp"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(bytecode)
+
+namespace
+{
+    std::vector<std::byte> encode(std::string const &source, bool withLocations = true)
+    {
+        std::istringstream sourceStream(source);
+        brainfuck::Lexer lexer(sourceStream);
+        return brainfuck::encodeBytecode(brainfuck::parse(lexer), withLocations);
+    }
+
+    std::string run(brainfuck::BytecodeView const &view, std::string const &input)
+    {
+        std::vector<std::uint8_t> tape(brainfuck::BRAINFUCK_MEMSIZE);
+        brainfuck::BufferIo io(input);
+        brainfuck::ScopedProgramIo binding(io);
+
+        BOOST_CHECK_EQUAL(0, brainfuck::runBytecode(view, tape.data()));
+
+        return io.output();
+    }
+
+    std::string const ROT13 = "-,+[-[>>++++[>++++++++<-]<+<-[>+>+>-[>>>]<[[>+<-]>>+>]<<<<<-]]>>>[-]+>--[-[<->+++[-]]]<[++++++++++++<[>-[>+>>]>[+[<+>-]>+>>]<<<<<-]>>[<+>-]>[-[-<<[-]>>]<<[<<->>-]>>]<<[<<+>>-]]<[-]<.[-]<-,+]";
+}
+
+BOOST_AUTO_TEST_CASE(layout)
+{
+    auto image = encode("+++>>[-]\n.,");
+    brainfuck::BytecodeView view(image);
+
+    BOOST_CHECK_EQUAL(brainfuck::BYTECODE_VERSION, view.header().version);
+
+    auto instructions = view.instructions();
+    std::vector<brainfuck::BytecodeOpcode> opcodes;
+    for (auto const &instruction : instructions)
+    {
+        opcodes.push_back(instruction.opcode);
+    }
+
+    using enum brainfuck::BytecodeOpcode;
+    std::vector<brainfuck::BytecodeOpcode> expected{add, move, jumpIfZero, add, jumpIfNonZero, write, read};
+    BOOST_CHECK(expected == opcodes);
+
+    BOOST_CHECK_EQUAL(3, instructions[0].value);
+    BOOST_CHECK_EQUAL(2, instructions[1].operand);
+    BOOST_CHECK_EQUAL(255, instructions[3].value);
+    BOOST_CHECK_EQUAL(2, instructions[2].operand);
+    BOOST_CHECK_EQUAL(-2, instructions[4].operand);
+
+    auto locations = view.locations();
+    BOOST_REQUIRE_EQUAL(instructions.size(), locations.size());
+    BOOST_CHECK_EQUAL(1, locations[1].line);
+    BOOST_CHECK_EQUAL(4, locations[1].column);
+    BOOST_CHECK_EQUAL(2, locations[5].line);
+    BOOST_CHECK_EQUAL(1, locations[5].column);
+
+    BOOST_CHECK(brainfuck::BytecodeView(encode("+++>>[-]\n.,", false)).locations().empty());
+}
+
+BOOST_AUTO_TEST_CASE(run_in_memory)
+{
+    auto image = encode(ROT13);
+    BOOST_CHECK_EQUAL("Uryyb, Jbeyq!", run(brainfuck::BytecodeView(image), "Hello, World!"));
+}
+
+BOOST_AUTO_TEST_CASE(run_mapped)
+{
+    auto image = encode(ROT13, false);
+    auto path = std::filesystem::temp_directory_path() / (std::to_string(getpid()) + "_rot13.bfc");
+
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<char const *>(image.data()), image.size());
+
+    {
+        brainfuck::MappedBytecode mapped(path);
+        BOOST_CHECK_EQUAL("nopqrstuvwxyzabcdefghijklm", run(mapped.view(), "abcdefghijklmnopqrstuvwxyz"));
+    }
+
+    std::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(reject_malformed)
+{
+    auto image = encode("+[>+<-]");
+
+    auto truncated = image;
+    truncated.resize(truncated.size() - 20);
+    BOOST_CHECK_THROW(brainfuck::BytecodeView{truncated}, std::invalid_argument);
+
+    auto badMagic = image;
+    badMagic[0] = std::byte{'X'};
+    BOOST_CHECK_THROW(brainfuck::BytecodeView{badMagic}, std::invalid_argument);
+
+    // Let the loop's closing jump point outside of the program.
+    auto badJump = image;
+    auto header = reinterpret_cast<brainfuck::BytecodeHeader const *>(badJump.data());
+    auto instructions = reinterpret_cast<brainfuck::BytecodeInstruction *>(badJump.data() + header->instructionOffset);
+    instructions[header->instructionCount - 1].operand = 100;
+    BOOST_CHECK_THROW(brainfuck::BytecodeView{badJump}, std::invalid_argument);
+
+    // Add 2 instead of 1, which only the content hash catches.
+    auto badValue = image;
+    instructions = reinterpret_cast<brainfuck::BytecodeInstruction *>(badValue.data() + header->instructionOffset);
+    ++instructions[0].value;
+    BOOST_CHECK_THROW(brainfuck::BytecodeView{badValue}, std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(reject_malformed_mapped)
+{
+    auto image = encode("+[>+<-]");
+    image[0] = std::byte{'X'};
+    auto path = std::filesystem::temp_directory_path() / (std::to_string(getpid()) + "_malformed.bfc");
+
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<char const *>(image.data()), image.size());
+    BOOST_CHECK_THROW(brainfuck::MappedBytecode{path}, std::invalid_argument);
+
+    std::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,20 +1,27 @@
 #include <boost/test/unit_test.hpp>
 
 #include "brainfuck/codegen.hpp"
-#include "brainfuck/objcode.hpp"
+#include "brainfuck/jit.hpp"
 #include "brainfuck/optimizer.hpp"
 #include "brainfuck/parser.hpp"
-
-#include <boost/asio/io_service.hpp>
-#include <boost/process.hpp>
-#include <boost/process/async.hpp>
-
-#include <unistd.h>
-
-#include <cstdlib>
-#include <filesystem>
+#include "brainfuck/runtime.hpp"
+
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/IRBuilder.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <optional>
+#include <set>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 BOOST_AUTO_TEST_SUITE(codegen)
 
@@ -26,47 +33,116 @@ namespace
         std::string expectedOutput;
     };
 
-    void testRunModule(llvm::Module &module,
-                       brainfuck::ObjCodeWriter &writer,
-                       TestCommunication const &io,
-                       std::string const &tag)
+    struct RunResult
     {
-        namespace bp = boost::process;
+        int status;
+        std::string output;
+        std::chrono::nanoseconds elapsed;
+    };
+
+    // Returned by main when the step limit is reached. Generated code
+    // itself only ever returns 0.
+    int const STEP_LIMIT_STATUS = 125;
+    std::uint64_t const DEFAULT_STEP_LIMIT = 100'000'000;
 
-        auto tempPath = std::filesystem::temp_directory_path();
-        auto pidStr = std::to_string(getpid());
-        auto tempModule = tempPath / (pidStr + "_" + tag + "_module.o");
-        auto tempAout = tempPath / (pidStr + "_" + tag + "_a.out");
+    // Makes main give up with STEP_LIMIT_STATUS once it has entered
+    // stepLimit basic blocks, so runaway programs fail the test instead of
+    // hanging it. Blocks are counted rather than wall-clock time so the
+    // outcome does not depend on the load of the machine.
+    void instrumentStepLimit(llvm::Module &module, std::uint64_t stepLimit)
+    {
+        auto &context = module.getContext();
+        auto mainFunc = module.getFunction("main");
+        auto countType = llvm::Type::getInt64Ty(context);
+
+        auto stepsLeft = new llvm::GlobalVariable(module, countType, false, llvm::GlobalValue::InternalLinkage,
+                                                  llvm::ConstantInt::get(countType, stepLimit), "stepsLeft");
+
+        std::vector<llvm::BasicBlock *> blocks;
+        for (auto &block : *mainFunc)
+        {
+            blocks.push_back(&block);
+        }
+
+        auto limitBB = llvm::BasicBlock::Create(context, "stepLimitBlock", mainFunc);
+        llvm::IRBuilder<> builder(limitBB);
+        builder.CreateRet(builder.getInt32(STEP_LIMIT_STATUS));
+
+        for (auto block : blocks)
+        {
+            auto continueBB = block->splitBasicBlock(block->getFirstNonPHI(), "stepOkBlock");
+            block->getTerminator()->eraseFromParent();
+
+            builder.SetInsertPoint(block);
+            auto oldSteps = builder.CreateLoad(countType, stepsLeft);
+            auto newSteps = builder.CreateSub(oldSteps, builder.getInt64(1));
+            builder.CreateStore(newSteps, stepsLeft);
+            builder.CreateCondBr(builder.CreateICmpEQ(newSteps, builder.getInt64(0)), limitBB, continueBB);
+        }
+    }
+
+    // Compiles the program in-process and runs it with its I/O routed to
+    // memory. Every run has its own JIT and I/O binding, so runs can happen
+    // on several threads at once; Boost.Test checks, however, must stay on
+    // the main thread.
+    RunResult runProgram(std::vector<brainfuck::AST> const &ast,
+                         std::string const &input,
+                         bool optimize,
+                         std::optional<std::uint64_t> stepLimit = DEFAULT_STEP_LIMIT)
+    {
+        brainfuck::JitEngine jit;
+        brainfuck::CodeGenerator codegen(jit.getDataLayout());
 
-        writer.writeModuleToFile(tempModule.string(), module);
+        codegen(ast);
 
-        bp::child linkerProcess(bp::search_path("cc"), tempModule.string(), "-o", tempAout.string());
-        linkerProcess.wait();
+        auto tsafeModule = codegen.finalizeModule();
+        auto module = tsafeModule.getModuleUnlocked();
 
-        bp::opstream toChild;
-        bp::ipstream fromChild;
-        std::ostringstream bufferStream;
-        bp::child runnerProcess(tempAout.string(),
-                                (bp::std_in < toChild),
-                                (bp::std_out > fromChild));
+        if (optimize)
+        {
+            brainfuck::optimizeModule(*module);
+        }
 
-        toChild << io.prompt << std::flush;
-        toChild.pipe().close();
+        if (stepLimit)
+        {
+            instrumentStepLimit(*module, *stepLimit);
+        }
 
-        runnerProcess.wait_for(std::chrono::milliseconds(100));
-        BOOST_CHECK(!runnerProcess.running());
-        runnerProcess.terminate();
+        jit.addModule(std::move(tsafeModule));
+        auto mainFunc = jit.lookupMain();
 
-        bufferStream << fromChild.rdbuf();
+        brainfuck::BufferIo io(input);
+        brainfuck::ScopedProgramIo binding(io);
 
-        BOOST_CHECK_EQUAL(io.expectedOutput, bufferStream.str());
+        auto start = std::chrono::steady_clock::now();
+        int status = mainFunc();
+        auto elapsed = std::chrono::steady_clock::now() - start;
 
-        std::error_code ec;
+        return {status, io.takeOutput(), elapsed};
+    }
 
-        std::filesystem::remove(tempAout, ec);
-        BOOST_CHECK(!ec);
-        std::filesystem::remove(tempModule, ec);
-        BOOST_CHECK(!ec);
+    // Runs the unoptimized and the optimized build of the program side by
+    // side and checks that both behave as expected.
+    void testRunProgram(std::string const &source, TestCommunication const &io)
+    {
+        std::istringstream sourceStream(source);
+        brainfuck::Lexer lexer(sourceStream);
+        auto ast = brainfuck::parse(lexer);
+
+        auto unoptimizedRun = std::async(std::launch::async, [&]
+                                         { return runProgram(ast, io.prompt, false); });
+        auto optimized = runProgram(ast, io.prompt, true);
+        auto unoptimized = unoptimizedRun.get();
+
+        for (auto const *result : {&unoptimized, &optimized})
+        {
+            BOOST_CHECK_EQUAL(0, result->status);
+            BOOST_CHECK_EQUAL(io.expectedOutput, result->output);
+        }
+
+        using Microseconds = std::chrono::duration<double, std::micro>;
+        BOOST_TEST_MESSAGE("unoptimized: " << Microseconds(unoptimized.elapsed).count() << " us, "
+                                           << "optimized: " << Microseconds(optimized.elapsed).count() << " us");
     }
 }
 
@@ -76,24 +152,8 @@ BOOST_AUTO_TEST_CASE(helloworld)
                          "]<+.+++++++..+++.>>++++++[<+++++++>-]<++."
                          "------------.>++++++[<+++++++++>-]<+.<.++"
                          "+.------.--------.>>>++++[<++++++++>-]<+.";
-    std::istringstream sourceStream(source);
-
-    brainfuck::Lexer lexer(sourceStream);
-    auto ast = brainfuck::parse(lexer);
-
-    brainfuck::ObjCodeWriter writer;
-    brainfuck::CodeGenerator codegen(writer.getDataLayout());
-
-    codegen(ast);
-
-    auto tsafeModule = codegen.finalizeModule();
-    auto module = tsafeModule.getModuleUnlocked();
-
-    TestCommunication io{"", "Hello, World!"};
 
-    testRunModule(*module, writer, io, "hello_unoptimized");
-    brainfuck::optimizeModule(*module);
-    testRunModule(*module, writer, io, "hello_optimized");
+    testRunProgram(source, {"", "Hello, World!"});
 }
 
 BOOST_AUTO_TEST_CASE(rot13)
@@ -109,24 +169,230 @@ BOOST_AUTO_TEST_CASE(rot13)
                          "<<[<<->>-]>>]<<[<<+"
                          ">>-]]<[-]<.[-]<-,+]";
 
-    std::istringstream sourceStream(source);
+    testRunProgram(source, {"Hello\n", "Uryyb\n"});
+}
 
+BOOST_AUTO_TEST_CASE(read_stores_one_cell)
+{
+    // Reading EOF must not spill into the cells to the right.
+    testRunProgram(">+<,>.", {"", "\x01"});
+}
+
+BOOST_AUTO_TEST_CASE(counted_loops)
+{
+    // Three iterations with nested loops and I/O, then an odd step that
+    // needs 171 iterations to wrap around, then an even step.
+    std::string source = "+++[>++++++++[>++++++++<-]>+.[-]<<-]"
+                         "+[>+++++[>+++++++++++++<-]>.[-]<<---]"
+                         "++++[>+++++++[>+++++++<-]>.[-]<<--]";
+
+    testRunProgram(source, {"", "AAA" + std::string(171, 'A') + "11"});
+}
+
+BOOST_AUTO_TEST_CASE(counted_loops_without_exit)
+{
+    // An even step never takes an odd cell to 0. The loop must keep
+    // running until the step limit stops it, rather than end after some
+    // huge trip count that LLVM can compute the result of.
+    std::istringstream sourceStream("+[>+<--]>.");
     brainfuck::Lexer lexer(sourceStream);
     auto ast = brainfuck::parse(lexer);
 
-    brainfuck::ObjCodeWriter writer;
-    brainfuck::CodeGenerator codegen(writer.getDataLayout());
+    for (bool optimize : {false, true})
+    {
+        auto result = runProgram(ast, "", optimize, 100'000);
 
-    codegen(ast);
+        BOOST_CHECK_EQUAL(STEP_LIMIT_STATUS, result.status);
+        BOOST_CHECK_EQUAL("", result.output);
+    }
+}
 
-    auto tsafeModule = codegen.finalizeModule();
-    auto module = tsafeModule.getModuleUnlocked();
+BOOST_AUTO_TEST_CASE(step_limit)
+{
+    std::istringstream sourceStream("+.[]");
+    brainfuck::Lexer lexer(sourceStream);
+    auto ast = brainfuck::parse(lexer);
+
+    for (bool optimize : {false, true})
+    {
+        auto result = runProgram(ast, "", optimize, 1000);
 
-    TestCommunication io{"Hello\n", "Uryyb\n"};
+        BOOST_CHECK_EQUAL(STEP_LIMIT_STATUS, result.status);
+        BOOST_CHECK_EQUAL("\x01", result.output);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(fuel)
+{
+    struct MeteredRun
+    {
+        int status;
+        std::string output;
+        std::uint64_t fuelLeft;
+    };
+
+    auto runMetered = [](std::string const &source, std::uint64_t fuel, bool optimize, bool emitCountedLoops)
+    {
+        std::istringstream sourceStream(source);
+        brainfuck::Lexer lexer(sourceStream);
+
+        brainfuck::CodeGenOptions options;
+        options.meterFuel = true;
+        options.emitCountedLoops = emitCountedLoops;
+
+        brainfuck::JitEngine jit;
+        brainfuck::CodeGenerator codegen(jit.getDataLayout(), {}, brainfuck::DebugInfoLevel::none, options);
+        codegen(brainfuck::parse(lexer));
+
+        auto tsafeModule = codegen.finalizeModule();
+        if (optimize)
+        {
+            brainfuck::optimizeModule(*tsafeModule.getModuleUnlocked());
+        }
+
+        jit.addModule(std::move(tsafeModule));
+        auto mainFunc = jit.lookupMain();
+
+        brainfuck::BufferIo io;
+        brainfuck::ScopedProgramIo binding(io);
+        brainfuck::ScopedFuel fuelBinding(fuel);
+
+        int status = mainFunc();
+        return MeteredRun{status, io.takeOutput(), fuelBinding.remaining()};
+    };
+
+    for (bool optimize : {false, true})
+    {
+        // Three iterations of a five instruction body, each charged six.
+        auto plain = runMetered("+++[>++<-]>.", 1000, optimize, false);
+        BOOST_CHECK_EQUAL(0, plain.status);
+        BOOST_CHECK_EQUAL("\x06", plain.output);
+        BOOST_CHECK_EQUAL(1000 - 18, plain.fuelLeft);
+
+        // The same loop as a counted loop pays for everything on entry.
+        auto counted = runMetered("+++[>++<-]>.", 1000, optimize, true);
+        BOOST_CHECK_EQUAL(0, counted.status);
+        BOOST_CHECK_EQUAL("\x06", counted.output);
+        BOOST_CHECK_EQUAL(1000 - 18, counted.fuelLeft);
+
+        // Stops before the iteration it cannot pay for.
+        auto exhausted = runMetered("+[.]", 10, optimize, false);
+        BOOST_CHECK_EQUAL(brainfuck::OUT_OF_FUEL_STATUS, exhausted.status);
+        BOOST_CHECK_EQUAL(std::string(5, '\x01'), exhausted.output);
+        BOOST_CHECK_EQUAL(0, exhausted.fuelLeft);
+
+        // A counted loop that never terminates cannot be paid for at all.
+        auto exhaustedCounted = runMetered("+[>+<--]", 10, optimize, true);
+        BOOST_CHECK_EQUAL(brainfuck::OUT_OF_FUEL_STATUS, exhaustedCounted.status);
+        BOOST_CHECK_EQUAL(10, exhaustedCounted.fuelLeft);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tape_bounds)
+{
+    auto runChecked = [](std::string const &source, bool optimize)
+    {
+        std::istringstream sourceStream(source);
+        brainfuck::Lexer lexer(sourceStream);
+
+        brainfuck::CodeGenOptions options;
+        options.entryPoint = brainfuck::EntryPoint::tapeArgument;
+        options.entryName = "checked";
+        options.checkTapeBounds = true;
+
+        brainfuck::JitEngine jit;
+        brainfuck::CodeGenerator codegen(jit.getDataLayout(), {}, brainfuck::DebugInfoLevel::none, options);
+        codegen(brainfuck::parse(lexer));
+
+        auto tsafeModule = codegen.finalizeModule();
+        if (optimize)
+        {
+            brainfuck::optimizeModule(*tsafeModule.getModuleUnlocked());
+        }
+
+        jit.addModule(std::move(tsafeModule));
+        auto entry = jit.lookupTapeEntry("checked");
+
+        // Guard cells on both sides, which the program must not touch.
+        std::vector<std::uint8_t> memory(brainfuck::BRAINFUCK_MEMSIZE + 2, 0xaa);
+        std::fill(memory.begin() + 1, memory.end() - 1, 0);
+
+        brainfuck::BufferIo io;
+        brainfuck::ScopedProgramIo binding(io);
+        int status = entry(memory.data() + 1);
+
+        BOOST_CHECK_EQUAL(0xaa, memory.front());
+        BOOST_CHECK_EQUAL(0xaa, memory.back());
+        return std::make_pair(status, io.takeOutput());
+    };
+
+    for (bool optimize : {false, true})
+    {
+        BOOST_CHECK_EQUAL(0, runChecked("+++[>++<-]>.", optimize).first);
+
+        auto left = runChecked("+.<+", optimize);
+        BOOST_CHECK_EQUAL(brainfuck::OUT_OF_TAPE_STATUS, left.first);
+        BOOST_CHECK_EQUAL("\x01", left.second);
+
+        // Both ends of the tape are usable.
+        BOOST_CHECK_EQUAL(0, runChecked(std::string(brainfuck::BRAINFUCK_MEMSIZE - 1, '>') + "+.", optimize).first);
+        BOOST_CHECK_EQUAL(brainfuck::OUT_OF_TAPE_STATUS, runChecked("+[>+]", optimize).first);
+        BOOST_CHECK_EQUAL(brainfuck::OUT_OF_TAPE_STATUS, runChecked(">>>+[[-]<+]", optimize).first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(debug_info_levels)
+{
+    struct DebugInfoSummary
+    {
+        std::set<std::pair<unsigned, unsigned>> locations;
+        bool declaresVariables = false;
+        std::optional<llvm::DICompileUnit::DebugEmissionKind> emissionKind;
+    };
+
+    auto generate = [](brainfuck::DebugInfoLevel level)
+    {
+        std::istringstream sourceStream("+++>>>\n---<<<[-]");
+        brainfuck::Lexer lexer(sourceStream);
+
+        brainfuck::CodeGenerator codegen(llvm::DataLayout(""), "levels.bf", level);
+        codegen(brainfuck::parse(lexer));
+
+        auto tsafeModule = codegen.finalizeModule();
+        auto &module = *tsafeModule.getModuleUnlocked();
+
+        DebugInfoSummary summary;
+        for (auto &instruction : llvm::instructions(*module.getFunction("main")))
+        {
+            if (auto const &location = instruction.getDebugLoc())
+            {
+                summary.locations.insert({location.getLine(), location.getCol()});
+            }
+            summary.declaresVariables |= llvm::isa<llvm::DbgDeclareInst>(instruction);
+        }
+        for (auto compileUnit : module.debug_compile_units())
+        {
+            summary.emissionKind = compileUnit->getEmissionKind();
+        }
+
+        return summary;
+    };
 
-    testRunModule(*module, writer, io, "rot13_unoptimized");
-    brainfuck::optimizeModule(*module);
-    testRunModule(*module, writer, io, "rot13_optimized");
+    auto none = generate(brainfuck::DebugInfoLevel::none);
+    BOOST_TEST(none.locations.empty());
+    BOOST_TEST(!none.emissionKind);
+
+    // Every instruction has a column of its own.
+    auto full = generate(brainfuck::DebugInfoLevel::full);
+    BOOST_TEST(full.locations.size() == 14u);
+    BOOST_TEST(full.declaresVariables);
+    BOOST_TEST((full.emissionKind == llvm::DICompileUnit::FullDebug));
+
+    // One location for each line, plus one for the loop.
+    auto lineTables = generate(brainfuck::DebugInfoLevel::lineTablesOnly);
+    BOOST_TEST((lineTables.locations == std::set<std::pair<unsigned, unsigned>>{{1, 1}, {2, 1}, {2, 7}}));
+    BOOST_TEST(!lineTables.declaresVariables);
+    BOOST_TEST((lineTables.emissionKind == llvm::DICompileUnit::LineTablesOnly));
 }
 
 BOOST_AUTO_TEST_SUITE_END()
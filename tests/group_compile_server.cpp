@@ -0,0 +1,263 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/compile_server.hpp"
+#include "brainfuck/codegen.hpp"
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(compile_server)
+
+namespace
+{
+    std::filesystem::path socketPath()
+    {
+        return std::filesystem::temp_directory_path() / (std::to_string(getpid()) + "_compile_server.sock");
+    }
+
+    // Serves on a background thread for the lifetime of the fixture.
+    struct RunningServer
+    {
+        explicit RunningServer(unsigned threadCount = 4, std::size_t jitProgramLimit = 256,
+                               brainfuck::OutputCache *outputCache = nullptr)
+            : server(socketPath(), threadCount, 64 << 20, jitProgramLimit, std::chrono::seconds(10), outputCache),
+              thread([this]
+                     { server.serve(); })
+        {
+        }
+
+        ~RunningServer()
+        {
+            server.stop();
+            thread.join();
+        }
+
+        brainfuck::CompileServer server;
+        std::thread thread;
+    };
+
+    std::string const CAT = ",+[-.,+]";
+}
+
+BOOST_AUTO_TEST_CASE(compiles_and_runs)
+{
+    RunningServer running;
+    brainfuck::CompileClient client(socketPath());
+
+    brainfuck::CompileRequest request;
+    request.source = CAT;
+
+    auto object = client.request(request);
+    BOOST_REQUIRE(object.ok);
+    BOOST_CHECK_EQUAL("\x7f" "ELF", object.payload.substr(0, 4));
+
+    // Served from the cache the second time.
+    BOOST_CHECK(object.payload == client.request(request).payload);
+
+    request.kind = brainfuck::CompileRequestKind::assembly;
+    auto assembly = client.request(request);
+    BOOST_REQUIRE(assembly.ok);
+    BOOST_CHECK(assembly.payload.find("main") != std::string::npos);
+
+    request.kind = brainfuck::CompileRequestKind::run;
+    request.input = "hello";
+    auto run = client.request(request);
+    BOOST_REQUIRE(run.ok);
+    BOOST_CHECK_EQUAL(0, run.status);
+    BOOST_CHECK_EQUAL("hello", run.payload);
+}
+
+BOOST_AUTO_TEST_CASE(reports_errors)
+{
+    RunningServer running;
+    brainfuck::CompileClient client(socketPath());
+
+    brainfuck::CompileRequest request;
+    request.source = "+]";
+
+    auto response = client.request(request);
+    BOOST_CHECK(!response.ok);
+    BOOST_CHECK(response.payload.find("unmatched ]") != std::string::npos);
+
+    // The connection stays usable, and runs are bounded by their fuel.
+    request.kind = brainfuck::CompileRequestKind::run;
+    request.source = "+[]";
+    request.fuel = 1000;
+    response = client.request(request);
+    BOOST_REQUIRE(response.ok);
+    BOOST_CHECK_EQUAL(brainfuck::OUT_OF_FUEL_STATUS, response.status);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_clients)
+{
+    RunningServer running;
+
+    std::size_t const clientCount = 8;
+    std::vector<std::string> outputs(clientCount);
+    std::vector<std::thread> clients;
+
+    for (std::size_t i = 0; i < clientCount; ++i)
+    {
+        clients.emplace_back([&, i]
+                             {
+                                 brainfuck::CompileClient client(socketPath());
+
+                                 brainfuck::CompileRequest request;
+                                 request.kind = brainfuck::CompileRequestKind::run;
+                                 // Half of the clients share a program.
+                                 request.source = CAT + std::string(i % 2, '>');
+
+                                 for (int j = 0; j < 10; ++j)
+                                 {
+                                     request.input = std::to_string(i);
+                                     outputs[i] += client.request(request).payload;
+                                 } });
+    }
+
+    for (auto &client : clients)
+    {
+        client.join();
+    }
+
+    for (std::size_t i = 0; i < clientCount; ++i)
+    {
+        std::string expected;
+        for (int j = 0; j < 10; ++j)
+        {
+            expected += std::to_string(i);
+        }
+
+        BOOST_CHECK_EQUAL(expected, outputs[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(request_settings)
+{
+    RunningServer running;
+    brainfuck::CompileClient client(socketPath());
+
+    brainfuck::CompileRequest request;
+    request.kind = brainfuck::CompileRequestKind::assembly;
+    request.source = CAT;
+
+    auto plain = client.request(request);
+    BOOST_REQUIRE(plain.ok);
+    BOOST_CHECK(plain.payload.find(".loc") == std::string::npos);
+
+    request.debugInfo = brainfuck::DebugInfoLevel::lineTablesOnly;
+    request.sourcePath = "cat.bf";
+    auto withLines = client.request(request);
+    BOOST_REQUIRE(withLines.ok);
+    BOOST_CHECK(withLines.payload.find(".loc") != std::string::npos);
+    BOOST_CHECK(withLines.payload.find("cat.bf") != std::string::npos);
+
+    request.optLevel = 4;
+    BOOST_CHECK(!client.request(request).ok);
+
+    request.optLevel = 1;
+    request.triple = "no-such-arch-unknown-none";
+    BOOST_CHECK(!client.request(request).ok);
+
+    request.triple = {};
+    request.cpu = "no-such-cpu";
+    BOOST_CHECK(!client.request(request).ok);
+
+    request.kind = brainfuck::CompileRequestKind::run;
+    request.cpu = {};
+    request.input = "hi";
+    BOOST_CHECK_EQUAL("hi", client.request(request).payload);
+}
+
+BOOST_AUTO_TEST_CASE(idle_connections_hold_no_thread)
+{
+    RunningServer running(1);
+
+    // An idle client does not keep the only thread from serving others.
+    brainfuck::CompileClient idle(socketPath());
+
+    brainfuck::CompileRequest request;
+    request.kind = brainfuck::CompileRequestKind::run;
+    request.source = CAT;
+    request.input = "a";
+
+    brainfuck::CompileClient client(socketPath());
+    BOOST_CHECK_EQUAL("a", client.request(request).payload);
+
+    request.input = "b";
+    BOOST_CHECK_EQUAL("b", idle.request(request).payload);
+}
+
+BOOST_AUTO_TEST_CASE(jit_programs_are_evicted)
+{
+    RunningServer running(2, 2);
+    brainfuck::CompileClient client(socketPath());
+
+    brainfuck::CompileRequest request;
+    request.kind = brainfuck::CompileRequestKind::run;
+
+    // Each round evicts the program that the next one needs.
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int shift = 0; shift < 3; ++shift)
+        {
+            request.source = CAT + std::string(shift, '>');
+            request.input = std::to_string(round * 3 + shift);
+            BOOST_CHECK_EQUAL(request.input, client.request(request).payload);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(runs_stop_at_the_ends_of_the_tape)
+{
+    RunningServer running;
+    brainfuck::CompileClient client(socketPath());
+
+    brainfuck::CompileRequest request;
+    request.kind = brainfuck::CompileRequestKind::run;
+
+    // Output up to the move off the tape is kept.
+    request.source = "+.<+";
+    auto left = client.request(request);
+    BOOST_REQUIRE(left.ok);
+    BOOST_CHECK_EQUAL(brainfuck::OUT_OF_TAPE_STATUS, left.status);
+    BOOST_CHECK_EQUAL("\x01", left.payload);
+
+    request.source = "+[>+]";
+    BOOST_CHECK_EQUAL(brainfuck::OUT_OF_TAPE_STATUS, client.request(request).status);
+
+    // The server is unharmed.
+    request.source = CAT;
+    request.input = "hello";
+    auto cat = client.request(request);
+    BOOST_CHECK_EQUAL(0, cat.status);
+    BOOST_CHECK_EQUAL("hello", cat.payload);
+}
+
+BOOST_AUTO_TEST_CASE(runs_come_from_the_output_cache)
+{
+    brainfuck::OutputCache cache;
+    RunningServer running(4, 256, &cache);
+    brainfuck::CompileClient client(socketPath());
+
+    brainfuck::CompileRequest request;
+    request.kind = brainfuck::CompileRequestKind::run;
+    request.source = CAT;
+    request.input = "hello";
+
+    BOOST_CHECK_EQUAL("hello", client.request(request).payload);
+    BOOST_CHECK_EQUAL("hello", client.request(request).payload);
+    BOOST_CHECK_EQUAL(1u, cache.statistics().memoryHits);
+
+    // With a fuel limit, the output may be cut short, so it is cached
+    // separately.
+    request.fuel = 1000;
+    BOOST_CHECK(client.request(request).ok);
+    BOOST_CHECK_EQUAL(1u, cache.statistics().memoryHits);
+    BOOST_CHECK_EQUAL(2u, cache.statistics().stores);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,106 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/constant_propagation.hpp"
+#include "brainfuck/parser.hpp"
+#include "brainfuck/x86_jit.hpp"
+#include "test_util.hpp"
+
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(constant_propagation)
+
+namespace
+{
+    void checkSet(brainfuck::AST const &ast, int expectedValue)
+    {
+        auto set = std::get_if<brainfuck::SetAST>(&ast);
+        BOOST_REQUIRE(set);
+        BOOST_CHECK_EQUAL(expectedValue, set->value());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(leading_comment_loop)
+{
+    auto ast = brainfuck::propagateConstants(parseSource("[This is a comment, really.]+++."));
+
+    BOOST_REQUIRE_EQUAL(2, ast.size());
+    checkSet(ast[0], 3);
+    BOOST_CHECK(std::holds_alternative<brainfuck::WriteAST>(ast[1]));
+    BOOST_CHECK_EQUAL(brainfuck::SourceLocation(1, 29), astLocation(ast[0]));
+}
+
+BOOST_AUTO_TEST_CASE(loop_after_loop)
+{
+    auto ast = brainfuck::propagateConstants(parseSource(",[>+<-][>.<]"));
+
+    BOOST_REQUIRE_EQUAL(2, ast.size());
+    BOOST_CHECK(std::holds_alternative<brainfuck::ReadAST>(ast[0]));
+    BOOST_CHECK(std::holds_alternative<brainfuck::LoopAST>(ast[1]));
+}
+
+BOOST_AUTO_TEST_CASE(clear_and_store)
+{
+    auto ast = brainfuck::propagateConstants(parseSource(",++[-]+++.[-]"));
+
+    BOOST_REQUIRE_EQUAL(4, ast.size());
+    BOOST_CHECK(std::holds_alternative<brainfuck::ReadAST>(ast[0]));
+    checkSet(ast[1], 3);
+    BOOST_CHECK(std::holds_alternative<brainfuck::WriteAST>(ast[2]));
+    checkSet(ast[3], 0);
+}
+
+BOOST_AUTO_TEST_CASE(balanced_loop_keeps_untouched_cells)
+{
+    auto ast = brainfuck::propagateConstants(parseSource(">+++<,[>.<-]>+."));
+
+    BOOST_REQUIRE_EQUAL(8, ast.size());
+    BOOST_CHECK(std::holds_alternative<brainfuck::RightAST>(ast[0]));
+    checkSet(ast[1], 3);
+    BOOST_CHECK(std::holds_alternative<brainfuck::LeftAST>(ast[2]));
+    BOOST_CHECK(std::holds_alternative<brainfuck::ReadAST>(ast[3]));
+    BOOST_CHECK(std::holds_alternative<brainfuck::LoopAST>(ast[4]));
+    BOOST_CHECK(std::holds_alternative<brainfuck::RightAST>(ast[5]));
+    checkSet(ast[6], 4);
+    BOOST_CHECK(std::holds_alternative<brainfuck::WriteAST>(ast[7]));
+}
+
+BOOST_AUTO_TEST_CASE(unbalanced_loop_forgets_everything)
+{
+    auto ast = brainfuck::propagateConstants(parseSource(">+++<,[>]<+."));
+
+    BOOST_REQUIRE_EQUAL(8, ast.size());
+    BOOST_CHECK(std::holds_alternative<brainfuck::LeftAST>(ast[5]));
+    BOOST_CHECK(std::holds_alternative<brainfuck::IncrAST>(ast[6]));
+}
+
+#if defined(__x86_64__)
+BOOST_AUTO_TEST_CASE(preserves_semantics)
+{
+    std::string source = "[comment]-,+[-[>>++++[>+++++"
+                         "+++<-]<+<-[>+>+>-[>"
+                         ">>]<[[>+<-]>>+>]<<<"
+                         "<<-]]>>>[-]+>--[-[<"
+                         "->+++[-]]]<[+++++++"
+                         "+++++<[>-[>+>>]>[+["
+                         "<+>-]>+>>]<<<<<-]>>"
+                         "[<+>-]>[-[-<<[-]>>]"
+                         "<<[<<->>-]>>]<<[<<+"
+                         ">>-]]<[-]<.[-]<-,+]";
+
+    brainfuck::X86TemplateJit original(parseSource(source));
+    brainfuck::X86TemplateJit simplified(brainfuck::propagateConstants(parseSource(source)));
+
+    for (auto jit : {&original, &simplified})
+    {
+        std::vector<std::uint8_t> tape(brainfuck::BRAINFUCK_MEMSIZE);
+        brainfuck::BufferIo io("Hello\n");
+        brainfuck::ScopedProgramIo binding(io);
+
+        jit->run(tape.data());
+        BOOST_CHECK_EQUAL("Uryyb\n", io.output());
+    }
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,115 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/executable.hpp"
+#include "brainfuck/optimizer.hpp"
+#include "brainfuck/parser.hpp"
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#if defined(__x86_64__) && defined(__linux__)
+
+BOOST_AUTO_TEST_SUITE(executable)
+
+namespace
+{
+    std::filesystem::path tempPath(std::string const &name)
+    {
+        return std::filesystem::temp_directory_path() / (std::to_string(getpid()) + "_" + name);
+    }
+
+    std::string runExecutable(std::string const &source, std::string const &input,
+                              brainfuck::DebugInfoLevel debugInfo = brainfuck::DebugInfoLevel::none)
+    {
+        std::istringstream sourceStream(source);
+        brainfuck::Lexer lexer(sourceStream);
+
+        brainfuck::ObjCodeWriter objWriter;
+        brainfuck::CodeGenerator codegen(objWriter.getDataLayout(), "program.bf", debugInfo);
+        codegen(brainfuck::parse(lexer));
+
+        auto tsafeModule = codegen.finalizeModule();
+        auto module = tsafeModule.getModuleUnlocked();
+        brainfuck::optimizeModule(*module);
+
+        auto exePath = tempPath("program");
+        auto inputPath = tempPath("input");
+        auto outputPath = tempPath("output");
+
+        brainfuck::writeExecutable(objWriter, *module, exePath);
+        std::ofstream(inputPath) << input;
+
+        auto command = exePath.string() + " < " + inputPath.string() + " > " + outputPath.string();
+        auto status = std::system(command.c_str());
+
+        BOOST_CHECK(WIFEXITED(status));
+        BOOST_CHECK_EQUAL(0, WEXITSTATUS(status));
+
+        std::ifstream outputStream(outputPath);
+        std::string output((std::istreambuf_iterator<char>(outputStream)), std::istreambuf_iterator<char>());
+
+        std::filesystem::remove(exePath);
+        std::filesystem::remove(inputPath);
+        std::filesystem::remove(outputPath);
+
+        return output;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(helloworld)
+{
+    auto output = runExecutable("++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]>>.>---.+++++++..+++.>>.<-.<.+++.------.--------.>>+.>++.",
+                                "");
+
+    BOOST_CHECK_EQUAL("Hello World!\n", output);
+}
+
+BOOST_AUTO_TEST_CASE(echo_until_eof)
+{
+    // Copies stdin until EOF, which getchar reports as 255 after truncation.
+    // The output is longer than the runtime's buffer.
+    std::string input(10000, 'x');
+
+    BOOST_CHECK_EQUAL(input, runExecutable(",+[-.,+]", input));
+}
+
+BOOST_AUTO_TEST_CASE(debug_info_is_dropped)
+{
+    for (auto level : {brainfuck::DebugInfoLevel::lineTablesOnly, brainfuck::DebugInfoLevel::full})
+    {
+        BOOST_CHECK_EQUAL("ab", runExecutable(",.,.", "ab", level));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(undefined_symbol)
+{
+    llvm::LLVMContext context;
+    llvm::Module module("undefined", context);
+
+    auto function = llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(context), false),
+                                           llvm::Function::ExternalLinkage, "_start", module);
+    auto callee = llvm::Function::Create(function->getFunctionType(), llvm::Function::ExternalLinkage, "missing", module);
+
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "entry", function));
+    builder.CreateCall(callee);
+    builder.CreateRetVoid();
+
+    brainfuck::ObjCodeWriter objWriter;
+    llvm::SmallVector<char, 0> object;
+    llvm::raw_svector_ostream objectStream(object);
+    objWriter.writeModuleToStream(objectStream, module);
+
+    llvm::MemoryBufferRef buffer(llvm::StringRef(object.data(), object.size()), "undefined");
+    BOOST_CHECK_THROW(brainfuck::linkStaticExecutable(buffer, tempPath("undefined")), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif
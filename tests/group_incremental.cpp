@@ -0,0 +1,59 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/incremental.hpp"
+#include "brainfuck/parser.hpp"
+#include "test_util.hpp"
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(incremental)
+
+namespace
+{
+    // Two independent loops, each large enough to be compiled on its own.
+    std::string const firstLoop = "+[>++++[>++++<-]>[<<+>>-]<<-]";
+    std::string const secondLoop = ">>>+[>+++[>+++++<-]>[<<+>>-]<<-]";
+}
+
+BOOST_AUTO_TEST_CASE(rebuilds_only_changed_loops)
+{
+    auto directory = std::filesystem::temp_directory_path() / (std::to_string(getpid()) + "_incremental");
+    auto mainObject = directory / "main.o";
+    brainfuck::ObjCodeWriter writer;
+
+    {
+        brainfuck::IncrementalCompiler compiler(writer, directory / "cache");
+        auto objects = compiler.compile(parseSource(firstLoop + secondLoop), {}, mainObject);
+
+        BOOST_CHECK_EQUAL(3, objects.size());
+        BOOST_CHECK_EQUAL(2, compiler.statistics().loopsRebuilt);
+        BOOST_CHECK_EQUAL(0, compiler.statistics().loopsReused);
+    }
+
+    {
+        // The second loop now adds 4 instead of 3.
+        brainfuck::IncrementalCompiler compiler(writer, directory / "cache");
+        compiler.compile(parseSource(firstLoop + ">>>+[>++++[>+++++<-]>[<<+>>-]<<-]"), {}, mainObject);
+
+        BOOST_CHECK_EQUAL(1, compiler.statistics().loopsRebuilt);
+        BOOST_CHECK_EQUAL(1, compiler.statistics().loopsReused);
+    }
+
+    {
+        brainfuck::IncrementalSettings settings;
+        settings.optimizer.level = 3;
+
+        brainfuck::IncrementalCompiler compiler(writer, directory / "cache", 16, settings);
+        compiler.compile(parseSource(firstLoop + secondLoop), {}, mainObject);
+
+        BOOST_CHECK_EQUAL(2, compiler.statistics().loopsRebuilt);
+        BOOST_CHECK_EQUAL(0, compiler.statistics().loopsReused);
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,78 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/lazy_jit.hpp"
+#include "brainfuck/parser.hpp"
+#include "brainfuck/runtime.hpp"
+#include "test_util.hpp"
+
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(lazy_jit)
+
+namespace
+{
+    std::string run(brainfuck::LazyProgram &program, std::string const &input = {})
+    {
+        std::vector<std::uint8_t> tape(brainfuck::BRAINFUCK_MEMSIZE);
+        brainfuck::BufferIo io(input);
+        brainfuck::ScopedProgramIo binding(io);
+
+        BOOST_CHECK_EQUAL(0, program.run(tape.data()));
+        return io.takeOutput();
+    }
+
+    std::string const HELLO_WORLD = "++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]>>.>---.+++++++..+++.>>.<-.<.+++.------.--------.>>+.>++.";
+}
+
+BOOST_AUTO_TEST_CASE(loops_that_are_never_entered_are_never_compiled)
+{
+    // The first loop is skipped, since its cell is zero; the second one
+    // prints "A".
+    brainfuck::LazyProgram program(parseSource("[>++++[<+++>-]<.[-]]>+[>++++++++[<++++++++>-]<.[-]]"), 1000);
+
+    BOOST_CHECK_EQUAL(2u, program.lazyLoopCount());
+    BOOST_CHECK_EQUAL(0u, program.compiledLoopCount());
+
+    BOOST_CHECK_EQUAL("A", run(program));
+    BOOST_CHECK_EQUAL(1u, program.compiledLoopCount());
+}
+
+BOOST_AUTO_TEST_CASE(nested_loops_are_compiled_on_demand)
+{
+    brainfuck::LazyProgram program(parseSource(HELLO_WORLD), 1);
+
+    BOOST_CHECK_EQUAL(3u, program.lazyLoopCount());
+    BOOST_CHECK_EQUAL("Hello World!\n", run(program));
+    BOOST_CHECK_EQUAL(3u, program.compiledLoopCount());
+}
+
+BOOST_AUTO_TEST_CASE(compiles_on_the_running_thread_without_compile_threads)
+{
+    brainfuck::LazyProgram program(parseSource(",+[-.,+]"), 1, 0);
+
+    BOOST_CHECK_EQUAL("lazy", run(program, "lazy"));
+    BOOST_CHECK_EQUAL("again", run(program, "again"));
+    BOOST_CHECK_EQUAL(1u, program.compiledLoopCount());
+}
+
+BOOST_AUTO_TEST_CASE(long_programs_run_in_chunks)
+{
+    // Many chunks' worth of loops that the zero input never enters,
+    // between two outputs.
+    std::string source = "++++++++[>++++++++<-]>+.";
+    for (std::size_t i = 0; i < 3 * brainfuck::LAZY_CHUNK_SIZE; ++i)
+    {
+        source += ">,[>+++[<--->-]<.]";
+    }
+    source += "++++++++[>++++++++<-]>++.";
+
+    brainfuck::LazyProgram program(parseSource(source), 1000);
+
+    BOOST_CHECK_EQUAL(3 * brainfuck::LAZY_CHUNK_SIZE + 2, program.lazyLoopCount());
+    BOOST_CHECK_EQUAL("AB", run(program, std::string(3 * brainfuck::LAZY_CHUNK_SIZE, '\0')));
+    BOOST_CHECK_EQUAL(2u, program.compiledLoopCount());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
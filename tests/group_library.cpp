@@ -0,0 +1,132 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/jit.hpp"
+#include "brainfuck/library.hpp"
+#include "brainfuck/optimizer.hpp"
+#include "brainfuck/parser.hpp"
+#include "test_util.hpp"
+
+#include <llvm/IR/IRBuilder.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(library)
+
+namespace
+{
+    // Reads from input and appends to output.
+    struct StringContext : brainfuck::RuntimeContext
+    {
+        explicit StringContext(std::string in)
+            : input(std::move(in))
+        {
+            user = this;
+            putchar = [](void *self, int c)
+            {
+                static_cast<StringContext *>(self)->output += static_cast<char>(c);
+                return c;
+            };
+            getchar = [](void *self)
+            {
+                auto context = static_cast<StringContext *>(self);
+                return context->read < context->input.size()
+                           ? static_cast<unsigned char>(context->input[context->read++])
+                           : -1;
+            };
+        }
+
+        std::string input;
+        std::size_t read = 0;
+        std::string output;
+    };
+}
+
+BOOST_AUTO_TEST_CASE(programs_share_one_module)
+{
+    brainfuck::JitEngine jit;
+    brainfuck::LibraryBuilder library(jit.getDataLayout());
+
+    auto cat = library.add("cat", parseSource(",+[-.,+]"));
+    auto upper = library.add("upper-case", parseSource(",+[-" + std::string(32, '-') + ".,+]"));
+    BOOST_CHECK_EQUAL("bf_cat", cat);
+    BOOST_CHECK_EQUAL("bf_upper_case", upper);
+
+    auto module = library.finalizeModule();
+    brainfuck::optimizeModule(*module.getModuleUnlocked());
+    jit.addModule(std::move(module));
+
+    StringContext catContext("abc");
+    BOOST_CHECK_EQUAL(0, jit.lookupContextEntry(cat)(&catContext));
+    BOOST_CHECK_EQUAL("abc", catContext.output);
+
+    StringContext upperContext("abc");
+    BOOST_CHECK_EQUAL(0, jit.lookupContextEntry(upper)(&upperContext));
+    BOOST_CHECK_EQUAL("ABC", upperContext.output);
+
+    // Every run gets a fresh tape.
+    StringContext again("xy");
+    BOOST_CHECK_EQUAL(0, jit.lookupContextEntry(cat)(&again));
+    BOOST_CHECK_EQUAL("xy", again.output);
+}
+
+BOOST_AUTO_TEST_CASE(program_table)
+{
+    brainfuck::JitEngine jit;
+    brainfuck::LibraryBuilder library(jit.getDataLayout());
+
+    library.add("hello", parseSource("++++++++[>++++++++<-]>."));
+    library.add("hello", parseSource("++++++++[>++++++++<-]>+."));
+    library.add("hello.bf", parseSource("++++++++[>++++++++<-]>++."));
+    jit.addModule(library.finalizeModule());
+
+    std::map<std::string, std::string> outputs;
+    for (auto entry = jit.lookupLibraryPrograms(); entry->name != nullptr; ++entry)
+    {
+        StringContext context("");
+        BOOST_CHECK_EQUAL(0, entry->run(&context));
+        outputs[entry->name] = context.output;
+    }
+
+    std::map<std::string, std::string> expected = {{"bf_hello", "@"}, {"bf_hello_2", "A"}, {"bf_hello_bf", "B"}};
+    BOOST_CHECK(expected == outputs);
+}
+
+BOOST_AUTO_TEST_CASE(tape_allocation_failure)
+{
+    brainfuck::JitEngine jit;
+    brainfuck::LibraryBuilder library(jit.getDataLayout());
+
+    auto hello = library.add("hello", parseSource("++++++++[>++++++++<-]>."));
+    auto module = library.finalizeModule();
+
+    // Stands in for calloc failing.
+    auto tape = module.getModuleUnlocked()->getFunction("brainfuck_context_tape");
+    tape->deleteBody();
+    tape->setLinkage(llvm::GlobalValue::InternalLinkage);
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(tape->getContext(), "entry", tape));
+    builder.CreateRet(llvm::ConstantPointerNull::get(llvm::Type::getInt8PtrTy(tape->getContext())));
+    jit.addModule(std::move(module));
+
+    StringContext context("");
+    BOOST_CHECK_EQUAL(brainfuck::OUT_OF_MEMORY_STATUS, jit.lookupContextEntry(hello)(&context));
+    BOOST_CHECK_EQUAL("", context.output);
+}
+
+BOOST_AUTO_TEST_CASE(rejects_options_without_runtime_support)
+{
+    brainfuck::LibraryBuilder library;
+
+    brainfuck::CodeGenOptions metered;
+    metered.meterFuel = true;
+    BOOST_CHECK_THROW(library.add("metered", parseSource("+[-]"), metered), std::invalid_argument);
+
+    brainfuck::CodeGenOptions profiled;
+    profiled.profileTape = true;
+    BOOST_CHECK_THROW(library.add("profiled", parseSource("+[-]"), profiled), std::invalid_argument);
+
+    BOOST_CHECK(library.entryNames().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,62 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/loop_analysis.hpp"
+#include "brainfuck/parser.hpp"
+
+#include <sstream>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(loop_analysis)
+
+namespace
+{
+    brainfuck::LoopAST parseLoop(std::string const &source)
+    {
+        std::istringstream sourceStream(source);
+        brainfuck::Lexer lexer(sourceStream);
+        auto ast = brainfuck::parse(lexer);
+        return std::get<brainfuck::LoopAST>(ast.at(0));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(footprint)
+{
+    auto loop = parseLoop("[>+>,<<.>>>[-<.>]<<<-]");
+    auto footprint = brainfuck::balancedFootprint(loop.loopBody());
+
+    BOOST_REQUIRE(footprint);
+    BOOST_CHECK((footprint->reads == std::set<long>{0, 1, 2, 3}));
+    BOOST_CHECK((footprint->writes == std::set<long>{0, 1, 2, 3}));
+
+    BOOST_CHECK(!brainfuck::balancedFootprint(parseLoop("[>]").loopBody()));
+    BOOST_CHECK(!brainfuck::balancedFootprint(parseLoop("[[>]]").loopBody()));
+}
+
+BOOST_AUTO_TEST_CASE(counted_loops)
+{
+    auto withIo = brainfuck::analyzeCountedLoop(parseLoop("[->.>,[-]<<--]"));
+    BOOST_REQUIRE(withIo);
+    BOOST_CHECK_EQUAL(253, withIo->step);
+    BOOST_CHECK((withIo->controlUpdates == std::set<std::size_t>{0, 8, 9}));
+
+    auto incrementing = brainfuck::analyzeCountedLoop(parseLoop("[>+<+++]"));
+    BOOST_REQUIRE(incrementing);
+    BOOST_CHECK_EQUAL(3, incrementing->step);
+}
+
+BOOST_AUTO_TEST_CASE(uncounted_loops)
+{
+    // unbalanced
+    BOOST_CHECK(!brainfuck::analyzeCountedLoop(parseLoop("[->]")));
+    // no net change
+    BOOST_CHECK(!brainfuck::analyzeCountedLoop(parseLoop("[>+<+-]")));
+    // control cell is read or written otherwise
+    BOOST_CHECK(!brainfuck::analyzeCountedLoop(parseLoop("[-.]")));
+    BOOST_CHECK(!brainfuck::analyzeCountedLoop(parseLoop("[-,]")));
+    BOOST_CHECK(!brainfuck::analyzeCountedLoop(parseLoop("[-[>+<-]]")));
+    BOOST_CHECK(!brainfuck::analyzeCountedLoop(parseLoop("[->[<.>-]<]")));
+    // nested loop moves the pointer
+    BOOST_CHECK(!brainfuck::analyzeCountedLoop(parseLoop("[->[>]<]")));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
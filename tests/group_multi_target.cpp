@@ -0,0 +1,73 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/multi_target.hpp"
+#include "brainfuck/optimizer.hpp"
+#include "brainfuck/parser.hpp"
+
+#include <llvm/Support/Host.h>
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(multi_target)
+
+BOOST_AUTO_TEST_CASE(parse_target_spec)
+{
+    auto plain = brainfuck::parseTargetSpec("aarch64-linux-gnu");
+    BOOST_CHECK_EQUAL("aarch64-linux-gnu", plain.triple);
+    BOOST_CHECK_EQUAL("generic", plain.cpu);
+    BOOST_CHECK_EQUAL("", plain.features);
+    BOOST_CHECK_EQUAL("aarch64-linux-gnu", plain.fileSuffix());
+
+    auto full = brainfuck::parseTargetSpec("x86_64-pc-linux-gnu:x86-64-v3:+avx2");
+    BOOST_CHECK_EQUAL("x86_64-pc-linux-gnu", full.triple);
+    BOOST_CHECK_EQUAL("x86-64-v3", full.cpu);
+    BOOST_CHECK_EQUAL("+avx2", full.features);
+    BOOST_CHECK_EQUAL("x86_64-pc-linux-gnu.x86-64-v3", full.fileSuffix());
+
+    BOOST_CHECK_THROW(brainfuck::parseTargetSpec(":x86-64"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(write_objects)
+{
+    std::istringstream sourceStream("++++++++[>++++[>++>+++<<-]>-]>>.");
+    brainfuck::Lexer lexer(sourceStream);
+
+    brainfuck::CodeGenerator codegen;
+    codegen(brainfuck::parse(lexer));
+
+    auto tsafeModule = codegen.finalizeModule();
+    auto module = tsafeModule.getModuleUnlocked();
+    brainfuck::optimizeModule(*module);
+
+    auto host = llvm::sys::getProcessTriple();
+    auto pathStem = std::filesystem::temp_directory_path() / (std::to_string(getpid()) + "_multi_target");
+
+    std::vector<brainfuck::TargetSpec> targets{brainfuck::parseTargetSpec(host),
+                                               brainfuck::parseTargetSpec(host + ":znver2")};
+    auto paths = brainfuck::writeModuleForTargets(*module, targets, pathStem);
+
+    BOOST_REQUIRE_EQUAL(2, paths.size());
+    BOOST_CHECK_NE(paths[0], paths[1]);
+
+    for (auto const &path : paths)
+    {
+        std::ifstream object(path, std::ios::binary);
+        std::string magic(4, '\0');
+        object.read(magic.data(), magic.size());
+
+        BOOST_CHECK(object);
+        BOOST_CHECK_EQUAL("\x7f" "ELF", magic);
+        BOOST_CHECK(std::filesystem::file_size(path) > 0);
+
+        std::filesystem::remove(path);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
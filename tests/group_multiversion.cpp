@@ -0,0 +1,72 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/jit.hpp"
+#include "brainfuck/multiversion.hpp"
+#include "brainfuck/optimizer.hpp"
+#include "brainfuck/parser.hpp"
+#include "test_util.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(multiversion)
+
+#if defined(__x86_64__)
+
+BOOST_AUTO_TEST_CASE(kernel_per_level)
+{
+    brainfuck::ObjCodeWriter writer(llvm::sys::getProcessTriple());
+    auto tsModule = brainfuck::buildMultiversionModule(parseSource("++++++++[>++++++++<-]>+."), writer);
+    auto &module = *tsModule.getModuleUnlocked();
+
+    for (auto level : {"x86-64", "x86-64-v2", "x86-64-v3", "x86-64-v4"})
+    {
+        std::string name = std::string("main_") + level;
+        std::replace(name.begin(), name.end(), '-', '_');
+
+        auto kernel = module.getFunction(name);
+        BOOST_REQUIRE(kernel);
+        BOOST_CHECK_EQUAL(level, kernel->getFnAttribute("target-cpu").getValueAsString().str());
+    }
+
+    BOOST_CHECK(module.getFunction("main"));
+    BOOST_CHECK(module.getFunction("main_isa_level"));
+}
+
+BOOST_AUTO_TEST_CASE(picks_supported_level)
+{
+    brainfuck::JitEngine jit;
+    brainfuck::ObjCodeWriter writer(llvm::sys::getProcessTriple());
+
+    auto tsModule = brainfuck::buildMultiversionModule(parseSource("++++++++[>++++++++<-]>+."), writer);
+    brainfuck::optimizeModule(*tsModule.getModuleUnlocked(), {}, &writer.targetMachine());
+    jit.addModule(std::move(tsModule));
+
+    auto level = reinterpret_cast<int (*)()>(jit.lookupMain("main_isa_level"))();
+
+    __builtin_cpu_init();
+    auto expected = !__builtin_cpu_supports("sse4.2")    ? 0
+                    : !__builtin_cpu_supports("avx2")    ? 1
+                    : !__builtin_cpu_supports("avx512bw") ? 2
+                                                          : 3;
+    BOOST_CHECK_EQUAL(expected, level);
+
+    brainfuck::BufferIo io;
+    brainfuck::ScopedProgramIo binding(io);
+    BOOST_CHECK_EQUAL(0, jit.lookupMain()());
+    BOOST_CHECK_EQUAL("A", io.output());
+}
+
+#endif
+
+BOOST_AUTO_TEST_CASE(rejects_other_targets)
+{
+    brainfuck::ObjCodeWriter writer("aarch64-unknown-linux-gnu");
+    BOOST_CHECK_THROW(brainfuck::buildMultiversionModule(parseSource("+."), writer), std::invalid_argument);
+
+    brainfuck::ObjCodeWriter x86Writer("x86_64-unknown-linux-gnu");
+    BOOST_CHECK_THROW(brainfuck::buildMultiversionModule(parseSource("+."), x86Writer, {"pentium4"}), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,155 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/bytecode.hpp"
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/constant_propagation.hpp"
+#include "brainfuck/parser.hpp"
+#include "brainfuck/structural_hash.hpp"
+#include "test_util.hpp"
+
+#include <llvm/IR/Verifier.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(nesting)
+
+namespace
+{
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+
+    // Depths far beyond what recursive parsing, code generation, AST passes
+    // or AST destruction survive with a default-sized stack.
+    std::vector<std::size_t> const DEPTHS = {1'000, 10'000, 100'000};
+
+    std::size_t nestingDepth(std::vector<brainfuck::AST> const *block)
+    {
+        std::size_t depth = 0;
+
+        for (;;)
+        {
+            auto loop = std::find_if(block->begin(), block->end(), [](auto const &ast)
+                                     { return std::holds_alternative<brainfuck::LoopAST>(ast); });
+
+            if (loop == block->end())
+            {
+                return depth;
+            }
+
+            ++depth;
+            block = &std::get<brainfuck::LoopAST>(*loop).loopBody();
+        }
+    }
+
+    std::string nestedSource(std::string const &open, std::string const &innermost, std::string const &close, std::size_t depth)
+    {
+        std::string source;
+        source.reserve(depth * (open.size() + close.size()) + innermost.size());
+
+        for (std::size_t i = 0; i < depth; ++i)
+        {
+            source += open;
+        }
+
+        source += innermost;
+
+        for (std::size_t i = 0; i < depth; ++i)
+        {
+            source += close;
+        }
+
+        return source;
+    }
+
+    // Parses, generates and destroys the program, logging how long each
+    // step took.
+    void measure(std::string const &shape, std::string const &open, std::string const &innermost, std::string const &close, std::size_t depth)
+    {
+        auto source = nestedSource(open, innermost, close, depth);
+
+        auto start = std::chrono::steady_clock::now();
+        auto ast = std::make_unique<std::vector<brainfuck::AST>>(parseSource(source));
+        auto parsed = std::chrono::steady_clock::now();
+
+        BOOST_CHECK_EQUAL(depth, nestingDepth(ast.get()));
+
+        brainfuck::CodeGenerator codegen;
+        codegen(*ast);
+        auto module = codegen.finalizeModule();
+        auto generated = std::chrono::steady_clock::now();
+
+        BOOST_CHECK(!llvm::verifyModule(*module.getModuleUnlocked(), &llvm::errs()));
+
+        auto verified = std::chrono::steady_clock::now();
+        ast.reset();
+        auto destroyed = std::chrono::steady_clock::now();
+
+        BOOST_TEST_MESSAGE(shape << " depth " << depth
+                                 << ": parse " << Milliseconds(parsed - start).count() << " ms"
+                                 << ", codegen " << Milliseconds(generated - parsed).count() << " ms"
+                                 << ", teardown " << Milliseconds(destroyed - verified).count() << " ms");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(plain_loops)
+{
+    for (auto depth : DEPTHS)
+    {
+        measure("[", "+[", "-", "]", depth);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(counted_loops)
+{
+    // The innermost loops are generated as counted loops.
+    for (auto depth : DEPTHS)
+    {
+        measure("[>+", "[>+", "", "<-]", depth);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ast_passes)
+{
+    for (auto depth : DEPTHS)
+    {
+        auto ast = parseSource(nestedSource("+[", "-", "]", depth));
+
+        auto start = std::chrono::steady_clock::now();
+        auto copy = ast;
+        auto copied = std::chrono::steady_clock::now();
+        auto propagated = brainfuck::propagateConstants(ast);
+        auto afterPropagation = std::chrono::steady_clock::now();
+        auto digest = brainfuck::structuralDigest(ast);
+        auto loops = brainfuck::loopDigests(ast);
+        auto hashed = std::chrono::steady_clock::now();
+        auto image = brainfuck::encodeBytecode(ast);
+        auto encoded = std::chrono::steady_clock::now();
+
+        BOOST_CHECK_EQUAL(depth, nestingDepth(&copy));
+        BOOST_CHECK_EQUAL(digest.hash, brainfuck::structuralDigest(copy).hash);
+        // The innermost [-] becomes a store.
+        BOOST_CHECK_EQUAL(depth - 1, nestingDepth(&propagated));
+        BOOST_CHECK_EQUAL(2 * depth + 1, digest.size);
+        BOOST_CHECK_EQUAL(depth, loops.size());
+        BOOST_CHECK_EQUAL(2 * depth, loops.at(&std::get<brainfuck::LoopAST>(ast[1])).size);
+        BOOST_CHECK_EQUAL(3 * depth + 1, brainfuck::BytecodeView(image).instructions().size());
+
+        BOOST_TEST_MESSAGE("depth " << depth
+                                    << ": copy " << Milliseconds(copied - start).count() << " ms"
+                                    << ", constant propagation " << Milliseconds(afterPropagation - copied).count() << " ms"
+                                    << ", structural hash " << Milliseconds(hashed - afterPropagation).count() << " ms"
+                                    << ", bytecode " << Milliseconds(encoded - hashed).count() << " ms");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(unbalanced_brackets)
+{
+    std::string open(100'000, '[');
+
+    BOOST_CHECK_THROW(parseSource(open), brainfuck::ParseError);
+    BOOST_CHECK_THROW(parseSource(open + std::string(100'001, ']')), brainfuck::ParseError);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
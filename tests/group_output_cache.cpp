@@ -0,0 +1,246 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/jit.hpp"
+#include "brainfuck/library.hpp"
+#include "brainfuck/output_cache.hpp"
+#include "brainfuck/parser.hpp"
+#include "brainfuck/structural_hash.hpp"
+#include "test_util.hpp"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(output_cache)
+
+namespace
+{
+    std::filesystem::path cacheDirectory()
+    {
+        return std::filesystem::temp_directory_path() / (std::to_string(getpid()) + "_output_cache");
+    }
+
+    std::vector<std::string> entryFiles(std::filesystem::path const &directory)
+    {
+        std::vector<std::string> names;
+        for (auto const &file : std::filesystem::directory_iterator(directory))
+        {
+            names.push_back(file.path().filename().string());
+        }
+        return names;
+    }
+
+    std::string const ROT1 = ",+[.,+]";
+}
+
+BOOST_AUTO_TEST_CASE(evicts_the_least_recently_used_entry)
+{
+    // Room for two entries of ten bytes with their overhead.
+    brainfuck::OutputCache cache(2 * (10 + 64));
+
+    cache.store(1, "a", {0, "0123456789"});
+    cache.store(1, "b", {0, "abcdefghij"});
+    BOOST_CHECK(cache.find(1, "a").has_value());
+    cache.store(1, "c", {3, "ABCDEFGHIJ"});
+
+    BOOST_CHECK(!cache.find(1, "b").has_value());
+    auto a = cache.find(1, "a");
+    BOOST_REQUIRE(a.has_value());
+    BOOST_CHECK_EQUAL("0123456789", a->output);
+    auto c = cache.find(1, "c");
+    BOOST_REQUIRE(c.has_value());
+    BOOST_CHECK_EQUAL(3, c->status);
+
+    auto stats = cache.statistics();
+    BOOST_CHECK_EQUAL(3u, stats.memoryHits);
+    BOOST_CHECK_EQUAL(1u, stats.misses);
+    BOOST_CHECK_EQUAL(1u, stats.evictions);
+    BOOST_CHECK_EQUAL(2u * (10 + 64), stats.memoryBytes);
+}
+
+BOOST_AUTO_TEST_CASE(keys_on_program_and_input)
+{
+    brainfuck::OutputCache cache;
+    cache.store(1, "input", {0, "one"});
+
+    BOOST_CHECK(!cache.find(2, "input").has_value());
+    BOOST_CHECK(!cache.find(1, "input2").has_value());
+    BOOST_CHECK(!cache.find(1, "").has_value());
+    BOOST_CHECK_EQUAL("one", cache.find(1, "input")->output);
+}
+
+BOOST_AUTO_TEST_CASE(does_not_store_oversized_outputs)
+{
+    brainfuck::OutputCache cache(1 << 20, 4);
+    cache.store(1, "a", {0, "12345"});
+    cache.store(1, "b", {0, "1234"});
+
+    BOOST_CHECK(!cache.find(1, "a").has_value());
+    BOOST_CHECK(cache.find(1, "b").has_value());
+    BOOST_CHECK_EQUAL(1u, cache.statistics().oversized);
+    BOOST_CHECK_EQUAL(1u, cache.statistics().stores);
+}
+
+BOOST_AUTO_TEST_CASE(entries_persist_on_disk)
+{
+    auto directory = cacheDirectory();
+
+    {
+        brainfuck::OutputCache cache(1 << 20, 1 << 20, directory);
+        cache.store(7, "input", {1, std::string("with\0nul", 8)});
+    }
+
+    brainfuck::OutputCache cache(1 << 20, 1 << 20, directory);
+    auto found = cache.find(7, "input");
+    BOOST_REQUIRE(found.has_value());
+    BOOST_CHECK_EQUAL(1, found->status);
+    BOOST_CHECK(found->output == std::string("with\0nul", 8));
+
+    // Now from memory.
+    BOOST_CHECK(cache.find(7, "input").has_value());
+
+    auto stats = cache.statistics();
+    BOOST_CHECK_EQUAL(1u, stats.diskHits);
+    BOOST_CHECK_EQUAL(1u, stats.memoryHits);
+
+    std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(entry_files_carry_the_codegen_version)
+{
+    auto directory = cacheDirectory();
+
+    {
+        brainfuck::OutputCache cache(1 << 20, 1 << 20, directory);
+        cache.store(7, "input", {0, "output"});
+    }
+
+    auto names = entryFiles(directory);
+    BOOST_REQUIRE_EQUAL(1u, names.size());
+    BOOST_CHECK(names[0].starts_with("v" + std::to_string(brainfuck::CODEGEN_VERSION) + "-"));
+
+    // An entry written by another compiler version is not picked up.
+    std::filesystem::rename(directory / names[0], directory / ("v0" + names[0].substr(names[0].find('-'))));
+    brainfuck::OutputCache cache(1 << 20, 1 << 20, directory);
+    BOOST_CHECK(!cache.find(7, "input").has_value());
+
+    std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(disk_stays_within_its_budget)
+{
+    auto directory = cacheDirectory();
+
+    // Entries take four bytes of status plus their output; the budget
+    // holds four of them, and trimming goes down to three.
+    std::string output(96, 'x');
+    brainfuck::OutputCache cache(1 << 20, 1 << 20, directory, 4 * 100);
+
+    for (char input = 'a'; input < 'e'; ++input)
+    {
+        cache.store(1, std::string(1, input), {0, output});
+    }
+
+    BOOST_CHECK_EQUAL(4u, entryFiles(directory).size());
+    BOOST_CHECK_EQUAL(0u, cache.statistics().diskEvictions);
+
+    // Backdates all but the entry for "b", as if it had been used last.
+    for (auto const &name : entryFiles(directory))
+    {
+        auto path = directory / name;
+        std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) - std::chrono::hours(1));
+    }
+    BOOST_CHECK(brainfuck::OutputCache(1 << 20, 1 << 20, directory).find(1, "b").has_value());
+
+    cache.store(1, "e", {0, output});
+
+    auto stats = cache.statistics();
+    BOOST_CHECK_EQUAL(2u, stats.diskEvictions);
+    BOOST_CHECK_EQUAL(3u * 100, stats.diskBytes);
+    BOOST_CHECK_EQUAL(3u, entryFiles(directory).size());
+
+    // Still in memory, but only "b" and "e" are left on disk, with one of
+    // the others.
+    brainfuck::OutputCache reopened(1 << 20, 1 << 20, directory);
+    BOOST_CHECK_EQUAL(3u * 100, reopened.statistics().diskBytes);
+    BOOST_CHECK(reopened.find(1, "b").has_value());
+    BOOST_CHECK(reopened.find(1, "e").has_value());
+
+    std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(disk_errors_are_counted)
+{
+    auto directory = cacheDirectory();
+    brainfuck::OutputCache cache(1 << 20, 1 << 20, directory);
+
+    // Nothing can be written under a file.
+    std::filesystem::remove_all(directory);
+    std::ofstream(directory) << "not a directory";
+
+    BOOST_CHECK_NO_THROW(cache.store(1, "a", {0, "output"}));
+    BOOST_CHECK_EQUAL(1u, cache.statistics().diskErrors);
+    BOOST_CHECK_EQUAL(1u, cache.statistics().stores);
+    BOOST_CHECK_EQUAL("output", cache.find(1, "a")->output);
+
+    std::filesystem::remove(directory);
+}
+
+BOOST_AUTO_TEST_CASE(runs_jit_programs_through_the_cache)
+{
+    brainfuck::JitEngine jit;
+
+    brainfuck::CodeGenOptions options;
+    options.entryPoint = brainfuck::EntryPoint::tapeArgument;
+    options.entryName = "cached_rot1";
+
+    auto program = parseSource(ROT1);
+    brainfuck::CodeGenerator codegen(jit.getDataLayout(), {}, brainfuck::DebugInfoLevel::none, options);
+    codegen(program);
+    jit.addModule(codegen.finalizeModule());
+    auto entry = jit.lookupTapeEntry(options.entryName);
+
+    brainfuck::OutputCache cache;
+    auto hash = brainfuck::structuralDigest(program).hash;
+    BOOST_CHECK_EQUAL("bcd", brainfuck::runCached(&cache, hash, entry, "abc").output);
+    BOOST_CHECK_EQUAL("bcd", brainfuck::runCached(&cache, hash, entry, "abc").output);
+    BOOST_CHECK_EQUAL("bcd", brainfuck::runCached(nullptr, hash, entry, "abc").output);
+
+    auto stats = cache.statistics();
+    BOOST_CHECK_EQUAL(1u, stats.misses);
+    BOOST_CHECK_EQUAL(1u, stats.memoryHits);
+}
+
+BOOST_AUTO_TEST_CASE(runs_library_programs_through_the_cache)
+{
+    brainfuck::JitEngine jit;
+    brainfuck::LibraryBuilder library(jit.getDataLayout());
+
+    auto program = parseSource(ROT1);
+    library.add("rot1", program);
+    jit.addModule(library.finalizeModule());
+
+    auto const &entry = *jit.lookupLibraryPrograms();
+    BOOST_CHECK_EQUAL(brainfuck::structuralDigest(program).hash, entry.hash);
+
+    brainfuck::OutputCache cache;
+    BOOST_CHECK_EQUAL("bcd", brainfuck::runCached(&cache, entry, "abc").output);
+    BOOST_CHECK_EQUAL("bcd", brainfuck::runCached(&cache, entry, "abc").output);
+    BOOST_CHECK_EQUAL(1u, cache.statistics().memoryHits);
+}
+
+BOOST_AUTO_TEST_CASE(runs_static_programs_through_the_cache)
+{
+    brainfuck::OutputCache cache;
+    BOOST_CHECK_EQUAL("bcd", brainfuck::runStaticCached<",+[.,+]">(&cache, "abc").output);
+    BOOST_CHECK_EQUAL("bcd", brainfuck::runStaticCached<",+[.,+]">(&cache, "abc").output);
+    BOOST_CHECK_EQUAL("bcd", brainfuck::runStaticCached<",+[.,+]">(nullptr, "abc").output);
+    BOOST_CHECK_EQUAL(1u, cache.statistics().memoryHits);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
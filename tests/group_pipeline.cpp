@@ -0,0 +1,101 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/parser.hpp"
+#include "brainfuck/pipeline.hpp"
+#include "test_util.hpp"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(pipeline)
+
+namespace
+{
+    std::string const ROT13 = "-,+[-[>>++++[>++++++++<-]<+<-[>+>+>-[>>>]<[[>+<-]>>+>]<<<<<-]]>>>[-]+>--[-[<->+++[-]]]<[++++++++++++<[>-[>+>>]>[+[<+>-]>+>>]<<<<<-]>>[<+>-]>[-[-<<[-]>>]<<[<<->>-]>>]<<[<<+>>-]]<[-]<.[-]<-,+]";
+    std::string const CAT = ",+[-.,+]";
+}
+
+BOOST_AUTO_TEST_CASE(ring_order_and_eof)
+{
+    // A tiny ring makes both sides block over and over.
+    brainfuck::ByteRing ring(3);
+    BOOST_CHECK_EQUAL(4, ring.capacity());
+
+    int const count = 100'000;
+
+    std::thread producer([&]
+                         {
+                             for (int i = 0; i < count; ++i)
+                             {
+                                 ring.push(static_cast<std::uint8_t>(i));
+                             }
+
+                             ring.closeWriting(); });
+
+    bool inOrder = true;
+    for (int i = 0; i < count; ++i)
+    {
+        inOrder = inOrder && ring.pop() == (i & 0xff);
+    }
+
+    BOOST_CHECK(inOrder);
+    BOOST_CHECK_EQUAL(EOF, ring.pop());
+    BOOST_CHECK_EQUAL(EOF, ring.pop());
+
+    producer.join();
+}
+
+BOOST_AUTO_TEST_CASE(closed_reader_unblocks_writer)
+{
+    brainfuck::ByteRing ring(4);
+
+    std::thread producer([&]
+                         {
+                             for (int i = 0; i < 1000; ++i)
+                             {
+                                 ring.push('x');
+                             } });
+
+    BOOST_CHECK_EQUAL('x', ring.pop());
+    ring.closeReading();
+
+    producer.join();
+}
+
+BOOST_AUTO_TEST_CASE(chained_stages)
+{
+    brainfuck::Pipeline pipeline({parseSource(ROT13), parseSource(CAT), parseSource(ROT13)}, 16);
+
+    std::string input;
+    for (int i = 0; i < 1000; ++i)
+    {
+        input += "Hello, World! ";
+    }
+
+    brainfuck::BufferIo io(input);
+    auto statuses = pipeline.run(io, io);
+
+    BOOST_CHECK_EQUAL(3, statuses.size());
+    BOOST_CHECK_EQUAL(input, io.output());
+
+    // Runs can be repeated with fresh rings.
+    io.reset("abc");
+    pipeline.run(io, io);
+    BOOST_CHECK_EQUAL("abc", io.output());
+}
+
+BOOST_AUTO_TEST_CASE(early_exit_downstream)
+{
+    // The second stage stops after one byte while the first one goes on
+    // to write 255 * 255 bytes, far more than fits into the ring.
+    brainfuck::Pipeline pipeline({parseSource("-[>-[.-]<-]"), parseSource(",.")}, 16);
+
+    brainfuck::BufferIo io;
+    pipeline.run(io, io);
+
+    BOOST_CHECK_EQUAL("\xff", io.output());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,120 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/constant_propagation.hpp"
+#include "brainfuck/optimizer.hpp"
+#include "brainfuck/parser.hpp"
+#include "brainfuck/remarks.hpp"
+#include "test_util.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(remarks)
+
+namespace
+{
+    bool hasRemark(brainfuck::RemarkCollector const &collector, std::string const &pass, std::string const &name, brainfuck::SourceLocation location)
+    {
+        auto const &remarks = collector.remarks();
+        return std::any_of(remarks.begin(), remarks.end(), [&](auto const &remark)
+                           { return remark.pass == pass && remark.name == name && remark.location == location; });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ast_remarks)
+{
+    brainfuck::RemarkCollector collector;
+
+    brainfuck::CodeGenOptions options;
+    options.remarks = &collector;
+    brainfuck::CodeGenerator codegen(llvm::DataLayout(""), {}, brainfuck::DebugInfoLevel::none, options);
+
+    codegen(brainfuck::propagateConstants(parseSource("[comment]+++[-],[>+<-]>[<]"), &collector));
+
+    BOOST_CHECK(hasRemark(collector, "constant-propagation", "DeadLoop", {1, 1}));
+    BOOST_CHECK(hasRemark(collector, "constant-propagation", "ConstantFold", {1, 10}));
+    BOOST_CHECK(hasRemark(collector, "constant-propagation", "ClearLoop", {1, 13}));
+    BOOST_CHECK(hasRemark(collector, "constant-propagation", "UnbalancedLoop", {1, 24}));
+    BOOST_CHECK(hasRemark(collector, "codegen", "CountedLoop", {1, 17}));
+}
+
+BOOST_AUTO_TEST_CASE(llvm_remarks_have_source_locations)
+{
+    brainfuck::RemarkCollector collector;
+
+    brainfuck::CodeGenerator codegen(llvm::DataLayout(""), "remarks.bf", brainfuck::DebugInfoLevel::full);
+    codegen(parseSource(",[\n>+++<-]>."));
+
+    auto tsafeModule = codegen.finalizeModule();
+    auto module = tsafeModule.getModuleUnlocked();
+
+    {
+        brainfuck::ScopedLlvmRemarks capture(module->getContext(), collector);
+        brainfuck::optimizeModule(*module);
+    }
+
+    auto const &remarks = collector.remarks();
+    BOOST_CHECK(!remarks.empty());
+
+    for (auto const &remark : remarks)
+    {
+        BOOST_TEST_MESSAGE(remark.pass << " " << remark.name << ": " << remark.message);
+
+        if (remark.location)
+        {
+            BOOST_CHECK(remark.location->line() == 1 || remark.location->line() == 2);
+        }
+    }
+
+    auto located = std::count_if(remarks.begin(), remarks.end(), [](auto const &remark)
+                                 { return remark.location.has_value(); });
+    BOOST_CHECK(located > 0);
+}
+
+BOOST_AUTO_TEST_CASE(llvm_loop_remarks_point_at_the_loop_with_line_tables)
+{
+    brainfuck::RemarkCollector collector;
+
+    // As bfcompile generates by default. The loop is not the first
+    // instruction on its line.
+    brainfuck::CodeGenerator codegen(llvm::DataLayout(""), "remarks.bf", brainfuck::DebugInfoLevel::lineTablesOnly);
+    codegen(parseSource("+>,[.>+<-]"));
+
+    auto tsafeModule = codegen.finalizeModule();
+    auto module = tsafeModule.getModuleUnlocked();
+
+    {
+        brainfuck::ScopedLlvmRemarks capture(module->getContext(), collector);
+        brainfuck::optimizeModule(*module);
+    }
+
+    auto const &remarks = collector.remarks();
+    auto atLoop = std::count_if(remarks.begin(), remarks.end(), [](auto const &remark)
+                                { return remark.location == brainfuck::SourceLocation(1, 4); });
+    BOOST_CHECK(atLoop > 0);
+
+    for (auto const &remark : remarks)
+    {
+        BOOST_TEST_MESSAGE(remark.pass << " " << remark.name << ": " << remark.message);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(json_output)
+{
+    brainfuck::RemarkCollector collector;
+    collector.add({brainfuck::Remark::Kind::missed, "loop-vectorize", "MissedDetails", "say \"no\"\n", brainfuck::SourceLocation(3, 7)});
+    collector.add({brainfuck::Remark::Kind::passed, "licm", "Hoisted", "hoisted", std::nullopt});
+
+    std::ostringstream out;
+    collector.writeJson(out);
+
+    BOOST_CHECK_EQUAL("[\n"
+                      "  {\"kind\": \"missed\", \"pass\": \"loop-vectorize\", \"name\": \"MissedDetails\", \"line\": 3, \"column\": 7, \"message\": \"say \\\"no\\\"\\u000a\"},\n"
+                      "  {\"kind\": \"passed\", \"pass\": \"licm\", \"name\": \"Hoisted\", \"message\": \"hoisted\"}\n"
+                      "]\n",
+                      out.str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
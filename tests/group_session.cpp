@@ -0,0 +1,107 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/parser.hpp"
+#include "brainfuck/session.hpp"
+#include "brainfuck/thread_pool.hpp"
+#include "test_util.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(session)
+
+namespace
+{
+    std::string const CAT = ",+[-.,+]";
+}
+
+BOOST_AUTO_TEST_CASE(suspends_for_input)
+{
+    brainfuck::ResumableProgram program(parseSource(CAT));
+    brainfuck::Session session(program);
+
+    BOOST_CHECK(brainfuck::SessionStatus::suspended == session.resume());
+    BOOST_CHECK_EQUAL("", session.takeOutput());
+
+    session.feed("ab");
+    BOOST_CHECK(brainfuck::SessionStatus::suspended == session.resume());
+    BOOST_CHECK_EQUAL("ab", session.takeOutput());
+
+    session.feed("c");
+    BOOST_CHECK(brainfuck::SessionStatus::suspended == session.resume());
+    BOOST_CHECK_EQUAL("c", session.takeOutput());
+
+    session.closeInput();
+    BOOST_CHECK(brainfuck::SessionStatus::finished == session.resume());
+    BOOST_CHECK(brainfuck::SessionStatus::finished == session.resume());
+    BOOST_CHECK_EQUAL("", session.takeOutput());
+}
+
+BOOST_AUTO_TEST_CASE(tape_survives_suspension)
+{
+    // Reverses its input up to a zero byte, reading inside a loop that
+    // moves along the tape.
+    brainfuck::ResumableProgram program(parseSource(">,[>,]<[.<]"));
+    brainfuck::Session session(program);
+
+    for (char c : std::string("hello"))
+    {
+        session.feed(std::string(1, c));
+        BOOST_CHECK(brainfuck::SessionStatus::suspended == session.resume());
+    }
+
+    session.feed(std::string(1, '\0'));
+    BOOST_CHECK(brainfuck::SessionStatus::finished == session.resume());
+    BOOST_CHECK_EQUAL("olleh", session.takeOutput());
+}
+
+BOOST_AUTO_TEST_CASE(many_sessions_few_threads)
+{
+    brainfuck::ResumableProgram program(parseSource(CAT));
+    brainfuck::ThreadPool pool(4);
+
+    std::size_t const sessionCount = 1000;
+    std::string const input = "session";
+
+    std::vector<std::unique_ptr<brainfuck::Session>> sessions;
+    std::vector<std::string> outputs(sessionCount);
+    for (std::size_t i = 0; i < sessionCount; ++i)
+    {
+        sessions.push_back(std::make_unique<brainfuck::Session>(program));
+    }
+
+    // Every round feeds each session one byte and resumes it on whichever
+    // worker is free, so a session moves between threads.
+    for (std::size_t round = 0; round <= input.size(); ++round)
+    {
+        for (std::size_t i = 0; i < sessionCount; ++i)
+        {
+            pool.submit([&, i, round]
+                        {
+                            auto &session = *sessions[i];
+
+                            if (round < input.size())
+                            {
+                                session.feed(input.substr(round, 1));
+                            }
+                            else
+                            {
+                                session.closeInput();
+                            }
+
+                            session.resume();
+                            outputs[i] += session.takeOutput(); });
+        }
+
+        pool.wait();
+    }
+
+    for (std::size_t i = 0; i < sessionCount; ++i)
+    {
+        BOOST_CHECK(brainfuck::SessionStatus::finished == sessions[i]->status());
+        BOOST_CHECK_EQUAL(input, outputs[i]);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,97 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/static_program.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+BOOST_AUTO_TEST_SUITE(static_program)
+
+namespace
+{
+    using brainfuck::StaticOpcode;
+
+    constexpr auto FOLDED = brainfuck::staticProgram<"+++[-]>>+-+<,[>.<-]">;
+
+    // Runs of +/- and </> fold into single instructions with constant
+    // offsets, and the add before [-] is dropped.
+    static_assert(FOLDED.size() == 8);
+    static_assert(FOLDED[0].opcode == StaticOpcode::set && FOLDED[0].offset == 0);
+    static_assert(FOLDED[1].opcode == StaticOpcode::incr && FOLDED[1].offset == 2 && FOLDED[1].value == 1);
+    static_assert(FOLDED[2].opcode == StaticOpcode::read && FOLDED[2].offset == 1);
+    static_assert(FOLDED[3].opcode == StaticOpcode::right && FOLDED[3].offset == 1);
+    static_assert(FOLDED[4].opcode == StaticOpcode::loop_start && FOLDED[4].match == 7);
+    static_assert(FOLDED[5].opcode == StaticOpcode::write && FOLDED[5].offset == 1);
+    static_assert(FOLDED[6].opcode == StaticOpcode::incr && FOLDED[6].offset == 0 && FOLDED[6].value == 255);
+    static_assert(FOLDED[7].opcode == StaticOpcode::loop_end && FOLDED[7].match == 4);
+
+    // Comments and unfolded runs do not change the hash; the code does.
+    static_assert(brainfuck::staticProgramHash<",[.,]"> == brainfuck::staticProgramHash<"cat: , [ . , ]">);
+    static_assert(brainfuck::staticProgramHash<"++>"> == brainfuck::staticProgramHash<"+-++>">);
+    static_assert(brainfuck::staticProgramHash<",[.,]"> != brainfuck::staticProgramHash<",[+.,]">);
+
+    template <brainfuck::StaticSource source, std::size_t outputSize>
+    constexpr auto runAtCompileTime(std::string_view input)
+    {
+        std::array<std::uint8_t, 64> tape{};
+        std::array<char, outputSize + 1> output{};
+        std::size_t written = 0;
+
+        brainfuck::runStatic<source>(
+            tape.data(), [&](std::uint8_t c)
+            { output[written++] = static_cast<char>(c); },
+            [&]
+            {
+                if (input.empty())
+                {
+                    return EOF;
+                }
+
+                unsigned char c = input.front();
+                input.remove_prefix(1);
+                return static_cast<int>(c); });
+
+        return output;
+    }
+
+    constexpr std::string_view HELLO = "Hello, World!";
+
+    // The program runs completely during constant evaluation.
+    static_assert(std::string_view(runAtCompileTime<">++++++++[<+++++++++>-]<.>++++[<+++++++>-"
+                                                    "]<+.+++++++..+++.>>++++++[<+++++++>-]<++."
+                                                    "------------.>++++++[<+++++++++>-]<+.<.++"
+                                                    "+.------.--------.>>>++++[<++++++++>-]<+.",
+                                                    13>({})
+                                       .data()) == HELLO);
+}
+
+BOOST_AUTO_TEST_CASE(rot13)
+{
+    std::string input = "Hello, World!\n";
+    std::string output;
+
+    std::array<std::uint8_t, brainfuck::BRAINFUCK_STATIC_MEMSIZE> tape{};
+    brainfuck::runStatic<"-,+[-[>>++++[>++++++++<-]<+<-[>+>+>-[>>>]<[[>+<-]>>+>]<<<<<-]]>>>[-]+>--[-[<->+++[-]]]"
+                         "<[++++++++++++<[>-[>+>>]>[+[<+>-]>+>>]<<<<<-]>>[<+>-]>[-[-<<[-]>>]<<[<<->>-]>>]<<[<<+>>-]]"
+                         "<[-]<.[-]<-,+]">(
+        tape.data(), [&](std::uint8_t c)
+        { output.push_back(static_cast<char>(c)); },
+        [&]
+        {
+            if (input.empty())
+            {
+                return EOF;
+            }
+
+            unsigned char c = input.front();
+            input.erase(0, 1);
+            return static_cast<int>(c);
+        });
+
+    BOOST_CHECK_EQUAL("Uryyb, Jbeyq!\n", output);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,48 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/parser.hpp"
+#include "brainfuck/structural_hash.hpp"
+#include "test_util.hpp"
+
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(structural_hash)
+
+BOOST_AUTO_TEST_CASE(ignores_locations)
+{
+    auto compact = parseSource("+[->+<]");
+    auto spread = parseSource("comment\n+ [ - > + < ]\n");
+
+    BOOST_CHECK_EQUAL(brainfuck::structuralDigest(compact).hash, brainfuck::structuralDigest(spread).hash);
+    BOOST_CHECK_EQUAL(5, brainfuck::structuralDigest(compact[1]).size);
+}
+
+BOOST_AUTO_TEST_CASE(distinguishes_structure)
+{
+    auto a = brainfuck::structuralDigest(parseSource("[->+<]"));
+    auto b = brainfuck::structuralDigest(parseSource("[-<+>]"));
+    auto c = brainfuck::structuralDigest(parseSource("[-]>+<"));
+    auto d = brainfuck::structuralDigest(parseSource("[->+<]"), 1);
+
+    BOOST_CHECK_NE(a.hash, b.hash);
+    BOOST_CHECK_NE(a.hash, c.hash);
+    BOOST_CHECK_NE(a.hash, d.hash);
+}
+
+BOOST_AUTO_TEST_CASE(loop_digests)
+{
+    auto program = parseSource("+[>[-]<-]>[-]");
+    auto digests = brainfuck::loopDigests(program, 42);
+
+    BOOST_CHECK_EQUAL(3, digests.size());
+
+    auto const &outer = std::get<brainfuck::LoopAST>(program[1]);
+    auto const &inner = std::get<brainfuck::LoopAST>(outer.loopBody()[1]);
+    auto const &last = std::get<brainfuck::LoopAST>(program[3]);
+
+    BOOST_CHECK_EQUAL(brainfuck::structuralDigest(program[1], 42).hash, digests.at(&outer).hash);
+    BOOST_CHECK_EQUAL(6, digests.at(&outer).size);
+    BOOST_CHECK_EQUAL(digests.at(&inner).hash, digests.at(&last).hash);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
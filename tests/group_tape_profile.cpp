@@ -0,0 +1,117 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/jit.hpp"
+#include "brainfuck/optimizer.hpp"
+#include "brainfuck/parser.hpp"
+#include "brainfuck/tape_profile.hpp"
+
+#include <sstream>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(tape_profile)
+
+namespace
+{
+    brainfuck::TapeProfile profile(std::string const &source, bool optimize = true)
+    {
+        std::istringstream sourceStream(source);
+        brainfuck::Lexer lexer(sourceStream);
+
+        brainfuck::CodeGenOptions options;
+        options.profileTape = true;
+
+        brainfuck::JitEngine jit;
+        brainfuck::CodeGenerator codegen(jit.getDataLayout(), {}, brainfuck::DebugInfoLevel::none, options);
+        codegen(brainfuck::parse(lexer));
+
+        auto tsafeModule = codegen.finalizeModule();
+        if (optimize)
+        {
+            brainfuck::optimizeModule(*tsafeModule.getModuleUnlocked(), {}, &jit.targetMachine());
+        }
+
+        jit.addModule(std::move(tsafeModule));
+        auto mainFunc = jit.lookupMain();
+
+        brainfuck::BufferIo io;
+        brainfuck::ScopedProgramIo binding(io);
+        brainfuck::TapeProfile tapeProfile(brainfuck::BRAINFUCK_MEMSIZE);
+        brainfuck::ScopedTapeProfile profileBinding(tapeProfile);
+
+        BOOST_TEST(mainFunc() == 0);
+        return tapeProfile;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(counts_every_access_as_written)
+{
+    for (bool optimize : {false, true})
+    {
+        auto straight = profile("+>++<.", optimize);
+        BOOST_TEST(straight.minPosition == 0);
+        BOOST_TEST(straight.maxPosition == 1);
+        BOOST_TEST(straight.reads[0] == 2u);
+        BOOST_TEST(straight.writes[0] == 1u);
+        BOOST_TEST(straight.reads[1] == 2u);
+        BOOST_TEST(straight.writes[1] == 2u);
+        BOOST_TEST(straight.reads[2] == 0u);
+
+        // The loop condition is read three times, and the loop is not
+        // turned into a counted loop.
+        auto loop = profile("++[>+<-]", optimize);
+        BOOST_TEST(loop.reads[0] == 7u);
+        BOOST_TEST(loop.writes[0] == 4u);
+        BOOST_TEST(loop.reads[1] == 2u);
+        BOOST_TEST(loop.writes[1] == 2u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(records_accesses_outside_the_tape)
+{
+    auto walk = profile("<+>");
+
+    BOOST_TEST(walk.minPosition == -1);
+    BOOST_TEST(walk.outsideAccesses == 2u);
+    BOOST_TEST(brainfuck::requiredTapeSize(walk) == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(buckets_accesses_by_cache_line)
+{
+    auto spread = profile("+" + std::string(70, '>') + "+" + std::string(70, '<'));
+
+    auto lines = brainfuck::cacheLineAccesses(spread);
+    BOOST_TEST(lines.size() == 2u);
+    BOOST_TEST(lines[0].line == 0u);
+    BOOST_TEST(lines[1].line == 1u);
+    BOOST_TEST(lines[1].writes == 1u);
+    BOOST_TEST(brainfuck::requiredTapeSize(spread) == 128u);
+    BOOST_TEST(brainfuck::requiredTapeSize(spread, 16) == 80u);
+
+    std::ostringstream report;
+    brainfuck::writeTapeReport(report, spread);
+    BOOST_TEST(report.str().find("pointer: 0 to 70") != std::string::npos);
+    BOOST_TEST(report.str().find("touched: 2 of 30000 cells in 2 lines of 64") != std::string::npos);
+    BOOST_TEST(report.str().find("64-127") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(runs_without_a_profile_bound)
+{
+    std::istringstream sourceStream("+[>+<-]>.");
+    brainfuck::Lexer lexer(sourceStream);
+
+    brainfuck::CodeGenOptions options;
+    options.profileTape = true;
+
+    brainfuck::JitEngine jit;
+    brainfuck::CodeGenerator codegen(jit.getDataLayout(), {}, brainfuck::DebugInfoLevel::none, options);
+    codegen(brainfuck::parse(lexer));
+    jit.addModule(codegen.finalizeModule());
+
+    brainfuck::BufferIo io;
+    brainfuck::ScopedProgramIo binding(io);
+    BOOST_TEST(jit.lookupMain()() == 0);
+    BOOST_TEST(io.takeOutput() == "\x01");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,70 @@
+#include <boost/test/unit_test.hpp>
+
+#include "brainfuck/codegen.hpp"
+#include "brainfuck/parser.hpp"
+#include "brainfuck/runtime.hpp"
+#include "brainfuck/x86_jit.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__)
+
+BOOST_AUTO_TEST_SUITE(x86_jit)
+
+namespace
+{
+    std::string runProgram(std::string const &source, std::string const &input)
+    {
+        std::istringstream sourceStream(source);
+        brainfuck::Lexer lexer(sourceStream);
+        brainfuck::X86TemplateJit jit(brainfuck::parse(lexer));
+
+        std::vector<std::uint8_t> tape(brainfuck::BRAINFUCK_MEMSIZE);
+        brainfuck::BufferIo io(input);
+        brainfuck::ScopedProgramIo binding(io);
+
+        BOOST_CHECK_EQUAL(0, jit.run(tape.data()));
+
+        return io.output();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(helloworld)
+{
+    std::string source = ">++++++++[<+++++++++>-]<.>++++[<+++++++>-"
+                         "]<+.+++++++..+++.>>++++++[<+++++++>-]<++."
+                         "------------.>++++++[<+++++++++>-]<+.<.++"
+                         "+.------.--------.>>>++++[<++++++++>-]<+.";
+
+    BOOST_CHECK_EQUAL("Hello, World!", runProgram(source, ""));
+}
+
+BOOST_AUTO_TEST_CASE(rot13)
+{
+    std::string source = "-,+[-[>>++++[>+++++"
+                         "+++<-]<+<-[>+>+>-[>"
+                         ">>]<[[>+<-]>>+>]<<<"
+                         "<<-]]>>>[-]+>--[-[<"
+                         "->+++[-]]]<[+++++++"
+                         "+++++<[>-[>+>>]>[+["
+                         "<+>-]>+>>]<<<<<-]>>"
+                         "[<+>-]>[-[-<<[-]>>]"
+                         "<<[<<->>-]>>]<<[<<+"
+                         ">>-]]<[-]<.[-]<-,+]";
+
+    BOOST_CHECK_EQUAL("Uryyb\n", runProgram(source, "Hello\n"));
+}
+
+BOOST_AUTO_TEST_CASE(folded_runs)
+{
+    // 300 increments wrap around to 44 (','); long moves need imm32.
+    std::string source = std::string(300, '+') + std::string(200, '>') + "+<" + std::string(199, '<') + ".";
+
+    BOOST_CHECK_EQUAL(",", runProgram(source, ""));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif
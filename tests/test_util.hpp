@@ -0,0 +1,20 @@
+#ifndef INCLUDED_LLVM_BRAINFUCK_TEST_UTIL_HPP
+#define INCLUDED_LLVM_BRAINFUCK_TEST_UTIL_HPP
+
+#include "brainfuck/ast.hpp"
+#include "brainfuck/lexer.hpp"
+#include "brainfuck/parser.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Lexes and parses source, without running any passes on it.
+inline std::vector<brainfuck::AST> parseSource(std::string const &source)
+{
+    std::istringstream sourceStream(source);
+    brainfuck::Lexer lexer(sourceStream);
+    return brainfuck::parse(lexer);
+}
+
+#endif